@@ -13,11 +13,18 @@ struct exception_handler {
 static struct exception_handler handlers[MAX_EXCEPTION_HANDLERS];
 static struct list live_handlers;
 static struct list free_handlers;
+static int initialized;
 
 static void exception_handler_install() {
-  for (int i = 0; i < MAX_EXCEPTION_HANDLERS; i++) {
-    struct exception_handler *handler = &handlers[i];
-    list_add(&free_handlers, &handler->it);
+  /* the handlers are only added to the free list once, the platform handler
+     may be installed again after each of the handlers has been removed */
+  if (!initialized) {
+    initialized = 1;
+
+    for (int i = 0; i < MAX_EXCEPTION_HANDLERS; i++) {
+      struct exception_handler *handler = &handlers[i];
+      list_add(&free_handlers, &handler->it);
+    }
   }
 
   int res = exception_handler_install_platform();
@@ -1,6 +1,7 @@
 #ifndef FILES_H
 #define FILES_H
 
+#include <stdint.h>
 #include <stdio.h>
 
 #if PLATFORM_ANDROID || PLATFORM_DARWIN || PLATFORM_LINUX
@@ -39,6 +40,9 @@ void fs_dirname(const char *path, char *dir, size_t size);
 void fs_basename(const char *path, char *base, size_t size);
 void fs_realpath(const char *path, char *resolved, size_t size);
 
+int fs_exepath(char *path, size_t size);
+int fs_filestat(const char *path, int64_t *size, int64_t *mtime);
+
 int fs_exists(const char *path);
 int fs_isdir(const char *path);
 int fs_isfile(const char *path);
@@ -4,6 +4,9 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#if PLATFORM_DARWIN
+#include <mach-o/dyld.h>
+#endif
 #include "core/core.h"
 #include "core/filesystem.h"
 
@@ -28,6 +31,30 @@ int fs_isdir(const char *path) {
   return (buffer.st_mode & S_IFDIR) == S_IFDIR;
 }
 
+int fs_exepath(char *path, size_t size) {
+#if PLATFORM_DARWIN
+  uint32_t len = (uint32_t)size;
+  return _NSGetExecutablePath(path, &len) == 0;
+#else
+  ssize_t len = readlink("/proc/self/exe", path, size - 1);
+  if (len < 0) {
+    return 0;
+  }
+  path[len] = 0;
+  return 1;
+#endif
+}
+
+int fs_filestat(const char *path, int64_t *size, int64_t *mtime) {
+  struct stat buffer;
+  if (stat(path, &buffer) != 0) {
+    return 0;
+  }
+  *size = (int64_t)buffer.st_size;
+  *mtime = (int64_t)buffer.st_mtime;
+  return 1;
+}
+
 int fs_exists(const char *path) {
   struct stat buffer;
   return stat(path, &buffer) == 0;
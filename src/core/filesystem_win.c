@@ -27,6 +27,21 @@ int fs_isdir(const char *path) {
   return (buffer.st_mode & S_IFDIR) == S_IFDIR;
 }
 
+int fs_exepath(char *path, size_t size) {
+  DWORD len = GetModuleFileNameA(NULL, path, (DWORD)size);
+  return len > 0 && len < size;
+}
+
+int fs_filestat(const char *path, int64_t *size, int64_t *mtime) {
+  struct _stat64 buffer;
+  if (_stat64(path, &buffer) != 0) {
+    return 0;
+  }
+  *size = (int64_t)buffer.st_size;
+  *mtime = (int64_t)buffer.st_mtime;
+  return 1;
+}
+
 int fs_exists(const char *path) {
   struct _stat buffer;
   return _stat(path, &buffer) == 0;
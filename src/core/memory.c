@@ -1,12 +1,141 @@
 #include <stdlib.h>
 #include "core/memory.h"
 #include "core/core.h"
+#include "core/constructor.h"
 #include "core/exception_handler.h"
 #include "core/interval_tree.h"
 #include "core/list.h"
+#include "core/thread.h"
 
 #define MAX_WATCHES 8192
 
+/*
+ * shared write protection
+ */
+struct protected_page {
+  uintptr_t addr;
+  int refs;
+  struct rb_node it;
+};
+
+static mutex_t protect_mutex;
+static struct rb_tree protected_pages;
+
+static int protected_page_cmp(const struct rb_node *rb_lhs,
+                              const struct rb_node *rb_rhs) {
+  const struct protected_page *lhs =
+      container_of(rb_lhs, const struct protected_page, it);
+  const struct protected_page *rhs =
+      container_of(rb_rhs, const struct protected_page, it);
+
+  if (lhs->addr < rhs->addr) {
+    return -1;
+  } else if (lhs->addr > rhs->addr) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static struct rb_callbacks protected_page_cb = {
+    &protected_page_cmp, NULL, NULL,
+};
+
+CONSTRUCTOR(protect_init) {
+  protect_mutex = mutex_create();
+}
+
+DESTRUCTOR(protect_shutdown) {
+  mutex_destroy(protect_mutex);
+}
+
+static struct protected_page *protect_get_page(uintptr_t addr) {
+  struct protected_page search;
+  search.addr = addr;
+
+  return rb_find_entry(&protected_pages, &search, struct protected_page, it,
+                       &protected_page_cb);
+}
+
+static void protect_release_page(uintptr_t addr, size_t page_size) {
+  struct protected_page *page = protect_get_page(addr);
+  CHECK_NOTNULL(page);
+
+  if (--page->refs) {
+    return;
+  }
+
+  CHECK(protect_pages((void *)addr, page_size, ACC_READWRITE));
+
+  rb_unlink(&protected_pages, &page->it, &protected_page_cb);
+  free(page);
+}
+
+static int protect_acquire_page(uintptr_t addr, size_t page_size) {
+  struct protected_page *page = protect_get_page(addr);
+
+  if (!page) {
+    if (!protect_pages((void *)addr, page_size, ACC_READONLY)) {
+      return 0;
+    }
+
+    page = calloc(1, sizeof(struct protected_page));
+    page->addr = addr;
+    rb_insert(&protected_pages, &page->it, &protected_page_cb);
+  }
+
+  page->refs++;
+
+  return 1;
+}
+
+int write_protect_pages(void *ptr, size_t size) {
+  size_t page_size = get_page_size();
+  uintptr_t begin = ALIGN_DOWN((uintptr_t)ptr, page_size);
+  uintptr_t end = ALIGN_UP((uintptr_t)ptr + size, page_size);
+  uintptr_t addr;
+
+  mutex_lock(protect_mutex);
+
+  for (addr = begin; addr < end; addr += page_size) {
+    if (!protect_acquire_page(addr, page_size)) {
+      break;
+    }
+  }
+
+  /* on failure, drop the references already taken */
+  int res = addr == end;
+
+  if (!res) {
+    while (addr > begin) {
+      addr -= page_size;
+      protect_release_page(addr, page_size);
+    }
+  }
+
+  mutex_unlock(protect_mutex);
+
+  return res;
+}
+
+void write_unprotect_pages(void *ptr, size_t size) {
+  size_t page_size = get_page_size();
+  uintptr_t begin = ALIGN_DOWN((uintptr_t)ptr, page_size);
+  uintptr_t end = ALIGN_UP((uintptr_t)ptr + size, page_size);
+
+  mutex_lock(protect_mutex);
+
+  for (uintptr_t addr = begin; addr < end; addr += page_size) {
+    protect_release_page(addr, page_size);
+  }
+
+  mutex_unlock(protect_mutex);
+}
+
+/*
+ * access watches
+ */
+
 struct memory_watch {
   enum memory_watch_type type;
   memory_watch_cb cb;
@@ -63,11 +192,6 @@ static int watcher_handle_exception(void *ctx, struct exception_state *ex) {
     watch->cb(ex, watch->data);
 
     if (watch->type == WATCH_SINGLE_WRITE) {
-      /* restore page permissions */
-      uintptr_t aligned_begin = n->low;
-      size_t aligned_size = (n->high - n->low) + 1;
-      CHECK(protect_pages((void *)aligned_begin, aligned_size, ACC_READWRITE));
-
       remove_memory_watch(watch);
     }
 
@@ -82,6 +206,13 @@ static int watcher_handle_exception(void *ctx, struct exception_state *ex) {
 }
 
 void remove_memory_watch(struct memory_watch *watch) {
+  /* release the watch's protection. the pages only become writable once no one
+     else is protecting them, e.g. the jit tracking code on the same pages. if
+     someone still is, the faulting write is retried and caught again by them */
+  uintptr_t aligned_begin = watch->tree_it.low;
+  size_t aligned_size = (watch->tree_it.high - watch->tree_it.low) + 1;
+  write_unprotect_pages((void *)aligned_begin, aligned_size);
+
   /* remove from interval tree */
   interval_tree_remove(&watcher->tree, &watch->tree_it);
 
@@ -109,7 +240,7 @@ struct memory_watch *add_single_write_watch(const void *ptr, size_t size,
   size_t aligned_size = (aligned_end - aligned_begin) + 1;
 
   /* disable writing to the pages */
-  CHECK(protect_pages((void *)aligned_begin, aligned_size, ACC_READONLY));
+  CHECK(write_protect_pages((void *)aligned_begin, aligned_size));
 
   /* allocate new access watch */
   struct memory_watch *watch =
@@ -21,6 +21,12 @@ int protect_pages(void *ptr, size_t size, enum page_access access);
 void *reserve_pages(void *ptr, size_t size);
 int release_pages(void *ptr, size_t size);
 
+/* reference counted write protection, shared by each system tracking writes
+   to the same pages. the pages are made read-only by the first reference, and
+   aren't made writable again until every reference has been released */
+int write_protect_pages(void *ptr, size_t size);
+void write_unprotect_pages(void *ptr, size_t size);
+
 /*
  * shared memory objects
  */
@@ -1,52 +1,401 @@
+#include <stdarg.h>
+#include <stdio.h>
 #include "core/profiler.h"
 #include "core/core.h"
+#include "core/ringbuf.h"
+#include "core/thread.h"
 #include "core/time.h"
 
-#define PROFILER_MAX_COUNTERS 32
+#define PROFILER_MAX_DEPTH 32
 
-struct counter {
+/* each thread's events are buffered until the next frame boundary, any which
+   don't fit by then are dropped */
+#define PROFILER_RING_SIZE (1024 * 1024)
+
+enum {
+  PROF_EVENT_ZONE,
+  PROF_EVENT_FRAME,
+  PROF_EVENT_COUNTER,
+};
+
+struct prof_event {
+  int type;
+  prof_token_t tok;
+  int64_t time;
+  /* duration of zones, value of counters */
+  int64_t value;
+};
+
+struct prof_counter {
+  const char *name;
   int aggregate;
   int64_t value[2];
 };
 
+struct prof_zone {
+  char *group;
+  char *name;
+};
+
+struct prof_thread {
+  int id;
+  const char *name;
+  int named;
+
+  /* only written to by the owning thread, and only read from while the
+     profiler's mutex is held */
+  struct ringbuf *rb;
+  int64_t dropped;
+
+  /* zones currently entered */
+  int depth;
+  prof_token_t toks[PROFILER_MAX_DEPTH];
+  int64_t starts[PROFILER_MAX_DEPTH];
+
+  struct list_node it;
+};
+
+int prof_enabled;
+
+static _Thread_local struct prof_thread *curr_thread;
+static _Thread_local const char *curr_thread_name;
+
 static struct {
-  struct counter counters[PROFILER_MAX_COUNTERS];
+  struct prof_counter *counters;
   int num_counters;
+  int max_counters;
 
   int64_t last_aggregation;
+
+  /* the remaining state is only created once the first trace is started, and
+     is never freed, as threads may still be referencing it */
+  mutex_t mutex;
+  struct prof_zone *zones;
+  int num_zones;
+  int max_zones;
+  struct list threads;
+  int num_threads;
+
+  /* current capture */
+  volatile int tracing;
+  FILE *trace;
+  int64_t trace_start;
+  int num_events;
 } prof;
 
-prof_token_t prof_get_next_token() {
+/*
+ * counters
+ */
+static prof_token_t prof_get_next_token(const char *name, int aggregate) {
+  /* counters are registered by constructors, before any other threads have
+     been created */
+  if (prof.num_counters == prof.max_counters) {
+    prof.max_counters = MAX(prof.max_counters * 2, 32);
+    prof.counters = realloc(prof.counters,
+                            prof.max_counters * sizeof(struct prof_counter));
+  }
+
   prof_token_t tok = prof.num_counters++;
-  CHECK_LT(tok, PROFILER_MAX_COUNTERS);
+  struct prof_counter *c = &prof.counters[tok];
+  c->name = name;
+  c->aggregate = aggregate;
+  c->value[0] = 0;
+  c->value[1] = 0;
   return tok;
 }
 
 prof_token_t prof_get_counter_token(const char *name) {
-  prof_token_t tok = prof_get_next_token();
-  struct counter *c = &prof.counters[tok];
-  c->aggregate = 0;
-  return tok;
+  return prof_get_next_token(name, 0);
 }
 
 prof_token_t prof_get_aggregate_token(const char *name) {
-  prof_token_t tok = prof_get_next_token();
-  struct counter *c = &prof.counters[tok];
-  c->aggregate = 1;
+  return prof_get_next_token(name, 1);
+}
+
+/*
+ * zones
+ */
+static struct prof_thread *prof_get_thread() {
+  struct prof_thread *thread = curr_thread;
+
+  if (thread) {
+    return thread;
+  }
+
+  thread = calloc(1, sizeof(struct prof_thread));
+  thread->name = curr_thread_name;
+  thread->rb = ringbuf_create(PROFILER_RING_SIZE);
+
+  mutex_lock(prof.mutex);
+  thread->id = prof.num_threads++;
+  list_add(&prof.threads, &thread->it);
+  mutex_unlock(prof.mutex);
+
+  curr_thread = thread;
+
+  return thread;
+}
+
+static void prof_write_event(struct prof_thread *thread, int type,
+                             prof_token_t tok, int64_t time, int64_t value) {
+  if (ringbuf_remaining(thread->rb) < (int)sizeof(struct prof_event)) {
+    thread->dropped++;
+    return;
+  }
+
+  struct prof_event *ev = ringbuf_write_ptr(thread->rb);
+  ev->type = type;
+  ev->tok = tok;
+  ev->time = time;
+  ev->value = value;
+  ringbuf_advance_write_ptr(thread->rb, sizeof(struct prof_event));
+}
+
+void prof_leave() {
+  struct prof_thread *thread = curr_thread;
+
+  /* the zone was entered before the capture started */
+  if (!thread || !thread->depth) {
+    return;
+  }
+
+  int depth = --thread->depth;
+
+  if (depth >= PROFILER_MAX_DEPTH) {
+    return;
+  }
+
+  int64_t now = time_nanoseconds();
+  int64_t start = thread->starts[depth];
+  prof_write_event(thread, PROF_EVENT_ZONE, thread->toks[depth], start,
+                   now - start);
+}
+
+void prof_enter(prof_token_t tok) {
+  struct prof_thread *thread = curr_thread;
+
+  /* keep recording zones nested inside of ones entered while capturing, so
+     each leave still pairs with the correct enter once the capture ends */
+  if (!prof.tracing && (!thread || !thread->depth)) {
+    return;
+  }
+
+  thread = prof_get_thread();
+
+  int depth = thread->depth++;
+
+  if (depth >= PROFILER_MAX_DEPTH) {
+    return;
+  }
+
+  thread->toks[depth] = tok;
+  thread->starts[depth] = time_nanoseconds();
+}
+
+prof_token_t prof_get_token(const char *group, const char *name) {
+  mutex_lock(prof.mutex);
+
+  prof_token_t tok = -1;
+
+  for (int i = 0; i < prof.num_zones; i++) {
+    struct prof_zone *zone = &prof.zones[i];
+
+    if (!strcmp(zone->group, group) && !strcmp(zone->name, name)) {
+      tok = i;
+      break;
+    }
+  }
+
+  if (tok < 0) {
+    if (prof.num_zones == prof.max_zones) {
+      prof.max_zones = MAX(prof.max_zones * 2, 32);
+      prof.zones =
+          realloc(prof.zones, prof.max_zones * sizeof(struct prof_zone));
+    }
+
+    tok = prof.num_zones++;
+    prof.zones[tok].group = strdup(group);
+    prof.zones[tok].name = strdup(name);
+  }
+
+  mutex_unlock(prof.mutex);
+
   return tok;
 }
 
+void prof_thread_name(const char *name) {
+  curr_thread_name = name;
+}
+
+/*
+ * trace capture
+ */
+static double prof_trace_time(int64_t time) {
+  /* trace timestamps are in microseconds */
+  return (time - prof.trace_start) / (double)NS_PER_USEC;
+}
+
+static void prof_trace_event(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  fprintf(prof.trace, "%s\n", prof.num_events++ ? "," : "");
+  vfprintf(prof.trace, fmt, args);
+  va_end(args);
+}
+
+static void prof_trace_thread(struct prof_thread *thread) {
+  if (!thread->named) {
+    char name[32];
+    if (thread->name) {
+      snprintf(name, sizeof(name), "%s", thread->name);
+    } else {
+      snprintf(name, sizeof(name), "thread %d", thread->id);
+    }
+
+    prof_trace_event("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                     "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                     thread->id, name);
+    thread->named = 1;
+  }
+
+  while (ringbuf_available(thread->rb) >= (int)sizeof(struct prof_event)) {
+    struct prof_event *ev = ringbuf_read_ptr(thread->rb);
+
+    switch (ev->type) {
+      case PROF_EVENT_ZONE: {
+        struct prof_zone *zone = &prof.zones[ev->tok];
+        prof_trace_event("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                         "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                         zone->name, zone->group, prof_trace_time(ev->time),
+                         ev->value / (double)NS_PER_USEC, thread->id);
+      } break;
+
+      case PROF_EVENT_FRAME: {
+        prof_trace_event("{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\","
+                         "\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                         prof_trace_time(ev->time), thread->id);
+      } break;
+
+      case PROF_EVENT_COUNTER: {
+        struct prof_counter *c = &prof.counters[ev->tok];
+        prof_trace_event("{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,"
+                         "\"pid\":1,\"args\":{\"value\":%" PRId64 "}}",
+                         c->name, prof_trace_time(ev->time), ev->value);
+      } break;
+
+      default:
+        LOG_FATAL("unexpected profiler event %d", ev->type);
+        break;
+    }
+
+    ringbuf_advance_read_ptr(thread->rb, sizeof(struct prof_event));
+  }
+}
+
+static void prof_trace_flush() {
+  mutex_lock(prof.mutex);
+
+  if (prof.trace) {
+    list_for_each_entry(thread, &prof.threads, struct prof_thread, it) {
+      prof_trace_thread(thread);
+    }
+  }
+
+  mutex_unlock(prof.mutex);
+}
+
+void prof_frame() {
+  if (!prof.tracing) {
+    return;
+  }
+
+  struct prof_thread *thread = prof_get_thread();
+  prof_write_event(thread, PROF_EVENT_FRAME, 0, time_nanoseconds(), 0);
+
+  prof_trace_flush();
+}
+
+void prof_trace_end() {
+  if (!prof.tracing) {
+    return;
+  }
+
+  prof.tracing = 0;
+  prof_trace_flush();
+
+  mutex_lock(prof.mutex);
+
+  int64_t dropped = 0;
+  list_for_each_entry(thread, &prof.threads, struct prof_thread, it) {
+    dropped += thread->dropped;
+  }
+
+  fprintf(prof.trace, "\n]}\n");
+  fclose(prof.trace);
+  prof.trace = NULL;
+
+  mutex_unlock(prof.mutex);
+
+  LOG_INFO("prof_trace_end %d events written, %" PRId64 " dropped",
+           prof.num_events, dropped);
+}
+
+int prof_trace_begin(const char *path) {
+  if (prof.tracing) {
+    return 0;
+  }
+
+  FILE *trace = fopen(path, "w");
+  if (!trace) {
+    LOG_WARNING("prof_trace_begin failed to open %s", path);
+    return 0;
+  }
+
+  if (!prof.mutex) {
+    prof.mutex = mutex_create();
+  }
+
+  mutex_lock(prof.mutex);
+  prof.trace = trace;
+  prof.trace_start = time_nanoseconds();
+  prof.num_events = 0;
+  fprintf(prof.trace, "{\"traceEvents\":[");
+
+  /* any events left over from a previous capture are now stale */
+  list_for_each_entry(thread, &prof.threads, struct prof_thread, it) {
+    int available = ringbuf_available(thread->rb);
+    ringbuf_advance_read_ptr(thread->rb, available);
+    thread->named = 0;
+  }
+  mutex_unlock(prof.mutex);
+
+  prof.tracing = 1;
+  prof_enabled = 1;
+
+  LOG_INFO("prof_trace_begin writing to %s", path);
+
+  return 1;
+}
+
+/*
+ * aggregation
+ */
 void prof_flip(int64_t now) {
   /* update time-based aggregate counters every second */
   int64_t next_aggregation = prof.last_aggregation + NS_PER_SEC;
 
   if (now > next_aggregation) {
-    for (int i = 0; i < PROFILER_MAX_COUNTERS; i++) {
-      struct counter *c = &prof.counters[i];
+    for (int i = 0; i < prof.num_counters; i++) {
+      struct prof_counter *c = &prof.counters[i];
 
       if (c->aggregate) {
         c->value[0] = c->value[1];
         c->value[1] = 0;
+
+        if (prof.tracing) {
+          prof_write_event(prof_get_thread(), PROF_EVENT_COUNTER, i, now,
+                           c->value[0]);
+        }
       }
     }
 
@@ -55,17 +404,17 @@ void prof_flip(int64_t now) {
 }
 
 void prof_counter_set(prof_token_t tok, int64_t count) {
-  struct counter *c = &prof.counters[tok];
+  struct prof_counter *c = &prof.counters[tok];
   c->value[1] = count;
 }
 
 void prof_counter_add(prof_token_t tok, int64_t count) {
-  struct counter *c = &prof.counters[tok];
+  struct prof_counter *c = &prof.counters[tok];
   c->value[1] += count;
 }
 
 int64_t prof_counter_load(prof_token_t tok) {
-  struct counter *c = &prof.counters[tok];
+  struct prof_counter *c = &prof.counters[tok];
   if (c->aggregate) {
     /* return the last aggregated value */
     return c->value[0];
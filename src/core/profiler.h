@@ -7,6 +7,9 @@
 
 typedef int prof_token_t;
 
+/*
+ * counters
+ */
 #define DECLARE_COUNTER(name) extern prof_token_t COUNTER_##name;
 
 #define DEFINE_COUNTER(name)                        \
@@ -22,7 +25,6 @@ typedef int prof_token_t;
     COUNTER_##name = prof_get_aggregate_token(#name); \
   }
 
-prof_token_t prof_get_token(const char *group, const char *name);
 prof_token_t prof_get_counter_token(const char *name);
 prof_token_t prof_get_aggregate_token(const char *name);
 
@@ -32,4 +34,48 @@ void prof_counter_set(prof_token_t tok, int64_t count);
 
 void prof_flip(int64_t now);
 
+/*
+ * zones
+ */
+
+/* each enter must be paired with a leave in the same scope. zones nest to form
+   a call tree per thread, and are only recorded while a trace is being
+   captured. until the first capture, each costs a single load and branch */
+#define PROF_ENTER(group, name)                 \
+  do {                                          \
+    static prof_token_t prof_tok = -1;          \
+    if (prof_enabled) {                         \
+      if (prof_tok < 0) {                       \
+        prof_tok = prof_get_token(group, name); \
+      }                                         \
+      prof_enter(prof_tok);                     \
+    }                                           \
+  } while (0)
+
+#define PROF_LEAVE()    \
+  do {                  \
+    if (prof_enabled) { \
+      prof_leave();     \
+    }                   \
+  } while (0)
+
+extern int prof_enabled;
+
+prof_token_t prof_get_token(const char *group, const char *name);
+void prof_enter(prof_token_t tok);
+void prof_leave();
+
+/* name the calling thread in captured traces */
+void prof_thread_name(const char *name);
+
+/* mark the end of a frame, and write out the events recorded by each thread
+   since the last frame */
+void prof_frame();
+
+/* capture zones, frame markers and aggregate counters to a chrome trace-event
+   file. threads record events to their own ring buffer without locking, which
+   are drained to the file at each frame boundary */
+int prof_trace_begin(const char *path);
+void prof_trace_end();
+
 #endif
@@ -10,6 +10,9 @@ typedef void *(*thread_fn)(void *);
 thread_t thread_create(thread_fn fn, const char *name, void *data);
 void thread_join(thread_t thread, void **result);
 
+/* number of logical cores available to the process */
+int thread_num_cores();
+
 /*
  * synchronization
  */
@@ -27,6 +30,7 @@ cond_t cond_create();
 void cond_wait(cond_t cond, mutex_t mutex);
 int cond_timedwait(cond_t cond, mutex_t mutex, int ms);
 void cond_signal(cond_t cond);
+void cond_broadcast(cond_t cond);
 void cond_destroy(cond_t cond);
 
 /*
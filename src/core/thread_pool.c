@@ -0,0 +1,144 @@
+#include "core/thread_pool.h"
+#include "core/core.h"
+#include "core/profiler.h"
+#include "core/thread.h"
+
+struct thread_pool {
+  const char *name;
+  thread_t *threads;
+  int num_threads;
+
+  mutex_t mutex;
+  cond_t work_cond;
+  cond_t done_cond;
+  int shutdown;
+
+  /* current batch of jobs */
+  thread_pool_fn fn;
+  void *data;
+  int next_job;
+  int num_jobs;
+  int remaining;
+};
+
+static void thread_pool_finish_job(struct thread_pool *pool) {
+  if (--pool->remaining == 0) {
+    cond_signal(pool->done_cond);
+  }
+}
+
+static void *thread_pool_worker(void *data) {
+  struct thread_pool *pool = data;
+
+  prof_thread_name(pool->name);
+
+  mutex_lock(pool->mutex);
+
+  while (1) {
+    while (!pool->shutdown && pool->next_job >= pool->num_jobs) {
+      cond_wait(pool->work_cond, pool->mutex);
+    }
+
+    if (pool->shutdown) {
+      break;
+    }
+
+    int job = pool->next_job++;
+    thread_pool_fn fn = pool->fn;
+    void *job_data = pool->data;
+
+    mutex_unlock(pool->mutex);
+    fn(job_data, job);
+    mutex_lock(pool->mutex);
+
+    thread_pool_finish_job(pool);
+  }
+
+  mutex_unlock(pool->mutex);
+
+  return NULL;
+}
+
+void thread_pool_run(struct thread_pool *pool, thread_pool_fn fn, void *data,
+                     int num_jobs) {
+  if (num_jobs <= 0) {
+    return;
+  }
+
+  mutex_lock(pool->mutex);
+
+  pool->fn = fn;
+  pool->data = data;
+  pool->next_job = 0;
+  pool->num_jobs = num_jobs;
+  pool->remaining = num_jobs;
+
+  if (pool->num_threads) {
+    cond_broadcast(pool->work_cond);
+  }
+
+  /* help out while waiting for the workers */
+  while (pool->next_job < pool->num_jobs) {
+    int job = pool->next_job++;
+
+    mutex_unlock(pool->mutex);
+    fn(data, job);
+    mutex_lock(pool->mutex);
+
+    pool->remaining--;
+  }
+
+  while (pool->remaining) {
+    cond_wait(pool->done_cond, pool->mutex);
+  }
+
+  mutex_unlock(pool->mutex);
+}
+
+int thread_pool_size(struct thread_pool *pool) {
+  return pool->num_threads + 1;
+}
+
+void thread_pool_destroy(struct thread_pool *pool) {
+  mutex_lock(pool->mutex);
+  pool->shutdown = 1;
+  cond_broadcast(pool->work_cond);
+  mutex_unlock(pool->mutex);
+
+  for (int i = 0; i < pool->num_threads; i++) {
+    void *result;
+    thread_join(pool->threads[i], &result);
+  }
+
+  cond_destroy(pool->done_cond);
+  cond_destroy(pool->work_cond);
+  mutex_destroy(pool->mutex);
+
+  free(pool->threads);
+  free(pool);
+}
+
+struct thread_pool *thread_pool_create(const char *name, int num_threads) {
+  struct thread_pool *pool = calloc(1, sizeof(struct thread_pool));
+
+  if (num_threads <= 0) {
+    num_threads = thread_num_cores();
+  }
+
+  /* the calling thread runs jobs as well */
+  int num_workers = num_threads - 1;
+
+  pool->name = name;
+  pool->mutex = mutex_create();
+  pool->work_cond = cond_create();
+  pool->done_cond = cond_create();
+  pool->threads = calloc(MAX(num_workers, 1), sizeof(thread_t));
+
+  for (int i = 0; i < num_workers; i++) {
+    thread_t thread = thread_create(&thread_pool_worker, name, pool);
+    CHECK_NOTNULL(thread, "failed to create worker thread");
+    pool->threads[pool->num_threads++] = thread;
+  }
+
+  return pool;
+}
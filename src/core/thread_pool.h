@@ -0,0 +1,24 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+typedef void (*thread_pool_fn)(void *, int);
+
+struct thread_pool;
+
+/* pool of worker threads for running data-parallel jobs. jobs are run on
+   num_threads threads, the thread running them being one of them. if
+   num_threads is zero, one thread per core is used */
+struct thread_pool *thread_pool_create(const char *name, int num_threads);
+void thread_pool_destroy(struct thread_pool *pool);
+
+/* number of threads jobs are run on, including the calling thread */
+int thread_pool_size(struct thread_pool *pool);
+
+/* call fn(data, i) for each i in [0, num_jobs) across the workers and the
+   calling thread, returning once every call has completed. jobs are started
+   in order, but may complete in any order. only one thread may run jobs on a
+   pool at a time */
+void thread_pool_run(struct thread_pool *pool, thread_pool_fn fn, void *data,
+                     int num_jobs);
+
+#endif
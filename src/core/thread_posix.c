@@ -2,6 +2,7 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 #include "core/core.h"
 #include "core/thread.h"
 
@@ -28,6 +29,11 @@ void thread_join(thread_t thread, void **result) {
   thread_destroy(pthread);
 }
 
+int thread_num_cores() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
 mutex_t mutex_create() {
   pthread_mutex_t *pmutex = calloc(1, sizeof(pthread_mutex_t));
 
@@ -114,6 +120,13 @@ void cond_signal(cond_t cond) {
   CHECK_EQ(res, 0);
 }
 
+void cond_broadcast(cond_t cond) {
+  pthread_cond_t *pcond = (pthread_cond_t *)cond;
+
+  int res = pthread_cond_broadcast(pcond);
+  CHECK_EQ(res, 0);
+}
+
 void cond_destroy(cond_t cond) {
   pthread_cond_t *pcond = (pthread_cond_t *)cond;
 
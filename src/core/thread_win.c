@@ -42,6 +42,12 @@ void thread_join(thread_t thread, void **result) {
   thread_destroy(wrapper);
 }
 
+int thread_num_cores() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return MAX((int)info.dwNumberOfProcessors, 1);
+}
+
 mutex_t mutex_create() {
   CRITICAL_SECTION *wmutex = calloc(1, sizeof(CRITICAL_SECTION));
 
@@ -105,6 +111,12 @@ void cond_signal(cond_t cond) {
   WakeConditionVariable(wcond);
 }
 
+void cond_broadcast(cond_t cond) {
+  CONDITION_VARIABLE *wcond = (CONDITION_VARIABLE *)cond;
+
+  WakeAllConditionVariable(wcond);
+}
+
 void cond_destroy(cond_t cond) {
   CONDITION_VARIABLE *wcond = (CONDITION_VARIABLE *)cond;
 
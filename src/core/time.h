@@ -6,6 +6,7 @@
 
 #define NS_PER_SEC INT64_C(1000000000)
 #define NS_PER_MS INT64_C(1000000)
+#define NS_PER_USEC INT64_C(1000)
 
 int64_t time_nanoseconds();
 
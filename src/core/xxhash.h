@@ -0,0 +1,11 @@
+#ifndef XXHASH_H
+#define XXHASH_H
+
+#include <stdint.h>
+
+/* 64-bit xxHash, a fast non-cryptographic hash. the output matches the
+   reference implementation's XXH64, see
+   https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md */
+uint64_t xxh64(const void *data, int size, uint64_t seed);
+
+#endif
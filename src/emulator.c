@@ -474,6 +474,8 @@ static void emu_run_until_vblank(struct emu *emu);
 static void *emu_run_thread(void *data) {
   struct emu *emu = data;
 
+  prof_thread_name("emu");
+
   while (1) {
     /* wait for video thread to request a frame to be ran */
     mutex_lock(emu->req_mutex);
@@ -498,17 +500,24 @@ static void *emu_run_thread(void *data) {
 }
 
 static void emu_run_until_vblank(struct emu *emu) {
-  const int64_t MACHINE_STEP = HZ_TO_NANO(1000);
+  /* the scheduler bounds the length of each slice itself, this only controls
+     how often the frame state is polled */
+  const int64_t MACHINE_STEP = MAX(OPTION_sched_max_slice, 1) * NS_PER_USEC;
+
+  PROF_ENTER("emu", "emu_run_until_vblank");
 
   emu->state = EMU_RUNFRAME;
 
   while (emu->state == EMU_RUNFRAME || emu->state == EMU_DRAWFRAME) {
     dc_tick(emu->dc, MACHINE_STEP);
   }
+
+  PROF_LEAVE();
 }
 
 void emu_render_frame(struct emu *emu) {
   prof_counter_add(COUNTER_frames, 1);
+  prof_frame();
 
   if (OPTION_aspect_dirty) {
     emu_set_aspect_ratio(emu, OPTION_aspect);
@@ -675,9 +684,15 @@ void emu_debug_menu(struct emu *emu) {
     int sh4_instrs = (int)(prof_counter_load(COUNTER_sh4_instrs) / 1000000.0f);
     int arm7_instrs =
         (int)(prof_counter_load(COUNTER_arm7_instrs) / 1000000.0f);
+    int64_t slices = MAX(prof_counter_load(COUNTER_sched_slices), 1);
+    int slice_us = (int)(prof_counter_load(COUNTER_sched_slice_ns) / slices /
+                         NS_PER_USEC);
+    int slices_per_frame = (int)(slices / MAX(frames, 1));
 
-    snprintf(status, sizeof(status), "FPS %3d RPS %3d VBS %3d SH4 %4d ARM %d",
-             frames, ta_renders, pvr_vblanks, sh4_instrs, arm7_instrs);
+    snprintf(status, sizeof(status),
+             "FPS %3d RPS %3d VBS %3d SH4 %4d ARM %d SLICE %4dus SPF %4d",
+             frames, ta_renders, pvr_vblanks, sh4_instrs, arm7_instrs,
+             slice_us, slices_per_frame);
 
     /* right align */
     struct ImVec2 content;
@@ -711,6 +726,8 @@ void emu_vid_destroyed(struct emu *emu) {
     emu_free_texture(emu, tex);
   }
 
+  tr_release_textures(emu->r);
+
   emu->r = NULL;
 }
 
@@ -739,6 +756,9 @@ void emu_destroy(struct emu *emu) {
   emu_vid_destroyed(emu);
   dc_destroy(emu->dc);
   free(emu);
+
+  /* every thread recording zones has been shutdown */
+  prof_trace_end();
 }
 
 struct emu *emu_create(struct host *host) {
@@ -746,6 +766,10 @@ struct emu *emu_create(struct host *host) {
 
   emu->host = host;
 
+  if (*OPTION_profile) {
+    prof_trace_begin(OPTION_profile);
+  }
+
   /* create dreamcast, bind client callbacks */
   emu->dc = dc_create();
   emu->dc->userdata = emu;
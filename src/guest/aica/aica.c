@@ -1,6 +1,7 @@
 #include "guest/aica/aica.h"
 #include "core/core.h"
 #include "core/filesystem.h"
+#include "guest/aica/aica_thread.h"
 #include "guest/aica/aica_types.h"
 #include "guest/arm7/arm7.h"
 #include "guest/dreamcast.h"
@@ -311,6 +312,14 @@ static void aica_update_sh(struct aica *aica) {
   uint32_t enabled_intr = aica->common_data->MCIEB;
   uint32_t pending_intr = aica->common_data->MCIPD & enabled_intr;
 
+  /* when run on its own thread, the interrupt is delivered at the next sync
+     with the sh4 */
+  if (aica->dc->aica_thread &&
+      aica_thread_post_interrupt(aica->dc->aica_thread, HOLLY_INT_G2AICINT,
+                                 pending_intr != 0)) {
+    return;
+  }
+
   if (pending_intr) {
     holly_raise_interrupt(hl, HOLLY_INT_G2AICINT);
   } else {
@@ -351,7 +360,7 @@ static uint32_t aica_timer_tctl(struct aica *aica, int n) {
 }
 
 static uint32_t aica_timer_tcnt(struct aica *aica, int n) {
-  struct scheduler *sched = aica->dc->sched;
+  struct scheduler *sched = aica->dc->aica_sched;
   struct timer *timer = aica->timers[n];
   if (!timer) {
     /* if no timer has been created, return the raw value */
@@ -368,7 +377,7 @@ static uint32_t aica_timer_tcnt(struct aica *aica, int n) {
 }
 
 static void aica_timer_reschedule(struct aica *aica, int n, uint32_t period) {
-  struct scheduler *sched = aica->dc->sched;
+  struct scheduler *sched = aica->dc->aica_sched;
   struct timer **timer = &aica->timers[n];
 
   int64_t freq = AICA_SAMPLE_FREQ >> aica_timer_tctl(aica, n);
@@ -425,7 +434,7 @@ static void aica_rtc_reg_write(struct aica *aica, uint32_t addr, uint32_t data,
 
 static void aica_rtc_timer(void *data) {
   struct aica *aica = data;
-  struct scheduler *sched = aica->dc->sched;
+  struct scheduler *sched = aica->dc->aica_sched;
   aica->rtc++;
   aica->rtc_timer = sched_start_timer(sched, &aica_rtc_timer, aica, NS_PER_SEC);
 }
@@ -837,7 +846,7 @@ static void aica_common_reg_write(struct aica *aica, uint32_t addr,
 
 static void aica_next_sample(void *data) {
   struct aica *aica = data;
-  struct scheduler *sched = aica->dc->sched;
+  struct scheduler *sched = aica->dc->aica_sched;
 
   aica_generate_frames(aica);
   aica_raise_interrupt(aica, AICA_INT_SAMPLE);
@@ -871,7 +880,7 @@ static void aica_toggle_recording(struct aica *aica) {
 static int aica_init(struct device *dev) {
   struct aica *aica = (struct aica *)dev;
   struct memory *mem = aica->dc->mem;
-  struct scheduler *sched = aica->dc->sched;
+  struct scheduler *sched = aica->dc->aica_sched;
 
   aica->aram = mem_aram(mem, 0x0);
 
@@ -999,7 +1008,7 @@ void aica_debug_menu(struct aica *aica) {
 #endif
 
 void aica_destroy(struct aica *aica) {
-  struct scheduler *sched = aica->dc->sched;
+  struct scheduler *sched = aica->dc->aica_sched;
 
   /* shutdown rtc */
   {
@@ -0,0 +1,171 @@
+#include "guest/aica/aica_thread.h"
+#include "core/core.h"
+#include "core/profiler.h"
+#include "core/thread.h"
+#include "guest/dreamcast.h"
+#include "guest/holly/holly.h"
+#include "guest/scheduler.h"
+
+#define AICA_THREAD_MAX_MSGS 16
+
+enum {
+  AICA_THREAD_IDLE,
+  AICA_THREAD_RUNNING,
+  AICA_THREAD_SHUTDOWN,
+};
+
+struct aica_msg {
+  holly_interrupt_t intr;
+  int raise;
+};
+
+struct aica_thread {
+  struct dreamcast *dc;
+  struct scheduler *sched;
+  thread_t thread;
+
+  mutex_t mutex;
+  cond_t run_cond;
+  cond_t done_cond;
+  int state;
+  int64_t run_ns;
+
+  /* interrupts raised by the thread on the sh4. the mailbox is only written
+     to by the thread while running, and only read from once it has finished,
+     so the handshake through the mutex is the only synchronization needed */
+  struct aica_msg msgs[AICA_THREAD_MAX_MSGS];
+  int num_msgs;
+};
+
+static _Thread_local int on_aica_thread;
+
+int aica_thread_post_interrupt(struct aica_thread *thread,
+                               holly_interrupt_t intr, int raise) {
+  if (!on_aica_thread) {
+    return 0;
+  }
+
+  /* only the final state of each interrupt matters */
+  for (int i = 0; i < thread->num_msgs; i++) {
+    struct aica_msg *msg = &thread->msgs[i];
+
+    if (msg->intr == intr) {
+      msg->raise = raise;
+      return 1;
+    }
+  }
+
+  CHECK_LT(thread->num_msgs, AICA_THREAD_MAX_MSGS);
+
+  struct aica_msg *msg = &thread->msgs[thread->num_msgs++];
+  msg->intr = intr;
+  msg->raise = raise;
+
+  return 1;
+}
+
+void aica_thread_sync(struct aica_thread *thread) {
+  struct holly *hl = thread->dc->holly;
+
+  mutex_lock(thread->mutex);
+
+  while (thread->state == AICA_THREAD_RUNNING) {
+    cond_wait(thread->done_cond, thread->mutex);
+  }
+
+  mutex_unlock(thread->mutex);
+
+  for (int i = 0; i < thread->num_msgs; i++) {
+    struct aica_msg *msg = &thread->msgs[i];
+
+    if (msg->raise) {
+      holly_raise_interrupt(hl, msg->intr);
+    } else {
+      holly_clear_interrupt(hl, msg->intr);
+    }
+  }
+
+  thread->num_msgs = 0;
+}
+
+void aica_thread_run(struct aica_thread *thread, int64_t ns) {
+  mutex_lock(thread->mutex);
+
+  CHECK_EQ(thread->state, AICA_THREAD_IDLE);
+  thread->state = AICA_THREAD_RUNNING;
+  thread->run_ns = ns;
+  cond_signal(thread->run_cond);
+
+  mutex_unlock(thread->mutex);
+}
+
+struct scheduler *aica_thread_sched(struct aica_thread *thread) {
+  return thread->sched;
+}
+
+static void *aica_thread_main(void *data) {
+  struct aica_thread *thread = data;
+
+  on_aica_thread = 1;
+  prof_thread_name("aica");
+
+  while (1) {
+    mutex_lock(thread->mutex);
+
+    while (thread->state == AICA_THREAD_IDLE) {
+      cond_wait(thread->run_cond, thread->mutex);
+    }
+
+    if (thread->state == AICA_THREAD_SHUTDOWN) {
+      mutex_unlock(thread->mutex);
+      break;
+    }
+
+    int64_t ns = thread->run_ns;
+
+    mutex_unlock(thread->mutex);
+
+    sched_tick(thread->sched, ns);
+
+    mutex_lock(thread->mutex);
+    thread->state = AICA_THREAD_IDLE;
+    cond_signal(thread->done_cond);
+    mutex_unlock(thread->mutex);
+  }
+
+  return NULL;
+}
+
+void aica_thread_destroy(struct aica_thread *thread) {
+  /* wait for any in-flight run, then shutdown the thread */
+  aica_thread_sync(thread);
+
+  mutex_lock(thread->mutex);
+  thread->state = AICA_THREAD_SHUTDOWN;
+  cond_signal(thread->run_cond);
+  mutex_unlock(thread->mutex);
+
+  void *result;
+  thread_join(thread->thread, &result);
+
+  cond_destroy(thread->done_cond);
+  cond_destroy(thread->run_cond);
+  mutex_destroy(thread->mutex);
+  sched_destroy(thread->sched);
+  free(thread);
+}
+
+struct aica_thread *aica_thread_create(struct dreamcast *dc) {
+  struct aica_thread *thread = calloc(1, sizeof(struct aica_thread));
+
+  thread->dc = dc;
+  thread->sched = sched_create(dc);
+  thread->mutex = mutex_create();
+  thread->run_cond = cond_create();
+  thread->done_cond = cond_create();
+  thread->state = AICA_THREAD_IDLE;
+  thread->thread = thread_create(&aica_thread_main, "aica", thread);
+  CHECK_NOTNULL(thread->thread);
+
+  return thread;
+}
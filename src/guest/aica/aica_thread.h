@@ -0,0 +1,33 @@
+#ifndef AICA_THREAD_H
+#define AICA_THREAD_H
+
+#include <stdint.h>
+#include "guest/holly/holly_types.h"
+
+struct aica_thread;
+struct dreamcast;
+struct scheduler;
+
+/* runs the arm7 and aica on their own thread, in lockstep with the sh4. each
+   call to dc_tick runs both threads concurrently for the same amount of guest
+   time, bounding the skew between them to the length of a tick */
+struct aica_thread *aica_thread_create(struct dreamcast *dc);
+void aica_thread_destroy(struct aica_thread *thread);
+
+/* scheduler driving the devices and timers run on the thread */
+struct scheduler *aica_thread_sched(struct aica_thread *thread);
+
+/* start running the thread for ns, returning immediately */
+void aica_thread_run(struct aica_thread *thread, int64_t ns);
+
+/* wait for the thread to finish running, after which its state may be safely
+   accessed, and deliver any interrupts it raised on the sh4 */
+void aica_thread_sync(struct aica_thread *thread);
+
+/* queue the interrupt to be raised or cleared on the sh4 at the next sync,
+   returning 0 if not called from the thread, in which case the interrupt
+   should be raised or cleared directly */
+int aica_thread_post_interrupt(struct aica_thread *thread,
+                               holly_interrupt_t intr, int raise);
+
+#endif
@@ -157,6 +157,8 @@ uint32_t arm7_mem_read(struct arm7 *arm, uint32_t addr, uint32_t mask) {
 void arm7_raise_interrupt(struct arm7 *arm, enum arm7_interrupt intr) {
   arm->requested_interrupts |= intr;
   arm7_update_pending_interrupts(arm);
+
+  sched_hint_interaction(arm->runif.sched);
 }
 
 void arm7_reset(struct arm7 *arm) {
@@ -184,9 +186,16 @@ static void arm7_run(struct device *dev, int64_t ns) {
   static int64_t ARM7_CLOCK_FREQ = INT64_C(20000000);
   int cycles = (int)NANO_TO_CYCLES(ns, ARM7_CLOCK_FREQ);
 
+  PROF_ENTER("cpu", "arm7_run");
+
+  int64_t start = time_nanoseconds();
   jit_run(arm->jit, cycles);
+  int64_t end = time_nanoseconds();
+
+  PROF_LEAVE();
 
   prof_counter_add(COUNTER_arm7_instrs, arm->ctx.ran_instrs);
+  prof_counter_add(COUNTER_arm7_run_ns, end - start);
 }
 
 static void arm7_guest_destroy(struct jit_guest *guest) {
@@ -210,6 +219,8 @@ static struct jit_guest *arm7_guest_create(struct arm7 *arm) {
   guest->w8 = &arm7_write8;
   guest->w16 = &arm7_write16;
   guest->w32 = &arm7_write32;
+  guest->page_table = arm7_page_table(arm->dc->mem);
+  guest->page_shift = MEM_PAGE_SHIFT;
 
   /* runtime interface */
   guest->data = arm;
@@ -275,6 +286,7 @@ struct arm7 *arm7_create(struct dreamcast *dc) {
   /* setup run interface */
   arm->runif.enabled = 1;
   arm->runif.run = &arm7_run;
+  arm->runif.sched = dc->aica_sched;
 
   return arm;
 }
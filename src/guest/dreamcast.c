@@ -1,6 +1,7 @@
 #include "guest/dreamcast.h"
 #include "core/core.h"
 #include "guest/aica/aica.h"
+#include "guest/aica/aica_thread.h"
 #include "guest/arm7/arm7.h"
 #include "guest/bios/bios.h"
 #include "guest/debugger.h"
@@ -14,6 +15,7 @@
 #include "guest/rom/flash.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
+#include "options.h"
 
 void dc_vblank_out(struct dreamcast *dc) {
   if (!dc->vblank_out) {
@@ -110,7 +112,13 @@ void dc_tick(struct dreamcast *dc, int64_t ns) {
   }
 
   if (dc->running) {
-    sched_tick(dc->sched, ns);
+    if (dc->aica_thread) {
+      aica_thread_run(dc->aica_thread, ns);
+      sched_tick(dc->sched, ns);
+      aica_thread_sync(dc->aica_thread);
+    } else {
+      sched_tick(dc->sched, ns);
+    }
   }
 }
 
@@ -224,6 +232,9 @@ void dc_destroy(struct dreamcast *dc) {
   arm7_destroy(dc->arm7);
   sh4_destroy(dc->sh4);
   bios_destroy(dc->bios);
+  if (dc->aica_thread) {
+    aica_thread_destroy(dc->aica_thread);
+  }
   sched_destroy(dc->sched);
   mem_destroy(dc->mem);
   if (dc->debugger) {
@@ -241,6 +252,11 @@ struct dreamcast *dc_create() {
 #endif
   dc->mem = mem_create(dc);
   dc->sched = sched_create(dc);
+  dc->aica_sched = dc->sched;
+  if (OPTION_aica_thread) {
+    dc->aica_thread = aica_thread_create(dc);
+    dc->aica_sched = aica_thread_sched(dc->aica_thread);
+  }
   dc->bios = bios_create(dc);
   dc->sh4 = sh4_create(dc);
   dc->arm7 = arm7_create(dc);
@@ -79,6 +79,9 @@ struct runif {
   int enabled;
   int running;
   device_run_cb run;
+
+  /* scheduler which runs the device */
+  struct scheduler *sched;
 };
 
 /*
@@ -125,6 +128,11 @@ struct dreamcast {
   struct memory *mem;
   struct scheduler *sched;
 
+  /* the arm7 and aica are driven by their own scheduler when run on a
+     separate thread, else this is the same as sched */
+  struct scheduler *aica_sched;
+  struct aica_thread *aica_thread;
+
   /* devices */
   struct bios *bios;
   struct sh4 *sh4;
@@ -3,6 +3,7 @@
 #include "guest/gdrom/gdrom.h"
 #include "guest/maple/maple.h"
 #include "guest/memory.h"
+#include "guest/pvr/pvr.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
 #include "imgui.h"
@@ -277,11 +278,32 @@ static uint32_t *holly_interrupt_status(struct holly *hl,
   }
 }
 
+static uint32_t holly_interrupt_mask(struct holly *hl,
+                                     enum holly_interrupt_type type) {
+  switch (type) {
+    case HOLLY_INT_NRM:
+      return *hl->SB_IML2NRM | *hl->SB_IML4NRM | *hl->SB_IML6NRM;
+    case HOLLY_INT_EXT:
+      return *hl->SB_IML2EXT | *hl->SB_IML4EXT | *hl->SB_IML6EXT;
+    case HOLLY_INT_ERR:
+      return *hl->SB_IML2ERR | *hl->SB_IML4ERR | *hl->SB_IML6ERR;
+    default:
+      LOG_FATAL("invalid interrupt type");
+  }
+}
+
 static int holly_init(struct device *dev) {
   struct holly *hl = (struct holly *)dev;
   return 1;
 }
 
+int holly_interrupt_enabled(struct holly *hl, holly_interrupt_t intr) {
+  enum holly_interrupt_type type = HOLLY_INTERRUPT_TYPE(intr);
+  uint32_t irq = HOLLY_INTERRUPT_IRQ(intr);
+
+  return (holly_interrupt_mask(hl, type) & irq) != 0;
+}
+
 void holly_clear_interrupt(struct holly *hl, holly_interrupt_t intr) {
   enum holly_interrupt_type type = HOLLY_INTERRUPT_TYPE(intr);
   uint32_t irq = HOLLY_INTERRUPT_IRQ(intr);
@@ -301,6 +323,8 @@ void holly_raise_interrupt(struct holly *hl, holly_interrupt_t intr) {
 
   holly_update_interrupts(hl);
 
+  sched_hint_interaction(hl->dc->sched);
+
   /* check for hardware dma initiation */
   if (intr == HOLLY_INT_PCVOINT && *hl->SB_MDTSEL && *hl->SB_MDEN) {
     holly_maple_dma(hl);
@@ -419,6 +443,9 @@ REG_W32(holly_cb, SB_SFRES) {
 
 REG_R32(holly_cb, SB_ISTNRM) {
   struct holly *hl = dc->holly;
+
+  pvr_update_hblank_status(dc->pvr);
+
   /* note that the two highest bits indicate the OR'ed result of all of the
      bits in SB_ISTEXT and SB_ISTERR, respectively, and writes to these two
      bits are ignored */
@@ -456,6 +483,7 @@ REG_W32(holly_cb, SB_IML2NRM) {
   struct holly *hl = dc->holly;
   *hl->SB_IML2NRM = value;
   holly_update_interrupts(hl);
+  pvr_reschedule_raster(dc->pvr);
 }
 
 REG_W32(holly_cb, SB_IML2EXT) {
@@ -474,6 +502,7 @@ REG_W32(holly_cb, SB_IML4NRM) {
   struct holly *hl = dc->holly;
   *hl->SB_IML4NRM = value;
   holly_update_interrupts(hl);
+  pvr_reschedule_raster(dc->pvr);
 }
 
 REG_W32(holly_cb, SB_IML4EXT) {
@@ -492,6 +521,7 @@ REG_W32(holly_cb, SB_IML6NRM) {
   struct holly *hl = dc->holly;
   *hl->SB_IML6NRM = value;
   holly_update_interrupts(hl);
+  pvr_reschedule_raster(dc->pvr);
 }
 
 REG_W32(holly_cb, SB_IML6EXT) {
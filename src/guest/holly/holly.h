@@ -46,4 +46,7 @@ void holly_reg_write(struct holly *hl, uint32_t addr, uint32_t data,
 void holly_raise_interrupt(struct holly *hl, holly_interrupt_t intr);
 void holly_clear_interrupt(struct holly *hl, holly_interrupt_t intr);
 
+/* returns true if the interrupt is unmasked at any of the sh4 irl levels */
+int holly_interrupt_enabled(struct holly *hl, holly_interrupt_t intr);
+
 #endif
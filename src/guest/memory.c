@@ -38,17 +38,24 @@
 #define ARAM_OFFSET VRAM_OFFSET + VRAM_SIZE
 #define PHYSICAL_SIZE RAM_SIZE + VRAM_SIZE + ARAM_SIZE
 
-/* page table constants */
-#define MEM_PAGE_BITS 11
-#define MEM_OFFSET_BITS 21
-#define MEM_MAX_PAGES (1 << MEM_PAGE_BITS)
-#define MEM_PAGE_SHIFT MEM_OFFSET_BITS
-#define MEM_OFFSET_MASK ((1 << MEM_OFFSET_BITS) - 1)
+#define MEM_MAX_MIRRORS 64
+
+/* each range of physical memory mapped into an address space. used to find
+   every view of a physical page when changing its protection */
+struct mirror {
+  uint32_t begin;
+  uint32_t size;
+  int offset;
+};
 
 /* address spaces provide different views of the same physical memory */
 struct address_space {
   uint8_t *base;
 
+  /* physical memory mappings */
+  struct mirror mirrors[MEM_MAX_MIRRORS];
+  int num_mirrors;
+
   /* page table */
   uint8_t *ptrs[MEM_MAX_PAGES];
   mmio_read_cb read[MEM_MAX_PAGES];
@@ -135,7 +142,8 @@ enum {
   define_read_bytes(space, read32, uint32_t);   \
   define_read_bytes(space, read16, uint16_t);   \
   define_read_bytes(space, read8, uint8_t);     \
-  define_base(space);
+  define_base(space);                           \
+  define_page_table(space);
 
 #define define_lookup_ex(space)                                               \
   static void space##_lookup_ex(                                              \
@@ -294,6 +302,11 @@ enum {
     return mem->space.base;                   \
   }
 
+#define define_page_table(space)                     \
+  uint8_t **space##_page_table(struct memory *mem) { \
+    return mem->space.ptrs;                          \
+  }
+
 static void as_map(struct memory *mem, struct address_space *space,
                    uint32_t begin, uint32_t size, int type, mmio_read_cb read,
                    mmio_write_cb write, mmio_read_string_cb read_string,
@@ -322,6 +335,14 @@ static void as_map(struct memory *mem, struct address_space *space,
   /* add entries to page table */
   CHECK(size % page_size == 0);
 
+  if (ptr) {
+    CHECK_LT(space->num_mirrors, MEM_MAX_MIRRORS);
+    struct mirror *mirror = &space->mirrors[space->num_mirrors++];
+    mirror->begin = begin;
+    mirror->size = size;
+    mirror->offset = offset;
+  }
+
   for (uint32_t page_offset = 0; page_offset < size; page_offset += page_size) {
     uint32_t addr = begin + page_offset;
     int page = addr >> MEM_PAGE_SHIFT;
@@ -342,6 +363,12 @@ static void as_map(struct memory *mem, struct address_space *space,
   }
 
 #ifdef HAVE_FASTMEM
+  /* the address space couldn't be reserved, accesses will go through the page
+     table instead */
+  if (!space->base) {
+    return;
+  }
+
   uint8_t *target = space->base + begin;
   void *res = NULL;
 
@@ -367,8 +394,10 @@ static int as_init(struct address_space *space) {
   }
 
 #ifdef HAVE_FASTMEM
+  /* fastmem is an optimization, carry on without it if the address space
+     can't be reserved */
   if (!reserve_address_space(&space->base)) {
-    return 0;
+    space->base = NULL;
   }
 #endif
 
@@ -532,6 +561,145 @@ int sh4_init(struct memory *mem) {
   return 1;
 }
 
+static int mem_physical_offset(struct memory *mem, const uint8_t *ptr) {
+  if (ptr >= mem->ram && ptr < mem->ram + RAM_SIZE) {
+    return RAM_OFFSET + (int)(ptr - mem->ram);
+  } else if (ptr >= mem->vram && ptr < mem->vram + VRAM_SIZE) {
+    return VRAM_OFFSET + (int)(ptr - mem->vram);
+  } else if (ptr >= mem->aram && ptr < mem->aram + ARAM_SIZE) {
+    return ARAM_OFFSET + (int)(ptr - mem->aram);
+  }
+  return -1;
+}
+
+#ifdef HAVE_FASTMEM
+static uint8_t *as_mirror_ptr(struct address_space *space, int i, int offset,
+                              int size) {
+  struct mirror *mirror = &space->mirrors[i];
+  int64_t mirror_end = (int64_t)mirror->offset + mirror->size;
+
+  if (offset < mirror->offset || offset + size > mirror_end) {
+    return NULL;
+  }
+
+  return space->base + mirror->begin + (offset - mirror->offset);
+}
+
+static void as_unprotect(struct address_space *space, int offset, int size,
+                         int num_mirrors) {
+  if (!space->base) {
+    return;
+  }
+
+  for (int i = 0; i < num_mirrors; i++) {
+    uint8_t *ptr = as_mirror_ptr(space, i, offset, size);
+
+    if (ptr) {
+      write_unprotect_pages(ptr, size);
+    }
+  }
+}
+
+static int as_protect(struct address_space *space, int offset, int size) {
+  if (!space->base) {
+    return 1;
+  }
+
+  for (int i = 0; i < space->num_mirrors; i++) {
+    uint8_t *ptr = as_mirror_ptr(space, i, offset, size);
+
+    if (ptr && !write_protect_pages(ptr, size)) {
+      as_unprotect(space, offset, size, i);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static uint8_t *as_lookup_host(struct address_space *space, const uint8_t *ptr,
+                               int *found) {
+  const uint64_t ADDRESS_SPACE_SIZE = UINT64_C(1) << 32;
+
+  if (!space->base || ptr < space->base ||
+      (uint64_t)(ptr - space->base) >= ADDRESS_SPACE_SIZE) {
+    *found = 0;
+    return NULL;
+  }
+
+  uint32_t addr = (uint32_t)(ptr - space->base);
+  uint8_t *backing = space->ptrs[addr >> MEM_PAGE_SHIFT];
+  *found = 1;
+  return backing ? backing + (addr & MEM_OFFSET_MASK) : NULL;
+}
+#endif
+
+int mem_protect(struct memory *mem, uint8_t *ptr, int size) {
+#ifdef HAVE_FASTMEM
+  int offset = mem_physical_offset(mem, ptr);
+
+  if (offset < 0) {
+    return 0;
+  }
+
+  /* write-protect the backing memory, as well as every view of it in each
+     address space, so that writes through any mirror are caught */
+  if (!write_protect_pages(ptr, size)) {
+    return 0;
+  }
+
+  if (!as_protect(&mem->sh4, offset, size)) {
+    write_unprotect_pages(ptr, size);
+    return 0;
+  }
+
+  if (!as_protect(&mem->arm7, offset, size)) {
+    as_unprotect(&mem->sh4, offset, size, mem->sh4.num_mirrors);
+    write_unprotect_pages(ptr, size);
+    return 0;
+  }
+
+  return 1;
+#else
+  /* without fastmem, the backing memory is allocated on the heap and isn't
+     guaranteed to be page aligned, so it can't be safely protected */
+  return 0;
+#endif
+}
+
+void mem_unprotect(struct memory *mem, uint8_t *ptr, int size) {
+#ifdef HAVE_FASTMEM
+  int offset = mem_physical_offset(mem, ptr);
+  CHECK_GE(offset, 0);
+
+  write_unprotect_pages(ptr, size);
+
+  as_unprotect(&mem->sh4, offset, size, mem->sh4.num_mirrors);
+  as_unprotect(&mem->arm7, offset, size, mem->arm7.num_mirrors);
+#endif
+}
+
+uint8_t *mem_lookup_host(struct memory *mem, const void *host) {
+  const uint8_t *ptr = host;
+
+  if (mem_physical_offset(mem, ptr) >= 0) {
+    return (uint8_t *)ptr;
+  }
+
+#ifdef HAVE_FASTMEM
+  int found = 0;
+  uint8_t *backing = as_lookup_host(&mem->sh4, ptr, &found);
+
+  if (!found) {
+    backing = as_lookup_host(&mem->arm7, ptr, &found);
+  }
+
+  return backing;
+#else
+  return NULL;
+#endif
+}
+
 uint8_t *mem_vram(struct memory *mem, uint32_t offset) {
   return mem->vram + offset;
 }
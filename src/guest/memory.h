@@ -7,6 +7,13 @@
 struct dreamcast;
 struct memory;
 
+/* page table constants */
+#define MEM_PAGE_BITS 11
+#define MEM_OFFSET_BITS 21
+#define MEM_MAX_PAGES (1 << MEM_PAGE_BITS)
+#define MEM_PAGE_SHIFT MEM_OFFSET_BITS
+#define MEM_OFFSET_MASK ((1 << MEM_OFFSET_BITS) - 1)
+
 /*
  * mmio callbacks and helpers
  */
@@ -22,6 +29,7 @@ typedef void (*mmio_write_string_cb)(void *, uint32_t, const uint8_t *, int);
 
 #define DECLARE_ADDRESS_SPACE(space)                                       \
   uint8_t *space##_base(struct memory *mem);                               \
+  uint8_t **space##_page_table(struct memory *mem);                        \
   uint8_t space##_read8(struct memory *mem, uint32_t addr);                \
   uint16_t space##_read16(struct memory *mem, uint32_t addr);              \
   uint32_t space##_read32(struct memory *mem, uint32_t addr);              \
@@ -50,4 +58,14 @@ uint8_t *mem_ram(struct memory *mem, uint32_t offset);
 uint8_t *mem_aram(struct memory *mem, uint32_t offset);
 uint8_t *mem_vram(struct memory *mem, uint32_t offset);
 
+/* code tracking helpers. mem_protect write-protects the physical memory
+   backing ptr in every address space it's mapped to, until released by a
+   matching call to mem_unprotect. the protection is shared with the memory
+   watches, so the pages stay read-only while either still needs them to be.
+   mem_lookup_host translates a host address from any of these views back to
+   the backing memory */
+int mem_protect(struct memory *mem, uint8_t *ptr, int size);
+void mem_unprotect(struct memory *mem, uint8_t *ptr, int size);
+uint8_t *mem_lookup_host(struct memory *mem, const void *host);
+
 #endif
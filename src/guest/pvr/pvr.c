@@ -227,22 +227,148 @@ static void pvr_vblank_in(struct pvr *pvr) {
   dc_vblank_in(pvr->dc, pvr->VO_CONTROL->blank_video);
 }
 
-static void pvr_next_scanline(void *data) {
-  struct pvr *pvr = data;
-  struct holly *hl = pvr->dc->holly;
+static int pvr_line_in_vblank(struct pvr *pvr, uint32_t line) {
+  if (pvr->SPG_VBLANK->vbstart < pvr->SPG_VBLANK->vbend) {
+    return line >= pvr->SPG_VBLANK->vbstart && line < pvr->SPG_VBLANK->vbend;
+  }
+  return line >= pvr->SPG_VBLANK->vbstart || line < pvr->SPG_VBLANK->vbend;
+}
+
+/* returns the number of lines after line until the next line which raises an
+   interrupt or changes the vsync state */
+static uint32_t pvr_lines_until_event(struct pvr *pvr, uint32_t line) {
+  uint32_t num_lines = pvr->SPG_LOAD->vcount + 1;
+  uint32_t events[5];
+  int num_events = 0;
+
+  /* when raised on every line, the hblank interrupt only needs to be
+     generated while it's unmasked */
+  if (pvr->SPG_HBLANK_INT->hblank_int_mode != 0x0) {
+    if (pvr->SPG_HBLANK_INT->hblank_int_mode != 0x2 ||
+        holly_interrupt_enabled(pvr->dc->holly, HOLLY_INT_PCHIINT)) {
+      return 1;
+    }
+  } else {
+    events[num_events++] = pvr->SPG_HBLANK_INT->line_comp_val;
+  }
+
+  events[num_events++] = pvr->SPG_VBLANK_INT->vblank_in_line_number;
+  events[num_events++] = pvr->SPG_VBLANK_INT->vblank_out_line_number;
+  events[num_events++] = pvr->SPG_VBLANK->vbstart;
+  events[num_events++] = pvr->SPG_VBLANK->vbend;
+
+  uint32_t lines = num_lines;
+
+  for (int i = 0; i < num_events; i++) {
+    if (events[i] >= num_lines) {
+      continue;
+    }
+
+    uint32_t n = (events[i] + num_lines - line - 1) % num_lines + 1;
+    lines = MIN(lines, n);
+  }
+
+  return lines;
+}
+
+/* returns the line currently being output, as well as the time until the next
+   line begins, based on the time remaining until the line timer expires. the
+   time is measured from the sh4's position in its slice, not the end of the
+   slice, so lines which haven't begun yet for it aren't reported */
+static uint32_t pvr_current_line(struct pvr *pvr, int64_t *next_ns) {
   struct scheduler *sched = pvr->dc->sched;
+  uint32_t num_lines = pvr->SPG_LOAD->vcount + 1;
+  int64_t line_ns = HZ_TO_NANO(pvr->line_clock);
+  int64_t remaining = sched_remaining_time(sched, pvr->line_timer) +
+                      sh4_remaining_time(pvr->dc->sh4);
+
+  /* if the timer is due, but hasn't run yet, its line hasn't begun */
+  int64_t lines_left = MAX((remaining + line_ns - 1) / line_ns, 1);
 
+  if (next_ns) {
+    *next_ns = remaining - (lines_left - 1) * line_ns;
+  }
+
+  return (pvr->next_line + num_lines - (uint32_t)(lines_left % num_lines)) %
+         num_lines;
+}
+
+static void pvr_next_scanline(void *data);
+
+static void pvr_schedule_scanline(struct pvr *pvr, uint32_t line,
+                                  int64_t next_ns) {
+  struct scheduler *sched = pvr->dc->sched;
   uint32_t num_lines = pvr->SPG_LOAD->vcount + 1;
-  pvr->current_line = (pvr->current_line + 1) % num_lines;
+  int64_t line_ns = HZ_TO_NANO(pvr->line_clock);
+
+  /* rather than waking up for each line, skip ahead to the next line which
+     has an observable side effect. the current line is derived from the
+     timer on demand when SPG_STATUS is read */
+  uint32_t lines = pvr_lines_until_event(pvr, line);
+  int64_t ns = next_ns + (lines - 1) * line_ns;
+
+  /* next_ns is relative to the sh4's position, while timers are relative to
+     the end of its slice */
+  ns = MAX(ns - sh4_remaining_time(pvr->dc->sh4), 0);
+
+  pvr->next_line = (line + lines) % num_lines;
+  pvr->line_timer = sched_start_timer(sched, &pvr_next_scanline, pvr, ns);
+}
+
+void pvr_update_hblank_status(struct pvr *pvr) {
+  struct holly *hl = pvr->dc->holly;
+
+  if (!pvr->line_timer || pvr->SPG_HBLANK_INT->hblank_int_mode != 0x2) {
+    return;
+  }
+
+  /* while PCHIINT is masked, the raster doesn't wake up on each line to raise
+     it, so raise it now for whichever line the sh4 has reached */
+  if (holly_interrupt_enabled(hl, HOLLY_INT_PCHIINT)) {
+    return;
+  }
+
+  uint32_t line = pvr_current_line(pvr, NULL);
+
+  if (line != pvr->hblank_line) {
+    pvr->hblank_line = line;
+    holly_raise_interrupt(hl, HOLLY_INT_PCHIINT);
+  }
+}
+
+void pvr_reschedule_raster(struct pvr *pvr) {
+  struct scheduler *sched = pvr->dc->sched;
+
+  if (!pvr->line_timer) {
+    return;
+  }
+
+  /* the timer is about to expire and reschedule itself */
+  if (sched_remaining_time(sched, pvr->line_timer) <= 0) {
+    return;
+  }
+
+  int64_t next_ns;
+  uint32_t line = pvr_current_line(pvr, &next_ns);
+
+  sched_cancel_timer(sched, pvr->line_timer);
+  pvr_schedule_scanline(pvr, line, next_ns);
+}
+
+static void pvr_next_scanline(void *data) {
+  struct pvr *pvr = data;
+  struct holly *hl = pvr->dc->holly;
+  uint32_t line = pvr->next_line;
 
   /* hblank in */
   switch (pvr->SPG_HBLANK_INT->hblank_int_mode) {
     case 0x0:
-      if (pvr->current_line == pvr->SPG_HBLANK_INT->line_comp_val) {
+      if (line == pvr->SPG_HBLANK_INT->line_comp_val) {
         holly_raise_interrupt(hl, HOLLY_INT_PCHIINT);
       }
       break;
     case 0x2:
+      pvr->hblank_line = line;
       holly_raise_interrupt(hl, HOLLY_INT_PCHIINT);
       break;
     default:
@@ -251,24 +377,18 @@ static void pvr_next_scanline(void *data) {
   }
 
   /* vblank in */
-  if (pvr->current_line == pvr->SPG_VBLANK_INT->vblank_in_line_number) {
+  if (line == pvr->SPG_VBLANK_INT->vblank_in_line_number) {
     holly_raise_interrupt(hl, HOLLY_INT_PCVIINT);
   }
 
   /* vblank out */
-  if (pvr->current_line == pvr->SPG_VBLANK_INT->vblank_out_line_number) {
+  if (line == pvr->SPG_VBLANK_INT->vblank_out_line_number) {
     holly_raise_interrupt(hl, HOLLY_INT_PCVOINT);
   }
 
   int was_vsync = pvr->SPG_STATUS->vsync;
-  if (pvr->SPG_VBLANK->vbstart < pvr->SPG_VBLANK->vbend) {
-    pvr->SPG_STATUS->vsync = pvr->current_line >= pvr->SPG_VBLANK->vbstart &&
-                             pvr->current_line < pvr->SPG_VBLANK->vbend;
-  } else {
-    pvr->SPG_STATUS->vsync = pvr->current_line >= pvr->SPG_VBLANK->vbstart ||
-                             pvr->current_line < pvr->SPG_VBLANK->vbend;
-  }
-  pvr->SPG_STATUS->scanline = pvr->current_line;
+  pvr->SPG_STATUS->vsync = pvr_line_in_vblank(pvr, line);
+  pvr->SPG_STATUS->scanline = line;
 
   if (!was_vsync && pvr->SPG_STATUS->vsync) {
     pvr_vblank_in(pvr);
@@ -276,14 +396,18 @@ static void pvr_next_scanline(void *data) {
     pvr_vblank_out(pvr);
   }
 
-  /* reschedule */
-  pvr->line_timer = sched_start_timer(sched, &pvr_next_scanline, pvr,
-                                      HZ_TO_NANO(pvr->line_clock));
+  pvr_schedule_scanline(pvr, line, HZ_TO_NANO(pvr->line_clock));
 }
 
 static void pvr_reconfigure_spg(struct pvr *pvr) {
   struct scheduler *sched = pvr->dc->sched;
 
+  /* resume output from the current line, calculated with the old timings */
+  uint32_t line = 0;
+  if (pvr->line_timer) {
+    line = pvr_current_line(pvr, NULL) % (pvr->SPG_LOAD->vcount + 1);
+  }
+
   /* scale pixel clock frequency */
   int pixel_clock = 13500000;
   if (pvr->FB_R_CTRL->vclk_div) {
@@ -315,8 +439,7 @@ static void pvr_reconfigure_spg(struct pvr *pvr) {
     pvr->line_timer = NULL;
   }
 
-  pvr->line_timer = sched_start_timer(sched, &pvr_next_scanline, pvr,
-                                      HZ_TO_NANO(pvr->line_clock));
+  pvr_schedule_scanline(pvr, line, HZ_TO_NANO(pvr->line_clock));
 }
 
 static int pvr_init(struct device *dev) {
@@ -495,6 +618,40 @@ REG_W32(pvr_cb, SPG_LOAD) {
   pvr_reconfigure_spg(pvr);
 }
 
+REG_R32(pvr_cb, SPG_STATUS) {
+  struct pvr *pvr = dc->pvr;
+
+  uint32_t line = pvr_current_line(pvr, NULL);
+  pvr->SPG_STATUS->scanline = line;
+  pvr->SPG_STATUS->vsync = pvr_line_in_vblank(pvr, line);
+
+  return pvr->SPG_STATUS->full;
+}
+
+REG_W32(pvr_cb, SPG_HBLANK_INT) {
+  struct pvr *pvr = dc->pvr;
+
+  pvr->SPG_HBLANK_INT->full = value;
+
+  pvr_reschedule_raster(pvr);
+}
+
+REG_W32(pvr_cb, SPG_VBLANK_INT) {
+  struct pvr *pvr = dc->pvr;
+
+  pvr->SPG_VBLANK_INT->full = value;
+
+  pvr_reschedule_raster(pvr);
+}
+
+REG_W32(pvr_cb, SPG_VBLANK) {
+  struct pvr *pvr = dc->pvr;
+
+  pvr->SPG_VBLANK->full = value;
+
+  pvr_reschedule_raster(pvr);
+}
+
 REG_W32(pvr_cb, FB_R_CTRL) {
   struct pvr *pvr = dc->pvr;
 
@@ -15,10 +15,14 @@ struct pvr {
   uint8_t *vram;
   uint32_t reg[PVR_NUM_REGS];
 
-  /* raster progress */
+  /* raster progress. the line timer only expires on lines with side effects,
+     the current line is derived from the time remaining until it expires */
   struct timer *line_timer;
   int line_clock;
-  uint32_t current_line;
+  uint32_t next_line;
+
+  /* last line the hblank status bit was raised for */
+  uint32_t hblank_line;
 
   /* copy of deinterlaced framebuffer from texture memory */
   uint8_t framebuffer[PVR_FRAMEBUFFER_SIZE];
@@ -38,6 +42,13 @@ void pvr_destroy(struct pvr *pvr);
 
 void pvr_video_size(struct pvr *pvr, int *video_width, int *video_height);
 
+/* recalculate the next raster event after a change to state affecting which
+   lines have events, such as the holly interrupt masks */
+void pvr_reschedule_raster(struct pvr *pvr);
+
+/* raise the hblank status bit for any line which began without a wakeup */
+void pvr_update_hblank_status(struct pvr *pvr);
+
 uint32_t pvr_reg_read(struct pvr *pvr, uint32_t addr, uint32_t mask);
 void pvr_reg_write(struct pvr *pvr, uint32_t addr, uint32_t data,
                    uint32_t mask);
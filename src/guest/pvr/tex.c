@@ -2,6 +2,10 @@
 #include "core/core.h"
 #include "render/render_backend.h"
 
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
 /*
  * pixel formats
  */
@@ -282,6 +286,26 @@ static inline void RGBA_pack_twiddled(RGBA_type *dst, int x, int y, int stride,
   RGBA_pack(&dst[(y + 1) * stride + (x + 1)], rgba + 0xc);
 }
 
+/* RGBA5551, RGB565 and RGBA4444
+
+   16-bit formats supported natively by the render backend. textures in the
+   equivalent pvr format are only swizzled when converted to these, instead
+   of being unpacked and expanded to RGBA */
+typedef uint16_t RGBA5551_type;
+typedef uint16_t RGBA4444_type;
+
+static inline RGBA5551_type ARGB1555_to_RGBA5551(ARGB1555_type src) {
+  return (src << 1) | (src >> 15);
+}
+
+static inline RGB565_type RGB565_to_RGB565(RGB565_type src) {
+  return src;
+}
+
+static inline RGBA4444_type ARGB4444_to_RGBA4444(ARGB4444_type src) {
+  return (src << 4) | (src >> 12);
+}
+
 /*
  * texture formats
  *
@@ -314,15 +338,17 @@ void pvr_init_twiddle_table() {
     return;
   }
 
-  twitbl_init = 1;
-
   for (int i = 0; i < ARRAY_SIZE(twitbl); i++) {
-    twitbl[i] = 0;
+    int pos = 0;
 
     for (int j = 0, k = 1; k <= i; j++, k <<= 1) {
-      twitbl[i] |= (i & k) << j;
+      pos |= (i & k) << j;
     }
+
+    twitbl[i] = pos;
   }
+
+  twitbl_init = 1;
 }
 
 static int pvr_twiddle_pos(int x, int y) {
@@ -439,6 +465,71 @@ static int pvr_twiddle_pos(int x, int y) {
     }                                                                        \
   }
 
+/* the same conversions for 16-bit textures being output in a native 16-bit
+   format, each 2x2 twiddled block is only reordered */
+#define define_convert_bitmap16(FROM, TO)                                   \
+  void convert_bitmap_##FROM##_##TO(const FROM##_type *src, TO##_type *dst, \
+                                    int width, int height, int stride) {    \
+    for (int y = 0; y < height; y++) {                                      \
+      for (int x = 0; x < width; x++) {                                     \
+        dst[y * width + x] = FROM##_to_##TO(src[y * stride + x]);           \
+      }                                                                     \
+    }                                                                       \
+  }
+
+#define define_convert_twiddled16(FROM, TO)                                   \
+  void convert_twiddled_##FROM##_##TO(const FROM##_type *src, TO##_type *dst, \
+                                      int width, int height) {                \
+    pvr_init_twiddle_table();                                                 \
+                                                                              \
+    int size = MIN(width, height);                                            \
+    int base = 0;                                                             \
+                                                                              \
+    for (int y = 0; y < height; y += size) {                                  \
+      for (int x = 0; x < width; x += size) {                                 \
+        for (int y2 = 0; y2 < size; y2 += 2) {                                \
+          for (int x2 = 0; x2 < size; x2 += 2) {                              \
+            const FROM##_type *texels = &src[base + pvr_twiddle_pos(x2, y2)]; \
+            TO##_type *row = &dst[(y + y2) * width + (x + x2)];               \
+            row[0] = FROM##_to_##TO(texels[0]);                               \
+            row[1] = FROM##_to_##TO(texels[2]);                               \
+            row[width + 0] = FROM##_to_##TO(texels[1]);                       \
+            row[width + 1] = FROM##_to_##TO(texels[3]);                       \
+          }                                                                   \
+        }                                                                     \
+        base += size * size;                                                  \
+      }                                                                       \
+    }                                                                         \
+  }
+
+#define define_convert_vq16(FROM, TO)                                        \
+  void convert_vq_##FROM##_##TO(const uint8_t *src, const uint8_t *codebook, \
+                                TO##_type *dst, int width, int height) {     \
+    pvr_init_twiddle_table();                                                \
+                                                                             \
+    int size = MIN(width, height);                                           \
+    int base = 0;                                                            \
+                                                                             \
+    for (int y = 0; y < height; y += size) {                                 \
+      for (int x = 0; x < width; x += size) {                                \
+        for (int y2 = 0; y2 < size; y2 += 2) {                               \
+          for (int x2 = 0; x2 < size; x2 += 2) {                             \
+            int pos = base + pvr_twiddle_pos(x2, y2);                        \
+            /* each codebook entry is 4x2 bytes long */                      \
+            int idx = src[pos / 4] * 8;                                      \
+            const FROM##_type *code = (const FROM##_type *)&codebook[idx];   \
+            TO##_type *row = &dst[(y + y2) * width + (x + x2)];              \
+            row[0] = FROM##_to_##TO(code[0]);                                \
+            row[1] = FROM##_to_##TO(code[2]);                                \
+            row[width + 0] = FROM##_to_##TO(code[1]);                        \
+            row[width + 1] = FROM##_to_##TO(code[3]);                        \
+          }                                                                  \
+        }                                                                    \
+        base += size * size;                                                 \
+      }                                                                      \
+    }                                                                        \
+  }
+
 define_convert_bitmap(ARGB1555, RGBA);
 define_convert_bitmap(RGB565, RGBA);
 define_convert_bitmap(UYVY422, RGBA);
@@ -464,6 +555,509 @@ define_convert_vq(RGB565, RGBA);
 define_convert_vq(ARGB4444, RGBA);
 define_convert_vq(UYVY422, RGBA);
 
+define_convert_bitmap16(ARGB1555, RGBA5551);
+define_convert_bitmap16(RGB565, RGB565);
+define_convert_bitmap16(ARGB4444, RGBA4444);
+
+define_convert_twiddled16(ARGB1555, RGBA5551);
+define_convert_twiddled16(RGB565, RGB565);
+define_convert_twiddled16(ARGB4444, RGBA4444);
+
+define_convert_vq16(ARGB1555, RGBA5551);
+define_convert_vq16(RGB565, RGB565);
+define_convert_vq16(ARGB4444, RGBA4444);
+
+/*
+ * sse2 conversions
+ *
+ * the sse2 conversions work on a 4x4 block of texels at a time. in twiddled
+ * order, a 4x4 block is 16 consecutive texels made up of four 2x2 blocks:
+
+   00 02 | 08 10
+         |
+   01 03 | 09 11
+   -------------
+   04 06 | 12 14
+         |
+   05 07 | 13 15
+
+   once unpacked to RGBA, each 2x2 block fits in a single register, and each
+   row of the 4x4 block is formed by interleaving two of these registers
+
+   paletted and vq compressed textures are converted by first unpacking the
+   palette or codebook to RGBA, reducing each texel to a single lookup
+
+   sse2 is part of the x86-64 baseline, so these are always used on x86-64
+   hosts, falling back to the reference conversions above for textures which
+   are too small to be converted a block at a time */
+#if ARCH_X64
+static inline __m128i COLOR_EXTEND_4_sse2(__m128i c) {
+  return _mm_or_si128(_mm_slli_epi16(c, 4), c);
+}
+
+static inline __m128i COLOR_EXTEND_5_sse2(__m128i c) {
+  return _mm_or_si128(_mm_slli_epi16(c, 3), _mm_srli_epi16(c, 2));
+}
+
+static inline __m128i COLOR_EXTEND_6_sse2(__m128i c) {
+  return _mm_or_si128(_mm_slli_epi16(c, 2), _mm_srli_epi16(c, 4));
+}
+
+/* interleave eight 8-bit color components, stored in 16-bit lanes, into eight
+   RGBA texels */
+static inline void RGBA_pack_sse2(__m128i r, __m128i g, __m128i b, __m128i a,
+                                  __m128i *lo, __m128i *hi) {
+  __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+  __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+  *lo = _mm_unpacklo_epi16(rg, ba);
+  *hi = _mm_unpackhi_epi16(rg, ba);
+}
+
+/* write out four twiddled 2x2 blocks as a 4x4 block of rows */
+static inline void RGBA_pack_block_sse2(RGBA_type *dst, int x, int y,
+                                        int stride, __m128i a, __m128i b,
+                                        __m128i c, __m128i d) {
+  /* reorder each 2x2 block from column-major to row-major */
+  a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+  b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+  c = _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 1, 2, 0));
+  d = _mm_shuffle_epi32(d, _MM_SHUFFLE(3, 1, 2, 0));
+
+  RGBA_type *row = &dst[y * stride + x];
+  _mm_storeu_si128((__m128i *)row, _mm_unpacklo_epi64(a, c));
+  row += stride;
+  _mm_storeu_si128((__m128i *)row, _mm_unpackhi_epi64(a, c));
+  row += stride;
+  _mm_storeu_si128((__m128i *)row, _mm_unpacklo_epi64(b, d));
+  row += stride;
+  _mm_storeu_si128((__m128i *)row, _mm_unpackhi_epi64(b, d));
+}
+
+/* ARGB1555 */
+static inline void ARGB1555_unpack_sse2(__m128i src, __m128i *lo,
+                                        __m128i *hi) {
+  __m128i mask = _mm_set1_epi16(0x1f);
+  __m128i r = COLOR_EXTEND_5_sse2(_mm_and_si128(_mm_srli_epi16(src, 10), mask));
+  __m128i g = COLOR_EXTEND_5_sse2(_mm_and_si128(_mm_srli_epi16(src, 5), mask));
+  __m128i b = COLOR_EXTEND_5_sse2(_mm_and_si128(src, mask));
+  __m128i a = _mm_srli_epi16(_mm_srai_epi16(src, 15), 8);
+  RGBA_pack_sse2(r, g, b, a, lo, hi);
+}
+
+#define ARGB1555_unpack_bitmap_sse2 ARGB1555_unpack_sse2
+#define ARGB1555_unpack_twiddled_sse2 ARGB1555_unpack_sse2
+
+/* RGB565 */
+static inline void RGB565_unpack_sse2(__m128i src, __m128i *lo, __m128i *hi) {
+  __m128i r = COLOR_EXTEND_5_sse2(_mm_srli_epi16(src, 11));
+  __m128i g = COLOR_EXTEND_6_sse2(
+      _mm_and_si128(_mm_srli_epi16(src, 5), _mm_set1_epi16(0x3f)));
+  __m128i b = COLOR_EXTEND_5_sse2(_mm_and_si128(src, _mm_set1_epi16(0x1f)));
+  __m128i a = _mm_set1_epi16(0xff);
+  RGBA_pack_sse2(r, g, b, a, lo, hi);
+}
+
+#define RGB565_unpack_bitmap_sse2 RGB565_unpack_sse2
+#define RGB565_unpack_twiddled_sse2 RGB565_unpack_sse2
+
+/* ARGB4444 */
+static inline void ARGB4444_unpack_sse2(__m128i src, __m128i *lo,
+                                        __m128i *hi) {
+  __m128i mask = _mm_set1_epi16(0xf);
+  __m128i r = COLOR_EXTEND_4_sse2(_mm_and_si128(_mm_srli_epi16(src, 8), mask));
+  __m128i g = COLOR_EXTEND_4_sse2(_mm_and_si128(_mm_srli_epi16(src, 4), mask));
+  __m128i b = COLOR_EXTEND_4_sse2(_mm_and_si128(src, mask));
+  __m128i a = COLOR_EXTEND_4_sse2(_mm_srli_epi16(src, 12));
+  RGBA_pack_sse2(r, g, b, a, lo, hi);
+}
+
+#define ARGB4444_unpack_bitmap_sse2 ARGB4444_unpack_sse2
+#define ARGB4444_unpack_twiddled_sse2 ARGB4444_unpack_sse2
+
+/* UYVY422 */
+
+/* signed division by a power of two, rounding towards zero to match the
+   reference conversion */
+static inline __m128i yuv_div_sse2(__m128i x, int shift) {
+  __m128i bias =
+      _mm_and_si128(_mm_srai_epi16(x, 15), _mm_set1_epi16((1 << shift) - 1));
+  return _mm_srai_epi16(_mm_add_epi16(x, bias), shift);
+}
+
+static inline __m128i yuv_clamp_sse2(__m128i x) {
+  return _mm_max_epi16(_mm_min_epi16(x, _mm_set1_epi16(0xff)),
+                       _mm_setzero_si128());
+}
+
+/* u and v contain the chroma shared by each texel, already splatted across
+   the lanes of the texels sharing it */
+static inline void UYVY422_unpack_sse2(__m128i src, __m128i u, __m128i v,
+                                       __m128i *lo, __m128i *hi) {
+  __m128i mask = _mm_set1_epi16(0xff);
+  __m128i bias = _mm_set1_epi16(128);
+  __m128i y = _mm_srli_epi16(src, 8);
+  u = _mm_sub_epi16(_mm_and_si128(u, mask), bias);
+  v = _mm_sub_epi16(_mm_and_si128(v, mask), bias);
+
+  __m128i rv = yuv_div_sse2(_mm_mullo_epi16(v, _mm_set1_epi16(11)), 3);
+  __m128i guv = yuv_div_sse2(
+      _mm_add_epi16(_mm_mullo_epi16(u, _mm_set1_epi16(11)),
+                    _mm_mullo_epi16(v, _mm_set1_epi16(22))),
+      5);
+  __m128i bu = yuv_div_sse2(_mm_mullo_epi16(u, _mm_set1_epi16(55)), 5);
+
+  __m128i r = yuv_clamp_sse2(_mm_add_epi16(y, rv));
+  __m128i g = yuv_clamp_sse2(_mm_sub_epi16(y, guv));
+  __m128i b = yuv_clamp_sse2(_mm_add_epi16(y, bu));
+  RGBA_pack_sse2(r, g, b, mask, lo, hi);
+}
+
+static inline void UYVY422_unpack_bitmap_sse2(__m128i src, __m128i *lo,
+                                              __m128i *hi) {
+  /* horizontally adjacent texels are consecutive */
+  __m128i u = _mm_shufflelo_epi16(src, _MM_SHUFFLE(2, 2, 0, 0));
+  u = _mm_shufflehi_epi16(u, _MM_SHUFFLE(2, 2, 0, 0));
+  __m128i v = _mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 1, 1));
+  v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 1, 1));
+  UYVY422_unpack_sse2(src, u, v, lo, hi);
+}
+
+static inline void UYVY422_unpack_twiddled_sse2(__m128i src, __m128i *lo,
+                                                __m128i *hi) {
+  /* horizontally adjacent texels are two apart */
+  __m128i u = _mm_shufflelo_epi16(src, _MM_SHUFFLE(1, 0, 1, 0));
+  u = _mm_shufflehi_epi16(u, _MM_SHUFFLE(1, 0, 1, 0));
+  __m128i v = _mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 2, 3, 2));
+  v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 2, 3, 2));
+  UYVY422_unpack_sse2(src, u, v, lo, hi);
+}
+
+
+#define define_convert_bitmap_sse2(FROM, TO)                                 \
+  static void convert_bitmap_##FROM##_##TO##_sse2(                           \
+      const FROM##_type *src, TO##_type *dst, int width, int height,         \
+      int stride) {                                                          \
+    if (width & 7) {                                                         \
+      convert_bitmap_##FROM##_##TO(src, dst, width, height, stride);         \
+      return;                                                                \
+    }                                                                        \
+                                                                             \
+    for (int y = 0; y < height; y++) {                                       \
+      for (int x = 0; x < width; x += 8) {                                   \
+        __m128i lo, hi;                                                      \
+        const __m128i *texels = (const __m128i *)&src[y * stride + x];       \
+        FROM##_unpack_bitmap_sse2(_mm_loadu_si128(texels), &lo, &hi);        \
+        _mm_storeu_si128((__m128i *)&dst[y * width + x + 0], lo);            \
+        _mm_storeu_si128((__m128i *)&dst[y * width + x + 4], hi);            \
+      }                                                                      \
+    }                                                                        \
+  }
+
+#define define_convert_twiddled_sse2(FROM, TO)                               \
+  static void convert_twiddled_##FROM##_##TO##_sse2(                         \
+      const FROM##_type *src, TO##_type *dst, int width, int height) {       \
+    int size = MIN(width, height);                                           \
+                                                                             \
+    if (size < 4) {                                                          \
+      convert_twiddled_##FROM##_##TO(src, dst, width, height);               \
+      return;                                                                \
+    }                                                                        \
+                                                                             \
+    pvr_init_twiddle_table();                                                \
+                                                                             \
+    int base = 0;                                                            \
+                                                                             \
+    for (int y = 0; y < height; y += size) {                                 \
+      for (int x = 0; x < width; x += size) {                                \
+        for (int y2 = 0; y2 < size; y2 += 4) {                               \
+          for (int x2 = 0; x2 < size; x2 += 4) {                             \
+            int pos = base + pvr_twiddle_pos(x2, y2);                        \
+            __m128i a, b, c, d;                                              \
+            const __m128i *texels = (const __m128i *)&src[pos];              \
+            FROM##_unpack_twiddled_sse2(_mm_loadu_si128(texels), &a, &b);    \
+            FROM##_unpack_twiddled_sse2(_mm_loadu_si128(texels + 1), &c,     \
+                                        &d);                                 \
+            TO##_pack_block_sse2(dst, x + x2, y + y2, width, a, b, c, d);    \
+          }                                                                  \
+        }                                                                    \
+        base += size * size;                                                 \
+      }                                                                      \
+    }                                                                        \
+  }
+
+/* converts texels which have already been unpacked to RGBA by a lookup table.
+   idx is the texel's index into the table, src the byte containing it */
+#define define_convert_lut_sse2(NAME, TEXEL)                                 \
+  static void convert_##NAME##_lut_sse2(const uint8_t *src, uint32_t *dst,   \
+                                        const uint32_t *lut, int width,      \
+                                        int height) {                        \
+    pvr_init_twiddle_table();                                                \
+                                                                             \
+    int size = MIN(width, height);                                           \
+    int base = 0;                                                            \
+                                                                             \
+    for (int y = 0; y < height; y += size) {                                 \
+      for (int x = 0; x < width; x += size) {                                \
+        for (int y2 = 0; y2 < size; y2 += 4) {                               \
+          for (int x2 = 0; x2 < size; x2 += 4) {                             \
+            int pos = base + pvr_twiddle_pos(x2, y2);                        \
+            __m128i block[4];                                                \
+            for (int i = 0; i < 4; i++) {                                    \
+              block[i] = TEXEL(src, pos + i * 4, lut);                       \
+            }                                                                \
+            RGBA_pack_block_sse2(dst, x + x2, y + y2, width, block[0],       \
+                                 block[1], block[2], block[3]);              \
+          }                                                                  \
+        }                                                                    \
+        base += size * size;                                                 \
+      }                                                                      \
+    }                                                                        \
+  }
+
+/* each 2x2 block is four 4-bit indices into the palette */
+static inline __m128i pal4_texels_sse2(const uint8_t *src, int pos,
+                                       const uint32_t *lut) {
+  const uint8_t *idx = &src[pos >> 1];
+  return _mm_setr_epi32(lut[idx[0] & 15], lut[idx[0] >> 4], lut[idx[1] & 15],
+                        lut[idx[1] >> 4]);
+}
+
+/* each 2x2 block is four 8-bit indices into the palette */
+static inline __m128i pal8_texels_sse2(const uint8_t *src, int pos,
+                                       const uint32_t *lut) {
+  const uint8_t *idx = &src[pos];
+  return _mm_setr_epi32(lut[idx[0]], lut[idx[1]], lut[idx[2]], lut[idx[3]]);
+}
+
+/* each 2x2 block is a single 8-bit index into the codebook */
+static inline __m128i vq_texels_sse2(const uint8_t *src, int pos,
+                                     const uint32_t *lut) {
+  return _mm_loadu_si128((const __m128i *)&lut[src[pos / 4] * 4]);
+}
+
+define_convert_lut_sse2(pal4, pal4_texels_sse2);
+define_convert_lut_sse2(pal8, pal8_texels_sse2);
+define_convert_lut_sse2(vq, vq_texels_sse2);
+
+#define define_convert_pal4_sse2(FROM, TO)                                   \
+  static void convert_pal4_##FROM##_##TO##_sse2(                             \
+      const uint8_t *src, TO##_type *dst, const uint32_t *palette,           \
+      int width, int height) {                                               \
+    if (MIN(width, height) < 4) {                                            \
+      convert_pal4_##FROM##_##TO(src, dst, palette, width, height);          \
+      return;                                                                \
+    }                                                                        \
+                                                                             \
+    uint32_t lut[16];                                                        \
+    for (int i = 0; i < 16; i++) {                                           \
+      FROM##_unpack((FROM##_type)palette[i], (uint8_t *)&lut[i]);            \
+    }                                                                        \
+    convert_pal4_lut_sse2(src, dst, lut, width, height);                     \
+  }
+
+#define define_convert_pal8_sse2(FROM, TO)                                   \
+  static void convert_pal8_##FROM##_##TO##_sse2(                             \
+      const uint8_t *src, TO##_type *dst, const uint32_t *palette,           \
+      int width, int height) {                                               \
+    if (MIN(width, height) < 4) {                                            \
+      convert_pal8_##FROM##_##TO(src, dst, palette, width, height);          \
+      return;                                                                \
+    }                                                                        \
+                                                                             \
+    uint32_t lut[256];                                                       \
+    for (int i = 0; i < 256; i++) {                                          \
+      FROM##_unpack((FROM##_type)palette[i], (uint8_t *)&lut[i]);            \
+    }                                                                        \
+    convert_pal8_lut_sse2(src, dst, lut, width, height);                     \
+  }
+
+#define define_convert_vq_sse2(FROM, TO)                                     \
+  static void convert_vq_##FROM##_##TO##_sse2(                               \
+      const uint8_t *src, const uint8_t *codebook, TO##_type *dst,           \
+      int width, int height) {                                               \
+    if (MIN(width, height) < 4) {                                            \
+      convert_vq_##FROM##_##TO(src, codebook, dst, width, height);           \
+      return;                                                                \
+    }                                                                        \
+                                                                             \
+    /* each codebook entry is a 2x2 twiddled block */                        \
+    uint32_t lut[256 * 4];                                                   \
+    for (int i = 0; i < 256; i++) {                                          \
+      const FROM##_type *code = (const FROM##_type *)&codebook[i * 8];      \
+      FROM##_unpack_twiddled(code, (uint8_t *)&lut[i * 4]);                  \
+    }                                                                        \
+    convert_vq_lut_sse2(src, dst, lut, width, height);                       \
+  }
+
+define_convert_bitmap_sse2(ARGB1555, RGBA);
+define_convert_bitmap_sse2(RGB565, RGBA);
+define_convert_bitmap_sse2(UYVY422, RGBA);
+define_convert_bitmap_sse2(ARGB4444, RGBA);
+
+define_convert_twiddled_sse2(ARGB1555, RGBA);
+define_convert_twiddled_sse2(RGB565, RGBA);
+define_convert_twiddled_sse2(UYVY422, RGBA);
+define_convert_twiddled_sse2(ARGB4444, RGBA);
+
+define_convert_pal4_sse2(ARGB1555, RGBA);
+define_convert_pal4_sse2(RGB565, RGBA);
+define_convert_pal4_sse2(ARGB4444, RGBA);
+define_convert_pal4_sse2(ARGB8888, RGBA);
+
+define_convert_pal8_sse2(ARGB1555, RGBA);
+define_convert_pal8_sse2(RGB565, RGBA);
+define_convert_pal8_sse2(ARGB4444, RGBA);
+define_convert_pal8_sse2(ARGB8888, RGBA);
+
+define_convert_vq_sse2(ARGB1555, RGBA);
+define_convert_vq_sse2(RGB565, RGBA);
+define_convert_vq_sse2(ARGB4444, RGBA);
+define_convert_vq_sse2(UYVY422, RGBA);
+
+/* 16-bit native conversions */
+static inline __m128i ARGB1555_to_RGBA5551_sse2(__m128i src) {
+  return _mm_or_si128(_mm_slli_epi16(src, 1), _mm_srli_epi16(src, 15));
+}
+
+static inline __m128i RGB565_to_RGB565_sse2(__m128i src) {
+  return src;
+}
+
+static inline __m128i ARGB4444_to_RGBA4444_sse2(__m128i src) {
+  return _mm_or_si128(_mm_slli_epi16(src, 4), _mm_srli_epi16(src, 12));
+}
+
+/* write out a 4x4 block of 16-bit texels, lo containing the first two twiddled
+   2x2 blocks and hi the second two */
+static inline void pack_block16_sse2(uint16_t *dst, int x, int y, int stride,
+                                     __m128i lo, __m128i hi) {
+  /* reorder each 2x2 block from column-major to row-major, pairing up the
+     texels in each row */
+  lo = _mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 1, 2, 0));
+  lo = _mm_shufflehi_epi16(lo, _MM_SHUFFLE(3, 1, 2, 0));
+  hi = _mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 1, 2, 0));
+  hi = _mm_shufflehi_epi16(hi, _MM_SHUFFLE(3, 1, 2, 0));
+
+  __m128i rows01 = _mm_unpacklo_epi32(lo, hi);
+  __m128i rows23 = _mm_unpackhi_epi32(lo, hi);
+
+  uint16_t *row = &dst[y * stride + x];
+  _mm_storel_epi64((__m128i *)row, rows01);
+  row += stride;
+  _mm_storel_epi64((__m128i *)row, _mm_unpackhi_epi64(rows01, rows01));
+  row += stride;
+  _mm_storel_epi64((__m128i *)row, rows23);
+  row += stride;
+  _mm_storel_epi64((__m128i *)row, _mm_unpackhi_epi64(rows23, rows23));
+}
+
+#define define_convert_bitmap16_sse2(FROM, TO)                               \
+  static void convert_bitmap_##FROM##_##TO##_sse2(                           \
+      const FROM##_type *src, TO##_type *dst, int width, int height,         \
+      int stride) {                                                          \
+    if (width & 7) {                                                         \
+      convert_bitmap_##FROM##_##TO(src, dst, width, height, stride);         \
+      return;                                                                \
+    }                                                                        \
+                                                                             \
+    for (int y = 0; y < height; y++) {                                       \
+      for (int x = 0; x < width; x += 8) {                                   \
+        const __m128i *texels = (const __m128i *)&src[y * stride + x];       \
+        __m128i out = FROM##_to_##TO##_sse2(_mm_loadu_si128(texels));        \
+        _mm_storeu_si128((__m128i *)&dst[y * width + x], out);               \
+      }                                                                      \
+    }                                                                        \
+  }
+
+#define define_convert_twiddled16_sse2(FROM, TO)                             \
+  static void convert_twiddled_##FROM##_##TO##_sse2(                         \
+      const FROM##_type *src, TO##_type *dst, int width, int height) {       \
+    int size = MIN(width, height);                                           \
+                                                                             \
+    if (size < 4) {                                                          \
+      convert_twiddled_##FROM##_##TO(src, dst, width, height);               \
+      return;                                                                \
+    }                                                                        \
+                                                                             \
+    pvr_init_twiddle_table();                                                \
+                                                                             \
+    int base = 0;                                                            \
+                                                                             \
+    for (int y = 0; y < height; y += size) {                                 \
+      for (int x = 0; x < width; x += size) {                                \
+        for (int y2 = 0; y2 < size; y2 += 4) {                               \
+          for (int x2 = 0; x2 < size; x2 += 4) {                             \
+            int pos = base + pvr_twiddle_pos(x2, y2);                        \
+            const __m128i *texels = (const __m128i *)&src[pos];              \
+            __m128i lo = FROM##_to_##TO##_sse2(_mm_loadu_si128(texels));     \
+            __m128i hi = FROM##_to_##TO##_sse2(_mm_loadu_si128(texels + 1)); \
+            pack_block16_sse2(dst, x + x2, y + y2, width, lo, hi);           \
+          }                                                                  \
+        }                                                                    \
+        base += size * size;                                                 \
+      }                                                                      \
+    }                                                                        \
+  }
+
+static void convert_vq16_lut_sse2(const uint8_t *src, uint16_t *dst,
+                                  const uint16_t *lut, int width,
+                                  int height) {
+  pvr_init_twiddle_table();
+
+  int size = MIN(width, height);
+  int base = 0;
+
+  for (int y = 0; y < height; y += size) {
+    for (int x = 0; x < width; x += size) {
+      for (int y2 = 0; y2 < size; y2 += 4) {
+        for (int x2 = 0; x2 < size; x2 += 4) {
+          int pos = base + pvr_twiddle_pos(x2, y2);
+          const uint8_t *idx = &src[pos / 4];
+          __m128i a = _mm_loadl_epi64((const __m128i *)&lut[idx[0] * 4]);
+          __m128i b = _mm_loadl_epi64((const __m128i *)&lut[idx[1] * 4]);
+          __m128i c = _mm_loadl_epi64((const __m128i *)&lut[idx[2] * 4]);
+          __m128i d = _mm_loadl_epi64((const __m128i *)&lut[idx[3] * 4]);
+          pack_block16_sse2(dst, x + x2, y + y2, width,
+                            _mm_unpacklo_epi64(a, b),
+                            _mm_unpacklo_epi64(c, d));
+        }
+      }
+      base += size * size;
+    }
+  }
+}
+
+#define define_convert_vq16_sse2(FROM, TO)                                   \
+  static void convert_vq_##FROM##_##TO##_sse2(                               \
+      const uint8_t *src, const uint8_t *codebook, TO##_type *dst,           \
+      int width, int height) {                                               \
+    if (MIN(width, height) < 4) {                                            \
+      convert_vq_##FROM##_##TO(src, codebook, dst, width, height);           \
+      return;                                                                \
+    }                                                                        \
+                                                                             \
+    /* swizzle each codebook entry, keeping them in twiddled order */        \
+    const FROM##_type *code = (const FROM##_type *)codebook;                 \
+    TO##_type lut[256 * 4];                                                  \
+    for (int i = 0; i < 256 * 4; i++) {                                      \
+      lut[i] = FROM##_to_##TO(code[i]);                                      \
+    }                                                                        \
+    convert_vq16_lut_sse2(src, dst, lut, width, height);                     \
+  }
+
+define_convert_bitmap16_sse2(ARGB1555, RGBA5551);
+define_convert_bitmap16_sse2(RGB565, RGB565);
+define_convert_bitmap16_sse2(ARGB4444, RGBA4444);
+
+define_convert_twiddled16_sse2(ARGB1555, RGBA5551);
+define_convert_twiddled16_sse2(RGB565, RGB565);
+define_convert_twiddled16_sse2(ARGB4444, RGBA4444);
+
+define_convert_vq16_sse2(ARGB1555, RGBA5551);
+define_convert_vq16_sse2(RGB565, RGB565);
+define_convert_vq16_sse2(ARGB4444, RGBA4444);
+#endif
+
 /*
  * texture loading
  */
@@ -574,9 +1168,48 @@ const uint8_t *pvr_tex_data(const uint8_t *src) {
   return data;
 }
 
+/* select between the simd and reference conversions */
+#if ARCH_X64
+#define CONVERT(name, ...) \
+  (simd ? convert_##name##_sse2(__VA_ARGS__) : convert_##name(__VA_ARGS__))
+#else
+#define CONVERT(name, ...) convert_##name(__VA_ARGS__)
+#endif
+
+/* convert a non-paletted texture to RGBA, or to a native 16-bit format */
+#define CONVERT_TEXELS(FROM, TO)                                        \
+  do {                                                                  \
+    TO##_type *out = (TO##_type *)dst;                                  \
+    if (compressed) {                                                   \
+      CONVERT(vq_##FROM##_##TO, index, codebook, out, width, height);   \
+    } else if (twiddled) {                                              \
+      CONVERT(twiddled_##FROM##_##TO, src16, out, width, height);       \
+    } else {                                                            \
+      CONVERT(bitmap_##FROM##_##TO, src16, out, width, height, stride); \
+    }                                                                   \
+  } while (0)
+
+enum pxl_format pvr_tex_decoded_fmt(int pixel_fmt, int flags) {
+  if (flags & PVR_DECODE_NATIVE) {
+    switch (pixel_fmt) {
+      case PVR_PXL_ARGB1555:
+      case PVR_PXL_RESERVED:
+        return PXL_RGBA5551;
+      case PVR_PXL_RGB565:
+        return PXL_RGB565;
+      case PVR_PXL_ARGB4444:
+        return PXL_RGBA4444;
+    }
+  }
+
+  return PXL_RGBA;
+}
+
 void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
                     int texture_fmt, int pixel_fmt, const uint8_t *palette,
-                    int palette_fmt, uint8_t *dst, int size) {
+                    int palette_fmt, uint8_t *dst, int size, int flags) {
+  int native = pvr_tex_decoded_fmt(pixel_fmt, flags) != PXL_RGBA;
+  int simd = !(flags & PVR_DECODE_REF);
   int twiddled = pvr_tex_twiddled(texture_fmt);
   int compressed = pvr_tex_compressed(texture_fmt);
   int mipmaps = pvr_tex_mipmaps(texture_fmt);
@@ -611,62 +1244,50 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
   switch (pixel_fmt) {
     case PVR_PXL_ARGB1555:
     case PVR_PXL_RESERVED:
-      if (compressed) {
-        convert_vq_ARGB1555_RGBA(index, codebook, dst32, width, height);
-      } else if (twiddled) {
-        convert_twiddled_ARGB1555_RGBA(src16, dst32, width, height);
+      if (native) {
+        CONVERT_TEXELS(ARGB1555, RGBA5551);
       } else {
-        convert_bitmap_ARGB1555_RGBA(src16, dst32, width, height, stride);
+        CONVERT_TEXELS(ARGB1555, RGBA);
       }
       break;
 
     case PVR_PXL_RGB565:
-      if (compressed) {
-        convert_vq_RGB565_RGBA(index, codebook, dst32, width, height);
-      } else if (twiddled) {
-        convert_twiddled_RGB565_RGBA(src16, dst32, width, height);
+      if (native) {
+        CONVERT_TEXELS(RGB565, RGB565);
       } else {
-        convert_bitmap_RGB565_RGBA(src16, dst32, width, height, stride);
+        CONVERT_TEXELS(RGB565, RGBA);
       }
       break;
 
     case PVR_PXL_ARGB4444:
-      if (compressed) {
-        convert_vq_ARGB4444_RGBA(index, codebook, dst32, width, height);
-      } else if (twiddled) {
-        convert_twiddled_ARGB4444_RGBA(src16, dst32, width, height);
+      if (native) {
+        CONVERT_TEXELS(ARGB4444, RGBA4444);
       } else {
-        convert_bitmap_ARGB4444_RGBA(src16, dst32, width, height, stride);
+        CONVERT_TEXELS(ARGB4444, RGBA);
       }
       break;
 
     case PVR_PXL_YUV422:
-      if (compressed) {
-        convert_vq_UYVY422_RGBA(index, codebook, dst32, width, height);
-      } else if (twiddled) {
-        convert_twiddled_UYVY422_RGBA(src16, dst32, width, height);
-      } else {
-        convert_bitmap_UYVY422_RGBA(src16, dst32, width, height, stride);
-      }
+      CONVERT_TEXELS(UYVY422, RGBA);
       break;
 
     case PVR_PXL_4BPP:
       CHECK(!compressed);
       switch (palette_fmt) {
         case PVR_PAL_ARGB1555:
-          convert_pal4_ARGB1555_RGBA(src, dst32, pal32, width, height);
+          CONVERT(pal4_ARGB1555_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_RGB565:
-          convert_pal4_RGB565_RGBA(src, dst32, pal32, width, height);
+          CONVERT(pal4_RGB565_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB4444:
-          convert_pal4_ARGB4444_RGBA(src, dst32, pal32, width, height);
+          CONVERT(pal4_ARGB4444_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB8888:
-          convert_pal4_ARGB8888_RGBA(src, dst32, pal32, width, height);
+          CONVERT(pal4_ARGB8888_RGBA, src, dst32, pal32, width, height);
           break;
 
         default:
@@ -680,19 +1301,19 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
       CHECK(!compressed);
       switch (palette_fmt) {
         case PVR_PAL_ARGB1555:
-          convert_pal8_ARGB1555_RGBA(src, dst32, pal32, width, height);
+          CONVERT(pal8_ARGB1555_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_RGB565:
-          convert_pal8_RGB565_RGBA(src, dst32, pal32, width, height);
+          CONVERT(pal8_RGB565_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB4444:
-          convert_pal8_ARGB4444_RGBA(src, dst32, pal32, width, height);
+          CONVERT(pal8_ARGB4444_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB8888:
-          convert_pal8_ARGB8888_RGBA(src, dst32, pal32, width, height);
+          CONVERT(pal8_ARGB8888_RGBA, src, dst32, pal32, width, height);
           break;
 
         default:
@@ -2,6 +2,7 @@
 #define TEX_H
 
 #include <stdint.h>
+#include "render/render_backend.h"
 
 #define PVR_CODEBOOK_SIZE (256 * 8)
 
@@ -71,11 +72,29 @@ static inline int pvr_tex_mipmaps(int texture_fmt) {
          texture_fmt == PVR_TEX_PALETTE_8BPP_MIPMAPS;
 }
 
+/* the twiddle table used by the decoders is built lazily by the first decode,
+   which isn't thread-safe. call this before decoding from multiple threads */
+void pvr_init_twiddle_table();
+
 const struct pvr_tex_header *pvr_tex_header(const uint8_t *src);
 const uint8_t *pvr_tex_data(const uint8_t *src);
 
+/* decode flags */
+enum {
+  /* output ARGB1555, RGB565 and ARGB4444 textures in the equivalent 16-bit
+     format supported by the render backend, instead of expanding them to
+     RGBA. see pvr_tex_decoded_fmt */
+  PVR_DECODE_NATIVE = 0x1,
+  /* use only the portable reference conversions, used to validate the simd
+     conversions which are otherwise used when supported by the host */
+  PVR_DECODE_REF = 0x2,
+};
+
+/* pixel format of the data output by pvr_tex_decode */
+enum pxl_format pvr_tex_decoded_fmt(int pixel_fmt, int flags);
+
 void pvr_tex_decode(const uint8_t *data, int width, int height, int stride,
                     int texture_fmt, int pixel_fmt, const uint8_t *palette,
-                    int pal_pixel_fmt, uint8_t *out, int size);
+                    int pal_pixel_fmt, uint8_t *out, int size, int flags);
 
 #endif
@@ -7,9 +7,16 @@
 
 #include "guest/pvr/tr.h"
 #include "core/core.h"
+#include "core/hash.h"
+#include "core/profiler.h"
 #include "core/sort.h"
+#include "core/thread_pool.h"
+#include "core/time.h"
+#include "core/xxhash.h"
 #include "guest/pvr/ta.h"
 #include "guest/pvr/tex.h"
+#include "options.h"
+#include "stats.h"
 
 struct tr {
   struct render_backend *r;
@@ -26,6 +33,15 @@ struct tr {
   /* sprite params */
   uint8_t sprite_color[4];
   uint8_t sprite_offset_color[4];
+
+  /* textures decoded for the context */
+  int num_decoded;
+  int64_t decoded_bytes;
+
+  /* dirty textures whose source hash did or didn't match an existing handle */
+  int num_reused;
+  int num_missed;
+  int64_t reused_bytes;
 };
 
 static int compressed_mipmap_offsets[] = {
@@ -109,6 +125,445 @@ static inline enum shade_mode translate_shade_mode(uint32_t shade_mode) {
   return shade_modes[shade_mode];
 }
 
+struct tr_decode_job {
+  struct tr_texture *entry;
+  int texture_fmt;
+  int pixel_fmt;
+  int mipmaps;
+  int width;
+  int height;
+  int stride;
+  int palette_fmt;
+  enum filter_mode filter;
+  enum wrap_mode wrap_u;
+  enum wrap_mode wrap_v;
+
+  /* hash of the source data and the parameters above, 0 if not hashed */
+  uint64_t hash;
+
+  /* decoded output, 16-bit textures are kept in a native 16-bit format */
+  enum pxl_format decoded_fmt;
+  uint8_t *converted;
+  int size;
+};
+
+/* dirty textures used by the context being converted are decoded up front in
+   parallel, each into their own region of a shared output buffer, and are
+   then uploaded to the render backend in the order they were first used */
+static struct {
+  struct thread_pool *pool;
+
+  struct tr_decode_job *jobs;
+  int num_jobs;
+  int max_jobs;
+
+  uint8_t *buffer;
+  int buffer_size;
+} tr_decoder;
+
+/* before a dirty texture is decoded, its source data is hashed. if the data
+   is unchanged since the texture was last uploaded, e.g. when a game streams
+   the same texture back in after loading a level, or writes to another part
+   of a page being watched, the existing handle is reused without decoding or
+   uploading anything
+
+   further, handles replaced by a new upload aren't destroyed right away. a
+   number of the most recently replaced are retained, keyed by the same hash,
+   in case the data they were created from is seen again by any texture */
+#define TR_RETAINED_BITS 8
+
+struct tr_retained {
+  uint64_t hash;
+  texture_handle_t handle;
+  struct list_node it;
+  struct list_node lru_it;
+};
+
+static struct {
+  /* retained handles are only valid for the backend that created them */
+  struct render_backend *r;
+
+  struct tr_retained *entries;
+  int num_entries;
+  struct list free_entries;
+  struct list lru_entries;
+  DECLARE_HASHTABLE(retained, TR_RETAINED_BITS);
+
+  /* totals since the cache was last released */
+  int64_t hits;
+  int64_t misses;
+  int64_t saved_bytes;
+} tr_cache;
+
+static inline int tr_texture_valid(const struct tr_texture *entry) {
+  return entry->handle && !entry->dirty;
+}
+
+static struct tr_retained *tr_cache_find(uint64_t hash) {
+  struct list *bkt = hash_bkt(tr_cache.retained, hash);
+
+  hash_bkt_for_each_entry(ret, bkt, struct tr_retained, it) {
+    if (ret->hash == hash) {
+      return ret;
+    }
+  }
+
+  return NULL;
+}
+
+static void tr_cache_remove(struct tr_retained *ret) {
+  hash_del(hash_bkt(tr_cache.retained, ret->hash), &ret->it);
+  list_remove(&tr_cache.lru_entries, &ret->lru_it);
+  list_add(&tr_cache.free_entries, &ret->lru_it);
+}
+
+static void tr_cache_reset(struct render_backend *r) {
+  tr_cache.r = r;
+
+  if (!tr_cache.entries && OPTION_tex_hash_retained > 0) {
+    tr_cache.num_entries = OPTION_tex_hash_retained;
+    tr_cache.entries =
+        calloc(tr_cache.num_entries, sizeof(struct tr_retained));
+  }
+
+  list_clear(&tr_cache.free_entries);
+  list_clear(&tr_cache.lru_entries);
+
+  for (int i = 0; i < HASH_SIZE(tr_cache.retained); i++) {
+    list_clear(&tr_cache.retained[i]);
+  }
+
+  for (int i = 0; i < tr_cache.num_entries; i++) {
+    list_add(&tr_cache.free_entries, &tr_cache.entries[i].lru_it);
+  }
+}
+
+void tr_release_textures(struct render_backend *r) {
+  if (tr_cache.r != r) {
+    return;
+  }
+
+  list_for_each_entry_safe(ret, &tr_cache.lru_entries, struct tr_retained,
+                           lru_it) {
+    r_destroy_texture(r, ret->handle);
+    tr_cache_remove(ret);
+  }
+
+  if (tr_cache.hits || tr_cache.misses) {
+    int64_t total = tr_cache.hits + tr_cache.misses;
+    LOG_INFO("tr_release_textures %" PRId64 " / %" PRId64
+             " hashed textures reused (%.2f%%), %.2f mb not decoded",
+             tr_cache.hits, total, (tr_cache.hits * 100.0) / total,
+             tr_cache.saved_bytes / (1024.0 * 1024.0));
+  }
+
+  tr_cache.r = NULL;
+  tr_cache.hits = 0;
+  tr_cache.misses = 0;
+  tr_cache.saved_bytes = 0;
+}
+
+/* release the handle an entry was using, retaining it if possible */
+static void tr_retire_texture(struct tr *tr, struct tr_texture *entry) {
+  if (!entry->handle) {
+    return;
+  }
+
+  if (entry->hash && tr_cache.num_entries && !tr_cache_find(entry->hash)) {
+    /* evict the least recently retained handle to make room */
+    if (!list_first_entry(&tr_cache.free_entries, struct tr_retained,
+                          lru_it)) {
+      struct tr_retained *oldest = list_first_entry(
+          &tr_cache.lru_entries, struct tr_retained, lru_it);
+      r_destroy_texture(tr->r, oldest->handle);
+      tr_cache_remove(oldest);
+    }
+
+    struct tr_retained *ret =
+        list_first_entry(&tr_cache.free_entries, struct tr_retained, lru_it);
+    list_remove(&tr_cache.free_entries, &ret->lru_it);
+
+    ret->hash = entry->hash;
+    ret->handle = entry->handle;
+    hash_add(hash_bkt(tr_cache.retained, ret->hash), &ret->it);
+    list_add(&tr_cache.lru_entries, &ret->lru_it);
+  } else {
+    r_destroy_texture(tr->r, entry->handle);
+  }
+
+  entry->handle = 0;
+}
+
+static void tr_init_decode_job(struct tr_decode_job *job,
+                               const struct ta_context *ctx,
+                               struct tr_texture *entry, union tsp tsp,
+                               union tcw tcw) {
+  job->entry = entry;
+  job->texture_fmt = ta_texture_format(tcw);
+  job->pixel_fmt = tcw.pixel_fmt;
+  job->mipmaps = ta_texture_mipmaps(tcw);
+  job->width = ta_texture_width(tsp, tcw);
+  job->height = ta_texture_height(tsp, tcw);
+  job->stride = ta_texture_stride(tsp, tcw, ctx->stride);
+  job->palette_fmt = ctx->palette_fmt;
+
+  /* ignore trilinear filtering for now */
+  job->filter = tsp.filter_mode == 0 ? FILTER_NEAREST : FILTER_BILINEAR;
+  job->wrap_u = tsp.clamp_u ? WRAP_CLAMP_TO_EDGE
+                            : (tsp.flip_u ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
+  job->wrap_v = tsp.clamp_v ? WRAP_CLAMP_TO_EDGE
+                            : (tsp.flip_v ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
+
+  job->hash = 0;
+  job->decoded_fmt = pvr_tex_decoded_fmt(job->pixel_fmt, PVR_DECODE_NATIVE);
+  job->converted = NULL;
+  job->size = job->width * job->height * (job->decoded_fmt == PXL_RGBA ? 4 : 2);
+}
+
+static void tr_hash_job(struct tr_decode_job *job) {
+  struct tr_texture *entry = job->entry;
+
+  /* the source's size is needed to hash it */
+  if (!entry->texture_size) {
+    return;
+  }
+
+  /* seed the hash with everything else affecting the backend's texture */
+  int params[] = {job->texture_fmt, job->pixel_fmt, job->mipmaps,
+                  job->width,       job->height,    job->stride,
+                  job->palette_fmt, job->filter,    job->wrap_u,
+                  job->wrap_v};
+
+  PROF_ENTER("gpu", "tr_hash_job");
+  uint64_t hash = xxh64(params, sizeof(params), 0);
+  hash = xxh64(entry->texture, entry->texture_size, hash);
+  if (entry->palette) {
+    hash = xxh64(entry->palette, entry->palette_size, hash);
+  }
+  PROF_LEAVE();
+
+  /* 0 is reserved for textures which haven't been hashed */
+  job->hash = hash ? hash : 1;
+}
+
+static void tr_run_decode_job(struct tr_decode_job *job) {
+  struct tr_texture *entry = job->entry;
+
+  PROF_ENTER("gpu", "pvr_tex_decode");
+  pvr_tex_decode(entry->texture, job->width, job->height, job->stride,
+                 job->texture_fmt, job->pixel_fmt, entry->palette,
+                 job->palette_fmt, job->converted, job->size,
+                 PVR_DECODE_NATIVE);
+  PROF_LEAVE();
+}
+
+static void tr_hash_thread(void *data, int index) {
+  tr_hash_job(&tr_decoder.jobs[index]);
+}
+
+static void tr_decode_thread(void *data, int index) {
+  tr_run_decode_job(&tr_decoder.jobs[index]);
+}
+
+static void tr_run_jobs(void (*fn)(void *, int), int num_jobs) {
+  if (num_jobs > 1) {
+    if (!tr_decoder.pool) {
+      tr_decoder.pool = thread_pool_create("tex", OPTION_tex_threads);
+    }
+
+    /* build the twiddle table before any of the pool's threads use it */
+    pvr_init_twiddle_table();
+
+    thread_pool_run(tr_decoder.pool, fn, NULL, num_jobs);
+  } else if (num_jobs) {
+    fn(NULL, 0);
+  }
+}
+
+static void tr_assign_texture(struct tr_texture *entry,
+                              const struct tr_decode_job *job,
+                              texture_handle_t handle) {
+  entry->handle = handle;
+  entry->hash = job->hash;
+  entry->filter = job->filter;
+  entry->wrap_u = job->wrap_u;
+  entry->wrap_v = job->wrap_v;
+  entry->format = job->texture_fmt;
+  entry->width = job->width;
+  entry->height = job->height;
+  entry->dirty = 0;
+}
+
+/* try to satisfy a hashed job with an existing handle instead of decoding */
+static int tr_reuse_texture(struct tr *tr, const struct tr_decode_job *job) {
+  struct tr_texture *entry = job->entry;
+
+  if (!job->hash) {
+    return 0;
+  }
+
+  if (tr_cache.r != tr->r) {
+    tr_cache_reset(tr->r);
+  }
+
+  texture_handle_t handle = 0;
+
+  if (entry->handle && entry->hash == job->hash) {
+    /* the source data hasn't changed since it was uploaded */
+    handle = entry->handle;
+  } else {
+    /* the source data matches a handle replaced earlier */
+    struct tr_retained *ret = tr_cache_find(job->hash);
+
+    if (ret) {
+      handle = ret->handle;
+      tr_cache_remove(ret);
+      tr_retire_texture(tr, entry);
+    }
+  }
+
+  if (!handle) {
+    tr->num_missed++;
+    tr_cache.misses++;
+    return 0;
+  }
+
+  tr_assign_texture(entry, job, handle);
+
+  tr->num_reused++;
+  tr->reused_bytes += job->size;
+  tr_cache.hits++;
+  tr_cache.saved_bytes += job->size;
+
+  return 1;
+}
+
+static texture_handle_t tr_upload_texture(struct tr *tr,
+                                          struct tr_decode_job *job) {
+  struct tr_texture *entry = job->entry;
+
+  /* if there's a dirty handle, release it before creating the new one */
+  tr_retire_texture(tr, entry);
+
+  texture_handle_t handle = r_create_texture(
+      tr->r, job->decoded_fmt, job->filter, job->wrap_u, job->wrap_v,
+      job->mipmaps, job->width, job->height, job->converted);
+  tr_assign_texture(entry, job, handle);
+
+  tr->num_decoded++;
+  tr->decoded_bytes += job->size;
+
+  return handle;
+}
+
+static void tr_queue_texture(struct tr *tr, const struct ta_context *ctx,
+                             union tsp tsp, union tcw tcw) {
+  struct tr_texture *entry = tr->find_texture(tr->userdata, tsp, tcw);
+  CHECK_NOTNULL(entry);
+
+  if (tr_texture_valid(entry)) {
+    return;
+  }
+
+  for (int i = 0; i < tr_decoder.num_jobs; i++) {
+    if (tr_decoder.jobs[i].entry == entry) {
+      return;
+    }
+  }
+
+  if (tr_decoder.num_jobs == tr_decoder.max_jobs) {
+    tr_decoder.max_jobs = MAX(tr_decoder.max_jobs * 2, 64);
+    int size = tr_decoder.max_jobs * sizeof(struct tr_decode_job);
+    tr_decoder.jobs = realloc(tr_decoder.jobs, size);
+  }
+
+  struct tr_decode_job *job = &tr_decoder.jobs[tr_decoder.num_jobs++];
+  tr_init_decode_job(job, ctx, entry, tsp, tcw);
+}
+
+static void tr_queue_textures(struct tr *tr, const struct ta_context *ctx) {
+  const uint8_t *data = ctx->params;
+  const uint8_t *end = ctx->params + ctx->size;
+  int vert_type = TA_NUM_VERTS;
+
+  if (ctx->bg_isp.texture) {
+    tr_queue_texture(tr, ctx, ctx->bg_tsp, ctx->bg_tcw);
+  }
+
+  /* walk the param stream the same as tr_convert_context, only looking at
+     the textures used by each poly param */
+  while (data < end) {
+    union pcw pcw = *(union pcw *)data;
+
+    switch (pcw.para_type) {
+      case TA_PARAM_END_OF_LIST:
+        vert_type = TA_NUM_VERTS;
+        break;
+
+      case TA_PARAM_POLY_OR_VOL:
+      case TA_PARAM_SPRITE: {
+        const union poly_param *param = (const union poly_param *)data;
+        vert_type = ta_vert_type(param->type0.pcw);
+
+        if (ta_poly_type(param->type0.pcw) != 6 && param->type0.pcw.texture) {
+          tr_queue_texture(tr, ctx, param->type0.tsp, param->type0.tcw);
+        }
+      } break;
+    }
+
+    data += ta_param_size(pcw, vert_type);
+  }
+}
+
+static void tr_decode_textures(struct tr *tr, const struct ta_context *ctx) {
+  tr_decoder.num_jobs = 0;
+
+  tr_queue_textures(tr, ctx);
+
+  /* hash each texture and drop those which can reuse an existing handle */
+  if (OPTION_tex_hash) {
+    tr_run_jobs(&tr_hash_thread, tr_decoder.num_jobs);
+
+    int num_jobs = 0;
+    for (int i = 0; i < tr_decoder.num_jobs; i++) {
+      if (!tr_reuse_texture(tr, &tr_decoder.jobs[i])) {
+        tr_decoder.jobs[num_jobs++] = tr_decoder.jobs[i];
+      }
+    }
+    tr_decoder.num_jobs = num_jobs;
+  }
+
+  int num_jobs = tr_decoder.num_jobs;
+
+  if (!num_jobs) {
+    return;
+  }
+
+  /* carve out each job's output from the shared buffer */
+  int size = 0;
+  for (int i = 0; i < num_jobs; i++) {
+    size += tr_decoder.jobs[i].size;
+  }
+
+  if (size > tr_decoder.buffer_size) {
+    tr_decoder.buffer_size = size;
+    tr_decoder.buffer = realloc(tr_decoder.buffer, size);
+  }
+
+  uint8_t *converted = tr_decoder.buffer;
+  for (int i = 0; i < num_jobs; i++) {
+    tr_decoder.jobs[i].converted = converted;
+    converted += tr_decoder.jobs[i].size;
+  }
+
+  tr_run_jobs(&tr_decode_thread, num_jobs);
+
+  /* upload in order, the render backend isn't thread-safe */
+  for (int i = 0; i < num_jobs; i++) {
+    tr_upload_texture(tr, &tr_decoder.jobs[i]);
+  }
+}
+
 static texture_handle_t tr_convert_texture(struct tr *tr,
                                            const struct ta_context *ctx,
                                            union tsp tsp, union tcw tcw) {
@@ -119,53 +574,29 @@ static texture_handle_t tr_convert_texture(struct tr *tr,
   struct tr_texture *entry = tr->find_texture(tr->userdata, tsp, tcw);
   CHECK_NOTNULL(entry);
 
-  /* if there's a non-dirty handle, return it */
-  if (entry->handle && !entry->dirty) {
+  /* textures are normally decoded up front by tr_decode_textures */
+  if (tr_texture_valid(entry)) {
     return entry->handle;
   }
 
-  /* if there's a dirty handle, destroy it before creating the new one */
-  if (entry->handle && entry->dirty) {
-    r_destroy_texture(tr->r, entry->handle);
-    entry->handle = 0;
-  }
-
   static uint8_t converted[1024 * 1024 * 4];
-  const uint8_t *palette = entry->palette;
-  const uint8_t *texture = entry->texture;
 
-  /* get texture dimensions */
-  int texture_fmt = ta_texture_format(tcw);
-  int mipmaps = ta_texture_mipmaps(tcw);
-  int width = ta_texture_width(tsp, tcw);
-  int height = ta_texture_height(tsp, tcw);
-  int stride = ta_texture_stride(tsp, tcw, ctx->stride);
+  struct tr_decode_job job;
+  tr_init_decode_job(&job, ctx, entry, tsp, tcw);
+  job.converted = converted;
+  job.size = MIN(job.size, (int)sizeof(converted));
 
-  /* figure out the texture format */
-  pvr_tex_decode(texture, width, height, stride, texture_fmt, tcw.pixel_fmt,
-                 palette, ctx->palette_fmt, converted, sizeof(converted));
+  if (OPTION_tex_hash) {
+    tr_hash_job(&job);
 
-  /* ignore trilinear filtering for now */
-  enum filter_mode filter =
-      tsp.filter_mode == 0 ? FILTER_NEAREST : FILTER_BILINEAR;
-  enum wrap_mode wrap_u =
-      tsp.clamp_u ? WRAP_CLAMP_TO_EDGE
-                  : (tsp.flip_u ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
-  enum wrap_mode wrap_v =
-      tsp.clamp_v ? WRAP_CLAMP_TO_EDGE
-                  : (tsp.flip_v ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
-
-  entry->handle = r_create_texture(tr->r, PXL_RGBA, filter, wrap_u, wrap_v,
-                                   mipmaps, width, height, converted);
-  entry->filter = filter;
-  entry->wrap_u = wrap_u;
-  entry->wrap_v = wrap_v;
-  entry->format = texture_fmt;
-  entry->width = width;
-  entry->height = height;
-  entry->dirty = 0;
+    if (tr_reuse_texture(tr, &job)) {
+      return entry->handle;
+    }
+  }
+
+  tr_run_decode_job(&job);
 
-  return entry->handle;
+  return tr_upload_texture(tr, &job);
 }
 
 static struct ta_surface *tr_reserve_surf(struct tr *tr, struct tr_context *rc,
@@ -877,6 +1308,8 @@ void tr_render_context(struct render_backend *r, const struct tr_context *rc) {
 void tr_convert_context(struct render_backend *r, void *userdata,
                         tr_find_texture_cb find_texture,
                         const struct ta_context *ctx, struct tr_context *rc) {
+  PROF_ENTER("gpu", "tr_convert_context");
+
   struct tr tr;
   tr.r = r;
   tr.userdata = userdata;
@@ -887,6 +1320,17 @@ void tr_convert_context(struct render_backend *r, void *userdata,
 
   ta_init_tables();
 
+  int64_t texture_start = time_nanoseconds();
+
+  tr.num_decoded = 0;
+  tr.decoded_bytes = 0;
+  tr.num_reused = 0;
+  tr.num_missed = 0;
+  tr.reused_bytes = 0;
+  tr_decode_textures(&tr, ctx);
+
+  int64_t parse_start = time_nanoseconds();
+
   tr_reset(&tr, rc);
 
   rc->width = ctx->video_width;
@@ -937,13 +1381,33 @@ void tr_convert_context(struct render_backend *r, void *userdata,
     data += ta_param_size(pcw, tr.vert_type);
   }
 
+  int64_t sort_start = time_nanoseconds();
+
   /* sort surfaces if requested */
   if (ctx->autosort) {
     tr_sort_surfaces(&tr, rc, TA_LIST_TRANSLUCENT);
     tr_sort_surfaces(&tr, rc, TA_LIST_PUNCH_THROUGH);
   }
 
+  int64_t index_start = time_nanoseconds();
+
   for (int i = 0; i < TA_NUM_LISTS; i++) {
     tr_generate_indices(&tr, rc, i);
   }
+
+  int64_t index_end = time_nanoseconds();
+
+  rc->texture_ns = parse_start - texture_start;
+  rc->parse_ns = sort_start - parse_start;
+  rc->sort_ns = index_start - sort_start;
+  rc->index_ns = index_end - index_start;
+
+  prof_counter_set(COUNTER_tex_decodes, tr.num_decoded);
+  prof_counter_set(COUNTER_tex_decode_bytes, tr.decoded_bytes);
+  prof_counter_set(COUNTER_tex_decode_ns, rc->texture_ns);
+  prof_counter_set(COUNTER_tex_hash_hits, tr.num_reused);
+  prof_counter_set(COUNTER_tex_hash_misses, tr.num_missed);
+  prof_counter_set(COUNTER_tex_hash_saved_bytes, tr.reused_bytes);
+
+  PROF_LEAVE();
 }
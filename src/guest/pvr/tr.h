@@ -30,6 +30,8 @@ struct tr_texture {
   int width;
   int height;
   texture_handle_t handle;
+  /* hash of the source data the handle was created from, 0 if not hashed */
+  uint64_t hash;
 };
 
 struct tr_param {
@@ -74,6 +76,12 @@ struct tr_context {
   /* debug structures for stepping through the param stream in the tracer */
   struct tr_param params[TA_MAX_PARAMS];
   int num_params;
+
+  /* host time spent in each stage of the conversion */
+  int64_t texture_ns;
+  int64_t parse_ns;
+  int64_t sort_ns;
+  int64_t index_ns;
 };
 
 static inline tr_texture_key_t tr_texture_key(union tsp tsp, union tcw tcw) {
@@ -89,4 +97,8 @@ void tr_render_context(struct render_backend *r, const struct tr_context *rc);
 void tr_render_context_until(struct render_backend *r,
                              const struct tr_context *rc, int end_surf);
 
+/* destroys any replaced texture handles retained for reuse, must be called
+   before the render backend they were created with is destroyed */
+void tr_release_textures(struct render_backend *r);
+
 #endif
@@ -3,80 +3,244 @@
 #include "core/core.h"
 #include "core/list.h"
 #include "guest/dreamcast.h"
+#include "options.h"
+#include "stats.h"
 
-#define MAX_TIMERS 128
+/* timers are allocated in chunks which are never freed until the scheduler is
+   destroyed, keeping the pointers handed out to devices stable */
+#define TIMERS_PER_CHUNK 128
 
 struct timer {
   int active;
   int64_t expire;
+  /* order the timer was started in, breaking ties between timers expiring at
+     the same time so they fire in the order they were started */
+  uint64_t seq;
   timer_cb cb;
   void *data;
+
+  /* index into the heap, or -1 if the timer isn't queued */
+  int index;
+  struct list_node it;
+};
+
+struct timer_chunk {
+  struct timer timers[TIMERS_PER_CHUNK];
   struct list_node it;
 };
 
 struct scheduler {
   struct dreamcast *dc;
-  struct timer timers[MAX_TIMERS];
+  struct list chunks;
   struct list free_timers;
-  struct list live_timers;
   int64_t base_time;
+
+  /* max length of the next slice under the adaptive slice policy */
+  int64_t slice;
+  int interacted;
+
+  /* binary min-heap of live timers, ordered by expiration time and then by
+     the order they were started in */
+  struct timer **heap;
+  int num_heap;
+  int max_heap;
+  uint64_t next_seq;
 };
 
-void sched_cancel_timer(struct scheduler *sched, struct timer *timer) {
-  if (!timer->active) {
+static int sched_timer_before(const struct timer *a, const struct timer *b) {
+  return a->expire < b->expire || (a->expire == b->expire && a->seq < b->seq);
+}
+
+static void sched_heap_set(struct scheduler *sched, int i,
+                           struct timer *timer) {
+  sched->heap[i] = timer;
+  timer->index = i;
+}
+
+static void sched_heap_up(struct scheduler *sched, int i) {
+  struct timer *timer = sched->heap[i];
+
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+
+    if (!sched_timer_before(timer, sched->heap[parent])) {
+      break;
+    }
+
+    sched_heap_set(sched, i, sched->heap[parent]);
+    i = parent;
+  }
+
+  sched_heap_set(sched, i, timer);
+}
+
+static void sched_heap_down(struct scheduler *sched, int i) {
+  struct timer *timer = sched->heap[i];
+
+  while (1) {
+    int child = i * 2 + 1;
+
+    if (child >= sched->num_heap) {
+      break;
+    }
+
+    if (child + 1 < sched->num_heap &&
+        sched_timer_before(sched->heap[child + 1], sched->heap[child])) {
+      child++;
+    }
+
+    if (!sched_timer_before(sched->heap[child], timer)) {
+      break;
+    }
+
+    sched_heap_set(sched, i, sched->heap[child]);
+    i = child;
+  }
+
+  sched_heap_set(sched, i, timer);
+}
+
+static void sched_heap_push(struct scheduler *sched, struct timer *timer) {
+  if (sched->num_heap == sched->max_heap) {
+    sched->max_heap = MAX(sched->max_heap * 2, TIMERS_PER_CHUNK);
+    sched->heap =
+        realloc(sched->heap, sched->max_heap * sizeof(struct timer *));
+  }
+
+  int i = sched->num_heap++;
+  sched_heap_set(sched, i, timer);
+  sched_heap_up(sched, i);
+}
+
+static void sched_heap_remove(struct scheduler *sched, struct timer *timer) {
+  int i = timer->index;
+  struct timer *last = sched->heap[--sched->num_heap];
+
+  timer->index = -1;
+
+  if (last == timer) {
     return;
   }
 
+  /* move the last entry into the hole, and restore the heap property in
+     whichever direction it's violated */
+  sched_heap_set(sched, i, last);
+
+  if (i > 0 && sched_timer_before(last, sched->heap[(i - 1) / 2])) {
+    sched_heap_up(sched, i);
+  } else {
+    sched_heap_down(sched, i);
+  }
+}
+
+static struct timer *sched_alloc_timer(struct scheduler *sched) {
+  struct timer *timer = list_first_entry(&sched->free_timers, struct timer, it);
+
+  if (!timer) {
+    struct timer_chunk *chunk = calloc(1, sizeof(struct timer_chunk));
+    list_add(&sched->chunks, &chunk->it);
+
+    for (int i = 0; i < TIMERS_PER_CHUNK; i++) {
+      chunk->timers[i].index = -1;
+      list_add(&sched->free_timers, &chunk->timers[i].it);
+    }
+
+    timer = list_first_entry(&sched->free_timers, struct timer, it);
+  }
+
+  list_remove(&sched->free_timers, &timer->it);
+
+  return timer;
+}
+
+static void sched_free_timer(struct scheduler *sched, struct timer *timer) {
   timer->active = 0;
-  list_remove(&sched->live_timers, &timer->it);
   list_add(&sched->free_timers, &timer->it);
 }
 
+void sched_cancel_timer(struct scheduler *sched, struct timer *timer) {
+  if (!timer->active) {
+    return;
+  }
+
+  if (timer->index >= 0) {
+    sched_heap_remove(sched, timer);
+  }
+
+  sched_free_timer(sched, timer);
+}
+
 int64_t sched_remaining_time(struct scheduler *sched, struct timer *timer) {
   return timer->expire - sched->base_time;
 }
 
 struct timer *sched_start_timer(struct scheduler *sched, timer_cb cb,
                                 void *data, int64_t ns) {
-  struct timer *timer = list_first_entry(&sched->free_timers, struct timer, it);
-  CHECK_NOTNULL(timer);
+  struct timer *timer = sched_alloc_timer(sched);
   timer->active = 1;
   timer->expire = sched->base_time + ns;
+  timer->seq = sched->next_seq++;
   timer->cb = cb;
   timer->data = data;
 
-  /* remove from free list */
-  list_remove(&sched->free_timers, &timer->it);
+  sched_heap_push(sched, timer);
 
-  /* add to sorted live list */
-  struct list_node *after = NULL;
+  return timer;
+}
 
-  list_for_each(&sched->live_timers, it) {
-    struct timer *entry = list_entry(it, struct timer, it);
+static void sched_expire_timers(struct scheduler *sched) {
+  while (sched->num_heap) {
+    struct timer *timer = sched->heap[0];
 
-    if (entry->expire > timer->expire) {
+    if (timer->expire > sched->base_time) {
       break;
     }
 
-    after = it;
+    sched_heap_remove(sched, timer);
+    sched_free_timer(sched, timer);
+    timer->cb(timer->data);
   }
+}
 
-  list_add_after(&sched->live_timers, after, &timer->it);
+void sched_hint_interaction(struct scheduler *sched) {
+  sched->interacted = 1;
+}
 
-  return timer;
+/* returns the max length of the next slice. with the adaptive policy, slices
+   are shortened to the min length after devices interact, giving the other
+   devices a chance to respond promptly, and are doubled back up to the max
+   length for each slice in which nothing happens */
+static int64_t sched_next_slice(struct scheduler *sched) {
+  int64_t max_slice = MAX(OPTION_sched_max_slice, 1) * NS_PER_USEC;
+  int64_t min_slice = MAX(OPTION_sched_min_slice, 1) * NS_PER_USEC;
+
+  if (!OPTION_sched_adaptive) {
+    sched->interacted = 0;
+    return max_slice;
+  }
+
+  if (sched->interacted) {
+    sched->slice = min_slice;
+    sched->interacted = 0;
+  } else {
+    sched->slice = sched->slice * 2;
+  }
+
+  sched->slice = CLAMP(sched->slice, MIN(min_slice, max_slice), max_slice);
+
+  return sched->slice;
 }
 
 void sched_tick(struct scheduler *sched, int64_t ns) {
   int64_t target_time = sched->base_time + ns;
 
   while (sched->dc->running && sched->base_time < target_time) {
-    /* run devices up to the next timer */
-    int64_t next_time = target_time;
-    struct timer *next_timer =
-        list_first_entry(&sched->live_timers, struct timer, it);
+    /* run devices up to the next timer deadline */
+    int64_t max_time = sched->base_time + sched_next_slice(sched);
+    int64_t next_time = MIN(target_time, max_time);
 
-    if (next_timer && next_timer->expire < next_time) {
-      next_time = next_timer->expire;
+    if (sched->num_heap) {
+      next_time = MIN(next_time, sched->heap[0]->expire);
     }
 
     /* update base time before running devices and expiring timers in case one
@@ -84,32 +248,29 @@ void sched_tick(struct scheduler *sched, int64_t ns) {
     int64_t slice = next_time - sched->base_time;
     sched->base_time += slice;
 
+    prof_counter_add(COUNTER_sched_slices, 1);
+    prof_counter_add(COUNTER_sched_slice_ns, slice);
+
     /* execute each device */
     list_for_each_entry(dev, &sched->dc->devices, struct device, it) {
-      if (dev->runif.enabled && dev->runif.running) {
+      if (dev->runif.enabled && dev->runif.running &&
+          dev->runif.sched == sched) {
         dev->runif.run(dev, slice);
       }
     }
 
-    /* execute expired timers */
-    while (1) {
-      struct timer *timer =
-          list_first_entry(&sched->live_timers, struct timer, it);
-
-      if (!timer || timer->expire > sched->base_time) {
-        break;
-      }
-
-      sched_cancel_timer(sched, timer);
-
-      /* run the timer */
-      timer->cb(timer->data);
-    }
+    sched_expire_timers(sched);
   }
 }
 
-void sched_destroy(struct scheduler *sch) {
-  free(sch);
+void sched_destroy(struct scheduler *sched) {
+  list_for_each_entry_safe(chunk, &sched->chunks, struct timer_chunk, it) {
+    list_remove(&sched->chunks, &chunk->it);
+    free(chunk);
+  }
+
+  free(sched->heap);
+  free(sched);
 }
 
 struct scheduler *sched_create(struct dreamcast *dc) {
@@ -117,11 +278,5 @@ struct scheduler *sched_create(struct dreamcast *dc) {
 
   sched->dc = dc;
 
-  /* add all timers to the free list initially */
-  for (int i = 0; i < MAX_TIMERS; i++) {
-    struct timer *timer = &sched->timers[i];
-    list_add(&sched->free_timers, &timer->it);
-  }
-
   return sched;
 }
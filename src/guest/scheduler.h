@@ -20,6 +20,11 @@ void sched_destroy(struct scheduler *sch);
 
 void sched_tick(struct scheduler *sch, int64_t ns);
 
+/* signal that a device did something which another device will likely react
+   to, such as raising an interrupt. when adaptive slicing is enabled, the next
+   slices are shortened so the other devices see it sooner */
+void sched_hint_interaction(struct scheduler *sch);
+
 struct timer *sched_start_timer(struct scheduler *sch, timer_cb cb, void *data,
                                 int64_t ns);
 int64_t sched_remaining_time(struct scheduler *sch, struct timer *);
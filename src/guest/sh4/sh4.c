@@ -169,9 +169,16 @@ static void sh4_run(struct device *dev, int64_t ns) {
   int cycles = (int)NANO_TO_CYCLES(ns, SH4_CLOCK_FREQ);
   cycles = MAX(cycles, 1);
 
+  PROF_ENTER("cpu", "sh4_run");
+
+  int64_t start = time_nanoseconds();
   jit_run(sh4->jit, cycles);
+  int64_t end = time_nanoseconds();
+
+  PROF_LEAVE();
 
   prof_counter_add(COUNTER_sh4_instrs, sh4->ctx.ran_instrs);
+  prof_counter_add(COUNTER_sh4_run_ns, end - start);
 }
 
 static void sh4_guest_destroy(struct jit_guest *guest) {
@@ -195,6 +202,11 @@ static struct jit_guest *sh4_guest_create(struct sh4 *sh4) {
   guest->w8 = &sh4_write8;
   guest->w16 = &sh4_write16;
   guest->w32 = &sh4_write32;
+  guest->page_table = sh4_page_table(sh4->dc->mem);
+  guest->page_shift = MEM_PAGE_SHIFT;
+  guest->protect = &mem_protect;
+  guest->unprotect = &mem_unprotect;
+  guest->lookup_host = &mem_lookup_host;
 
   /* runtime interface */
   guest->data = sh4;
@@ -234,6 +246,12 @@ static int sh4_init(struct device *dev) {
   return 1;
 }
 
+int64_t sh4_remaining_time(struct sh4 *sh4) {
+  /* the scheduler's base time is advanced to the end of the slice before the
+     sh4 runs, while running, this is how far short of it the sh4 actually is */
+  return CYCLES_TO_NANO(MAX(sh4->ctx.run_cycles, 0), SH4_CLOCK_FREQ);
+}
+
 void sh4_clear_interrupt(struct sh4 *sh4, enum sh4_interrupt intr) {
   sh4->requested_interrupts &= ~sh4->sort_id[intr];
   sh4_intc_update_pending(sh4);
@@ -344,6 +362,7 @@ struct sh4 *sh4_create(struct dreamcast *dc) {
   /* setup run interface */
   sh4->runif.enabled = 1;
   sh4->runif.run = &sh4_run;
+  sh4->runif.sched = dc->sched;
 
   return sh4;
 }
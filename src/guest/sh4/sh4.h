@@ -86,4 +86,7 @@ void sh4_set_exception_handler(struct sh4 *sh4,
 void sh4_raise_interrupt(struct sh4 *sh4, enum sh4_interrupt intr);
 void sh4_clear_interrupt(struct sh4 *sh4, enum sh4_interrupt intr);
 
+/* returns the time left in the slice currently being ran */
+int64_t sh4_remaining_time(struct sh4 *sh4);
+
 #endif
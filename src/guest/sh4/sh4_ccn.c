@@ -26,7 +26,9 @@ static void sh4_ccn_reset(struct sh4 *sh4) {
      end the block */
   LOG_INFO("sh4_ccn_reset");
 
-  jit_invalidate_code(sh4->jit);
+  /* only throw away code on pages that have been written to since the last
+     reset, the rest of the compiled code is still valid */
+  jit_invalidate_dirty_code(sh4->jit);
 }
 
 void sh4_ccn_pref(struct sh4 *sh4, uint32_t addr) {
@@ -1,4 +1,5 @@
 #include "guest/aica/aica.h"
+#include "guest/aica/aica_thread.h"
 #include "guest/holly/holly.h"
 #include "guest/memory.h"
 #include "guest/pvr/pvr.h"
@@ -174,6 +175,18 @@ uint32_t sh4_area1_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
   }
 }
 
+/* when the aica is run on its own thread, wait for it to stop before
+   accessing its registers. note, aram is mapped directly and never reaches
+   the area 0 handlers, so it's always accessed without syncing, like the
+   shared memory it models */
+static void sh4_sync_aica(struct sh4 *sh4) {
+  struct dreamcast *dc = sh4->dc;
+
+  if (dc->aica_thread) {
+    aica_thread_sync(dc->aica_thread);
+  }
+}
+
 void sh4_area0_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
                      uint32_t mask) {
   struct dreamcast *dc = sh4->dc;
@@ -199,6 +212,7 @@ void sh4_area0_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
   } else if (addr >= SH4_MODEM_BEGIN && addr <= SH4_MODEM_END) {
     /* nop */
   } else if (addr >= SH4_AICA_REG_BEGIN && addr <= SH4_AICA_REG_END) {
+    sh4_sync_aica(sh4);
     aica_reg_write(dc->aica, addr - SH4_AICA_REG_BEGIN, data, mask);
   } else if (addr >= SH4_AICA_MEM_BEGIN && addr <= SH4_AICA_MEM_END) {
     aica_mem_write(dc->aica, addr - SH4_AICA_MEM_BEGIN, data, mask);
@@ -236,6 +250,7 @@ uint32_t sh4_area0_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
   } else if (addr >= SH4_MODEM_BEGIN && addr <= SH4_MODEM_END) {
     return 0;
   } else if (addr >= SH4_AICA_REG_BEGIN && addr <= SH4_AICA_REG_END) {
+    sh4_sync_aica(sh4);
     return aica_reg_read(dc->aica, addr - SH4_AICA_REG_BEGIN, mask);
   } else if (addr >= SH4_AICA_MEM_BEGIN && addr <= SH4_AICA_MEM_END) {
     return aica_mem_read(dc->aica, addr - SH4_AICA_MEM_BEGIN, mask);
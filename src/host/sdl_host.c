@@ -990,6 +990,8 @@ struct host *host_create() {
 int main(int argc, char **argv) {
   LOG_INFO("redream " GIT_VERSION);
 
+  prof_thread_name("main");
+
 #if PLATFORM_ANDROID
   const char *appdir = SDL_AndroidGetExternalStoragePath();
   fs_set_appdir(appdir);
@@ -1,19 +1,114 @@
 #include <stdlib.h>
+#include "core/list.h"
+#include "core/math.h"
 #include "jit/jit.h"
 #include "jit/jit_backend.h"
 #include "jit/jit_frontend.h"
 #include "jit/jit_guest.h"
 
+/* predecoded guest instruction */
+struct interp_instr {
+  jit_fallback fallback;
+  uint32_t data;
+  int cycles;
+};
+
+/* predecoded block of guest code, with one entry per possible instruction
+   address in the block. entries are indexed by the current pc rather than
+   executed in order, so branches within the block and delay slots (which
+   are executed by their branch's fallback) are handled naturally */
+struct interp_block {
+  uint32_t guest_addr;
+  int guest_size;
+  struct list_node it;
+  struct interp_instr instrs[];
+};
+
 struct interp_backend {
   struct jit_backend;
 
   /* used to resolve the fallback handler for each instruction */
   struct jit_frontend *frontend;
+
+  /* cache of predecoded blocks, one entry per possible block begin */
+  struct interp_block **cache;
+  uint32_t cache_mask;
+  int cache_shift;
+  int cache_size;
+  struct list blocks;
+
+  /* set when the cache has been invalidated. blocks may be invalidated by
+     the instructions executing inside of them, so the cache is only flushed
+     once the current block has been exited */
+  int flush;
 };
 
+static void interp_backend_flush(struct interp_backend *backend) {
+  list_for_each_entry_safe(block, &backend->blocks, struct interp_block, it) {
+    uint32_t i =
+        (block->guest_addr & backend->cache_mask) >> backend->cache_shift;
+    backend->cache[i] = NULL;
+    list_remove(&backend->blocks, &block->it);
+    free(block);
+  }
+
+  backend->flush = 0;
+}
+
+static struct interp_block *interp_backend_decode(
+    struct interp_backend *backend, uint32_t guest_addr) {
+  struct jit_frontend *frontend = backend->frontend;
+  struct jit_guest *guest = backend->guest;
+
+  /* reuse the frontend's analysis to find the extents of the block */
+  int guest_size;
+  frontend->analyze_code(frontend, guest_addr, 0, &guest_size);
+
+  int instr_size = 1 << backend->cache_shift;
+  int num_instrs = guest_size / instr_size;
+
+  struct interp_block *block =
+      malloc(sizeof(struct interp_block) +
+             num_instrs * sizeof(struct interp_instr));
+  block->guest_addr = guest_addr;
+  block->guest_size = guest_size;
+
+  for (int i = 0; i < num_instrs; i++) {
+    struct interp_instr *instr = &block->instrs[i];
+    uint32_t data = guest->r32(guest->mem, guest_addr + i * instr_size);
+    const struct jit_opdef *def = frontend->lookup_op(frontend, &data);
+    instr->fallback = def->fallback;
+    instr->data = data;
+    instr->cycles = def->cycles;
+  }
+
+  list_add(&backend->blocks, &block->it);
+
+  return block;
+}
+
+static struct interp_block *interp_backend_lookup(
+    struct interp_backend *backend, uint32_t guest_addr) {
+  uint32_t i = (guest_addr & backend->cache_mask) >> backend->cache_shift;
+  struct interp_block *block = backend->cache[i];
+
+  /* the cache is indexed by the masked address, make sure the entry isn't for
+     a mirror of the address */
+  if (!block || block->guest_addr != guest_addr) {
+    if (block) {
+      list_remove(&backend->blocks, &block->it);
+      free(block);
+    }
+
+    block = interp_backend_decode(backend, guest_addr);
+    backend->cache[i] = block;
+  }
+
+  return block;
+}
+
 static void interp_backend_run_code(struct jit_backend *base, int cycles) {
   struct interp_backend *backend = (struct interp_backend *)base;
-  struct jit_frontend *frontend = backend->frontend;
   struct jit_guest *guest = backend->guest;
   uint8_t *ctx = guest->ctx;
   uint32_t *pc = (uint32_t *)(ctx + guest->offset_pc);
@@ -29,12 +124,27 @@ static void interp_backend_run_code(struct jit_backend *base, int cycles) {
     int instrs = 0;
 
     do {
-      uint32_t addr = *pc;
-      uint32_t data = guest->r32(guest->mem, addr);
-      const struct jit_opdef *def = frontend->lookup_op(frontend, &data);
-      def->fallback(guest, addr, data);
-      cycles += def->cycles;
-      instrs += 1;
+      if (backend->flush) {
+        interp_backend_flush(backend);
+      }
+
+      struct interp_block *block = interp_backend_lookup(backend, *pc);
+
+      /* execute until the pc leaves the block, or the block is invalidated */
+      do {
+        uint32_t addr = *pc;
+        uint32_t offset = addr - block->guest_addr;
+
+        if (offset >= (uint32_t)block->guest_size) {
+          break;
+        }
+
+        struct interp_instr *instr =
+            &block->instrs[offset >> backend->cache_shift];
+        instr->fallback(guest, addr, instr->data);
+        cycles += instr->cycles;
+        instrs += 1;
+      } while (cycles < RUN_SLICE && !backend->flush);
     } while (cycles < RUN_SLICE);
 
     *run_cycles -= cycles;
@@ -44,6 +154,12 @@ static void interp_backend_run_code(struct jit_backend *base, int cycles) {
   }
 }
 
+static void interp_backend_invalidate_all(struct jit_backend *base) {
+  struct interp_backend *backend = (struct interp_backend *)base;
+
+  backend->flush = 1;
+}
+
 static int interp_backend_handle_exception(struct jit_backend *base,
                                            struct exception_state *ex) {
   return 0;
@@ -53,11 +169,18 @@ static void interp_backend_dump_code(struct jit_backend *base,
                                      const uint8_t *addr, int size,
                                      FILE *output) {}
 
-static void interp_backend_reset(struct jit_backend *base) {}
+static void interp_backend_reset(struct jit_backend *base) {
+  struct interp_backend *backend = (struct interp_backend *)base;
+
+  backend->flush = 1;
+}
 
 static void interp_backend_destroy(struct jit_backend *base) {
   struct interp_backend *backend = (struct interp_backend *)base;
 
+  interp_backend_flush(backend);
+
+  free(backend->cache);
   free(backend);
 }
 
@@ -82,8 +205,15 @@ struct jit_backend *interp_backend_create(struct jit_guest *guest,
   backend->lookup_code = NULL;
   backend->cache_code = NULL;
   backend->invalidate_code = NULL;
+  backend->invalidate_all = &interp_backend_invalidate_all;
   backend->patch_edge = NULL;
   backend->restore_edge = NULL;
 
+  /* initialize block cache, one entry per possible block begin */
+  backend->cache_mask = guest->addr_mask;
+  backend->cache_shift = ctz32(guest->addr_mask);
+  backend->cache_size = (backend->cache_mask >> backend->cache_shift) + 1;
+  backend->cache = calloc(backend->cache_size, sizeof(struct interp_block *));
+
   return (struct jit_backend *)backend;
 }
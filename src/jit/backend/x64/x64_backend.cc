@@ -134,6 +134,84 @@ Xbyak::Xmm x64_backend_xmm(struct x64_backend *backend,
   return xmm;
 }
 
+Xbyak::Reg x64_backend_promoted_reg(struct x64_backend *backend,
+                                    const struct ir_promoted *p) {
+  CHECK_EQ(p->type, VALUE_I32);
+  Xbyak::Reg reg = *(const Xbyak::Reg *)x64_registers[p->reg].data;
+  CHECK(reg.isREG());
+  return reg.cvt32();
+}
+
+Xbyak::Xmm x64_backend_promoted_xmm(struct x64_backend *backend,
+                                    const struct ir_promoted *p) {
+  CHECK(p->type == VALUE_F32 || p->type == VALUE_V128);
+  Xbyak::Xmm xmm = *(const Xbyak::Xmm *)x64_registers[p->reg].data;
+  CHECK(xmm.isXMM());
+  return xmm;
+}
+
+/* promoted context values live in host registers while inside of the block.
+   they're synced with the context whenever control leaves the block, or calls
+   out to code which may access the context */
+void x64_backend_load_promoted(struct x64_backend *backend, struct ir *ir) {
+  auto &e = *backend->codegen;
+
+  for (int i = 0; i < ir->num_promoted; i++) {
+    const struct ir_promoted *p = &ir->promoted[i];
+
+    if (p->type == VALUE_I32) {
+      e.mov(x64_backend_promoted_reg(backend, p),
+            e.dword[guestctx + p->offset]);
+    } else if (p->type == VALUE_V128) {
+      if (X64_USE_AVX) {
+        e.vmovups(x64_backend_promoted_xmm(backend, p),
+                  e.ptr[guestctx + p->offset]);
+      } else {
+        e.movups(x64_backend_promoted_xmm(backend, p),
+                 e.ptr[guestctx + p->offset]);
+      }
+    } else if (X64_USE_AVX) {
+      e.vmovss(x64_backend_promoted_xmm(backend, p),
+               e.dword[guestctx + p->offset]);
+    } else {
+      e.movss(x64_backend_promoted_xmm(backend, p),
+              e.dword[guestctx + p->offset]);
+    }
+  }
+}
+
+void x64_backend_store_promoted(struct x64_backend *backend, struct ir *ir) {
+  auto &e = *backend->codegen;
+
+  for (int i = 0; i < ir->num_promoted; i++) {
+    const struct ir_promoted *p = &ir->promoted[i];
+
+    /* the context is already up to date for values which are only read */
+    if (!p->dirty) {
+      continue;
+    }
+
+    if (p->type == VALUE_I32) {
+      e.mov(e.dword[guestctx + p->offset],
+            x64_backend_promoted_reg(backend, p));
+    } else if (p->type == VALUE_V128) {
+      if (X64_USE_AVX) {
+        e.vmovups(e.ptr[guestctx + p->offset],
+                  x64_backend_promoted_xmm(backend, p));
+      } else {
+        e.movups(e.ptr[guestctx + p->offset],
+                 x64_backend_promoted_xmm(backend, p));
+      }
+    } else if (X64_USE_AVX) {
+      e.vmovss(e.dword[guestctx + p->offset],
+               x64_backend_promoted_xmm(backend, p));
+    } else {
+      e.movss(e.dword[guestctx + p->offset],
+              x64_backend_promoted_xmm(backend, p));
+    }
+  }
+}
+
 int x64_backend_push_regs(struct x64_backend *backend, int mask) {
   int size = 0;
 
@@ -233,6 +311,52 @@ void x64_backend_load_mem(struct x64_backend *backend,
   }
 }
 
+void x64_backend_load_mem_ext(struct x64_backend *backend,
+                              const struct ir_value *dst,
+                              const struct ir_value *ext,
+                              const Xbyak::RegExp &src_exp) {
+  auto &e = *backend->codegen;
+
+  if (!ext) {
+    x64_backend_load_mem(backend, dst, src_exp);
+    return;
+  }
+
+  /* extend into the full 32-bit register, which also clears the upper bits
+     for the register's 64-bit uses */
+  Xbyak::Reg32 rd = x64_backend_reg(backend, dst).cvt32();
+  Xbyak::Address src =
+      ext->type == VALUE_I8 ? e.byte[src_exp] : e.word[src_exp];
+
+  if (ir_zext_constant(ext) == IR_LOAD_SEXT) {
+    e.movsx(rd, src);
+  } else {
+    e.movzx(rd, src);
+  }
+}
+
+void x64_backend_extend_reg(struct x64_backend *backend,
+                            const struct ir_value *dst,
+                            const struct ir_value *ext,
+                            const Xbyak::Reg64 &src) {
+  auto &e = *backend->codegen;
+
+  Xbyak::Reg32 rd = x64_backend_reg(backend, dst).cvt32();
+  Xbyak::Reg rs = src;
+
+  if (ext->type == VALUE_I8) {
+    rs = src.cvt8();
+  } else {
+    rs = src.cvt16();
+  }
+
+  if (ir_zext_constant(ext) == IR_LOAD_SEXT) {
+    e.movsx(rd, rs);
+  } else {
+    e.movzx(rd, rs);
+  }
+}
+
 void x64_backend_store_mem(struct x64_backend *backend,
                            const Xbyak::RegExp &dst_exp,
                            const struct ir_value *src) {
@@ -301,6 +425,38 @@ void x64_backend_store_mem(struct x64_backend *backend,
   }
 }
 
+/* guest memory accesses to non-constant addresses are looked up in the
+   guest's page table inline, only calling out to the mmio callbacks on a
+   miss */
+int x64_backend_use_page_table(struct x64_backend *backend,
+                               const struct ir_instr *instr) {
+  struct jit_guest *guest = backend->base.guest;
+
+  if (instr->op != OP_LOAD_GUEST && instr->op != OP_STORE_GUEST) {
+    return 0;
+  }
+
+  return guest->page_table && !ir_is_constant(instr->arg[0]);
+}
+
+/* emits a lookup of the guest address in the page table. on a hit, the
+   backing memory for the page is left in rax and the offset into the page in
+   arg0, otherwise control jumps to miss */
+void x64_backend_lookup_page(struct x64_backend *backend,
+                             const Xbyak::Reg32 &addr, Xbyak::Label &miss) {
+  struct jit_guest *guest = backend->base.guest;
+  auto &e = *backend->codegen;
+
+  e.mov(e.eax, addr);
+  e.shr(e.eax, guest->page_shift);
+  e.mov(arg0, (uint64_t)guest->page_table);
+  e.mov(e.rax, e.qword[arg0 + e.rax * 8]);
+  e.test(e.rax, e.rax);
+  e.jz(miss, Xbyak::CodeGenerator::T_NEAR);
+  e.mov(arg0.cvt32(), addr);
+  e.and_(arg0.cvt32(), (1u << guest->page_shift) - 1);
+}
+
 void x64_backend_mov_value(struct x64_backend *backend, const Xbyak::Reg &dst,
                            const struct ir_value *v) {
   auto &e = *backend->codegen;
@@ -452,6 +608,32 @@ static void x64_backend_emit_constants(struct x64_backend *backend) {
   e.dq(*(uint64_t *)&dbl_max_i32);
 }
 
+/* wrappers used to emulate a faulting movsx / movzx, extending the result of
+   the mmio handler into the full 32-bit register */
+static uint64_t x64_backend_read_sext8(struct memory *mem, uint32_t addr,
+                                       uint8_t (*read)(struct memory *,
+                                                       uint32_t)) {
+  return (uint32_t)(int32_t)(int8_t)read(mem, addr);
+}
+
+static uint64_t x64_backend_read_zext8(struct memory *mem, uint32_t addr,
+                                       uint8_t (*read)(struct memory *,
+                                                       uint32_t)) {
+  return (uint32_t)read(mem, addr);
+}
+
+static uint64_t x64_backend_read_sext16(struct memory *mem, uint32_t addr,
+                                        uint16_t (*read)(struct memory *,
+                                                         uint32_t)) {
+  return (uint32_t)(int32_t)(int16_t)read(mem, addr);
+}
+
+static uint64_t x64_backend_read_zext16(struct memory *mem, uint32_t addr,
+                                        uint16_t (*read)(struct memory *,
+                                                         uint32_t)) {
+  return (uint32_t)read(mem, addr);
+}
+
 static int x64_backend_handle_exception(struct jit_backend *base,
                                         struct exception_state *ex) {
   struct x64_backend *backend = container_of(base, struct x64_backend, base);
@@ -512,6 +694,21 @@ static int x64_backend_handle_exception(struct jit_backend *base,
         break;
     }
 
+    /* for extending loads, call the handler through a wrapper which extends
+       its result the same way the faulting movsx / movzx would have */
+    if (mov.is_sext || mov.is_zext) {
+      ex->thread_state.r[x64_arg2_idx] = ex->thread_state.rax;
+
+      if (mov.operand_size == 1) {
+        ex->thread_state.rax = mov.is_sext ? (uint64_t)&x64_backend_read_sext8
+                                           : (uint64_t)&x64_backend_read_zext8;
+      } else {
+        ex->thread_state.rax = mov.is_sext
+                                   ? (uint64_t)&x64_backend_read_sext16
+                                   : (uint64_t)&x64_backend_read_zext16;
+      }
+    }
+
     /* resume execution in the thunk once the exception handler exits */
     ex->thread_state.rip = (uint64_t)backend->load_thunk[mov.reg];
   } else {
@@ -549,7 +746,7 @@ static void x64_backend_dump_code(struct jit_backend *base, const uint8_t *addr,
                                   int size, FILE *output) {
   struct x64_backend *backend = container_of(base, struct x64_backend, base);
 
-  cs_insn *insns;
+  cs_insn *insns = NULL;
   size_t count = cs_disasm(backend->capstone_handle, addr, size, 0, 0, &insns);
 
   fprintf(output, "#==--------------------------------------------------==#\n");
@@ -598,6 +795,11 @@ void x64_backend_emit_branch(struct x64_backend *backend, struct ir *ir,
     dispatch_type = 2;
   }
 
+  /* sync promoted values before leaving the block */
+  if (dispatch_type) {
+    x64_backend_store_promoted(backend, ir);
+  }
+
   /* jump directly to the block / to dispatch */
   switch (dispatch_type) {
     case 0:
@@ -642,21 +844,81 @@ static void x64_backend_emit_prolog(struct x64_backend *backend, struct ir *ir,
     }
   }
 
-  /* yield control once remaining cycles are executed */
-  e.mov(e.eax, e.dword[guestctx + guest->offset_cycles]);
-  e.test(e.eax, e.eax);
-  e.js(backend->dispatch_exit);
-
-  /* yield control to any pending interrupts */
-  e.mov(e.rax, e.qword[guestctx + guest->offset_interrupts]);
-  e.test(e.rax, e.rax);
-  e.jnz(backend->dispatch_interrupt);
+  /* blocks which are only reachable by falling through or branching forward
+     from within the same region can't loop forever, and don't need to check
+     if control should be yielded */
+  int first_block = block == list_first_entry(&ir->blocks, struct ir_block, it);
+
+  int check = first_block || ir_is_loop_header(ir, block);
+
+  if (check && !ir->num_promoted) {
+    /* yield control once remaining cycles are executed */
+    e.mov(e.eax, e.dword[guestctx + guest->offset_cycles]);
+    e.test(e.eax, e.eax);
+    e.js(backend->dispatch_exit);
+
+    /* yield control to any pending interrupts */
+    e.mov(e.rax, e.qword[guestctx + guest->offset_interrupts]);
+    e.test(e.rax, e.rax);
+    e.jnz(backend->dispatch_interrupt);
+  } else if (check) {
+    /* same as above, but sync promoted values before yielding */
+    Xbyak::Label exit;
+    Xbyak::Label interrupt;
+    Xbyak::Label next;
+
+    e.mov(e.eax, e.dword[guestctx + guest->offset_cycles]);
+    e.test(e.eax, e.eax);
+    e.js(exit, Xbyak::CodeGenerator::T_NEAR);
+
+    e.mov(e.rax, e.qword[guestctx + guest->offset_interrupts]);
+    e.test(e.rax, e.rax);
+    e.jnz(interrupt, Xbyak::CodeGenerator::T_NEAR);
+    e.jmp(next, Xbyak::CodeGenerator::T_NEAR);
+
+    e.L(exit);
+    x64_backend_store_promoted(backend, ir);
+    e.jmp(backend->dispatch_exit);
+
+    e.L(interrupt);
+    x64_backend_store_promoted(backend, ir);
+    e.jmp(backend->dispatch_interrupt);
+
+    e.L(next);
+  }
 
   /* update debug run counts */
   e.sub(e.dword[guestctx + guest->offset_cycles], num_cycles);
   e.add(e.dword[guestctx + guest->offset_instrs], num_instrs);
 }
 
+static void x64_backend_emit_counter(struct x64_backend *backend,
+                                     struct ir *ir) {
+  auto &e = *backend->codegen;
+
+  struct ir_block *entry = list_first_entry(&ir->blocks, struct ir_block, it);
+  struct ir_value *counter = ir_get_meta(ir, entry, IR_META_COUNTER);
+  struct ir_value *threshold = ir_get_meta(ir, entry, IR_META_THRESHOLD);
+
+  if (!counter) {
+    return;
+  }
+
+  /* count each time the block is entered. this is emitted before the entry
+     block's label, so local branches back to the start of the block aren't
+     counted */
+  e.mov(e.rax, (uint64_t)counter->i64);
+  e.inc(e.qword[e.rax]);
+
+  /* once the threshold is crossed, jump to the compile thunk to have the
+     block recompiled. the pc has always been written to the context by the
+     time a block is entered */
+  if (threshold) {
+    e.cmp(e.qword[e.rax], threshold->i32);
+    e.je(backend->dispatch_compile);
+  }
+}
+
 static void x64_backend_emit(struct x64_backend *backend, struct ir *ir,
                              jit_emit_cb emit_cb, void *emit_data) {
   auto &e = *backend->codegen;
@@ -665,6 +927,12 @@ static void x64_backend_emit(struct x64_backend *backend, struct ir *ir,
 
   e.inLocalLabel();
 
+  x64_backend_emit_counter(backend, ir);
+
+  /* load promoted values before the entry block's label, local branches back
+     to the start of the block already have them loaded */
+  x64_backend_load_promoted(backend, ir);
+
   list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
     int first = 1;
     uint8_t *block_addr = e.getCurr<uint8_t *>();
@@ -694,7 +962,22 @@ static void x64_backend_emit(struct x64_backend *backend, struct ir *ir,
       struct jit_emitter *emitter = &x64_emitters[instr->op];
       x64_emit_cb emit = (x64_emit_cb)emitter->func;
       CHECK_NOTNULL(emit);
+
+      /* the called function may access the context, sync any promoted values
+         with it around the call. accesses using the page table only call out
+         on a miss, and sync the values themselves */
+      int call = (ir_opdefs[instr->op].flags & IR_FLAG_CALL) &&
+                 !x64_backend_use_page_table(backend, instr);
+
+      if (call) {
+        x64_backend_store_promoted(backend, ir);
+      }
+
       emit(backend, e, ir, instr);
+
+      if (call) {
+        x64_backend_load_promoted(backend, ir);
+      }
     }
 
     x64_backend_emit_epilog(backend, ir, block);
@@ -741,7 +1024,9 @@ static void x64_backend_reset(struct jit_backend *base) {
 static void x64_backend_destroy(struct jit_backend *base) {
   struct x64_backend *backend = container_of(base, struct x64_backend, base);
 
-  cs_close(&backend->capstone_handle);
+  if (backend->capstone_handle) {
+    cs_close(&backend->capstone_handle);
+  }
 
   delete backend->codegen;
 
@@ -757,6 +1042,8 @@ struct jit_backend *x64_backend_create(struct jit_guest *guest, void *code,
   Xbyak::util::Cpu cpu;
 
   backend->base.guest = guest;
+  backend->base.code = (uint8_t *)code;
+  backend->base.code_size = code_size;
   backend->base.destroy = &x64_backend_destroy;
 
   /* compile interface */
@@ -787,10 +1074,15 @@ struct jit_backend *x64_backend_create(struct jit_guest *guest, void *code,
 
   backend->codegen = new Xbyak::CodeGenerator(code_size, code);
   backend->use_avx = have_avx2;
+  backend->use_sse41 = cpu.has(Xbyak::util::Cpu::tSSE41);
 
-  /* create disassembler */
+  /* create disassembler. it's only used to dump code, so carry on without it
+     if capstone was built without x86 support */
   int res = cs_open(CS_ARCH_X86, CS_MODE_64, &backend->capstone_handle);
-  CHECK_EQ(res, CS_ERR_OK);
+  if (res != CS_ERR_OK) {
+    LOG_WARNING("x64_backend_create failed to create disassembler");
+    backend->capstone_handle = 0;
+  }
 
   /* emit initial thunks */
   x64_dispatch_init(backend);
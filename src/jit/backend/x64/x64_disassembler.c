@@ -31,6 +31,8 @@ int x64_decode_mov(const uint8_t *data, struct x64_mov *mov) {
   /* test for MOV opcode
      http://x86.renejeschke.de/html/file_module_x86_id_176.html */
   int is_load = 0;
+  int is_sext = 0;
+  int is_zext = 0;
   int has_imm = 0;
   int operand_size = 0;
 
@@ -72,6 +74,19 @@ int x64_decode_mov(const uint8_t *data, struct x64_mov *mov) {
     operand_size = *data == 0xc6 ? 1 : (has_opprefix ? 2 : 4);
     data++;
   }
+  /* MOVZX r32,r/m8
+     MOVZX r32,r/m16
+     MOVSX r32,r/m8
+     MOVSX r32,r/m16 */
+  else if (data[0] == 0x0f && (data[1] == 0xb6 || data[1] == 0xb7 ||
+                               data[1] == 0xbe || data[1] == 0xbf)) {
+    is_load = 1;
+    is_sext = data[1] == 0xbe || data[1] == 0xbf;
+    is_zext = !is_sext;
+    has_imm = 0;
+    operand_size = (data[1] == 0xb6 || data[1] == 0xbe) ? 1 : 2;
+    data += 2;
+  }
   /* not a supported MOV instruction */
   else {
     return 0;
@@ -85,6 +100,8 @@ int x64_decode_mov(const uint8_t *data, struct x64_mov *mov) {
   data++;
 
   mov->is_load = is_load;
+  mov->is_sext = is_sext;
+  mov->is_zext = is_zext;
   mov->is_indirect = (modrm_mod != 0b11);
   mov->has_imm = has_imm;
   mov->has_base = 0;
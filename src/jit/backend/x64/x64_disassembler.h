@@ -6,6 +6,8 @@
 struct x64_mov {
   int length;
   int is_load;
+  int is_sext;
+  int is_zext;
   int is_indirect;
   int has_imm;
   int has_base;
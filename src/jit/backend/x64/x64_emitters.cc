@@ -98,10 +98,15 @@ EMITTER(STORE_HOST, CONSTRAINTS(NONE, REG_I64, VAL_ALL)) {
   x64_backend_store_mem(backend, dst, data);
 }
 
-EMITTER(LOAD_GUEST, CONSTRAINTS(REG_ALL, REG_I64 | IMM_I32)) {
+EMITTER(LOAD_GUEST, CONSTRAINTS(REG_ALL, REG_I64 | IMM_I32, OPT | IMM_I32)) {
   struct jit_guest *guest = backend->base.guest;
   Xbyak::Reg dst = RES_REG;
   struct ir_value *addr = ARG0;
+  struct ir_value *ext = ARG1;
+
+  /* the width of the access differs from the result when an extension has
+     been folded into the load */
+  enum ir_type mem_type = ext ? ext->type : RES->type;
 
   if (ir_is_constant(addr)) {
     /* peel away one layer of abstraction and directly access the backing
@@ -113,22 +118,27 @@ EMITTER(LOAD_GUEST, CONSTRAINTS(REG_ALL, REG_I64 | IMM_I32)) {
 
     if (ptr) {
       e.mov(e.rax, (uint64_t)ptr);
-      x64_backend_load_mem(backend, RES, e.rax);
+      x64_backend_load_mem_ext(backend, RES, ext, e.rax);
     } else {
-      int data_size = ir_type_size(RES->type);
+      int data_size = ir_type_size(mem_type);
       uint32_t data_mask = (1 << (data_size * 8)) - 1;
 
       e.mov(arg0, (uint64_t)userdata);
       e.mov(arg1, (uint32_t)addr->i32);
       e.mov(arg2, data_mask);
       e.call((void *)read);
-      e.mov(dst, e.rax);
+
+      if (ext) {
+        x64_backend_extend_reg(backend, RES, ext, e.rax);
+      } else {
+        e.mov(dst, e.rax);
+      }
     }
   } else {
     Xbyak::Reg ra = x64_backend_reg(backend, addr);
 
     void *fn = nullptr;
-    switch (RES->type) {
+    switch (mem_type) {
       case VALUE_I8:
         fn = (void *)guest->r8;
         break;
@@ -146,10 +156,33 @@ EMITTER(LOAD_GUEST, CONSTRAINTS(REG_ALL, REG_I64 | IMM_I32)) {
         break;
     }
 
+    /* access the backing memory directly when the page isn't mmio */
+    Xbyak::Label miss;
+    Xbyak::Label done;
+    int page_table = x64_backend_use_page_table(backend, instr);
+
+    if (page_table) {
+      x64_backend_lookup_page(backend, ra.cvt32(), miss);
+      x64_backend_load_mem_ext(backend, RES, ext, e.rax + arg0);
+      e.jmp(done, Xbyak::CodeGenerator::T_NEAR);
+      e.L(miss);
+      x64_backend_store_promoted(backend, ir);
+    }
+
     e.mov(arg0, (uint64_t)guest->mem);
     e.mov(arg1, ra);
     e.call((void *)fn);
-    e.mov(dst, e.rax);
+
+    if (ext) {
+      x64_backend_extend_reg(backend, RES, ext, e.rax);
+    } else {
+      e.mov(dst, e.rax);
+    }
+
+    if (page_table) {
+      x64_backend_load_promoted(backend, ir);
+      e.L(done);
+    }
   }
 }
 
@@ -201,18 +234,37 @@ EMITTER(STORE_GUEST, CONSTRAINTS(NONE, REG_I64 | IMM_I32, VAL_ALL)) {
         break;
     }
 
+    /* access the backing memory directly when the page isn't mmio */
+    Xbyak::Label miss;
+    Xbyak::Label done;
+    int page_table = x64_backend_use_page_table(backend, instr);
+
+    if (page_table) {
+      x64_backend_lookup_page(backend, ra.cvt32(), miss);
+      x64_backend_store_mem(backend, e.rax + arg0, data);
+      e.jmp(done, Xbyak::CodeGenerator::T_NEAR);
+      e.L(miss);
+      x64_backend_store_promoted(backend, ir);
+    }
+
     e.mov(arg0, (uint64_t)guest->mem);
     e.mov(arg1, ra);
     x64_backend_mov_value(backend, arg2, data);
     e.call((void *)fn);
+
+    if (page_table) {
+      x64_backend_load_promoted(backend, ir);
+      e.L(done);
+    }
   }
 }
 
-EMITTER(LOAD_FAST, CONSTRAINTS(REG_ALL, REG_I64)) {
+EMITTER(LOAD_FAST, CONSTRAINTS(REG_ALL, REG_I64, OPT | IMM_I32)) {
   struct ir_value *dst = RES;
   Xbyak::Reg addr = ARG0_REG;
+  struct ir_value *ext = ARG1;
 
-  x64_backend_load_mem(backend, dst, addr.cvt64() + guestmem);
+  x64_backend_load_mem_ext(backend, dst, ext, addr.cvt64() + guestmem);
 }
 
 EMITTER(STORE_FAST, CONSTRAINTS(NONE, REG_I64, VAL_ALL)) {
@@ -225,15 +277,54 @@ EMITTER(STORE_FAST, CONSTRAINTS(NONE, REG_I64, VAL_ALL)) {
 EMITTER(LOAD_CONTEXT, CONSTRAINTS(REG_ALL, IMM_I32)) {
   struct ir_value *dst = RES;
   int offset = ARG0->i32;
+  const struct ir_promoted *promoted = ir_get_promoted(ir, offset);
+
+  if (!promoted) {
+    x64_backend_load_mem(backend, dst, guestctx + offset);
+    return;
+  }
 
-  x64_backend_load_mem(backend, dst, guestctx + offset);
+  /* copy from the value's promoted register */
+  if (promoted->type == VALUE_I32) {
+    e.mov(RES_REG, x64_backend_promoted_reg(backend, promoted));
+  } else if (X64_USE_AVX) {
+    e.vmovaps(RES_XMM, x64_backend_promoted_xmm(backend, promoted));
+  } else {
+    e.movaps(RES_XMM, x64_backend_promoted_xmm(backend, promoted));
+  }
 }
 
 EMITTER(STORE_CONTEXT, CONSTRAINTS(NONE, IMM_I32, VAL_ALL)) {
   int offset = ARG0->i32;
   struct ir_value *data = ARG1;
+  const struct ir_promoted *promoted = ir_get_promoted(ir, offset);
 
-  x64_backend_store_mem(backend, guestctx + offset, data);
+  if (!promoted) {
+    x64_backend_store_mem(backend, guestctx + offset, data);
+    return;
+  }
+
+  /* copy to the value's promoted register */
+  if (promoted->type == VALUE_I32) {
+    x64_backend_mov_value(backend,
+                          x64_backend_promoted_reg(backend, promoted), data);
+  } else {
+    Xbyak::Xmm rd = x64_backend_promoted_xmm(backend, promoted);
+
+    if (ir_is_constant(data)) {
+      e.mov(e.eax, data->i32);
+
+      if (X64_USE_AVX) {
+        e.vmovd(rd, e.eax);
+      } else {
+        e.movd(rd, e.eax);
+      }
+    } else if (X64_USE_AVX) {
+      e.vmovaps(rd, ARG1_XMM);
+    } else {
+      e.movaps(rd, ARG1_XMM);
+    }
+  }
 }
 
 EMITTER(LOAD_LOCAL, CONSTRAINTS(REG_ALL, IMM_I32)) {
@@ -764,9 +855,14 @@ EMITTER(VDOT, CONSTRAINTS(REG_V128, REG_V128, REG_V128)) {
     if (rd != ra) {
       e.movaps(rd, ra);
     }
-    e.mulps(rd, rb);
-    e.haddps(rd, rd);
-    e.haddps(rd, rd);
+
+    if (X64_USE_SSE41) {
+      e.dpps(rd, rb, 0b11110001);
+    } else {
+      e.mulps(rd, rb);
+      e.haddps(rd, rd);
+      e.haddps(rd, rd);
+    }
   }
 }
 
@@ -785,6 +881,25 @@ EMITTER(VMUL, CONSTRAINTS(REG_V128, REG_V128, REG_V128)) {
   }
 }
 
+EMITTER(VMADD, CONSTRAINTS(REG_V128, REG_V128, REG_V128, REG_V128)) {
+  Xbyak::Xmm rd = RES_XMM;
+  Xbyak::Xmm ra = ARG0_XMM;
+  Xbyak::Xmm rb = ARG1_XMM;
+  Xbyak::Xmm rc = ARG2_XMM;
+
+  /* always multiply and add separately, rounding twice, to match the
+     interpreter regardless of the host's fma support */
+  if (X64_USE_AVX) {
+    e.vmulps(e.xmm0, ra, rb);
+    e.vaddps(rd, e.xmm0, rc);
+  } else {
+    e.movaps(e.xmm0, ra);
+    e.mulps(e.xmm0, rb);
+    e.addps(e.xmm0, rc);
+    e.movaps(rd, e.xmm0);
+  }
+}
+
 EMITTER(AND, CONSTRAINTS(REG_ARG0, REG_I64, REG_I64 | IMM_I32)) {
   Xbyak::Reg rd = RES_REG;
 
@@ -34,6 +34,7 @@ struct x64_backend {
   /* codegen state */
   Xbyak::CodeGenerator *codegen;
   int use_avx;
+  int use_sse41;
   Xbyak::Label xmm_const[NUM_XMM_CONST];
   void *dispatch_dynamic;
   void *dispatch_static;
@@ -63,7 +64,10 @@ struct x64_backend {
 #define X64_STACK_LOCALS (X64_STACK_SHADOW_SPACE + 8)
 
 #define X64_USE_AVX backend->use_avx
+#define X64_USE_SSE41 backend->use_sse41
 
+struct ir;
+struct ir_promoted;
 struct ir_value;
 
 extern const Xbyak::Reg64 arg0;
@@ -79,14 +83,32 @@ Xbyak::Reg x64_backend_reg(struct x64_backend *backend,
                            const struct ir_value *v);
 Xbyak::Xmm x64_backend_xmm(struct x64_backend *backend,
                            const struct ir_value *v);
+Xbyak::Reg x64_backend_promoted_reg(struct x64_backend *backend,
+                                    const struct ir_promoted *p);
+Xbyak::Xmm x64_backend_promoted_xmm(struct x64_backend *backend,
+                                    const struct ir_promoted *p);
+void x64_backend_load_promoted(struct x64_backend *backend, struct ir *ir);
+void x64_backend_store_promoted(struct x64_backend *backend, struct ir *ir);
 int x64_backend_push_regs(struct x64_backend *backend, int mask);
 void x64_backend_pop_regs(struct x64_backend *backend, int mask);
 void x64_backend_load_mem(struct x64_backend *backend,
                           const struct ir_value *dst,
                           const Xbyak::RegExp &src_exp);
+void x64_backend_load_mem_ext(struct x64_backend *backend,
+                              const struct ir_value *dst,
+                              const struct ir_value *ext,
+                              const Xbyak::RegExp &src_exp);
+void x64_backend_extend_reg(struct x64_backend *backend,
+                            const struct ir_value *dst,
+                            const struct ir_value *ext,
+                            const Xbyak::Reg64 &src);
 void x64_backend_store_mem(struct x64_backend *backend,
                            const Xbyak::RegExp &dst_exp,
                            const struct ir_value *src);
+int x64_backend_use_page_table(struct x64_backend *backend,
+                               const struct ir_instr *instr);
+void x64_backend_lookup_page(struct x64_backend *backend,
+                             const Xbyak::Reg32 &addr, Xbyak::Label &miss);
 void x64_backend_mov_value(struct x64_backend *backend, const Xbyak::Reg &dst,
                            const struct ir_value *v);
 const Xbyak::Address x64_backend_xmm_constant(struct x64_backend *backend,
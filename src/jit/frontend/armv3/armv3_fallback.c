@@ -5,9 +5,10 @@
 #include "jit/frontend/armv3/armv3_guest.h"
 
 /* helper functions / macros for writing fallbacks */
-#define FALLBACK(op)                                                 \
-  void armv3_fallback_##op(struct armv3_guest *guest, uint32_t addr, \
-                           union armv3_instr i)
+#define FALLBACK(op)                                                    \
+  JIT_FALLBACK_SECTION void armv3_fallback_##op(struct armv3_guest *guest, \
+                                                uint32_t addr,             \
+                                                union armv3_instr i)
 
 #define CTX ((struct armv3_context *)guest->ctx)
 #define MODE() (CTX->r[CPSR] & M_MASK)
@@ -110,6 +111,16 @@ static inline void armv3_fallback_shift_ror(uint32_t in, uint32_t n,
   *carry = (*out >> 31) & 0x1;
 }
 
+static inline void armv3_fallback_shift_rrx(uint32_t in, uint32_t c,
+                                            uint32_t *out, uint32_t *carry) {
+  /*
+   * RRX shifts right by one, shifting the carry flag into bit 31, with carry
+   * out equal to bit 0 of input
+   */
+  *out = (c << 31) | (in >> 1);
+  *carry = in & 0x1;
+}
+
 static void armv3_fallback_shift(const struct armv3_context *ctx,
                                  enum armv3_shift_source src,
                                  enum armv3_shift_type type, uint32_t in,
@@ -135,6 +146,9 @@ static void armv3_fallback_shift(const struct armv3_context *ctx,
       case SHIFT_ROR:
         armv3_fallback_shift_ror(in, n, out, carry);
         break;
+      case SHIFT_RRX:
+        armv3_fallback_shift_rrx(in, *carry, out, carry);
+        break;
       default:
         LOG_FATAL("Unsupported shift type");
         break;
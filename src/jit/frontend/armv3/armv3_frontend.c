@@ -3,6 +3,7 @@
 #include "jit/frontend/armv3/armv3_disasm.h"
 #include "jit/frontend/armv3/armv3_fallback.h"
 #include "jit/frontend/armv3/armv3_guest.h"
+#include "jit/frontend/armv3/armv3_translate.h"
 #include "jit/ir/ir.h"
 #include "jit/jit.h"
 #include "jit/jit_guest.h"
@@ -47,21 +48,50 @@ static void armv3_frontend_translate_code(struct jit_frontend *base,
   struct armv3_guest *guest = (struct armv3_guest *)frontend->guest;
 
   int offset = 0;
+  int translated = 0;
+
+  /* append initial block */
+  struct ir_block *block = ir_append_block(ir);
+  ir_set_meta(ir, block, IR_META_ADDR, ir_alloc_i32(ir, begin_addr));
 
   while (offset < size) {
     uint32_t addr = begin_addr + offset;
     uint32_t data = guest->r32(guest->mem, addr);
+    union armv3_instr i = {data};
     struct jit_opdef *def = armv3_get_opdef(data);
 
     ir_source_info(ir, addr, 12);
-    ir_fallback(ir, def->fallback, addr, data);
+
+    /* emit the instruction's translation if available */
+    translated = armv3_translate(guest, ir, addr, i);
+
+    if (!translated) {
+      ir_fallback(ir, def->fallback, addr, data);
+    }
 
     offset += 4;
   }
+
+  /* fallbacks always write out the next pc, while translations only do so
+     when branching. if the block ended with a translation that didn't branch
+     (e.g. a conditional branch which wasn't taken), branch to the next
+     address */
+  if (translated) {
+    struct ir_block *tail_block =
+        list_last_entry(&ir->blocks, struct ir_block, it);
+    struct ir_instr *tail_instr =
+        list_last_entry(&tail_block->instrs, struct ir_instr, it);
+
+    if (!tail_instr || tail_instr->op != OP_BRANCH) {
+      ir_set_current_block(ir, tail_block);
+      ir_branch(ir, ir_alloc_i32(ir, begin_addr + offset));
+    }
+  }
 }
 
 static void armv3_frontend_analyze_code(struct jit_frontend *base,
-                                        uint32_t begin_addr, int *size) {
+                                        uint32_t begin_addr, int flags,
+                                        int *size) {
   struct armv3_frontend *frontend = (struct armv3_frontend *)base;
   struct armv3_guest *guest = (struct armv3_guest *)frontend->guest;
 
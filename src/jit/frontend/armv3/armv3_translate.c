@@ -0,0 +1,731 @@
+#include "jit/frontend/armv3/armv3_translate.h"
+#include "core/core.h"
+#include "jit/frontend/armv3/armv3_context.h"
+#include "jit/frontend/armv3/armv3_guest.h"
+#include "jit/ir/ir.h"
+
+/* helper functions / macros for writing translations. these mirror the
+   fallbacks in armv3_fallback.c, which remain the reference for each
+   instruction's behavior */
+#define TRANSLATE(op)                                                        \
+  static void armv3_translate_##op(struct armv3_guest *guest, struct ir *ir, \
+                                   uint32_t addr, union armv3_instr i)
+
+#define LOAD_REG(n) \
+  ir_load_context(ir, offsetof(struct armv3_context, r[n]), VALUE_I32)
+#define STORE_REG(n, v) \
+  ir_store_context(ir, offsetof(struct armv3_context, r[n]), v)
+#define LOAD_CPSR() LOAD_REG(CPSR)
+#define STORE_CPSR(v) STORE_REG(CPSR, v)
+
+#define LOAD_RN(rn) armv3_translate_load_rn(ir, addr, rn)
+#define LOAD_RD(rd) armv3_translate_load_rd(ir, addr, rd)
+
+#define FLAG(mask) ir_and(ir, cpsr, ir_alloc_i32(ir, mask))
+
+/* shift v into n's position, making n != v a single test of bit 31 */
+#define FLAG_NV()                                                \
+  ir_and(ir, ir_xor(ir, cpsr, ir_shli(ir, cpsr, N_BIT - V_BIT)), \
+         ir_alloc_i32(ir, N_MASK))
+
+static struct ir_value *armv3_translate_cond(struct ir *ir, uint32_t cond) {
+  struct ir_value *cpsr = LOAD_CPSR();
+  struct ir_value *zero = ir_alloc_i32(ir, 0);
+
+  switch (cond) {
+    case COND_EQ:
+      return ir_cmp_ne(ir, FLAG(Z_MASK), zero);
+    case COND_NE:
+      return ir_cmp_eq(ir, FLAG(Z_MASK), zero);
+    case COND_CS:
+      return ir_cmp_ne(ir, FLAG(C_MASK), zero);
+    case COND_CC:
+      return ir_cmp_eq(ir, FLAG(C_MASK), zero);
+    case COND_MI:
+      return ir_cmp_ne(ir, FLAG(N_MASK), zero);
+    case COND_PL:
+      return ir_cmp_eq(ir, FLAG(N_MASK), zero);
+    case COND_VS:
+      return ir_cmp_ne(ir, FLAG(V_MASK), zero);
+    case COND_VC:
+      return ir_cmp_eq(ir, FLAG(V_MASK), zero);
+    case COND_HI:
+      return ir_cmp_eq(ir, FLAG(C_MASK | Z_MASK), ir_alloc_i32(ir, C_MASK));
+    case COND_LS:
+      return ir_cmp_ne(ir, FLAG(C_MASK | Z_MASK), ir_alloc_i32(ir, C_MASK));
+    case COND_GE:
+      return ir_cmp_eq(ir, FLAG_NV(), zero);
+    case COND_LT:
+      return ir_cmp_ne(ir, FLAG_NV(), zero);
+    case COND_GT:
+      return ir_cmp_eq(ir, ir_or(ir, FLAG_NV(), FLAG(Z_MASK)), zero);
+    case COND_LE:
+      return ir_cmp_ne(ir, ir_or(ir, FLAG_NV(), FLAG(Z_MASK)), zero);
+    default:
+      LOG_FATAL("unexpected condition %d", cond);
+      return NULL;
+  }
+}
+
+static inline struct ir_value *armv3_translate_load_rn(struct ir *ir,
+                                                       uint32_t addr, int rn) {
+  if (rn == 15) {
+    /* account for instruction prefetching if loading the pc */
+    return ir_alloc_i32(ir, addr + 8);
+  }
+
+  return LOAD_REG(rn);
+}
+
+static inline struct ir_value *armv3_translate_load_rd(struct ir *ir,
+                                                       uint32_t addr, int rd) {
+  if (rd == 15) {
+    /* account for instruction prefetching if loading the pc */
+    return ir_alloc_i32(ir, addr + 12);
+  }
+
+  return LOAD_REG(rd);
+}
+
+/* returns the shifted value. carry is set to the shifter's carry out as a 0 or
+   1 value, or NULL when the carry flag passes through unchanged */
+static struct ir_value *armv3_translate_shift(struct ir *ir,
+                                              enum armv3_shift_type type,
+                                              struct ir_value *in, uint32_t n,
+                                              struct ir_value **carry) {
+  struct ir_value *one = ir_alloc_i32(ir, 1);
+
+  /* the shift amount is an immediate, so n is in the range 0-31 for LSL, 1-32
+     for LSR and ASR, 1-31 for ROR and 1 for RRX */
+  if (!n) {
+    *carry = NULL;
+    return in;
+  }
+
+  switch (type) {
+    case SHIFT_LSL:
+      *carry = ir_and(ir, ir_lshri(ir, in, 32 - n), one);
+      return ir_shli(ir, in, n);
+    case SHIFT_LSR:
+      *carry = ir_and(ir, ir_lshri(ir, in, n - 1), one);
+      return n == 32 ? ir_alloc_i32(ir, 0) : ir_lshri(ir, in, n);
+    case SHIFT_ASR:
+      *carry = ir_and(ir, ir_lshri(ir, in, n - 1), one);
+      return ir_ashri(ir, in, MIN(n, 31));
+    case SHIFT_ROR: {
+      struct ir_value *res =
+          ir_or(ir, ir_shli(ir, in, 32 - n), ir_lshri(ir, in, n));
+      *carry = ir_lshri(ir, res, 31);
+      return res;
+    }
+    case SHIFT_RRX: {
+      struct ir_value *c = ir_and(ir, LOAD_CPSR(), ir_alloc_i32(ir, C_MASK));
+      *carry = ir_and(ir, in, one);
+      return ir_or(ir, ir_shli(ir, c, N_BIT - C_BIT), ir_lshri(ir, in, 1));
+    }
+    default:
+      LOG_FATAL("unsupported shift type");
+      return NULL;
+  }
+}
+
+static struct ir_value *armv3_translate_parse_shift(struct ir *ir,
+                                                    uint32_t addr,
+                                                    uint32_t reg,
+                                                    uint32_t shift,
+                                                    struct ir_value **carry) {
+  enum armv3_shift_source src;
+  enum armv3_shift_type type;
+  uint32_t n;
+  armv3_disasm_shift(shift, &src, &type, &n);
+
+  /* register specified shift amounts are left to the fallbacks */
+  CHECK_EQ(src, SHIFT_IMM);
+
+  return armv3_translate_shift(ir, type, LOAD_RN(reg), n, carry);
+}
+
+/*
+ * branch and branch with link
+ */
+#define BRANCH_OFFSET() armv3_disasm_offset(i.branch.offset)
+
+TRANSLATE(B) {
+  ir_branch(ir, ir_alloc_i32(ir, addr + 8 + BRANCH_OFFSET()));
+}
+
+TRANSLATE(BL) {
+  STORE_REG(14, ir_alloc_i32(ir, addr + 4));
+  ir_branch(ir, ir_alloc_i32(ir, addr + 8 + BRANCH_OFFSET()));
+}
+
+/*
+ * data processing
+ */
+#define PARSE_OP2(carry) armv3_translate_parse_op2(ir, addr, i, carry)
+
+#define CARRY() \
+  ir_lshri(ir, ir_and(ir, LOAD_CPSR(), ir_alloc_i32(ir, C_MASK)), C_BIT)
+
+#define UPDATE_FLAGS_LOGICAL()                            \
+  if (i.data.s) {                                         \
+    armv3_translate_update_flags_logical(ir, res, carry); \
+  }
+
+#define UPDATE_FLAGS_SUB()                               \
+  if (i.data.s) {                                        \
+    armv3_translate_update_flags_sub(ir, lhs, rhs, res); \
+  }
+
+#define UPDATE_FLAGS_ADD()                               \
+  if (i.data.s) {                                        \
+    armv3_translate_update_flags_add(ir, lhs, rhs, res); \
+  }
+
+static struct ir_value *armv3_translate_parse_op2(struct ir *ir,
+                                                  uint32_t addr,
+                                                  union armv3_instr i,
+                                                  struct ir_value **carry) {
+  if (i.data.i) {
+    /* op2 is an immediate, rotate it at compile time */
+    uint32_t imm = i.data_imm.imm;
+    uint32_t n = i.data_imm.rot << 1;
+
+    if (n) {
+      imm = (imm >> n) | (imm << (32 - n));
+      *carry = ir_alloc_i32(ir, imm >> 31);
+    } else {
+      *carry = NULL;
+    }
+
+    return ir_alloc_i32(ir, imm);
+  }
+
+  /* op2 is as shifted register */
+  return armv3_translate_parse_shift(ir, addr, i.data_reg.rm, i.data_reg.shift,
+                                     carry);
+}
+
+/* returns the n and z flags for the result in their cpsr positions */
+static struct ir_value *armv3_translate_flags_nz(struct ir *ir,
+                                                 struct ir_value *res) {
+  struct ir_value *n = ir_and(ir, res, ir_alloc_i32(ir, N_MASK));
+  struct ir_value *z = ir_zext(ir, ir_cmp_eq(ir, res, ir_alloc_i32(ir, 0)),
+                               VALUE_I32);
+  return ir_or(ir, n, ir_shli(ir, z, Z_BIT));
+}
+
+static void armv3_translate_update_flags(struct ir *ir, uint32_t mask,
+                                         struct ir_value *flags) {
+  struct ir_value *cpsr = LOAD_CPSR();
+  cpsr = ir_and(ir, cpsr, ir_alloc_i32(ir, ~mask));
+  STORE_CPSR(ir_or(ir, cpsr, flags));
+}
+
+static void armv3_translate_update_flags_logical(struct ir *ir,
+                                                 struct ir_value *res,
+                                                 struct ir_value *carry) {
+  uint32_t mask = N_MASK | Z_MASK | V_MASK;
+  struct ir_value *flags = armv3_translate_flags_nz(ir, res);
+
+  if (carry) {
+    mask |= C_MASK;
+    flags = ir_or(ir, flags, ir_shli(ir, carry, C_BIT));
+  }
+
+  armv3_translate_update_flags(ir, mask, flags);
+}
+
+static void armv3_translate_update_flags_sub(struct ir *ir,
+                                             struct ir_value *lhs,
+                                             struct ir_value *rhs,
+                                             struct ir_value *res) {
+  uint32_t mask = N_MASK | Z_MASK | C_MASK | V_MASK;
+  struct ir_value *flags = armv3_translate_flags_nz(ir, res);
+
+  /* c = ~((~lhs & rhs) | ((~lhs | rhs) & res)) >> 31 */
+  struct ir_value *not_lhs = ir_not(ir, lhs);
+  struct ir_value *c = ir_not(
+      ir, ir_or(ir, ir_and(ir, not_lhs, rhs),
+                ir_and(ir, ir_or(ir, not_lhs, rhs), res)));
+  c = ir_and(ir, ir_lshri(ir, c, N_BIT - C_BIT), ir_alloc_i32(ir, C_MASK));
+  flags = ir_or(ir, flags, c);
+
+  /* v = ((lhs ^ rhs) & (res ^ lhs)) >> 31 */
+  struct ir_value *v =
+      ir_and(ir, ir_xor(ir, lhs, rhs), ir_xor(ir, res, lhs));
+  v = ir_and(ir, ir_lshri(ir, v, N_BIT - V_BIT), ir_alloc_i32(ir, V_MASK));
+  flags = ir_or(ir, flags, v);
+
+  armv3_translate_update_flags(ir, mask, flags);
+}
+
+static void armv3_translate_update_flags_add(struct ir *ir,
+                                             struct ir_value *lhs,
+                                             struct ir_value *rhs,
+                                             struct ir_value *res) {
+  uint32_t mask = N_MASK | Z_MASK | C_MASK | V_MASK;
+  struct ir_value *flags = armv3_translate_flags_nz(ir, res);
+
+  /* c = ((lhs & rhs) | ((lhs | rhs) & ~res)) >> 31 */
+  struct ir_value *c =
+      ir_or(ir, ir_and(ir, lhs, rhs),
+            ir_and(ir, ir_or(ir, lhs, rhs), ir_not(ir, res)));
+  c = ir_and(ir, ir_lshri(ir, c, N_BIT - C_BIT), ir_alloc_i32(ir, C_MASK));
+  flags = ir_or(ir, flags, c);
+
+  /* v = ((res ^ lhs) & (res ^ rhs)) >> 31 */
+  struct ir_value *v =
+      ir_and(ir, ir_xor(ir, res, lhs), ir_xor(ir, res, rhs));
+  v = ir_and(ir, ir_lshri(ir, v, N_BIT - V_BIT), ir_alloc_i32(ir, V_MASK));
+  flags = ir_or(ir, flags, v);
+
+  armv3_translate_update_flags(ir, mask, flags);
+}
+
+TRANSLATE(AND) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_and(ir, lhs, rhs);
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_LOGICAL();
+}
+
+TRANSLATE(EOR) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_xor(ir, lhs, rhs);
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_LOGICAL();
+}
+
+TRANSLATE(SUB) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_sub(ir, lhs, rhs);
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_SUB();
+}
+
+TRANSLATE(RSB) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = PARSE_OP2(&carry);
+  rhs = LOAD_RN(i.data.rn);
+  res = ir_sub(ir, lhs, rhs);
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_SUB();
+}
+
+TRANSLATE(ADD) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_add(ir, lhs, rhs);
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_ADD();
+}
+
+TRANSLATE(ADC) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_add(ir, ir_add(ir, lhs, rhs), CARRY());
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_ADD();
+}
+
+TRANSLATE(SBC) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_sub(ir, ir_add(ir, ir_sub(ir, lhs, rhs), CARRY()),
+               ir_alloc_i32(ir, 1));
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_SUB();
+}
+
+TRANSLATE(RSC) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = PARSE_OP2(&carry);
+  rhs = LOAD_RN(i.data.rn);
+  res = ir_sub(ir, ir_add(ir, ir_sub(ir, lhs, rhs), CARRY()),
+               ir_alloc_i32(ir, 1));
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_SUB();
+}
+
+TRANSLATE(TST) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_and(ir, lhs, rhs);
+
+  UPDATE_FLAGS_LOGICAL();
+}
+
+TRANSLATE(TEQ) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_xor(ir, lhs, rhs);
+
+  UPDATE_FLAGS_LOGICAL();
+}
+
+TRANSLATE(CMP) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_sub(ir, lhs, rhs);
+
+  UPDATE_FLAGS_SUB();
+}
+
+TRANSLATE(CMN) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_add(ir, lhs, rhs);
+
+  UPDATE_FLAGS_ADD();
+}
+
+TRANSLATE(ORR) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_or(ir, lhs, rhs);
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_LOGICAL();
+}
+
+TRANSLATE(MOV) {
+  struct ir_value *res, *carry;
+  res = PARSE_OP2(&carry);
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_LOGICAL();
+}
+
+TRANSLATE(BIC) {
+  struct ir_value *lhs, *rhs, *res, *carry;
+  lhs = LOAD_RN(i.data.rn);
+  rhs = PARSE_OP2(&carry);
+  res = ir_and(ir, lhs, ir_not(ir, rhs));
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_LOGICAL();
+}
+
+TRANSLATE(MVN) {
+  struct ir_value *rhs, *res, *carry;
+  rhs = PARSE_OP2(&carry);
+  res = ir_not(ir, rhs);
+
+  STORE_REG(i.data.rd, res);
+  UPDATE_FLAGS_LOGICAL();
+}
+
+/*
+ * multiply and multiply-accumulate
+ */
+#define UPDATE_FLAGS_MUL()                                           \
+  if (i.mul.s) {                                                     \
+    armv3_translate_update_flags(ir, N_MASK | Z_MASK,                \
+                                 armv3_translate_flags_nz(ir, res)); \
+  }
+
+TRANSLATE(MUL) {
+  struct ir_value *a = LOAD_REG(i.mul.rm);
+  struct ir_value *b = LOAD_REG(i.mul.rs);
+  struct ir_value *res = ir_umul(ir, a, b);
+
+  STORE_REG(i.mul.rd, res);
+  UPDATE_FLAGS_MUL();
+}
+
+TRANSLATE(MLA) {
+  struct ir_value *a = LOAD_REG(i.mul.rm);
+  struct ir_value *b = LOAD_REG(i.mul.rs);
+  struct ir_value *c = LOAD_REG(i.mul.rn);
+  struct ir_value *res = ir_add(ir, ir_umul(ir, a, b), c);
+
+  STORE_REG(i.mul.rd, res);
+  UPDATE_FLAGS_MUL();
+}
+
+/*
+ * single data transfer
+ */
+static void armv3_translate_memop(struct armv3_guest *guest, struct ir *ir,
+                                  uint32_t addr, union armv3_instr i) {
+  /* parse offset */
+  struct ir_value *offset = NULL;
+  if (i.xfr.i) {
+    struct ir_value *carry;
+    offset = armv3_translate_parse_shift(ir, addr, i.xfr_reg.rm,
+                                         i.xfr_reg.shift, &carry);
+  } else {
+    offset = ir_alloc_i32(ir, i.xfr_imm.imm);
+  }
+
+  struct ir_value *base = LOAD_RN(i.xfr.rn);
+  struct ir_value *final =
+      i.xfr.u ? ir_add(ir, base, offset) : ir_sub(ir, base, offset);
+  struct ir_value *ea = i.xfr.p ? final : base;
+
+  /*
+   * writeback is applied in pipeline before memory is read.
+   * note, post-increment mode always writes back
+   */
+  if (i.xfr.w || !i.xfr.p) {
+    STORE_REG(i.xfr.rn, final);
+  }
+
+  if (i.xfr.l) {
+    /* load data */
+    struct ir_value *data = NULL;
+    if (i.xfr.b) {
+      data = ir_zext(ir, ir_load_guest(ir, ea, VALUE_I8), VALUE_I32);
+    } else {
+      data = ir_load_guest(ir, ea, VALUE_I32);
+    }
+
+    STORE_REG(i.xfr.rd, data);
+  } else {
+    /* store data */
+    struct ir_value *data = LOAD_RD(i.xfr.rd);
+    if (i.xfr.b) {
+      ir_store_guest(ir, ea, ir_trunc(ir, data, VALUE_I8));
+    } else {
+      ir_store_guest(ir, ea, data);
+    }
+  }
+}
+
+TRANSLATE(LDR) {
+  armv3_translate_memop(guest, ir, addr, i);
+}
+
+TRANSLATE(STR) {
+  armv3_translate_memop(guest, ir, addr, i);
+}
+
+/*
+ * block data transfer
+ */
+#define BLK_EA(offset) ir_add(ir, base, ir_alloc_i32(ir, offset))
+
+TRANSLATE(LDM) {
+  struct ir_value *base = LOAD_RN(i.blk.rn);
+  int offset = popcnt32(i.blk.rlist) * 4;
+  struct ir_value *final = BLK_EA(i.blk.u ? offset : -offset);
+  int ea = 0;
+
+  /* writeback is applied in pipeline before memory is read */
+  if (i.blk.w) {
+    STORE_REG(i.blk.rn, final);
+  }
+
+  for (int bit = 0; bit < 16; bit++) {
+    int reg = bit;
+
+    if (!i.blk.u) {
+      reg = 15 - bit;
+    }
+
+    if (i.blk.rlist & (1 << reg)) {
+      /* pre-increment */
+      if (i.blk.p) {
+        ea = i.blk.u ? ea + 4 : ea - 4;
+      }
+
+      STORE_REG(reg, ir_load_guest(ir, BLK_EA(ea), VALUE_I32));
+
+      /* post-increment */
+      if (!i.blk.p) {
+        ea = i.blk.u ? ea + 4 : ea - 4;
+      }
+    }
+  }
+}
+
+TRANSLATE(STM) {
+  struct ir_value *base = LOAD_RN(i.blk.rn);
+  int offset = popcnt32(i.blk.rlist) * 4;
+  struct ir_value *final = BLK_EA(i.blk.u ? offset : -offset);
+  int ea = 0;
+  int wrote = 0;
+
+  for (int bit = 0; bit < 16; bit++) {
+    int reg = bit;
+
+    if (!i.blk.u) {
+      reg = 15 - bit;
+    }
+
+    if (i.blk.rlist & (1 << reg)) {
+      /* pre-increment */
+      if (i.blk.p) {
+        ea = i.blk.u ? ea + 4 : ea - 4;
+      }
+
+      ir_store_guest(ir, BLK_EA(ea), LOAD_RD(reg));
+
+      /* post-increment */
+      if (!i.blk.p) {
+        ea = i.blk.u ? ea + 4 : ea - 4;
+      }
+
+      /* the base is written back after the first register is stored, see the
+         notes in armv3_fallback_STM */
+      if (i.blk.w && !wrote) {
+        STORE_REG(i.blk.rn, final);
+        wrote = 1;
+      }
+    }
+  }
+}
+
+static armv3_translate_cb armv3_translators[NUM_ARMV3_OPS] = {
+    [ARMV3_OP_B] = &armv3_translate_B,
+    [ARMV3_OP_BL] = &armv3_translate_BL,
+    [ARMV3_OP_AND] = &armv3_translate_AND,
+    [ARMV3_OP_EOR] = &armv3_translate_EOR,
+    [ARMV3_OP_SUB] = &armv3_translate_SUB,
+    [ARMV3_OP_RSB] = &armv3_translate_RSB,
+    [ARMV3_OP_ADD] = &armv3_translate_ADD,
+    [ARMV3_OP_ADC] = &armv3_translate_ADC,
+    [ARMV3_OP_SBC] = &armv3_translate_SBC,
+    [ARMV3_OP_RSC] = &armv3_translate_RSC,
+    [ARMV3_OP_TST] = &armv3_translate_TST,
+    [ARMV3_OP_TEQ] = &armv3_translate_TEQ,
+    [ARMV3_OP_CMP] = &armv3_translate_CMP,
+    [ARMV3_OP_CMN] = &armv3_translate_CMN,
+    [ARMV3_OP_ORR] = &armv3_translate_ORR,
+    [ARMV3_OP_MOV] = &armv3_translate_MOV,
+    [ARMV3_OP_BIC] = &armv3_translate_BIC,
+    [ARMV3_OP_MVN] = &armv3_translate_MVN,
+    [ARMV3_OP_MUL] = &armv3_translate_MUL,
+    [ARMV3_OP_MLA] = &armv3_translate_MLA,
+    [ARMV3_OP_LDR] = &armv3_translate_LDR,
+    [ARMV3_OP_STR] = &armv3_translate_STR,
+    [ARMV3_OP_LDM] = &armv3_translate_LDM,
+    [ARMV3_OP_STM] = &armv3_translate_STM,
+};
+
+/* rare forms of the translated instructions are left to the fallbacks. this
+   covers writes to the pc (which may restore the mode from the spsr), user
+   bank transfers and register specified shift amounts */
+static int armv3_translate_supported(const struct jit_opdef *def,
+                                     union armv3_instr i) {
+  if (def->flags & FLAG_DATA) {
+    if (i.data.rd == 15) {
+      return 0;
+    }
+
+    /* bit 4 of the operand is set for register specified shift amounts */
+    if (!i.data.i && (i.data_reg.shift & 0x1)) {
+      return 0;
+    }
+  }
+
+  if (def->flags & FLAG_MUL) {
+    if (i.mul.rd == 15 || i.mul.rm == 15 || i.mul.rs == 15 ||
+        (i.mul.a && i.mul.rn == 15)) {
+      return 0;
+    }
+  }
+
+  if (def->flags & FLAG_XFR) {
+    if (i.xfr.l && i.xfr.rd == 15) {
+      return 0;
+    }
+
+    if (i.xfr.rn == 15 && (i.xfr.w || !i.xfr.p)) {
+      return 0;
+    }
+
+    if (i.xfr.i && (i.xfr_reg.shift & 0x1)) {
+      return 0;
+    }
+  }
+
+  if (def->flags & FLAG_BLK) {
+    if (i.blk.s || i.blk.rn == 15 || !i.blk.rlist) {
+      return 0;
+    }
+
+    if (i.blk.l && (i.blk.rlist & (1 << 15))) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static struct ir_block *armv3_translate_current_block(struct ir *ir) {
+  struct ir_insert_point point = ir_get_insert_point(ir);
+  return point.block ? point.block : point.instr->block;
+}
+
+int armv3_translate(struct armv3_guest *guest, struct ir *ir, uint32_t addr,
+                    union armv3_instr i) {
+  int op = armv3_get_op(i.raw);
+  armv3_translate_cb cb = armv3_translators[op];
+
+  if (!cb || !armv3_translate_supported(&armv3_opdefs[op], i)) {
+    return 0;
+  }
+
+  uint32_t cond = i.raw >> 28;
+
+  if (cond == COND_AL) {
+    cb(guest, ir, addr, i);
+    return 1;
+  }
+
+  /* the instruction is never executed */
+  if (cond == COND_NV) {
+    return 1;
+  }
+
+  /* conditionally execute the instruction by branching around it. the new
+     blocks are tagged with their guest address for the branches to them */
+  struct ir_block *cond_block = armv3_translate_current_block(ir);
+  struct ir_block *exec_block = ir_insert_block(ir, cond_block);
+  struct ir_block *next_block = ir_insert_block(ir, exec_block);
+  ir_set_meta(ir, exec_block, IR_META_ADDR, ir_alloc_i32(ir, addr));
+  ir_set_meta(ir, next_block, IR_META_ADDR, ir_alloc_i32(ir, addr + 4));
+
+  struct ir_value *exec = armv3_translate_cond(ir, cond);
+  ir_branch_cond(ir, exec, ir_alloc_block_ref(ir, exec_block),
+                 ir_alloc_block_ref(ir, next_block));
+
+  ir_set_current_block(ir, exec_block);
+  cb(guest, ir, addr, i);
+
+  /* fall through to the next instruction if the translation didn't branch */
+  struct ir_instr *last_instr =
+      list_last_entry(&exec_block->instrs, struct ir_instr, it);
+
+  if (last_instr->op != OP_BRANCH) {
+    ir_branch(ir, ir_alloc_block_ref(ir, next_block));
+  }
+
+  ir_set_current_block(ir, next_block);
+
+  return 1;
+}
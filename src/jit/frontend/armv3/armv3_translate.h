@@ -0,0 +1,17 @@
+#ifndef ARMV3_TRANSLATE_H
+#define ARMV3_TRANSLATE_H
+
+#include "jit/frontend/armv3/armv3_disasm.h"
+
+struct armv3_guest;
+struct ir;
+
+typedef void (*armv3_translate_cb)(struct armv3_guest *, struct ir *, uint32_t,
+                                   union armv3_instr);
+
+/* emits the instruction's translation, returning 0 if the instruction (or the
+   particular form of it) has no translation and must fallback */
+int armv3_translate(struct armv3_guest *guest, struct ir *ir, uint32_t addr,
+                    union armv3_instr i);
+
+#endif
@@ -38,6 +38,11 @@ static inline int32_t vmul_f32_el(int32_t a, int32_t b) {
   return *(int32_t *)&r;
 }
 
+static inline int32_t vmadd_f32_el(int32_t a, int32_t b, int32_t c) {
+  float r = *(float *)&a * *(float *)&b + *(float *)&c;
+  return *(int32_t *)&r;
+}
+
 static inline float vdot_f32(int32_t *a, int32_t *b) {
   return *(float *)&a[0] * *(float *)&b[0] + *(float *)&a[1] * *(float *)&b[1] +
          *(float *)&a[2] * *(float *)&b[2] + *(float *)&a[3] * *(float *)&b[3];
@@ -308,6 +313,10 @@ typedef int32_t int128_t[4];
                                       vmul_f32_el((a)[1], (b)[1]), \
                                       vmul_f32_el((a)[2], (b)[2]), \
                                       vmul_f32_el((a)[3], (b)[3])}
+#define VMADD_F32(a, b, c)           {vmadd_f32_el((a)[0], (b)[0], (c)[0]), \
+                                      vmadd_f32_el((a)[1], (b)[1], (c)[1]), \
+                                      vmadd_f32_el((a)[2], (b)[2], (c)[2]), \
+                                      vmadd_f32_el((a)[3], (b)[3], (c)[3])}
 #define VDOT_F32(a, b)               vdot_f32(a, b)
 
 #define AND_I8(a, b)                 ((a) & (b))
@@ -388,8 +397,9 @@ typedef int32_t int128_t[4];
 
 /* clang-format on */
 
-#define INSTR(name)                                                \
-  void sh4_fallback_##name(struct sh4_guest *guest, uint32_t addr, \
-                           union sh4_instr i)
+#define INSTR(name)                                                      \
+  JIT_FALLBACK_SECTION void sh4_fallback_##name(struct sh4_guest *guest, \
+                                                uint32_t addr,           \
+                                                union sh4_instr i)
 #include "jit/frontend/sh4/sh4_instr.h"
 #undef INSTR
@@ -7,6 +7,7 @@
 #include "jit/jit.h"
 #include "jit/jit_frontend.h"
 #include "jit/jit_guest.h"
+#include "options.h"
 
 /*
  * fsca estimate lookup table, used by the jit and interpreter
@@ -15,6 +16,12 @@ uint32_t sh4_fsca_table[0x20000] = {
 #include "jit/frontend/sh4/sh4_fsca.inc"
 };
 
+/* upper bound on the size of a region, in bytes. each region is a contiguous
+   range of guest code spanning one or more basic blocks, formed by continuing
+   past conditional branches, and past unconditional branches to reach the
+   targets of forward branches */
+#define SH4_MAX_REGION_SIZE 2048
+
 struct sh4_frontend {
   struct jit_frontend;
 };
@@ -38,6 +45,18 @@ static int sh4_frontend_is_terminator(struct jit_opdef *def) {
   return 0;
 }
 
+static int sh4_frontend_is_region_branch(struct jit_opdef *def) {
+  /* conditional branches fall through to the next instruction when not taken,
+     so the region can keep going */
+  return def->op == SH4_OP_BT || def->op == SH4_OP_BTS ||
+         def->op == SH4_OP_BF || def->op == SH4_OP_BFS;
+}
+
+static int sh4_frontend_is_static_branch(struct jit_opdef *def) {
+  return sh4_frontend_is_region_branch(def) || def->op == SH4_OP_BRA ||
+         def->op == SH4_OP_BSR;
+}
+
 static int sh4_frontend_is_idle_loop(struct sh4_frontend *frontend,
                                      uint32_t begin_addr) {
   struct sh4_guest *guest = (struct sh4_guest *)frontend->guest;
@@ -125,6 +144,114 @@ static void sh4_frontend_dump_code(struct jit_frontend *base,
   }
 }
 
+static int sh4_frontend_translate_flags(struct jit_frontend *base) {
+  struct sh4_frontend *frontend = (struct sh4_frontend *)base;
+  struct sh4_guest *guest = (struct sh4_guest *)frontend->guest;
+  struct sh4_context *ctx = (struct sh4_context *)guest->ctx;
+
+  int flags = 0;
+  if (ctx->fpscr & PR_MASK) {
+    flags |= SH4_DOUBLE_PR;
+  }
+  if (ctx->fpscr & SZ_MASK) {
+    flags |= SH4_DOUBLE_SZ;
+  }
+  return flags;
+}
+
+static void sh4_frontend_find_blocks(struct sh4_frontend *frontend,
+                                     uint32_t begin_addr, int size,
+                                     int8_t *leaders) {
+  struct jit_guest *guest = frontend->guest;
+  int8_t instrs[SH4_MAX_REGION_SIZE / 2 + 2] = {0};
+  uint32_t targets[SH4_MAX_REGION_SIZE / 2 + 2];
+  int num_targets = 0;
+  int offset = 0;
+
+  /* each basic block in the region starts at either the instruction following
+     a branch, or at the target of a branch back into the region */
+  leaders[0] = 1;
+
+  while (offset < size) {
+    uint32_t addr = begin_addr + offset;
+    uint16_t data = guest->r16(guest->mem, addr);
+    union sh4_instr instr = {data};
+    struct jit_opdef *def = sh4_get_opdef(data);
+
+    instrs[offset / 2] = 1;
+    offset += 2;
+
+    if (def->flags & SH4_FLAG_DELAYED) {
+      offset += 2;
+    }
+
+    if (def->flags & SH4_FLAG_STORE_PC) {
+      if (offset < size) {
+        leaders[offset / 2] = 1;
+      }
+
+      int branch_type;
+      uint32_t branch_addr;
+      uint32_t next_addr;
+      sh4_branch_info(addr, instr, &branch_type, &branch_addr, &next_addr);
+
+      if (branch_type == SH4_BRANCH_STATIC ||
+          branch_type == SH4_BRANCH_STATIC_TRUE ||
+          branch_type == SH4_BRANCH_STATIC_FALSE) {
+        targets[num_targets++] = branch_addr;
+      }
+    }
+  }
+
+  /* only targets which land on an instruction (not a delay slot) inside of the
+     region can be branched to directly */
+  for (int i = 0; i < num_targets; i++) {
+    uint32_t target_offset = targets[i] - begin_addr;
+
+    if (target_offset < (uint32_t)size && instrs[target_offset / 2] &&
+        !(target_offset & 1)) {
+      leaders[target_offset / 2] = 1;
+    }
+  }
+}
+
+static void sh4_frontend_link_blocks(struct ir *ir, uint32_t begin_addr,
+                                     int size, struct ir_block **blocks) {
+  list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
+    struct ir_instr *last_instr =
+        list_last_entry(&block->instrs, struct ir_instr, it);
+
+    /* explicitly fall through to the next block in the region */
+    if (last_instr->op != OP_BRANCH && last_instr->op != OP_BRANCH_COND) {
+      struct ir_block *next_block = list_next_entry(block, struct ir_block, it);
+      CHECK_NOTNULL(next_block);
+      ir_set_current_instr(ir, last_instr);
+      ir_branch(ir, ir_alloc_block_ref(ir, next_block));
+      continue;
+    }
+
+    /* replace static branches to addresses inside of the region with local
+       branches to the block */
+    for (int i = 0; i < 2; i++) {
+      struct ir_value *target = last_instr->arg[i];
+
+      if (!target || !ir_is_constant(target) || target->type != VALUE_I32) {
+        continue;
+      }
+
+      uint32_t target_offset = target->i32 - begin_addr;
+
+      if (target_offset >= (uint32_t)size || (target_offset & 1) ||
+          !blocks[target_offset / 2]) {
+        continue;
+      }
+
+      ir_set_arg(ir, last_instr, i,
+                 ir_alloc_block_ref(ir, blocks[target_offset / 2]));
+    }
+  }
+}
+
 static void sh4_frontend_translate_code(struct jit_frontend *base,
                                         uint32_t begin_addr, int size,
                                         struct ir *ir) {
@@ -134,19 +261,19 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
 
   int offset = 0;
   int use_fpscr = 0;
-  int was_delay = 0;
+
+  CHECK_LE(size, SH4_MAX_REGION_SIZE + 2);
+
+  /* find the basic blocks making up the region */
+  int8_t leaders[SH4_MAX_REGION_SIZE / 2 + 2] = {0};
+  struct ir_block *blocks[SH4_MAX_REGION_SIZE / 2 + 2] = {0};
+  sh4_frontend_find_blocks(frontend, begin_addr, size, leaders);
 
   /* append inital block */
   struct ir_block *block = ir_append_block(ir);
 
   /* generate code specialized for the current fpscr state */
-  int flags = 0;
-  if (ctx->fpscr & PR_MASK) {
-    flags |= SH4_DOUBLE_PR;
-  }
-  if (ctx->fpscr & SZ_MASK) {
-    flags |= SH4_DOUBLE_SZ;
-  }
+  int flags = sh4_frontend_translate_flags(base);
 
   /* cheap idle skip. in an idle loop, the block is just spinning, waiting for
      an interrupt such as vblank before it'll exit. scale the block's number of
@@ -156,18 +283,26 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
   int cycle_scale = idle_loop ? 8 : 1;
 
   while (offset < size) {
-    /* if a branch instruction / delay slot was just emitted, rewind and emit
-       the delay slot as its own instruction */
-    if (was_delay) {
-      offset -= 2;
-      was_delay = 0;
-    }
-
     uint32_t addr = begin_addr + offset;
     uint16_t data = guest->r16(guest->mem, addr);
     union sh4_instr instr = {data};
     struct jit_opdef *def = sh4_get_opdef(data);
 
+    /* start a new ir block for each basic block in the region, tagging it with
+       its guest address for when it's branched to */
+    if (leaders[offset / 2]) {
+      struct ir_block *tail_block =
+          list_last_entry(&ir->blocks, struct ir_block, it);
+
+      if (offset) {
+        tail_block = ir_insert_block(ir, tail_block);
+      }
+
+      ir_set_current_block(ir, tail_block);
+      ir_set_meta(ir, tail_block, IR_META_ADDR, ir_alloc_i32(ir, addr));
+      blocks[offset / 2] = tail_block;
+    }
+
     use_fpscr |= (def->flags & SH4_FLAG_USE_FPSCR) == SH4_FLAG_USE_FPSCR;
 
     /* emit meta information for the current guest instruction. this info is
@@ -224,7 +359,6 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
         ir_set_insert_point(ir, &original);
 
         offset += 2;
-        was_delay = 1;
       }
     } else {
       ir_fallback(ir, def->fallback, addr, data);
@@ -235,7 +369,6 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
          execute it */
       if (def->flags & SH4_FLAG_DELAYED) {
         offset += 2;
-        was_delay = 1;
       }
     }
 
@@ -251,7 +384,7 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
            not a branch (e.g. an invalid instruction trap); nothing needs to be
            done dispatch will always implicitly branch to the next pc */
     int store_pc = (def->flags & SH4_FLAG_STORE_PC) == SH4_FLAG_STORE_PC;
-    int end_of_block = sh4_frontend_is_terminator(def) || offset >= size;
+    int end_of_block = offset >= size;
 
     if (end_of_block) {
       if (!store_pc) {
@@ -267,6 +400,9 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
     }
   }
 
+  /* branch directly between the basic blocks inside of the region */
+  sh4_frontend_link_blocks(ir, begin_addr, size, blocks);
+
   /* if the block makes optimizations based on the fpscr state, assert that the
      run-time fpscr state matches the compile-time state */
   if (use_fpscr) {
@@ -290,33 +426,100 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
 }
 
 static void sh4_frontend_analyze_code(struct jit_frontend *base,
-                                      uint32_t begin_addr, int *size) {
+                                      uint32_t begin_addr, int flags,
+                                      int *size) {
   struct sh4_frontend *frontend = (struct sh4_frontend *)base;
   struct sh4_guest *guest = (struct sh4_guest *)frontend->guest;
 
+  /* idle loops are left as a single basic block, as their cycles are scaled
+     for the entire block */
+  int max_size = OPTION_jit_region_size * 2;
+
+  /* hot code is worth compiling wider regions for */
+  if (flags & JIT_ANALYZE_HOT) {
+    max_size *= 4;
+  }
+
+  max_size = MIN(max_size, SH4_MAX_REGION_SIZE);
+
+  if (sh4_frontend_is_idle_loop(frontend, begin_addr)) {
+    max_size = 0;
+  }
+
   *size = 0;
 
+  /* the end of the furthest target of a forward static branch seen so far
+     which fits in the region. the region continues until it's been reached */
+  int target_end = 0;
+
+  /* the region has continued past an unconditional branch, and the code being
+     scanned may only be reachable from outside of the region, or may not be
+     code at all */
+  int unreachable = 0;
+
   while (1) {
     uint32_t addr = begin_addr + *size;
     uint16_t data = guest->r16(guest->mem, addr);
+    union sh4_instr instr = {data};
     struct jit_opdef *def = sh4_get_opdef(data);
-
-    *size += 2;
+    int all_flags = def->flags;
 
     if (def->flags & SH4_FLAG_DELAYED) {
-      uint32_t delay_addr = begin_addr + *size;
-      uint16_t delay_data = guest->r16(guest->mem, delay_addr);
+      uint16_t delay_data = guest->r16(guest->mem, addr + 2);
       struct jit_opdef *delay_def = sh4_get_opdef(delay_data);
 
+      /* delay slots can't have another delay slot. however, unreachable code
+         may really be data, end the region before it instead */
+      if (delay_def->flags & SH4_FLAG_DELAYED) {
+        CHECK(unreachable);
+        break;
+      }
+
+      all_flags |= delay_def->flags;
       *size += 2;
+    }
 
-      /* delay slots can't have another delay slot */
-      CHECK(!(delay_def->flags & SH4_FLAG_DELAYED));
+    *size += 2;
+
+    if (sh4_frontend_is_static_branch(def)) {
+      int branch_type;
+      uint32_t branch_addr;
+      uint32_t next_addr;
+      sh4_branch_info(addr, instr, &branch_type, &branch_addr, &next_addr);
+
+      uint32_t target_offset = branch_addr - begin_addr;
+
+      if (target_offset < (uint32_t)max_size) {
+        target_end = MAX(target_end, (int)target_offset + 2);
+      }
     }
 
-    if (sh4_frontend_is_terminator(def)) {
+    /* if fpscr changed, the code after the branch can't be specialized for
+       the same fpscr state */
+    int store_fpscr = all_flags & SH4_FLAG_STORE_FPSCR;
+
+    /* continue the region past conditional branches until it's full */
+    if (sh4_frontend_is_region_branch(def) && !store_fpscr &&
+        *size < max_size) {
+      continue;
+    }
+
+    /* continue past unconditional branches until the targets of the forward
+       branches seen so far are inside of the region */
+    if ((def->op == SH4_OP_BRA || def->op == SH4_OP_BSR) && !store_fpscr &&
+        *size < target_end) {
+      unreachable = 1;
+      continue;
+    }
+
+    if (sh4_frontend_is_terminator(def) || store_fpscr ||
+        *size >= SH4_MAX_REGION_SIZE) {
       break;
     }
+
+    if (*size >= target_end) {
+      unreachable = 0;
+    }
   }
 }
 
@@ -332,6 +535,7 @@ struct jit_frontend *sh4_frontend_create(struct jit_guest *guest) {
   frontend->guest = guest;
   frontend->destroy = &sh4_frontend_destroy;
   frontend->analyze_code = &sh4_frontend_analyze_code;
+  frontend->translate_flags = &sh4_frontend_translate_flags;
   frontend->translate_code = &sh4_frontend_translate_code;
   frontend->dump_code = &sh4_frontend_dump_code;
   frontend->lookup_op = &sh4_frontend_lookup_op;
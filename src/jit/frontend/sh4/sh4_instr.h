@@ -2135,20 +2135,17 @@ INSTR(FTRV) {
   F32 el1 = LOAD_FPR_F32(n + 1);
   V128 col1 = LOAD_XFR_V128(4);
   V128 row1 = VBROADCAST_F32(el1);
-  V128 prod1 = VMUL_F32(col1, row1);
-  V128 result1 = VADD_F32(result0, prod1);
+  V128 result1 = VMADD_F32(col1, row1, result0);
 
   F32 el2 = LOAD_FPR_F32(n + 2);
   V128 col2 = LOAD_XFR_V128(8);
   V128 row2 = VBROADCAST_F32(el2);
-  V128 prod2 = VMUL_F32(col2, row2);
-  V128 result2 = VADD_F32(result1, prod2);
+  V128 result2 = VMADD_F32(col2, row2, result1);
 
   F32 el3 = LOAD_FPR_F32(n + 3);
   V128 col3 = LOAD_XFR_V128(12);
   V128 row3 = VBROADCAST_F32(el3);
-  V128 prod3 = VMUL_F32(col3, row3);
-  V128 result3 = VADD_F32(result2, prod3);
+  V128 result3 = VMADD_F32(col3, row3, result2);
 
   STORE_FPR_V128(n, result3);
   NEXT_INSTR();
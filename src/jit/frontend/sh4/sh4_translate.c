@@ -350,6 +350,7 @@ static void store_fpscr(struct sh4_guest *guest, struct ir *ir,
 #define VBROADCAST_F32(a)            ir_vbroadcast(ir, a)
 #define VADD_F32(a, b)               ir_vadd(ir, a, b, VALUE_F32)
 #define VMUL_F32(a, b)               ir_vmul(ir, a, b, VALUE_F32)
+#define VMADD_F32(a, b, c)           ir_vmadd(ir, a, b, c, VALUE_F32)
 #define VDOT_F32(a, b)               ir_vdot(ir, a, b, VALUE_F32)
 
 #define AND_I8(a, b)                 ir_and(ir, a, b)
@@ -419,28 +420,28 @@ static void store_fpscr(struct sh4_guest *guest, struct ir *ir,
 #define BRANCH_COND_IMM_I32(c, t, f) ir_branch_cond(ir, c, ir_alloc_i32(ir, t), ir_alloc_i32(ir, f))
 
 #define INVALID_INSTR()              {                                                                                     \
-                                        struct ir_value *invalid_instr = ir_alloc_i64(ir, (uint64_t)guest->invalid_instr); \
-                                        struct ir_value *data = ir_alloc_i64(ir, (uint64_t)guest->data);                   \
+                                        struct ir_value *invalid_instr = ir_alloc_ptr(ir, guest->invalid_instr);           \
+                                        struct ir_value *data = ir_alloc_ptr(ir, guest->data);                             \
                                         ir_call_1(ir, invalid_instr, data);                                                \
                                      }
 
 
 #define LDTLB()                      {                                                                   \
-                                        struct ir_value *ltlb = ir_alloc_i64(ir, (uint64_t)guest->ltlb); \
-                                        struct ir_value *data = ir_alloc_i64(ir, (uint64_t)guest->data); \
+                                        struct ir_value *ltlb = ir_alloc_ptr(ir, guest->ltlb);           \
+                                        struct ir_value *data = ir_alloc_ptr(ir, guest->data);           \
                                         ir_call_1(ir, ltlb, data);                                       \
                                      }
 
 
 #define PREF_COND(c, addr)           {                                                                   \
-                                        struct ir_value *pref = ir_alloc_i64(ir, (uint64_t)guest->pref); \
-                                        struct ir_value *data = ir_alloc_i64(ir, (uint64_t)guest->data); \
+                                        struct ir_value *pref = ir_alloc_ptr(ir, guest->pref);           \
+                                        struct ir_value *data = ir_alloc_ptr(ir, guest->data);           \
                                         ir_call_cond_2(ir, c, pref, data, addr);                         \
                                      }
 
 #define SLEEP()                      {                                                                     \
-                                        struct ir_value *sleep = ir_alloc_i64(ir, (uint64_t)guest->sleep); \
-                                        struct ir_value *data = ir_alloc_i64(ir, (uint64_t)guest->data);   \
+                                        struct ir_value *sleep = ir_alloc_ptr(ir, guest->sleep);           \
+                                        struct ir_value *data = ir_alloc_ptr(ir, guest->data);             \
                                         ir_call_1(ir, sleep, data);                                        \
                                      }
 
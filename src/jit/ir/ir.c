@@ -9,7 +9,7 @@ const struct ir_opdef ir_opdefs[IR_NUM_OPS] = {
 };
 
 const char *ir_meta_names[IR_NUM_META] = {
-    "addr", "cycles",
+    "addr", "cycles", "counter", "threshold",
 };
 
 static void *ir_calloc(struct ir *ir, int size) {
@@ -153,6 +153,32 @@ void ir_add_edge(struct ir *ir, struct ir_block *src, struct ir_block *dst) {
   }
 }
 
+int ir_is_loop_header(struct ir *ir, struct ir_block *block) {
+  /* check for a backwards branch to the block from itself or a block after it.
+     note, this scans the branch targets directly as opposed to using the edges
+     from the control flow analysis pass, as they're not always available */
+  struct ir_block *next = block;
+
+  while (next) {
+    struct ir_instr *last_instr =
+        list_last_entry(&next->instrs, struct ir_instr, it);
+
+    if (last_instr->op == OP_BRANCH || last_instr->op == OP_BRANCH_COND) {
+      for (int i = 0; i < 2; i++) {
+        struct ir_value *target = last_instr->arg[i];
+
+        if (target && target->type == VALUE_BLOCK && target->blk == block) {
+          return 1;
+        }
+      }
+    }
+
+    next = list_next_entry(next, struct ir_block, it);
+  }
+
+  return 0;
+}
+
 struct ir_instr *ir_append_instr(struct ir *ir, enum ir_op op,
                                  enum ir_type result_type) {
   /* allocate instruction and its result if needed */
@@ -269,7 +295,9 @@ struct ir_value *ir_alloc_f64(struct ir *ir, double c) {
 }
 
 struct ir_value *ir_alloc_ptr(struct ir *ir, void *c) {
-  return ir_alloc_i64(ir, (uint64_t)c);
+  struct ir_value *v = ir_alloc_i64(ir, (uint64_t)c);
+  v->ptr = 1;
+  return v;
 }
 
 struct ir_value *ir_alloc_block_ref(struct ir *ir, struct ir_block *block) {
@@ -827,6 +855,20 @@ struct ir_value *ir_vmul(struct ir *ir, struct ir_value *a, struct ir_value *b,
   return instr->result;
 }
 
+struct ir_value *ir_vmadd(struct ir *ir, struct ir_value *a,
+                          struct ir_value *b, struct ir_value *c,
+                          enum ir_type el_type) {
+  CHECK(ir_is_vector(a->type) && ir_is_vector(b->type) &&
+        ir_is_vector(c->type));
+  CHECK_EQ(el_type, VALUE_F32);
+
+  struct ir_instr *instr = ir_append_instr(ir, OP_VMADD, a->type);
+  ir_set_arg0(ir, instr, a);
+  ir_set_arg1(ir, instr, b);
+  ir_set_arg2(ir, instr, c);
+  return instr->result;
+}
+
 struct ir_value *ir_vdot(struct ir *ir, struct ir_value *a, struct ir_value *b,
                          enum ir_type el_type) {
   CHECK(ir_is_vector(a->type) && ir_is_vector(b->type));
@@ -935,7 +977,7 @@ struct ir_value *ir_lshd(struct ir *ir, struct ir_value *a,
 }
 
 void ir_branch(struct ir *ir, struct ir_value *dst) {
-  CHECK(dst->type == VALUE_I32);
+  CHECK(dst->type == VALUE_I32 || dst->type == VALUE_BLOCK);
 
   struct ir_instr *instr = ir_append_instr(ir, OP_BRANCH, VALUE_V);
   ir_set_arg0(ir, instr, dst);
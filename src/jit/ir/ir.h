@@ -7,6 +7,7 @@
 
 #define IR_MAX_ARGS 4
 #define IR_MAX_CONTEXT 512
+#define IR_MAX_PROMOTED 12
 
 enum ir_op {
 #define IR_OP(name, flags) OP_##name,
@@ -19,6 +20,15 @@ enum ir_flags {
   IR_FLAG_CALL = 0x1,
 };
 
+/* 8 and 16-bit guest loads may have the extension of their result folded into
+   them by the conversion elimination pass. the extension is encoded as an
+   optional second argument, a constant whose type is the width of the memory
+   access and whose value is one of the following */
+enum ir_load_ext {
+  IR_LOAD_SEXT = 1,
+  IR_LOAD_ZEXT,
+};
+
 enum ir_type {
   VALUE_V,
   VALUE_I8,
@@ -48,6 +58,8 @@ enum ir_cmp {
 enum ir_meta_type {
   IR_META_ADDR,
   IR_META_CYCLES,
+  IR_META_COUNTER,
+  IR_META_THRESHOLD,
   IR_NUM_META,
 };
 
@@ -88,6 +100,9 @@ struct ir_value {
     struct ir_block *blk;
   };
 
+  /* constant is a host pointer, only valid in the process it was created in */
+  int ptr;
+
   /* instruction that defines this value (non-constant values) */
   struct ir_instr *def;
 
@@ -164,6 +179,18 @@ struct ir_insert_point {
   struct ir_instr *instr;
 };
 
+/* context values which live in a host register for the entire ir unit, rather
+   than being loaded and stored on each access */
+struct ir_promoted {
+  int offset;
+  enum ir_type type;
+  int reg;
+
+  /* value is written to by the ir. values which are only read never need to
+     be written back to the context */
+  int dirty;
+};
+
 struct ir {
   /* backing memory buffer used by all allocations */
   uint8_t *buffer;
@@ -179,6 +206,10 @@ struct ir {
   /* total size of locals allocated */
   int locals_size;
 
+  /* context values promoted to host registers by the register allocator */
+  struct ir_promoted promoted[IR_MAX_PROMOTED];
+  int num_promoted;
+
   /* hashtables for each kind of meta data, keyed by each user's pointer */
   DECLARE_HASHTABLE(meta[IR_NUM_META], 7);
 };
@@ -225,6 +256,16 @@ static inline int ir_is_constant(const struct ir_value *v) {
   return !v->def;
 }
 
+static inline const struct ir_promoted *ir_get_promoted(const struct ir *ir,
+                                                        int offset) {
+  for (int i = 0; i < ir->num_promoted; i++) {
+    if (ir->promoted[i].offset == offset) {
+      return &ir->promoted[i];
+    }
+  }
+  return NULL;
+}
+
 int ir_read(FILE *input, struct ir *ir);
 void ir_write(struct ir *ir, FILE *output);
 
@@ -238,6 +279,7 @@ struct ir_block *ir_append_block(struct ir *ir);
 struct ir_block *ir_split_block(struct ir *ir, struct ir_instr *before);
 void ir_remove_block(struct ir *ir, struct ir_block *block);
 void ir_add_edge(struct ir *ir, struct ir_block *src, struct ir_block *dst);
+int ir_is_loop_header(struct ir *ir, struct ir_block *block);
 
 struct ir_instr *ir_append_instr(struct ir *ir, enum ir_op op,
                                  enum ir_type result_type);
@@ -379,6 +421,10 @@ struct ir_value *ir_vadd(struct ir *ir, struct ir_value *a, struct ir_value *b,
                          enum ir_type el_type);
 struct ir_value *ir_vmul(struct ir *ir, struct ir_value *a, struct ir_value *b,
                          enum ir_type el_type);
+/* a * b + c */
+struct ir_value *ir_vmadd(struct ir *ir, struct ir_value *a,
+                          struct ir_value *b, struct ir_value *c,
+                          enum ir_type el_type);
 struct ir_value *ir_vdot(struct ir *ir, struct ir_value *a, struct ir_value *b,
                          enum ir_type el_type);
 
@@ -316,6 +316,14 @@ static int ir_parse_label(struct ir_parser *p, int *label) {
 
 static int ir_parse_constant(struct ir_parser *p, enum ir_type type,
                              struct ir_value **value) {
+  /* host pointers are prefixed to distinguish them from plain integers */
+  int ptr = 0;
+  if (type == VALUE_I64 && p->tok == TOK_IDENTIFIER &&
+      !strcmp(p->val.s, "ptr")) {
+    ptr = 1;
+    ir_lex_next(p);
+  }
+
   if (p->tok != TOK_INTEGER) {
     LOG_INFO("unexpected token %d when parsing constant", p->tok);
     return 0;
@@ -337,6 +345,7 @@ static int ir_parse_constant(struct ir_parser *p, enum ir_type type,
     case VALUE_I64: {
       uint64_t v = (uint64_t)p->val.i;
       *value = ir_alloc_i64(p->ir, v);
+      (*value)->ptr = ptr;
     } break;
     case VALUE_F32: {
       uint32_t v = (uint32_t)p->val.i;
@@ -365,7 +374,7 @@ static int ir_parse_arg(struct ir_parser *p, struct ir_instr *instr, int arg) {
   }
 
   /* parse value */
-  if (p->tok == TOK_IDENTIFIER) {
+  if (p->tok == TOK_IDENTIFIER && strcmp(p->val.s, "ptr")) {
     const char *ident = p->val.s;
 
     if (ident[0] != '%') {
@@ -92,7 +92,7 @@ static void ir_write_value(struct ir_writer *w, const struct ir_value *value,
         fprintf(output, "0x%x", value->i32);
         break;
       case VALUE_I64:
-        fprintf(output, "0x%" PRIx64, value->i64);
+        fprintf(output, "%s0x%" PRIx64, value->ptr ? "ptr " : "", value->i64);
         break;
       case VALUE_F32: {
         float v = value->f32;
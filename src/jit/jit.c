@@ -2,93 +2,184 @@
 #include "core/core.h"
 #include "core/exception_handler.h"
 #include "core/filesystem.h"
+#include "core/md5.h"
+#include "core/memory.h"
+#include "core/version.h"
 #include "jit/ir/ir.h"
 #include "jit/jit_backend.h"
 #include "jit/jit_frontend.h"
+#include "jit/jit_guest.h"
+#include "jit/jit_profiler.h"
 #include "jit/passes/constant_propagation_pass.h"
 #include "jit/passes/control_flow_analysis_pass.h"
+#include "jit/passes/conversion_elimination_pass.h"
 #include "jit/passes/dead_code_elimination_pass.h"
 #include "jit/passes/expression_simplification_pass.h"
 #include "jit/passes/load_store_elimination_pass.h"
 #include "jit/passes/register_allocation_pass.h"
 #include "options.h"
+#include "stats.h"
 
 #if PLATFORM_DARWIN || PLATFORM_LINUX
 #include <unistd.h>
 #endif
 
-static int block_map_cmp(const struct rb_node *rb_lhs,
-                         const struct rb_node *rb_rhs) {
-  const struct jit_block *lhs =
-      container_of(rb_lhs, const struct jit_block, it);
-  const struct jit_block *rhs =
-      container_of(rb_rhs, const struct jit_block, it);
+static int page_map_cmp(const struct rb_node *rb_lhs,
+                        const struct rb_node *rb_rhs) {
+  const struct jit_page *lhs = container_of(rb_lhs, const struct jit_page, it);
+  const struct jit_page *rhs = container_of(rb_rhs, const struct jit_page, it);
 
-  if (lhs->guest_addr < rhs->guest_addr) {
+  if (lhs->addr < rhs->addr) {
     return -1;
-  } else if (lhs->guest_addr > rhs->guest_addr) {
+  } else if (lhs->addr > rhs->addr) {
     return 1;
   } else {
     return 0;
   }
 }
 
-static int reverse_block_map_cmp(const struct rb_node *rb_lhs,
-                                 const struct rb_node *rb_rhs) {
-  const struct jit_block *lhs =
-      container_of(rb_lhs, const struct jit_block, rit);
-  const struct jit_block *rhs =
-      container_of(rb_rhs, const struct jit_block, rit);
+static struct rb_callbacks page_map_cb = {
+    &page_map_cmp, NULL, NULL,
+};
 
-  if (lhs->host_addr < rhs->host_addr) {
-    return -1;
-  } else if (lhs->host_addr > rhs->host_addr) {
-    return 1;
-  } else {
-    return 0;
+static struct jit_block *jit_get_block(struct jit *jit, uint32_t guest_addr) {
+  return jit_block_map_find(&jit->blocks, guest_addr);
+}
+
+/* each thread's copy of this has a unique address, identifying the thread */
+static _Thread_local int jit_thread_id;
+
+static struct jit_block *jit_lookup_block_reverse(struct jit *jit,
+                                                  void *host_addr) {
+  return jit_block_index_find(&jit->reverse_blocks, host_addr);
+}
+
+static struct jit_page *jit_get_page(struct jit *jit, uintptr_t addr) {
+  struct jit_page search;
+  search.addr = addr;
+
+  return rb_find_entry(&jit->pages, &search, struct jit_page, it,
+                       &page_map_cb);
+}
+
+static int jit_protect_page(struct jit *jit, uintptr_t addr) {
+  struct jit_guest *guest = jit->backend->guest;
+  struct jit_page *page = jit_get_page(jit, addr);
+
+  if (!page) {
+    page = calloc(1, sizeof(struct jit_page));
+    page->addr = addr;
+    rb_insert(&jit->pages, &page->it, &page_map_cb);
   }
+
+  if (!page->readonly) {
+    if (!guest->protect(guest->mem, (uint8_t *)addr, (int)jit->page_size)) {
+      return 0;
+    }
+
+    page->readonly = 1;
+  }
+
+  return 1;
 }
 
-static struct rb_callbacks block_map_cb = {
-    &block_map_cmp, NULL, NULL,
-};
+static void jit_free_pages(struct jit *jit) {
+  struct jit_guest *guest = jit->backend->guest;
 
-static struct rb_callbacks reverse_block_map_cb = {
-    &reverse_block_map_cmp, NULL, NULL,
-};
+  rb_for_each_entry_safe(page, &jit->pages, struct jit_page, it) {
+    if (page->readonly) {
+      guest->unprotect(guest->mem, (uint8_t *)page->addr, (int)jit->page_size);
+    }
 
-static struct jit_block *jit_get_block(struct jit *jit, uint32_t guest_addr) {
-  struct jit_block search;
-  search.guest_addr = guest_addr;
+    rb_unlink(&jit->pages, &page->it, &page_map_cb);
+    free(page);
+  }
 
-  return rb_find_entry(&jit->blocks, &search, struct jit_block, it,
-                       &block_map_cb);
+  list_clear(&jit->dirty_pages);
 }
 
-static struct jit_block *jit_lookup_block_reverse(struct jit *jit,
-                                                  void *host_addr) {
-  struct jit_block search;
-  search.host_addr = host_addr;
+static void jit_track_block(struct jit *jit, struct jit_block *block) {
+  struct jit_guest *guest = jit->backend->guest;
 
-  struct rb_node *first = rb_first(&jit->reverse_blocks);
-  struct rb_node *last = rb_last(&jit->reverse_blocks);
-  struct rb_node *rit =
-      rb_upper_bound(&jit->reverse_blocks, &search.rit, &reverse_block_map_cb);
+  uint8_t *begin = NULL;
+  uint8_t *end = NULL;
 
-  if (rit == first) {
-    return NULL;
+  if (guest->protect) {
+    uint32_t last_addr = block->guest_addr + block->guest_size - 1;
+    guest->lookup(guest->mem, block->guest_addr, NULL, &begin, NULL, NULL);
+    guest->lookup(guest->mem, last_addr, NULL, &end, NULL, NULL);
   }
 
-  rit = rit ? rb_prev(rit) : last;
+  block->tracked = begin && end && (end - begin) == (block->guest_size - 1);
 
-  struct jit_block *block = container_of(rit, struct jit_block, rit);
-  if ((uint8_t *)host_addr < (uint8_t *)block->host_addr ||
-      (uint8_t *)host_addr >=
-          ((uint8_t *)block->host_addr + block->host_size)) {
-    return NULL;
+  /* write-protect each page backing the block, so the first write to it can
+     mark it dirty */
+  if (block->tracked) {
+    uintptr_t first_page = ALIGN_DOWN((uintptr_t)begin, jit->page_size);
+    uintptr_t last_page = ALIGN_DOWN((uintptr_t)end, jit->page_size);
+
+    for (uintptr_t addr = first_page; addr <= last_page;
+         addr += jit->page_size) {
+      if (!jit_protect_page(jit, addr)) {
+        block->tracked = 0;
+        break;
+      }
+    }
   }
 
-  return block;
+  if (block->tracked) {
+    block->code_it.low = (interval_type_t)begin;
+    block->code_it.high = (interval_type_t)end;
+    interval_tree_insert(&jit->code_map, &block->code_it);
+  } else {
+    list_add(&jit->untracked_blocks, &block->untracked_it);
+  }
+}
+
+static void jit_untrack_block(struct jit *jit, struct jit_block *block) {
+  if (block->tracked) {
+    interval_tree_remove(&jit->code_map, &block->code_it);
+  } else {
+    list_remove(&jit->untracked_blocks, &block->untracked_it);
+  }
+}
+
+static int jit_handle_code_write(struct jit *jit, struct exception_state *ex) {
+  struct jit_guest *guest = jit->backend->guest;
+
+  if (!guest->lookup_host) {
+    return 0;
+  }
+
+  /* translate the faulting address, which may be any view of the memory, back
+     to the memory backing it */
+  uint8_t *ptr = guest->lookup_host(guest->mem, (const void *)ex->fault_addr);
+
+  if (!ptr) {
+    return 0;
+  }
+
+  uintptr_t addr = ALIGN_DOWN((uintptr_t)ptr, jit->page_size);
+  struct jit_page *page = jit_get_page(jit, addr);
+
+  if (!page || !page->readonly) {
+    return 0;
+  }
+
+  /* let the write go through. the code on the page isn't invalidated until the
+     next call to jit_invalidate_dirty_code, which matches the guest only
+     seeing modified code once its instruction cache has been reset. note, if
+     a memory watch is still protecting the page, the write faults again and
+     is left for the watch to handle */
+  guest->unprotect(guest->mem, (uint8_t *)page->addr, (int)jit->page_size);
+  page->readonly = 0;
+
+  if (!page->dirty) {
+    page->dirty = 1;
+    list_add(&jit->dirty_pages, &page->dirty_it);
+  }
+
+  return 1;
 }
 
 static int jit_is_stale(struct jit *jit, struct jit_block *block) {
@@ -129,6 +220,10 @@ static void jit_restore_edges(struct jit *jit, struct jit_block *block) {
 
 static void jit_invalidate_block(struct jit *jit, struct jit_block *block,
                                  int fastmem) {
+  if (block->state == JIT_STATE_VALID) {
+    jit->num_blocks--;
+  }
+
   /* blocks that are invalidated due to a fastmem exception aren't invalid at
      the guest level, they just need to be recompiled with different options */
   block->state = fastmem ? JIT_STATE_RECOMPILE : JIT_STATE_INVALID;
@@ -157,46 +252,84 @@ static void jit_cache_block(struct jit *jit, struct jit_block *block) {
   CHECK(list_empty(&block->out_edges));
 }
 
+/* each block is allocated from the arena along with the meta data structs for
+   its guest code */
+static size_t jit_block_alloc_size(int guest_size) {
+  return sizeof(struct jit_block) + guest_size * sizeof(void *) +
+         guest_size * sizeof(int8_t);
+}
+
+static void jit_dealloc_block(struct jit *jit, struct jit_block *block) {
+  jit_arena_free(&jit->arena, block, jit_block_alloc_size(block->guest_size));
+}
+
 static void jit_free_block(struct jit *jit, struct jit_block *block) {
+  if (jit->profiler) {
+    jit_profiler_retire_block(jit->profiler, block);
+  }
+
   jit_invalidate_block(jit, block, 0);
 
-  free(block->source_map);
-  free(block->fastmem);
+  /* cancel any pending optimization of the block */
+  if (block->job) {
+    block->job->block = NULL;
+  }
 
-  rb_unlink(&jit->blocks, &block->it, &block_map_cb);
-  rb_unlink(&jit->reverse_blocks, &block->rit, &reverse_block_map_cb);
+  jit_block_map_remove(&jit->blocks, block);
+  jit_block_index_remove(&jit->reverse_blocks, block);
+  jit_untrack_block(jit, block);
 
-  free(block);
+  jit_dealloc_block(jit, block);
 }
 
 static void jit_finalize_block(struct jit *jit, struct jit_block *block) {
   CHECK(list_empty(&block->in_edges) && list_empty(&block->out_edges),
         "code shouldn't have any existing edges");
-  CHECK(rb_empty_node(&block->it) && rb_empty_node(&block->rit),
-        "code was already inserted in lookup tables");
 
   jit_cache_block(jit, block);
 
-  rb_insert(&jit->blocks, &block->it, &block_map_cb);
-  rb_insert(&jit->reverse_blocks, &block->rit, &reverse_block_map_cb);
+  jit_block_map_insert(&jit->blocks, block);
+  jit_block_index_insert(&jit->reverse_blocks, block);
+  jit_track_block(jit, block);
+
+  jit->num_blocks++;
+}
+
+static void jit_inherit_profile(struct jit *jit, struct jit_block *block,
+                                struct jit_block *prev) {
+  /* attribute any pending samples to the previous block before taking them
+     over, so they aren't retired along with it */
+  if (jit->profiler) {
+    jit_profiler_flush(jit->profiler);
+  }
+
+  block->run_count = prev->run_count;
+  block->samples = prev->samples;
+  block->compile_ns = prev->compile_ns;
+  prev->samples = 0;
 }
 
 static struct jit_block *jit_alloc_block(struct jit *jit, uint32_t guest_addr,
                                          int guest_size) {
-  struct jit_block *block = calloc(1, sizeof(struct jit_block));
+  uint8_t *ptr = jit_arena_alloc(&jit->arena, jit_block_alloc_size(guest_size));
+  struct jit_block *block = (struct jit_block *)ptr;
+  ptr += sizeof(struct jit_block);
 
   block->guest_addr = guest_addr;
   block->guest_size = guest_size;
 
-  /* allocate meta data structs for the original guest code */
-  block->source_map = calloc(block->guest_size, sizeof(void *));
-  block->fastmem = calloc(block->guest_size, sizeof(int8_t));
+  block->source_map = (void **)ptr;
+  ptr += guest_size * sizeof(void *);
+  block->fastmem = (int8_t *)ptr;
 
 #ifdef HAVE_FASTMEM
   /* enable fastmem for all accesses by default, falling back to the slow route
-     only after a segfault occurs. see jit_handle_exception */
+     only after a segfault occurs. see jit_handle_exception. note, the guest
+     won't have a base when its address space couldn't be reserved */
+  int fastmem = jit->backend->guest->membase != NULL;
+
   for (int i = 0; i < block->guest_size; i++) {
-    block->fastmem[i] = 1;
+    block->fastmem[i] = fastmem;
   }
 #endif
 
@@ -206,17 +339,16 @@ static struct jit_block *jit_alloc_block(struct jit *jit, uint32_t guest_addr,
 void jit_free_code(struct jit *jit) {
   /* invalidate code pointers and remove block entries from lookup maps. this
      is only safe to use when no code is currently executing */
-  struct rb_node *it = rb_first(&jit->blocks);
-
-  while (it) {
-    struct rb_node *next = rb_next(it);
+  struct jit_block_index *index = &jit->reverse_blocks;
 
-    struct jit_block *block = container_of(it, struct jit_block, it);
-    jit_free_block(jit, block);
-
-    it = next;
+  /* free in reverse order so each block is removed from the end of the index */
+  for (int i = index->size - 1; i >= 0; i--) {
+    jit_free_block(jit, index->entries[i]);
   }
 
+  /* release the protection on any pages that were backing the code */
+  jit_free_pages(jit);
+
   /* have the backend reset its code buffers */
   jit->backend->reset(jit->backend);
 }
@@ -224,20 +356,78 @@ void jit_free_code(struct jit *jit) {
 void jit_invalidate_code(struct jit *jit) {
   /* invalidate code pointers, but don't remove block entries from lookup maps.
      this is used when clearing the jit while code is currently executing */
-  struct rb_node *it = rb_first(&jit->blocks);
+  struct jit_block_index *index = &jit->reverse_blocks;
 
-  while (it) {
-    struct rb_node *next = rb_next(it);
+  for (int i = 0; i < index->size; i++) {
+    jit_invalidate_block(jit, index->entries[i], 0);
+  }
 
-    struct jit_block *block = container_of(it, struct jit_block, it);
-    jit_invalidate_block(jit, block, 0);
+  /* every block is gone, there's no need to track modified pages */
+  list_for_each_entry(page, &jit->dirty_pages, struct jit_page, dirty_it) {
+    page->dirty = 0;
+  }
+  list_clear(&jit->dirty_pages);
 
-    it = next;
+  if (jit->backend->invalidate_all) {
+    jit->backend->invalidate_all(jit->backend);
   }
 
   /* don't reset backend code buffers, code is still running */
 }
 
+void jit_invalidate_dirty_code(struct jit *jit) {
+  struct jit_guest *guest = jit->backend->guest;
+
+  /* without any way to track writes, assume everything was modified. the same
+     goes for backends caching code outside of the jit's blocks, as the pages
+     backing their code aren't tracked */
+  if (!guest->protect || jit->backend->invalidate_all) {
+    int num_blocks = jit->num_blocks;
+    jit_invalidate_code(jit);
+    prof_counter_add(COUNTER_jit_blocks_invalidated, num_blocks);
+    return;
+  }
+
+  /* invalidate code pointers for each block backed by a dirty page. like
+     jit_invalidate_code, the blocks stay in the lookup maps as code may still
+     be executing */
+  int num_invalidated = 0;
+
+  list_for_each_entry_safe(page, &jit->dirty_pages, struct jit_page,
+                           dirty_it) {
+    uintptr_t low = page->addr;
+    uintptr_t high = page->addr + jit->page_size - 1;
+    struct interval_tree_it it;
+    struct interval_node *n =
+        interval_tree_iter_first(&jit->code_map, low, high, &it);
+
+    while (n) {
+      struct jit_block *block = container_of(n, struct jit_block, code_it);
+
+      if (block->state == JIT_STATE_VALID) {
+        jit_invalidate_block(jit, block, 0);
+        num_invalidated++;
+      }
+
+      n = interval_tree_iter_next(&it);
+    }
+
+    page->dirty = 0;
+    list_remove(&jit->dirty_pages, &page->dirty_it);
+  }
+
+  list_for_each_entry(block, &jit->untracked_blocks, struct jit_block,
+                      untracked_it) {
+    if (block->state == JIT_STATE_VALID) {
+      jit_invalidate_block(jit, block, 0);
+      num_invalidated++;
+    }
+  }
+
+  prof_counter_add(COUNTER_jit_blocks_invalidated, num_invalidated);
+  prof_counter_add(COUNTER_jit_blocks_survived, jit->num_blocks);
+}
+
 void jit_link_code(struct jit *jit, void *branch, uint32_t addr) {
   struct jit_block *src = jit_lookup_block_reverse(jit, branch);
   struct jit_block *dst = jit_get_block(jit, addr);
@@ -288,6 +478,199 @@ static void jit_dump_block(struct jit *jit, const char *type,
   fclose(file);
 }
 
+/*
+ * persistent code cache. the optimized ir for each block is written out to the
+ * application directory, keyed by a hash of the guest code and the state the
+ * translation was specialized for, enabling future runs to skip translation
+ * and optimization entirely. the ir embeds absolute host pointers (fallbacks,
+ * guest data, lookup tables), so the bases these were relative to are stored
+ * alongside it, and used to relocate the pointers when the ir is loaded. only
+ * constants created as pointers (see ir_alloc_ptr) are relocated, and since
+ * pointers into the image are relocated by their offset from its base, the
+ * cache is also keyed by a stamp of the executable the ir was created by
+ */
+enum {
+  JIT_RELOC_IMAGE,
+  JIT_RELOC_DATA,
+  JIT_RELOC_CTX,
+  JIT_RELOC_MEMBASE,
+  JIT_RELOC_MEM,
+  JIT_NUM_RELOCS,
+};
+
+static void jit_cache_bases(struct jit *jit, uint64_t *bases) {
+  struct jit_guest *guest = jit->frontend->guest;
+
+  bases[JIT_RELOC_IMAGE] = (uint64_t)(uintptr_t)&jit_compile_code;
+  bases[JIT_RELOC_DATA] = (uint64_t)(uintptr_t)guest->data;
+  bases[JIT_RELOC_CTX] = (uint64_t)(uintptr_t)guest->ctx;
+  bases[JIT_RELOC_MEMBASE] = (uint64_t)(uintptr_t)guest->membase;
+  bases[JIT_RELOC_MEM] = (uint64_t)(uintptr_t)guest->mem;
+}
+
+static void jit_cache_relocate(struct ir *ir, const uint64_t *from,
+                               const uint64_t *to) {
+  int64_t delta = (int64_t)(to[JIT_RELOC_IMAGE] - from[JIT_RELOC_IMAGE]);
+
+  list_for_each_entry(blk, &ir->blocks, struct ir_block, it) {
+    list_for_each_entry(instr, &blk->instrs, struct ir_instr, it) {
+      for (int i = 0; i < IR_MAX_ARGS; i++) {
+        struct ir_value *arg = instr->arg[i];
+
+        if (!arg || !ir_is_constant(arg) || !arg->ptr) {
+          continue;
+        }
+
+        /* each constant is uniquely allocated by ir_read, so it's safe to
+           modify them in place */
+        uint64_t v = (uint64_t)arg->i64;
+        int found = 0;
+
+        for (int j = JIT_RELOC_IMAGE + 1; j < JIT_NUM_RELOCS; j++) {
+          if (from[j] && v == from[j]) {
+            arg->i64 = (int64_t)to[j];
+            found = 1;
+            break;
+          }
+        }
+
+        /* anything else points into the executable image, e.g. a fallback or
+           a static lookup table */
+        if (!found) {
+          arg->i64 = (int64_t)(v + delta);
+        }
+      }
+    }
+  }
+}
+
+static void jit_cache_key(struct jit *jit, struct jit_block *block,
+                          char *key) {
+  struct jit_guest *guest = jit->frontend->guest;
+
+  int flags = 0;
+  if (jit->frontend->translate_flags) {
+    flags = jit->frontend->translate_flags(jit->frontend);
+  }
+
+  /* the cached ir has its guest accesses promoted to fastmem accesses, which
+     can't be replayed by a run without a fastmem base, see jit_alloc_block */
+  int fastmem = 0;
+#ifdef HAVE_FASTMEM
+  fastmem = guest->membase != NULL;
+#endif
+
+  MD5_CTX md5_ctx;
+  MD5_Init(&md5_ctx);
+  MD5_Update(&md5_ctx, jit->cache_stamp, sizeof(jit->cache_stamp));
+  MD5_Update(&md5_ctx, jit->tag, strlen(jit->tag));
+  MD5_Update(&md5_ctx, &block->guest_addr, sizeof(block->guest_addr));
+  MD5_Update(&md5_ctx, &block->guest_size, sizeof(block->guest_size));
+  MD5_Update(&md5_ctx, &flags, sizeof(flags));
+  MD5_Update(&md5_ctx, &fastmem, sizeof(fastmem));
+
+  for (int i = 0; i < block->guest_size; i++) {
+    uint8_t data = guest->r8(guest->mem, block->guest_addr + i);
+    MD5_Update(&md5_ctx, &data, sizeof(data));
+  }
+
+  MD5_Final(key, &md5_ctx);
+}
+
+/* the version alone doesn't change for local builds, so also stamp the cache
+   with the executable's size and modification time */
+static int jit_cache_stamp(struct jit *jit) {
+  char exepath[PATH_MAX];
+  int64_t size, mtime;
+
+  if (!fs_exepath(exepath, sizeof(exepath)) ||
+      !fs_filestat(exepath, &size, &mtime)) {
+    return 0;
+  }
+
+  int num_relocs = JIT_NUM_RELOCS;
+
+  MD5_CTX md5_ctx;
+  MD5_Init(&md5_ctx);
+  MD5_Update(&md5_ctx, GIT_VERSION, sizeof(GIT_VERSION));
+  MD5_Update(&md5_ctx, &size, sizeof(size));
+  MD5_Update(&md5_ctx, &mtime, sizeof(mtime));
+  MD5_Update(&md5_ctx, &num_relocs, sizeof(num_relocs));
+  MD5_Final(jit->cache_stamp, &md5_ctx);
+
+  return 1;
+}
+
+static void jit_cache_path(struct jit *jit, const char *key, const char *ext,
+                           char *path, size_t size) {
+  snprintf(path, size, "%s" PATH_SEPARATOR "%s-cache" PATH_SEPARATOR "%s.%s",
+           fs_appdir(), jit->tag, key, ext);
+}
+
+static int jit_cache_load(struct jit *jit, const char *key, struct ir *ir) {
+  char filename[PATH_MAX];
+  jit_cache_path(jit, key, "ir", filename, sizeof(filename));
+
+  FILE *file = fopen(filename, "r");
+  if (!file) {
+    return 0;
+  }
+
+  uint64_t from[JIT_NUM_RELOCS];
+  uint64_t to[JIT_NUM_RELOCS];
+  int num_relocs = 0;
+  int res = fscanf(file, "# relocs %d", &num_relocs) == 1 &&
+            num_relocs == JIT_NUM_RELOCS;
+
+  for (int i = 0; i < num_relocs && res; i++) {
+    res = fscanf(file, " 0x%" SCNx64, &from[i]) == 1;
+  }
+
+  res = res && ir_read(file, ir);
+  fclose(file);
+
+  if (!res) {
+    LOG_WARNING("jit_cache_load failed to parse %s", filename);
+    return 0;
+  }
+
+  jit_cache_bases(jit, to);
+  jit_cache_relocate(ir, from, to);
+
+  return 1;
+}
+
+static void jit_cache_store(struct jit *jit, const char *key, struct ir *ir) {
+  char filename[PATH_MAX];
+  char tmpname[PATH_MAX];
+  jit_cache_path(jit, key, "ir", filename, sizeof(filename));
+  jit_cache_path(jit, key, "tmp", tmpname, sizeof(tmpname));
+
+  /* write to a temporary file first, so a partially written entry is never
+     loaded if the process is killed */
+  FILE *file = fopen(tmpname, "w");
+  if (!file) {
+    LOG_WARNING("jit_cache_store failed to open %s", tmpname);
+    return;
+  }
+
+  uint64_t bases[JIT_NUM_RELOCS];
+  jit_cache_bases(jit, bases);
+  fprintf(file, "# relocs %d", JIT_NUM_RELOCS);
+  for (int i = 0; i < JIT_NUM_RELOCS; i++) {
+    fprintf(file, " 0x%" PRIx64, bases[i]);
+  }
+  fprintf(file, "\n");
+  ir_write(ir, file);
+  fclose(file);
+
+  remove(filename);
+  if (rename(tmpname, filename) != 0) {
+    LOG_WARNING("jit_cache_store failed to write %s", filename);
+    remove(tmpname);
+  }
+}
+
 static void jit_emit_callback(struct jit *jit, int type, uint32_t guest_addr,
                               uint8_t *host_addr) {
   struct jit_block *block = jit->curr_block;
@@ -318,86 +701,365 @@ static void jit_promote_fastmem(struct jit *jit, struct jit_block *block,
   }
 }
 
-void jit_compile_code(struct jit *jit, uint32_t guest_addr) {
+static int jit_assemble_block(struct jit *jit, struct jit_block *block,
+                              struct ir *ir) {
+  jit->curr_block = block;
+
+  /* have the block count its executions, and dispatch back to the compiler to
+     recompile it once it crosses the hot threshold */
+  if (jit->profile_code) {
+    struct ir_block *entry = list_first_entry(&ir->blocks, struct ir_block, it);
+    ir_set_meta(ir, entry, IR_META_COUNTER,
+                ir_alloc_i64(ir, (int64_t)(uintptr_t)&block->run_count));
+
+    block->num_instrs = 0;
+    block->num_cycles = 0;
+
+    list_for_each_entry(blk, &ir->blocks, struct ir_block, it) {
+      list_for_each_entry(instr, &blk->instrs, struct ir_instr, it) {
+        if (instr->op == OP_SOURCE_INFO) {
+          block->num_instrs += 1;
+          block->num_cycles += instr->arg[1]->i32;
+        }
+      }
+    }
+
+    if (jit->hot_threshold && !block->hot) {
+      ir_set_meta(ir, entry, IR_META_THRESHOLD,
+                  ir_alloc_i32(ir, jit->hot_threshold));
+    }
+  }
+
+  /* assemble the ir into native code */
+  int res = jit->backend->assemble_code(jit->backend, ir, &block->host_addr,
+                                        &block->host_size,
+                                        (jit_emit_cb)jit_emit_callback, jit);
+
+  if (!res) {
+    /* if the backend overflowed, completely free the cache and let dispatch
+       try to compile again */
+    LOG_INFO("backend overflow, resetting code cache");
+    jit_free_code(jit);
+    jit_dealloc_block(jit, block);
+    return 0;
+  }
+
+  /* finish by adding code to caches */
+  jit_finalize_block(jit, block);
+
+  /* dump optimized ir */
+  if (jit->dump_code) {
+    jit_dump_block(jit, "opt", block, ir);
+  }
+
+  /* write out to perf map if enabled */
+  if (OPTION_perf) {
+    fprintf(jit->perf_map, "%" PRIxPTR " %x %s_0x%08x\n",
+            (uintptr_t)block->host_addr, block->host_size, jit->tag,
+            block->guest_addr);
+  }
+
+  return 1;
+}
+
+/*
+ * background compilation
+ */
+static struct jit_job *jit_alloc_job(struct jit *jit) {
+  /* the free list is only accessed from the emulation thread */
+  struct jit_job *job = list_first_entry(&jit->free_jobs, struct jit_job, it);
+
+  if (!job) {
+    return NULL;
+  }
+
+  list_remove(&jit->free_jobs, &job->it);
+
+  if (!job->ir_buffer) {
+    job->ir = malloc(sizeof(struct ir));
+    job->ir_buffer = malloc(sizeof(jit->ir_buffer));
+  }
+
+  memset(job->ir, 0, sizeof(*job->ir));
+  job->ir->buffer = job->ir_buffer;
+  job->ir->capacity = sizeof(jit->ir_buffer);
+
+  return job;
+}
+
+static void jit_free_job(struct jit *jit, struct jit_job *job) {
+  job->block = NULL;
+  list_add(&jit->free_jobs, &job->it);
+}
+
+static void jit_queue_job(struct jit *jit, struct jit_job *job,
+                          struct jit_block *block, const char *key) {
+  /* translate the block again for the compile thread to optimize. this is
+     done on the emulation thread, as the translation reads from guest memory
+     and is specialized for the current guest state */
+  jit->frontend->translate_code(jit->frontend, block->guest_addr,
+                                block->guest_size, job->ir);
+  jit_promote_fastmem(jit, block, job->ir);
+
+  job->block = block;
+  job->cacheable = key != NULL;
+  if (key) {
+    strncpy(job->key, key, sizeof(job->key));
+  }
+  block->job = job;
+
+  mutex_lock(jit->job_mutex);
+  list_add(&jit->pending_jobs, &job->it);
+  cond_signal(jit->job_cond);
+  mutex_unlock(jit->job_mutex);
+}
+
+static void jit_finish_jobs(struct jit *jit) {
+  struct list done = {0};
+
+  mutex_lock(jit->job_mutex);
+  done = jit->done_jobs;
+  list_clear(&jit->done_jobs);
+  mutex_unlock(jit->job_mutex);
+
+  list_for_each_entry_safe(job, &done, struct jit_job, it) {
+    struct jit_block *block = job->block;
+
+    list_remove(&done, &job->it);
+
+    /* the block may have been invalidated while it was being optimized, in
+       which case the optimized code is stale */
+    if (block && block->state == JIT_STATE_VALID) {
+      struct jit_block *opt =
+          jit_alloc_block(jit, block->guest_addr, block->guest_size);
+      memcpy(opt->fastmem, block->fastmem, block->guest_size * sizeof(int8_t));
+      jit_inherit_profile(jit, opt, block);
+      opt->hot = block->hot;
+
+      /* incoming edges are restored to go through dispatch, and are relinked
+         to the optimized block the next time they're executed */
+      block->job = NULL;
+      jit_free_block(jit, block);
+
+      if (jit->profiler) {
+        jit_profiler_begin_compile(jit->profiler);
+      }
+
+      int res = jit_assemble_block(jit, opt, job->ir);
+
+      if (jit->profiler) {
+        jit_profiler_end_compile(jit->profiler, res ? opt : NULL);
+      }
+    } else if (block) {
+      block->job = NULL;
+    }
+
+    jit_free_job(jit, job);
+  }
+}
+
+static void *jit_compile_thread(void *data) {
+  struct jit *jit = data;
+
+  prof_thread_name("jit");
+
+  mutex_lock(jit->job_mutex);
+
+  while (1) {
+    while (!jit->job_shutdown && list_empty(&jit->pending_jobs)) {
+      cond_wait(jit->job_cond, jit->job_mutex);
+    }
+
+    if (jit->job_shutdown) {
+      break;
+    }
+
+    struct jit_job *job =
+        list_first_entry(&jit->pending_jobs, struct jit_job, it);
+    list_remove(&jit->pending_jobs, &job->it);
+    mutex_unlock(jit->job_mutex);
+
+    /* the ir is owned by the job at this point, and the passes don't touch
+       any guest state, so they're safe to run without the lock held */
+    PROF_ENTER("jit", "jit_optimize_code");
+
+    struct ir *ir = job->ir;
+    cfa_run(jit->job_cfa, ir);
+    lse_run(jit->job_lse, ir);
+    cprop_run(jit->job_cprop, ir);
+    esimp_run(jit->job_esimp, ir);
+    cve_run(jit->job_cve, ir);
+    dce_run(jit->job_dce, ir);
+
+    if (job->cacheable) {
+      jit_cache_store(jit, job->key, ir);
+    }
+
+    ra_run(jit->job_ra, ir);
+
+    PROF_LEAVE();
+
+    mutex_lock(jit->job_mutex);
+    list_add(&jit->done_jobs, &job->it);
+  }
+
+  mutex_unlock(jit->job_mutex);
+
+  return NULL;
+}
+
+static struct jit_block *jit_compile_block(struct jit *jit,
+                                           uint32_t guest_addr) {
 #if 0
   LOG_INFO("jit_compile_block %s 0x%08x", jit->tag, guest_addr);
 #endif
 
+  /* a valid block is only ever compiled again once it has crossed the hot
+     threshold. blocks invalidated due to a fastmem exception stay hot */
+  struct jit_block *existing = jit_get_block(jit, guest_addr);
+  int hot = 0;
+
+  if (existing) {
+    hot = existing->state == JIT_STATE_VALID ||
+          (existing->state == JIT_STATE_RECOMPILE && existing->hot);
+  }
+
   /* analyze the guest code to get its extents */
   int guest_size;
-  jit->frontend->analyze_code(jit->frontend, guest_addr, &guest_size);
+  jit->frontend->analyze_code(jit->frontend, guest_addr,
+                              hot ? JIT_ANALYZE_HOT : 0, &guest_size);
 
   /* create block */
   struct jit_block *block = jit_alloc_block(jit, guest_addr, guest_size);
+  block->hot = hot;
   jit->curr_block = block;
 
   /* if the block had previously been invalidated, finish removing it now */
-  struct jit_block *existing = jit_get_block(jit, guest_addr);
+  int cacheable = jit->cache_code;
 
   if (existing) {
-    /* if the block was invalidated due to a fastmem exception, persist its
-       fastmem state */
+    /* if the block was invalidated due to a fastmem exception or is being
+       recompiled as hot, persist its fastmem state and execution count. note,
+       hot blocks may extend past the original block */
     if (existing->state != JIT_STATE_INVALID) {
-      CHECK_EQ(block->guest_size, existing->guest_size);
-      memcpy(block->fastmem, existing->fastmem,
-             block->guest_size * sizeof(int8_t));
+      int size = MIN(block->guest_size, existing->guest_size);
+      memcpy(block->fastmem, existing->fastmem, size * sizeof(int8_t));
+      jit_inherit_profile(jit, block, existing);
+
+      /* blocks with fastmem disabled for some instructions don't match the
+         default translation, and aren't cached */
+      cacheable = 0;
     }
 
     jit_free_block(jit, existing);
   }
 
-  /* translate guest code into ir */
+  char key[33];
+  int cached = 0;
+
   struct ir ir = {0};
   ir.buffer = jit->ir_buffer;
   ir.capacity = sizeof(jit->ir_buffer);
-  jit->frontend->translate_code(jit->frontend, guest_addr, guest_size, &ir);
 
-  /* dump raw ir */
-  if (jit->dump_code) {
-    jit_dump_block(jit, "raw", block, &ir);
+  if (cacheable) {
+    jit_cache_key(jit, block, key);
+    cached = jit_cache_load(jit, key, &ir);
+
+    if (cached) {
+      prof_counter_add(COUNTER_jit_cache_hits, 1);
+    } else {
+      prof_counter_add(COUNTER_jit_cache_misses, 1);
+
+      /* reset in case the entry was only partially read */
+      memset(&ir, 0, sizeof(ir));
+      ir.buffer = jit->ir_buffer;
+      ir.capacity = sizeof(jit->ir_buffer);
+    }
   }
 
-  /* run optimization passes */
-  jit_promote_fastmem(jit, block, &ir);
-  cfa_run(jit->cfa, &ir);
-  lse_run(jit->lse, &ir);
-  cprop_run(jit->cprop, &ir);
-  esimp_run(jit->esimp, &ir);
-  dce_run(jit->dce, &ir);
-  ra_run(jit->ra, &ir);
+  /* when compiling in the background, skip the optimization passes for now and
+     queue up the block to be optimized once it's been assembled. if all jobs
+     are in use, fall back to optimizing the block immediately */
+  struct jit_job *job = NULL;
 
-  /* assemble the ir into native code */
-  int res = jit->backend->assemble_code(jit->backend, &ir, &block->host_addr,
-                                        &block->host_size,
-                                        (jit_emit_cb)jit_emit_callback, jit);
+  if (!cached) {
+    if (jit->async_code) {
+      job = jit_alloc_job(jit);
+    }
 
-  if (!res) {
-    /* if the backend overflowed, completely free the cache and let dispatch
-       try to compile again */
-    LOG_INFO("backend overflow, resetting code cache");
-    jit_free_code(jit);
-    return;
+    /* translate guest code into ir */
+    jit->frontend->translate_code(jit->frontend, guest_addr, guest_size, &ir);
+
+    /* dump raw ir */
+    if (jit->dump_code) {
+      jit_dump_block(jit, "raw", block, &ir);
+    }
+
+    /* run optimization passes */
+    jit_promote_fastmem(jit, block, &ir);
+    cfa_run(jit->cfa, &ir);
+
+    if (!job) {
+      lse_run(jit->lse, &ir);
+      cprop_run(jit->cprop, &ir);
+      esimp_run(jit->esimp, &ir);
+      cve_run(jit->cve, &ir);
+      dce_run(jit->dce, &ir);
+
+      if (cacheable) {
+        jit_cache_store(jit, key, &ir);
+      }
+    }
   }
 
-  /* finish by adding code to caches */
-  jit_finalize_block(jit, block);
+  ra_run(jit->ra, &ir);
 
-  /* dump optimized ir */
-  if (jit->dump_code) {
-    jit_dump_block(jit, "opt", block, &ir);
+  if (!jit_assemble_block(jit, block, &ir)) {
+    if (job) {
+      jit_free_job(jit, job);
+    }
+    return NULL;
   }
 
-  /* write out to perf map if enabled */
-  if (OPTION_perf) {
-    fprintf(jit->perf_map, "%" PRIxPTR " %x %s_0x%08x\n",
-            (uintptr_t)block->host_addr, block->host_size, jit->tag,
-            block->guest_addr);
+  if (job) {
+    jit_queue_job(jit, job, block, cacheable ? key : NULL);
   }
+
+  return block;
+}
+
+void jit_compile_code(struct jit *jit, uint32_t guest_addr) {
+  PROF_ENTER("jit", "jit_compile_code");
+
+  prof_counter_add(COUNTER_jit_compiles, 1);
+
+  if (jit->profiler) {
+    jit_profiler_begin_compile(jit->profiler);
+    struct jit_block *block = jit_compile_block(jit, guest_addr);
+    jit_profiler_end_compile(jit->profiler, block);
+  } else {
+    jit_compile_block(jit, guest_addr);
+  }
+
+  PROF_LEAVE();
 }
 
 static int jit_handle_exception(void *data, struct exception_state *ex) {
   struct jit *jit = data;
 
+  /* every exception handler is called for exceptions raised on any thread,
+     leave those raised on other threads to their own jit */
+  if (jit->owner != &jit_thread_id) {
+    return 0;
+  }
+
+  /* see if the exception was caused by a write to a page backing compiled
+     code. note, this can be raised from outside of the compiled code, e.g. by
+     a dma transfer */
+  if (jit_handle_code_write(jit, ex)) {
+    return 1;
+  }
+
   /* see if there is a cached block corresponding to the current pc */
   struct jit_block *block = jit_lookup_block_reverse(jit, (void *)ex->pc);
 
@@ -431,24 +1093,104 @@ static int jit_handle_exception(void *data, struct exception_state *ex) {
 }
 
 void jit_run(struct jit *jit, int cycles) {
+  /* the jit may be created on a different thread than it's ran on */
+  jit->owner = &jit_thread_id;
+
+  if (jit->profiler) {
+    jit_profiler_begin_run(jit->profiler);
+  }
+
+  /* install any blocks optimized in the background before running, while no
+     compiled code is executing */
+  if (jit->async_code) {
+    jit_finish_jobs(jit);
+  }
+
   jit->backend->run_code(jit->backend, cycles);
+
+  if (jit->profiler) {
+    jit_profiler_end_run(jit->profiler);
+  }
 }
 
 void jit_destroy(struct jit *jit) {
+  if (jit->job_thread) {
+    mutex_lock(jit->job_mutex);
+    jit->job_shutdown = 1;
+    cond_signal(jit->job_cond);
+    mutex_unlock(jit->job_mutex);
+
+    void *result;
+    thread_join(jit->job_thread, &result);
+
+    cond_destroy(jit->job_cond);
+    mutex_destroy(jit->job_mutex);
+  }
+
+  for (int i = 0; i < JIT_MAX_JOBS; i++) {
+    struct jit_job *job = &jit->jobs[i];
+    free(job->ir_buffer);
+    free(job->ir);
+  }
+
   if (OPTION_perf) {
     if (jit->perf_map) {
       fclose(jit->perf_map);
     }
   }
 
+  if (jit->profiler) {
+    jit_profiler_write_report(jit->profiler);
+  }
+
   if (jit->backend) {
     jit_free_code(jit);
   }
 
+  if (jit->profiler) {
+    jit_profiler_destroy(jit->profiler);
+  }
+
+  jit_block_map_destroy(&jit->blocks);
+  jit_block_index_destroy(&jit->reverse_blocks);
+  jit_arena_destroy(&jit->arena);
+
+  if (jit->job_ra) {
+    ra_destroy(jit->job_ra);
+  }
+
+  if (jit->job_dce) {
+    dce_destroy(jit->job_dce);
+  }
+
+  if (jit->job_cve) {
+    cve_destroy(jit->job_cve);
+  }
+
+  if (jit->job_esimp) {
+    esimp_destroy(jit->job_esimp);
+  }
+
+  if (jit->job_cprop) {
+    cprop_destroy(jit->job_cprop);
+  }
+
+  if (jit->job_lse) {
+    lse_destroy(jit->job_lse);
+  }
+
+  if (jit->job_cfa) {
+    cfa_destroy(jit->job_cfa);
+  }
+
   if (jit->dce) {
     dce_destroy(jit->dce);
   }
 
+  if (jit->cve) {
+    cve_destroy(jit->cve);
+  }
+
   if (jit->esimp) {
     esimp_destroy(jit->esimp);
   }
@@ -479,12 +1221,23 @@ struct jit *jit_create(const char *tag, struct jit_frontend *frontend,
   strncpy(jit->tag, tag, sizeof(jit->tag));
   jit->frontend = frontend;
   jit->backend = backend;
+  jit->owner = &jit_thread_id;
+  jit->page_size = get_page_size();
+  jit->cache_code = OPTION_jit_cache;
+  jit->hot_threshold = OPTION_jit_hot_threshold;
+  jit->profile_code =
+      OPTION_jit_profile || OPTION_jit_sample || jit->hot_threshold;
+
+  if (jit->profile_code) {
+    jit->profiler = jit_profiler_create(jit);
+  }
 
   /* create optimization passes */
   jit->cfa = cfa_create();
   jit->lse = lse_create();
   jit->cprop = cprop_create();
   jit->esimp = esimp_create();
+  jit->cve = cve_create();
   jit->dce = dce_create();
   jit->ra = ra_create(jit->backend->registers, jit->backend->num_registers,
                       jit->backend->emitters, jit->backend->num_emitters);
@@ -493,6 +1246,45 @@ struct jit *jit_create(const char *tag, struct jit_frontend *frontend,
      related exceptions */
   jit->exc_handler = exception_handler_add(jit, &jit_handle_exception);
 
+  /* start compile thread if enabled. the interpreter backend doesn't compile
+     any code, so there's nothing to do in the background */
+  jit->async_code = OPTION_jit_async && jit->backend->assemble_code;
+
+  if (jit->async_code) {
+    jit->job_cfa = cfa_create();
+    jit->job_lse = lse_create();
+    jit->job_cprop = cprop_create();
+    jit->job_esimp = esimp_create();
+    jit->job_cve = cve_create();
+    jit->job_dce = dce_create();
+    jit->job_ra =
+        ra_create(jit->backend->registers, jit->backend->num_registers,
+                  jit->backend->emitters, jit->backend->num_emitters);
+
+    for (int i = 0; i < JIT_MAX_JOBS; i++) {
+      list_add(&jit->free_jobs, &jit->jobs[i].it);
+    }
+
+    jit->job_mutex = mutex_create();
+    jit->job_cond = cond_create();
+    jit->job_thread = thread_create(&jit_compile_thread, NULL, jit);
+    CHECK_NOTNULL(jit->job_thread);
+  }
+
+  /* the cache can't be safely used without knowing what built it */
+  if (jit->cache_code && !jit_cache_stamp(jit)) {
+    LOG_WARNING("jit_create failed to stamp code cache, disabling it");
+    jit->cache_code = 0;
+  }
+
+  /* create code cache directory if enabled */
+  if (jit->cache_code) {
+    char cachedir[PATH_MAX];
+    snprintf(cachedir, sizeof(cachedir), "%s" PATH_SEPARATOR "%s-cache",
+             fs_appdir(), jit->tag);
+    CHECK(fs_mkdir(cachedir));
+  }
+
   /* open perf map if enabled */
   if (OPTION_perf) {
 #if PLATFORM_DARWIN || PLATFORM_LINUX
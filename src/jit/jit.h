@@ -2,14 +2,20 @@
 #define JIT_H
 
 #include <stdio.h>
+#include "core/interval_tree.h"
 #include "core/list.h"
 #include "core/rb_tree.h"
+#include "core/thread.h"
+#include "jit/jit_block_map.h"
 
 struct address_space;
 struct cfa;
 struct cprop;
+struct cve;
 struct dce;
 struct ir;
+struct jit_job;
+struct jit_profiler;
 struct lse;
 struct ra;
 struct val;
@@ -41,9 +47,44 @@ struct jit_block {
   struct list in_edges;
   struct list out_edges;
 
-  /* lookup map iterators */
+  /* range of host memory backing the guest code. blocks whose code isn't
+     backed by a contiguous range of memory can't be tracked, and are
+     invalidated whenever any code is */
+  int tracked;
+  struct interval_node code_it;
+  struct list_node untracked_it;
+
+  /* pending job optimizing the block in the background */
+  struct jit_job *job;
+
+  /* number of times the block has been entered through dispatch, updated by
+     the compiled code when profiling is enabled. hot blocks have crossed the
+     hot threshold and been recompiled more aggressively */
+  uint64_t run_count;
+  int hot;
+
+  /* profiler stats. the guest instructions and cycles are totals for a single
+     pass through every instruction in the block, which overestimates blocks
+     spanning multiple branches */
+  int num_instrs;
+  int num_cycles;
+  uint64_t samples;
+  int64_t compile_ns;
+};
+
+/* page of host memory backing guest code that has been compiled */
+struct jit_page {
+  uintptr_t addr;
+
+  /* does the jit hold a write-protect reference on the page. other systems
+     may still be protecting the page when it doesn't */
+  int readonly;
+
+  /* has the page been written to since code was last invalidated */
+  int dirty;
+
   struct rb_node it;
-  struct rb_node rit;
+  struct list_node dirty_it;
 };
 
 struct jit_edge {
@@ -61,6 +102,23 @@ struct jit_edge {
   struct list_node out_it;
 };
 
+/* unoptimized block queued to be optimized on the compile thread */
+#define JIT_MAX_JOBS 16
+
+struct jit_job {
+  /* block the job was queued for, or NULL if the block has since been freed */
+  struct jit_block *block;
+
+  /* code cache key to store the optimized ir to */
+  int cacheable;
+  char key[33];
+
+  struct ir *ir;
+  uint8_t *ir_buffer;
+
+  struct list_node it;
+};
+
 struct jit {
   char tag[32];
 
@@ -68,21 +126,72 @@ struct jit {
   struct jit_backend *backend;
   struct exception_handler *exc_handler;
 
+  /* thread which runs the jit, only exceptions raised on it are handled, as
+     the jit's state is only safe to access from it */
+  void *owner;
+
   /* passes */
   struct cfa *cfa;
   struct lse *lse;
   struct cprop *cprop;
   struct esimp *esimp;
+  struct cve *cve;
   struct dce *dce;
   struct ra *ra;
 
   /* scratch compilation buffer */
   uint8_t ir_buffer[1024 * 1024 * 2];
 
+  /* background compilation. blocks are initially compiled without running the
+     optimization passes, and their ir is queued to be optimized on the compile
+     thread. finished jobs are assembled and replace the original blocks at the
+     start of the next jit_run */
+  int async_code;
+  thread_t job_thread;
+  mutex_t job_mutex;
+  cond_t job_cond;
+  int job_shutdown;
+  struct jit_job jobs[JIT_MAX_JOBS];
+  struct list free_jobs;
+  struct list pending_jobs;
+  struct list done_jobs;
+
+  /* passes used by the compile thread */
+  struct cfa *job_cfa;
+  struct lse *job_lse;
+  struct cprop *job_cprop;
+  struct esimp *job_esimp;
+  struct cve *job_cve;
+  struct dce *job_dce;
+  struct ra *job_ra;
+
   /* compiled blocks */
   struct jit_block *curr_block;
-  struct rb_tree blocks;
-  struct rb_tree reverse_blocks;
+  struct jit_block_map blocks;
+  struct jit_block_index reverse_blocks;
+  struct jit_arena arena;
+  int num_blocks;
+
+  /* page-level code tracking. pages backing compiled code are write-protected,
+     and marked dirty on the first write to them. the code map is an interval
+     tree of each block's backing memory, used to find the blocks on each
+     dirty page */
+  size_t page_size;
+  struct rb_tree pages;
+  struct list dirty_pages;
+  struct rb_tree code_map;
+  struct list untracked_blocks;
+
+  /* persist optimized ir to the application directory between runs, keyed by
+     a hash of the guest code it was translated from */
+  int cache_code;
+  char cache_stamp[33];
+
+  /* count executions of each block, recompiling blocks which cross the hot
+     threshold and writing out a report of the hottest blocks on exit */
+  int profile_code;
+  int hot_threshold;
+  struct jit_profiler *profiler;
 
   /* compiled block perf map */
   FILE *perf_map;
@@ -100,6 +209,7 @@ void jit_run(struct jit *jit, int cycles);
 void jit_compile_code(struct jit *jit, uint32_t guest_addr);
 void jit_link_code(struct jit *jit, void *code, uint32_t target);
 void jit_invalidate_code(struct jit *jit);
+void jit_invalidate_dirty_code(struct jit *jit);
 void jit_free_code(struct jit *jit);
 
 #endif
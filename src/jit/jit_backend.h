@@ -94,6 +94,11 @@ struct jit_backend {
   const struct jit_emitter *emitters;
   int num_emitters;
 
+  /* buffer the compiled code and thunks are emitted to, NULL for backends
+     which don't generate any code */
+  uint8_t *code;
+  int code_size;
+
   void (*destroy)(struct jit_backend *);
 
   /* compile interface */
@@ -108,6 +113,9 @@ struct jit_backend {
   void *(*lookup_code)(struct jit_backend *, uint32_t);
   void (*cache_code)(struct jit_backend *, uint32_t, void *);
   void (*invalidate_code)(struct jit_backend *, uint32_t);
+  /* optional, used by backends which cache guest code outside of the jit's
+     blocks to invalidate everything they've cached */
+  void (*invalidate_all)(struct jit_backend *);
   void (*patch_edge)(struct jit_backend *, void *, void *);
   void (*restore_edge)(struct jit_backend *, void *, uint32_t);
 };
@@ -0,0 +1,281 @@
+#include "jit/jit_block_map.h"
+#include "core/core.h"
+#include "core/hash.h"
+#include "jit/jit.h"
+
+/*
+ * guest address map
+ */
+#define JIT_BLOCK_MAP_MIN_BITS 10
+
+static inline uint32_t jit_block_map_slot(struct jit_block_map *map,
+                                          uint32_t guest_addr) {
+  return (uint32_t)hash_key(guest_addr, map->bits);
+}
+
+static void jit_block_map_resize(struct jit_block_map *map, int bits) {
+  struct jit_block **old_entries = map->entries;
+  int old_capacity = map->entries ? 1 << map->bits : 0;
+
+  map->entries = calloc(1 << bits, sizeof(struct jit_block *));
+  map->bits = bits;
+  map->size = 0;
+
+  for (int i = 0; i < old_capacity; i++) {
+    if (old_entries[i]) {
+      jit_block_map_insert(map, old_entries[i]);
+    }
+  }
+
+  free(old_entries);
+}
+
+void jit_block_map_insert(struct jit_block_map *map, struct jit_block *block) {
+  /* keep the load factor under 1/2 to keep probe sequences short */
+  if (!map->entries) {
+    jit_block_map_resize(map, JIT_BLOCK_MAP_MIN_BITS);
+  } else if ((map->size + 1) * 2 > (1 << map->bits)) {
+    jit_block_map_resize(map, map->bits + 1);
+  }
+
+  uint32_t mask = (1 << map->bits) - 1;
+  uint32_t i = jit_block_map_slot(map, block->guest_addr);
+
+  while (map->entries[i]) {
+    CHECK_NE(map->entries[i]->guest_addr, block->guest_addr,
+             "block already inserted in map");
+    i = (i + 1) & mask;
+  }
+
+  map->entries[i] = block;
+  map->size++;
+}
+
+void jit_block_map_remove(struct jit_block_map *map, struct jit_block *block) {
+  uint32_t mask = (1 << map->bits) - 1;
+  uint32_t i = jit_block_map_slot(map, block->guest_addr);
+
+  while (map->entries[i] != block) {
+    CHECK_NOTNULL(map->entries[i], "block not found in map");
+    i = (i + 1) & mask;
+  }
+
+  map->entries[i] = NULL;
+  map->size--;
+
+  /* rather than leaving a tombstone, shift back any following entries in the
+     probe sequence which can now be found from an earlier slot */
+  uint32_t j = i;
+
+  while (1) {
+    j = (j + 1) & mask;
+
+    struct jit_block *next = map->entries[j];
+
+    if (!next) {
+      break;
+    }
+
+    uint32_t k = jit_block_map_slot(map, next->guest_addr);
+
+    /* if the entry's home slot is cyclically within (i, j], it's already
+       reachable and must stay where it is */
+    int reachable = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+
+    if (!reachable) {
+      map->entries[i] = next;
+      map->entries[j] = NULL;
+      i = j;
+    }
+  }
+}
+
+struct jit_block *jit_block_map_find(struct jit_block_map *map,
+                                     uint32_t guest_addr) {
+  if (!map->entries) {
+    return NULL;
+  }
+
+  uint32_t mask = (1 << map->bits) - 1;
+  uint32_t i = jit_block_map_slot(map, guest_addr);
+
+  while (map->entries[i]) {
+    if (map->entries[i]->guest_addr == guest_addr) {
+      return map->entries[i];
+    }
+
+    i = (i + 1) & mask;
+  }
+
+  return NULL;
+}
+
+void jit_block_map_clear(struct jit_block_map *map) {
+  if (!map->entries) {
+    return;
+  }
+
+  memset(map->entries, 0, sizeof(struct jit_block *) * (1 << map->bits));
+  map->size = 0;
+}
+
+void jit_block_map_destroy(struct jit_block_map *map) {
+  free(map->entries);
+  memset(map, 0, sizeof(*map));
+}
+
+/*
+ * host address index
+ */
+#define JIT_BLOCK_INDEX_MIN_CAPACITY 1024
+
+/* returns the index of the first block whose host address is greater than
+   host_addr */
+static int jit_block_index_upper_bound(struct jit_block_index *index,
+                                       const void *host_addr) {
+  int lo = 0;
+  int hi = index->size;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+
+    if ((const uint8_t *)index->entries[mid]->host_addr <=
+        (const uint8_t *)host_addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+void jit_block_index_insert(struct jit_block_index *index,
+                            struct jit_block *block) {
+  if (index->size == index->capacity) {
+    index->capacity = MAX(index->capacity * 2, JIT_BLOCK_INDEX_MIN_CAPACITY);
+    index->entries = realloc(index->entries,
+                             sizeof(struct jit_block *) * index->capacity);
+  }
+
+  /* fast path for the common case of appending newly assembled code */
+  int i = index->size;
+
+  if (i && index->entries[i - 1]->host_addr >= block->host_addr) {
+    i = jit_block_index_upper_bound(index, block->host_addr);
+    memmove(&index->entries[i + 1], &index->entries[i],
+            sizeof(struct jit_block *) * (index->size - i));
+  }
+
+  index->entries[i] = block;
+  index->size++;
+}
+
+void jit_block_index_remove(struct jit_block_index *index,
+                            struct jit_block *block) {
+  int i = jit_block_index_upper_bound(index, block->host_addr) - 1;
+
+  CHECK(i >= 0 && index->entries[i] == block, "block not found in index");
+
+  memmove(&index->entries[i], &index->entries[i + 1],
+          sizeof(struct jit_block *) * (index->size - i - 1));
+  index->size--;
+}
+
+struct jit_block *jit_block_index_find(struct jit_block_index *index,
+                                       const void *host_addr) {
+  int i = jit_block_index_upper_bound(index, host_addr) - 1;
+
+  if (i < 0) {
+    return NULL;
+  }
+
+  struct jit_block *block = index->entries[i];
+
+  if ((const uint8_t *)host_addr >=
+      ((const uint8_t *)block->host_addr + block->host_size)) {
+    return NULL;
+  }
+
+  return block;
+}
+
+void jit_block_index_clear(struct jit_block_index *index) {
+  index->size = 0;
+}
+
+void jit_block_index_destroy(struct jit_block_index *index) {
+  free(index->entries);
+  memset(index, 0, sizeof(*index));
+}
+
+/*
+ * block arena
+ */
+struct jit_arena_chunk {
+  struct jit_arena_chunk *next;
+  /* unaligned pointer returned by malloc */
+  void *mem;
+};
+
+void *jit_arena_alloc(struct jit_arena *arena, size_t size) {
+  size_t cls = (size + JIT_ARENA_ALIGN - 1) / JIT_ARENA_ALIGN;
+
+  /* oversized allocations go straight to the system allocator */
+  if (cls >= JIT_ARENA_NUM_CLASSES) {
+    return calloc(1, size);
+  }
+
+  size_t cls_size = cls * JIT_ARENA_ALIGN;
+  uint8_t *ptr = arena->free[cls];
+
+  if (ptr) {
+    arena->free[cls] = *(void **)ptr;
+  } else {
+    if ((size_t)(arena->end - arena->ptr) < cls_size) {
+      /* malloc only guarantees the alignment of the largest scalar type,
+         over-allocate to align the chunk to JIT_ARENA_ALIGN */
+      uint8_t *mem = malloc(JIT_ARENA_CHUNK_SIZE + JIT_ARENA_ALIGN);
+      struct jit_arena_chunk *chunk = (struct jit_arena_chunk *)ALIGN_UP(
+          (uintptr_t)mem, (uintptr_t)JIT_ARENA_ALIGN);
+      chunk->next = arena->chunks;
+      chunk->mem = mem;
+      arena->chunks = chunk;
+
+      /* the chunk header occupies the first aligned slot */
+      arena->ptr = (uint8_t *)chunk + JIT_ARENA_ALIGN;
+      arena->end = (uint8_t *)chunk + JIT_ARENA_CHUNK_SIZE;
+    }
+
+    ptr = arena->ptr;
+    arena->ptr += cls_size;
+  }
+
+  memset(ptr, 0, cls_size);
+
+  return ptr;
+}
+
+void jit_arena_free(struct jit_arena *arena, void *ptr, size_t size) {
+  size_t cls = (size + JIT_ARENA_ALIGN - 1) / JIT_ARENA_ALIGN;
+
+  if (cls >= JIT_ARENA_NUM_CLASSES) {
+    free(ptr);
+    return;
+  }
+
+  *(void **)ptr = arena->free[cls];
+  arena->free[cls] = ptr;
+}
+
+void jit_arena_destroy(struct jit_arena *arena) {
+  struct jit_arena_chunk *chunk = arena->chunks;
+
+  while (chunk) {
+    struct jit_arena_chunk *next = chunk->next;
+    free(chunk->mem);
+    chunk = next;
+  }
+
+  memset(arena, 0, sizeof(*arena));
+}
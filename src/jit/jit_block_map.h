@@ -0,0 +1,71 @@
+#ifndef JIT_BLOCK_MAP_H
+#define JIT_BLOCK_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct jit_block;
+
+/*
+ * open-addressed hash map of guest address to block, used on every compile and
+ * link to find the block for a guest address
+ */
+struct jit_block_map {
+  struct jit_block **entries;
+  int bits;
+  int size;
+};
+
+void jit_block_map_insert(struct jit_block_map *map, struct jit_block *block);
+void jit_block_map_remove(struct jit_block_map *map, struct jit_block *block);
+struct jit_block *jit_block_map_find(struct jit_block_map *map,
+                                     uint32_t guest_addr);
+void jit_block_map_clear(struct jit_block_map *map);
+void jit_block_map_destroy(struct jit_block_map *map);
+
+/*
+ * flat array of blocks sorted by host address, used to map an address inside
+ * of compiled code back to the block containing it. code is allocated linearly
+ * from the backend's code buffer, so new blocks are almost always appended to
+ * the end, and blocks are only removed from the middle when recompiled
+ */
+struct jit_block_index {
+  struct jit_block **entries;
+  int capacity;
+  int size;
+};
+
+void jit_block_index_insert(struct jit_block_index *index,
+                            struct jit_block *block);
+void jit_block_index_remove(struct jit_block_index *index,
+                            struct jit_block *block);
+struct jit_block *jit_block_index_find(struct jit_block_index *index,
+                                       const void *host_addr);
+void jit_block_index_clear(struct jit_block_index *index);
+void jit_block_index_destroy(struct jit_block_index *index);
+
+/*
+ * arena for each block and its guest metadata. allocations are bucketed into
+ * size classes, each with its own free list, and carved out of large chunks to
+ * avoid a trip through the system allocator for each compile. the chunks are
+ * aligned such that each allocation starts on its own cache line, except for
+ * oversized allocations which go straight to the system allocator
+ */
+#define JIT_ARENA_CHUNK_SIZE (1024 * 1024)
+#define JIT_ARENA_ALIGN 64
+#define JIT_ARENA_NUM_CLASSES 256
+
+struct jit_arena_chunk;
+
+struct jit_arena {
+  struct jit_arena_chunk *chunks;
+  uint8_t *ptr;
+  uint8_t *end;
+  void *free[JIT_ARENA_NUM_CLASSES];
+};
+
+void *jit_arena_alloc(struct jit_arena *arena, size_t size);
+void jit_arena_free(struct jit_arena *arena, void *ptr, size_t size);
+void jit_arena_destroy(struct jit_arena *arena);
+
+#endif
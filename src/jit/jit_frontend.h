@@ -11,6 +11,14 @@ struct jit_frontend;
 
 typedef void (*jit_fallback)(struct jit_guest *, uint32_t, uint32_t);
 
+/* where supported, the fallbacks are placed in their own section, letting the
+   jit profiler attribute samples taken inside of them */
+#if PLATFORM_ANDROID || PLATFORM_LINUX
+#define JIT_FALLBACK_SECTION __attribute__((section("jit_fallback")))
+#else
+#define JIT_FALLBACK_SECTION
+#endif
+
 struct jit_opdef {
   int op;
   const char *name;
@@ -21,12 +29,22 @@ struct jit_opdef {
   jit_fallback fallback;
 };
 
+/* hints passed to analyze_code */
+enum {
+  /* the code has been executed frequently, and is worth spending extra effort
+     compiling */
+  JIT_ANALYZE_HOT = 0x1,
+};
+
 struct jit_frontend {
   struct jit_guest *guest;
 
   void (*destroy)(struct jit_frontend *);
 
-  void (*analyze_code)(struct jit_frontend *, uint32_t, int *);
+  void (*analyze_code)(struct jit_frontend *, uint32_t, int, int *);
+  /* optional, returns flags describing the run-time state the next translation
+     will be specialized for */
+  int (*translate_flags)(struct jit_frontend *);
   void (*translate_code)(struct jit_frontend *, uint32_t, int, struct ir *);
   void (*dump_code)(struct jit_frontend *, uint32_t, int, FILE *output);
 
@@ -2,6 +2,7 @@
 #define JIT_GUEST_H
 
 #include <stdint.h>
+#include "core/memory.h"
 
 typedef uint32_t (*mem_read_cb)(void *, uint32_t, uint32_t);
 typedef void (*mem_write_cb)(void *, uint32_t, uint32_t, uint32_t);
@@ -31,6 +32,19 @@ struct jit_guest {
   void (*w32)(struct memory *, uint32_t, uint32_t);
   void (*w64)(struct memory *, uint32_t, uint64_t);
 
+  /* optional page table mapping each page of the address space to its backing
+     memory, or NULL for mmio pages. used by the backend to inline accesses to
+     memory which haven't been promoted to fastmem */
+  uint8_t **page_table;
+  int page_shift;
+
+  /* optional interface used to write-protect memory containing compiled code,
+     enabling the jit to only invalidate code which has actually been modified.
+     each successful protect is balanced by an unprotect */
+  int (*protect)(struct memory *, uint8_t *, int);
+  void (*unprotect)(struct memory *, uint8_t *, int);
+  uint8_t *(*lookup_host)(struct memory *, const void *);
+
   /* runtime interface used by the backend and dispatch */
   void *data;
   int offset_pc;
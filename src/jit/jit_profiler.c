@@ -0,0 +1,475 @@
+#include "jit/jit_profiler.h"
+#include "core/core.h"
+#include "core/filesystem.h"
+#include "core/time.h"
+#include "jit/jit.h"
+#include "jit/jit_backend.h"
+#include "jit/jit_frontend.h"
+#include "options.h"
+
+#if PLATFORM_ANDROID || PLATFORM_LINUX
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#define HAVE_SAMPLER 1
+
+/* older libcs don't name the thread id member of sigevent */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+/* samples are buffered by the signal handler and attributed at the end of
+   each run, which is short enough that the buffer never fills up in practice */
+#define JIT_PROFILER_MAX_SAMPLES 4096
+
+enum {
+  JIT_PROFILER_IDLE,
+  JIT_PROFILER_RUN,
+  JIT_PROFILER_COMPILE,
+};
+
+struct jit_profiler {
+  struct jit *jit;
+  int64_t interval_ns;
+
+#ifdef HAVE_SAMPLER
+  /* timer measuring the cpu time of the thread last running the jit */
+  timer_t timer;
+  pid_t timer_tid;
+#endif
+
+  /* what the profiled thread is currently doing, read by the signal handler */
+  volatile int state;
+  int compile_prev_state;
+  int64_t compile_start;
+
+  /* host pcs sampled since the last flush */
+  uintptr_t samples[JIT_PROFILER_MAX_SAMPLES];
+  volatile int num_samples;
+
+  /* samples which weren't taken inside of a live block */
+  volatile uint64_t compile_samples;
+  volatile uint64_t dropped_samples;
+  uint64_t dispatch_samples;
+  uint64_t fallback_samples;
+  uint64_t runtime_samples;
+  uint64_t retired_samples;
+
+  int64_t compile_ns;
+  int num_compiles;
+};
+
+/*
+ * sampling
+ */
+#ifdef HAVE_SAMPLER
+static _Thread_local pid_t sampler_tid;
+static struct sigaction old_sigprof;
+static int num_samplers;
+
+static void jit_profiler_signal(int signo, siginfo_t *info, void *ctx) {
+  /* each profiler's timer only measures the cpu time of, and signals, the
+     thread running its jit. however, the thread may be running another jit
+     when it expires */
+  struct jit_profiler *prof = info->si_value.sival_ptr;
+
+  if (!prof || prof->state == JIT_PROFILER_IDLE) {
+    return;
+  }
+
+  /* ignore signals left pending by a timer which has since been moved to
+     another thread */
+  if (prof->timer_tid != sampler_tid) {
+    return;
+  }
+
+  if (prof->state == JIT_PROFILER_COMPILE) {
+    prof->compile_samples++;
+    return;
+  }
+
+  if (prof->num_samples == JIT_PROFILER_MAX_SAMPLES) {
+    prof->dropped_samples++;
+    return;
+  }
+
+  ucontext_t *uctx = ctx;
+#if ARCH_A64
+  uintptr_t pc = uctx->uc_mcontext.pc;
+#elif ARCH_X64
+  uintptr_t pc = uctx->uc_mcontext.gregs[REG_RIP];
+#endif
+
+  prof->samples[prof->num_samples] = pc;
+  prof->num_samples++;
+}
+
+static void jit_profiler_stop_timer(struct jit_profiler *prof) {
+  if (!prof->timer_tid) {
+    return;
+  }
+
+  timer_delete(prof->timer);
+  prof->timer_tid = 0;
+}
+
+static int jit_profiler_start_timer(struct jit_profiler *prof) {
+  struct sigevent sev = {0};
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGPROF;
+  sev.sigev_value.sival_ptr = prof;
+  sev.sigev_notify_thread_id = sampler_tid;
+
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &prof->timer) != 0) {
+    return 0;
+  }
+
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = prof->interval_ns / NS_PER_SEC;
+  spec.it_interval.tv_nsec = prof->interval_ns % NS_PER_SEC;
+  spec.it_value = spec.it_interval;
+
+  if (timer_settime(prof->timer, 0, &spec, NULL) != 0) {
+    timer_delete(prof->timer);
+    return 0;
+  }
+
+  prof->timer_tid = sampler_tid;
+
+  return 1;
+}
+
+static void jit_profiler_stop_sampler() {
+  if (--num_samplers) {
+    return;
+  }
+
+  sigaction(SIGPROF, &old_sigprof, NULL);
+}
+
+static void jit_profiler_sample_thread(struct jit_profiler *prof) {
+  if (!sampler_tid) {
+    sampler_tid = (pid_t)syscall(SYS_gettid);
+  }
+
+  /* the jit may be run from a different thread each time, e.g. when the arm7
+     is run on the aica thread, move the timer to the current thread */
+  if (prof->timer_tid == sampler_tid) {
+    return;
+  }
+
+  jit_profiler_stop_timer(prof);
+
+  if (!jit_profiler_start_timer(prof)) {
+    LOG_WARNING("failed to start sampling timer");
+    jit_profiler_stop_sampler();
+    prof->interval_ns = 0;
+  }
+}
+
+static int jit_profiler_start_sampler() {
+  /* the handler is shared by each profiled jit */
+  if (num_samplers++) {
+    return 1;
+  }
+
+  struct sigaction new_sa;
+  new_sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&new_sa.sa_mask);
+  new_sa.sa_sigaction = &jit_profiler_signal;
+
+  if (sigaction(SIGPROF, &new_sa, &old_sigprof) != 0) {
+    num_samplers--;
+    return 0;
+  }
+
+  return 1;
+}
+#endif
+
+#ifdef HAVE_SAMPLER
+/* bounds of the section the fallbacks are placed in, defined by the linker.
+   see JIT_FALLBACK_SECTION */
+extern const uint8_t __start_jit_fallback[] __attribute__((weak));
+extern const uint8_t __stop_jit_fallback[] __attribute__((weak));
+#endif
+
+static int jit_profiler_in_fallback(uintptr_t pc) {
+#ifdef HAVE_SAMPLER
+  return pc >= (uintptr_t)__start_jit_fallback &&
+         pc < (uintptr_t)__stop_jit_fallback;
+#else
+  return 0;
+#endif
+}
+
+void jit_profiler_flush(struct jit_profiler *prof) {
+  struct jit *jit = prof->jit;
+  struct jit_backend *backend = jit->backend;
+
+  /* the signal handler only interrupts the thread that owns the buffer, stop
+     it from writing to the buffer while it's being read */
+  int state = prof->state;
+  prof->state = JIT_PROFILER_IDLE;
+
+  for (int i = 0; i < prof->num_samples; i++) {
+    uintptr_t pc = prof->samples[i];
+    struct jit_block *block =
+        jit_block_index_find(&jit->reverse_blocks, (void *)pc);
+
+    if (block) {
+      block->samples++;
+    } else if (pc >= (uintptr_t)backend->code &&
+               pc < (uintptr_t)backend->code + backend->code_size) {
+      prof->dispatch_samples++;
+    } else if (jit_profiler_in_fallback(pc)) {
+      prof->fallback_samples++;
+    } else {
+      prof->runtime_samples++;
+    }
+  }
+
+  prof->num_samples = 0;
+  prof->state = state;
+}
+
+void jit_profiler_retire_block(struct jit_profiler *prof,
+                               struct jit_block *block) {
+  jit_profiler_flush(prof);
+
+  prof->retired_samples += block->samples;
+}
+
+void jit_profiler_end_compile(struct jit_profiler *prof,
+                              struct jit_block *block) {
+  int64_t ns = time_nanoseconds() - prof->compile_start;
+
+  prof->compile_ns += ns;
+  prof->num_compiles++;
+
+  if (block) {
+    block->compile_ns += ns;
+  }
+
+  prof->state = prof->compile_prev_state;
+}
+
+void jit_profiler_begin_compile(struct jit_profiler *prof) {
+  prof->compile_prev_state = prof->state;
+  prof->state = JIT_PROFILER_COMPILE;
+  prof->compile_start = time_nanoseconds();
+}
+
+void jit_profiler_end_run(struct jit_profiler *prof) {
+  prof->state = JIT_PROFILER_IDLE;
+
+  jit_profiler_flush(prof);
+}
+
+void jit_profiler_begin_run(struct jit_profiler *prof) {
+#ifdef HAVE_SAMPLER
+  if (prof->interval_ns) {
+    jit_profiler_sample_thread(prof);
+  }
+#endif
+
+  prof->state = JIT_PROFILER_RUN;
+}
+
+/*
+ * report
+ */
+static int jit_profiler_block_cmp(const void *a, const void *b) {
+  const struct jit_block *lhs = *(const struct jit_block **)a;
+  const struct jit_block *rhs = *(const struct jit_block **)b;
+
+  if (lhs->samples != rhs->samples) {
+    return lhs->samples > rhs->samples ? -1 : 1;
+  }
+
+  if (lhs->run_count != rhs->run_count) {
+    return lhs->run_count > rhs->run_count ? -1 : 1;
+  }
+
+  return 0;
+}
+
+static double jit_profiler_pct(uint64_t samples, uint64_t total) {
+  return total ? (samples * 100.0) / total : 0.0;
+}
+
+static void jit_profiler_write_json(struct jit_profiler *prof, FILE *file,
+                                    struct jit_block **blocks, int num_blocks,
+                                    uint64_t total) {
+  struct jit *jit = prof->jit;
+
+  fprintf(file, "{\n");
+  fprintf(file, "  \"tag\": \"%s\",\n", jit->tag);
+  fprintf(file, "  \"interval_ns\": %" PRId64 ",\n", prof->interval_ns);
+  fprintf(file, "  \"samples\": %" PRIu64 ",\n", total);
+  fprintf(file, "  \"dispatch_samples\": %" PRIu64 ",\n",
+          prof->dispatch_samples);
+  fprintf(file, "  \"compile_samples\": %" PRIu64 ",\n",
+          prof->compile_samples);
+  fprintf(file, "  \"fallback_samples\": %" PRIu64 ",\n",
+          prof->fallback_samples);
+  fprintf(file, "  \"runtime_samples\": %" PRIu64 ",\n",
+          prof->runtime_samples);
+  fprintf(file, "  \"retired_samples\": %" PRIu64 ",\n",
+          prof->retired_samples);
+  fprintf(file, "  \"dropped_samples\": %" PRIu64 ",\n",
+          prof->dropped_samples);
+  fprintf(file, "  \"compile_ns\": %" PRId64 ",\n", prof->compile_ns);
+  fprintf(file, "  \"compiles\": %d,\n", prof->num_compiles);
+  fprintf(file, "  \"blocks\": [");
+
+  for (int i = 0; i < num_blocks; i++) {
+    struct jit_block *block = blocks[i];
+
+    fprintf(file, "%s\n    {", i ? "," : "");
+    fprintf(file, "\"guest_addr\": \"0x%08x\", ", block->guest_addr);
+    fprintf(file, "\"guest_size\": %d, ", block->guest_size);
+    fprintf(file, "\"host_addr\": \"0x%" PRIxPTR "\", ",
+            (uintptr_t)block->host_addr);
+    fprintf(file, "\"host_size\": %d, ", block->host_size);
+    fprintf(file, "\"samples\": %" PRIu64 ", ", block->samples);
+    fprintf(file, "\"runs\": %" PRIu64 ", ", block->run_count);
+    fprintf(file, "\"instrs\": %" PRIu64 ", ",
+            block->run_count * block->num_instrs);
+    fprintf(file, "\"cycles\": %" PRIu64 ", ",
+            block->run_count * block->num_cycles);
+    fprintf(file, "\"compile_ns\": %" PRId64 ", ", block->compile_ns);
+    fprintf(file, "\"hot\": %d}", block->hot);
+  }
+
+  fprintf(file, "\n  ]\n}\n");
+}
+
+static void jit_profiler_write_text(struct jit_profiler *prof, FILE *file,
+                                    struct jit_block **blocks, int num_blocks,
+                                    uint64_t total) {
+  struct jit *jit = prof->jit;
+  uint64_t block_samples = total - prof->dispatch_samples -
+                           prof->compile_samples - prof->fallback_samples -
+                           prof->runtime_samples - prof->retired_samples;
+
+  fprintf(file, "# %s block profile, sampled every %" PRId64 " us\n",
+          jit->tag, prof->interval_ns / NS_PER_USEC);
+  fprintf(file,
+          "# %" PRIu64 " samples: blocks %.2f%%, dispatch %.2f%%, "
+          "compile %.2f%%, fallback %.2f%%, runtime %.2f%%, retired %.2f%%, "
+          "dropped %" PRIu64 "\n",
+          total, jit_profiler_pct(block_samples, total),
+          jit_profiler_pct(prof->dispatch_samples, total),
+          jit_profiler_pct(prof->compile_samples, total),
+          jit_profiler_pct(prof->fallback_samples, total),
+          jit_profiler_pct(prof->runtime_samples, total),
+          jit_profiler_pct(prof->retired_samples, total),
+          prof->dropped_samples);
+  fprintf(file, "# %d compiles in %.2f ms\n", prof->num_compiles,
+          prof->compile_ns / (double)NS_PER_MS);
+
+  /* the trailing fields match those written to the perf map, so the two can
+     be joined on the host address or symbol name */
+  fprintf(file,
+          "# samples time%% runs instrs cycles compile_us host size symbol\n");
+
+  for (int i = 0; i < num_blocks; i++) {
+    struct jit_block *block = blocks[i];
+
+    fprintf(file,
+            "%" PRIu64 " %.2f %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64
+            " %" PRIxPTR " %x %s_0x%08x%s\n",
+            block->samples, jit_profiler_pct(block->samples, total),
+            block->run_count, block->run_count * block->num_instrs,
+            block->run_count * block->num_cycles,
+            block->compile_ns / NS_PER_USEC, (uintptr_t)block->host_addr,
+            block->host_size, jit->tag, block->guest_addr,
+            block->hot ? " hot" : "");
+  }
+}
+
+void jit_profiler_write_report(struct jit_profiler *prof) {
+  struct jit *jit = prof->jit;
+  struct jit_block_index *index = &jit->reverse_blocks;
+  int json = !strcmp(OPTION_jit_profile_format, "json");
+
+  jit_profiler_flush(prof);
+
+  char filename[PATH_MAX];
+  snprintf(filename, sizeof(filename), "%s" PATH_SEPARATOR "%s-profile.%s",
+           fs_appdir(), jit->tag, json ? "json" : "txt");
+
+  FILE *file = fopen(filename, "w");
+  if (!file) {
+    LOG_WARNING("failed to open %s", filename);
+    return;
+  }
+
+  /* only report blocks which were either run or sampled */
+  struct jit_block **blocks = malloc(index->size * sizeof(struct jit_block *));
+  int num_blocks = 0;
+  uint64_t total = prof->dispatch_samples + prof->compile_samples +
+                   prof->fallback_samples + prof->runtime_samples +
+                   prof->retired_samples;
+
+  for (int i = 0; i < index->size; i++) {
+    struct jit_block *block = index->entries[i];
+
+    if (!block->samples && !block->run_count) {
+      continue;
+    }
+
+    blocks[num_blocks++] = block;
+    total += block->samples;
+  }
+
+  qsort(blocks, num_blocks, sizeof(struct jit_block *),
+        &jit_profiler_block_cmp);
+
+  if (json) {
+    jit_profiler_write_json(prof, file, blocks, num_blocks, total);
+  } else {
+    jit_profiler_write_text(prof, file, blocks, num_blocks, total);
+  }
+
+  free(blocks);
+  fclose(file);
+
+  LOG_INFO("wrote block profile to %s", filename);
+}
+
+void jit_profiler_destroy(struct jit_profiler *prof) {
+#ifdef HAVE_SAMPLER
+  if (prof->interval_ns) {
+    jit_profiler_stop_timer(prof);
+    jit_profiler_stop_sampler();
+  }
+#endif
+
+  free(prof);
+}
+
+struct jit_profiler *jit_profiler_create(struct jit *jit) {
+  struct jit_profiler *prof = calloc(1, sizeof(struct jit_profiler));
+
+  prof->jit = jit;
+
+  if (OPTION_jit_sample > 0) {
+#ifdef HAVE_SAMPLER
+    /* the timer is started on the first run, by the thread running the jit */
+    if (jit_profiler_start_sampler()) {
+      prof->interval_ns = OPTION_jit_sample * NS_PER_USEC;
+    } else {
+      LOG_WARNING("failed to start sampling profiler");
+    }
+#else
+    LOG_WARNING("sampling profiler isn't supported on this platform");
+#endif
+  }
+
+  return prof;
+}
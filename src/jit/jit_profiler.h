@@ -0,0 +1,42 @@
+#ifndef JIT_PROFILER_H
+#define JIT_PROFILER_H
+
+#include <stdint.h>
+
+struct jit;
+struct jit_block;
+struct jit_profiler;
+
+/* opt-in profiler attributing host time and guest instructions to each
+   compiled block. guest instructions are estimated from each block's
+   execution count, compile time is measured directly, and host time is
+   measured by periodically sampling the pc of the thread running the compiled
+   code, every so often of its cpu time. samples which don't land inside of a
+   block are attributed to either dispatch, compilation, the fallbacks called
+   out to by the blocks, or the rest of the runtime */
+struct jit_profiler *jit_profiler_create(struct jit *jit);
+void jit_profiler_destroy(struct jit_profiler *prof);
+
+/* bracket each run of the compiled code, samples are only taken while the
+   calling thread is inside of a run */
+void jit_profiler_begin_run(struct jit_profiler *prof);
+void jit_profiler_end_run(struct jit_profiler *prof);
+
+/* bracket the compilation of a block, which may be nested inside of a run */
+void jit_profiler_begin_compile(struct jit_profiler *prof);
+void jit_profiler_end_compile(struct jit_profiler *prof,
+                              struct jit_block *block);
+
+/* attribute any pending samples to the blocks they were taken in. must be
+   called before blocks are freed */
+void jit_profiler_flush(struct jit_profiler *prof);
+
+/* account for a block being freed, keeping its samples in the totals */
+void jit_profiler_retire_block(struct jit_profiler *prof,
+                               struct jit_block *block);
+
+/* write out a report of every live block, sorted by host time, to the
+   application directory */
+void jit_profiler_write_report(struct jit_profiler *prof);
+
+#endif
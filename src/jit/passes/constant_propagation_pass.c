@@ -13,6 +13,12 @@ static void cprop_run_block(struct cprop *cprop, struct ir *ir,
     struct ir_value *arg1 = instr->arg[1];
     struct ir_value *result = instr->result;
 
+    /* don't fold host pointers, the result couldn't be relocated if the ir
+       is persisted */
+    if ((arg0 && arg0->ptr) || (arg1 && arg1->ptr)) {
+      continue;
+    }
+
     /* fold constant binary ops */
     if (arg0 && ir_is_constant(arg0) && ir_is_int(arg0->type) && arg1 &&
         ir_is_constant(arg1) && ir_is_int(arg1->type) && result) {
@@ -5,66 +5,297 @@
 DEFINE_PASS_STAT(sext_removed, "sign extends eliminated");
 DEFINE_PASS_STAT(zext_removed, "zero extends eliminated");
 DEFINE_PASS_STAT(trunc_removed, "truncations eliminated");
+DEFINE_PASS_STAT(loads_extended, "extensions folded into loads");
+DEFINE_PASS_STAT(ops_narrowed, "operations narrowed");
 
-static void cve_run_block(struct ir *ir, struct ir_block *block) {
-  list_for_each_entry_safe(instr, &block->instrs, struct ir_instr, it) {
-    /* eliminate unnecessary sext / zext operations */
-    if (instr->op == OP_LOAD_HOST || instr->op == OP_LOAD_GUEST ||
-        instr->op == OP_LOAD_FAST || instr->op == OP_LOAD_CONTEXT) {
-      enum ir_type memory_type = VALUE_V;
-      int same_type = 1;
-      int all_sext = 1;
-      int all_zext = 1;
-
-      list_for_each_entry(use, &instr->result->uses, struct ir_use, it) {
-        struct ir_instr *use_instr = use->instr;
-        struct ir_value *use_result = use_instr->result;
-
-        if (use_instr->op == OP_SEXT || use_instr->op == OP_ZEXT) {
-          if (memory_type == VALUE_V) {
-            memory_type = use_result->type;
-          }
-
-          if (memory_type != use_result->type) {
-            same_type = 0;
-          }
-        }
-
-        if (use_instr->op != OP_SEXT) {
-          all_sext = 0;
-        }
-
-        if (use_instr->op != OP_ZEXT) {
-          all_zext = 0;
-        }
-      }
-
-      if (same_type && all_sext) {
-        /* TODO implement */
+/* instructions orphaned by the pass are tagged, and removed once all blocks
+   have been processed if nothing else still uses them. removing them
+   immediately isn't safe, as they may follow the instruction being visited */
+#define CVE_ORPHAN 1
 
-        STAT_sext_removed++;
-      } else if (same_type && all_zext) {
-        /* TODO implement */
+static void cve_orphan(struct ir_value *v) {
+  if (v->def) {
+    v->def->tag = CVE_ORPHAN;
+  }
+}
 
-        STAT_zext_removed++;
-      }
-    } else if (instr->op == OP_STORE_HOST || instr->op == OP_STORE_GUEST ||
-               instr->op == OP_STORE_FAST || instr->op == OP_STORE_CONTEXT) {
-      struct ir_value *store_value = instr->arg[1];
+static int cve_has_one_use(struct ir_value *v) {
+  return !list_empty(&v->uses) &&
+         list_first_entry(&v->uses, struct ir_use, it) ==
+             list_last_entry(&v->uses, struct ir_use, it);
+}
+
+/* fold a sign or zero extension which every user of a narrow load performs
+   into the load itself, letting the backend emit a single movsx / movzx */
+static void cve_fold_load(struct ir *ir, struct ir_instr *instr) {
+  struct ir_value *result = instr->result;
+
+  /* already folded */
+  if (instr->arg[1]) {
+    return;
+  }
+
+  if (result->type != VALUE_I8 && result->type != VALUE_I16) {
+    return;
+  }
+
+  if (list_empty(&result->uses)) {
+    return;
+  }
+
+  enum ir_op ext_op = OP_SEXT;
+  enum ir_type ext_type = VALUE_V;
+
+  list_for_each_entry(use, &result->uses, struct ir_use, it) {
+    struct ir_instr *use_instr = use->instr;
+
+    if (use_instr->op != OP_SEXT && use_instr->op != OP_ZEXT) {
+      return;
+    }
+
+    if (ext_type == VALUE_V) {
+      ext_op = use_instr->op;
+      ext_type = use_instr->result->type;
+    }
+
+    if (use_instr->op != ext_op || use_instr->result->type != ext_type) {
+      return;
+    }
+  }
+
+  /* the backend extends into 32-bit registers, leave 64-bit extensions to
+     the standalone instruction */
+  if (ext_type != VALUE_I16 && ext_type != VALUE_I32) {
+    return;
+  }
 
-      if (store_value->def && store_value->def->op == OP_TRUNC) {
-        /* TODO implement */
+  /* the load's result can't be retyped in place, as forwarding the
+     extensions' uses to it would grow the use list being iterated. instead,
+     emit a wide copy of the load directly after it */
+  struct ir_insert_point point = {NULL, instr};
+  ir_set_insert_point(ir, &point);
 
-        /* note, don't actually remove the truncation as other values may
-           reference it. let DCE clean it up */
+  int ext = ext_op == OP_SEXT ? IR_LOAD_SEXT : IR_LOAD_ZEXT;
+  struct ir_instr *load = ir_append_instr(ir, instr->op, ext_type);
+  ir_set_arg0(ir, load, instr->arg[0]);
+  ir_set_arg1(ir, load, ir_alloc_int(ir, ext, result->type));
+
+  list_for_each_entry(use, &result->uses, struct ir_use, it) {
+    struct ir_instr *use_instr = use->instr;
+    ir_replace_uses(use_instr->result, load->result);
+    use_instr->tag = CVE_ORPHAN;
+  }
+
+  instr->tag = CVE_ORPHAN;
+
+  STAT_loads_extended++;
+}
+
+/* returns the value of type narrow_type whose low bits match those of v, or
+   NULL if one isn't readily available */
+static struct ir_value *cve_narrow_arg(struct ir *ir, struct ir_value *v,
+                                       enum ir_type narrow_type) {
+  if (ir_is_constant(v)) {
+    return ir_alloc_int(ir, (int64_t)ir_zext_constant(v), narrow_type);
+  }
+
+  struct ir_instr *def = v->def;
+
+  if (def && (def->op == OP_SEXT || def->op == OP_ZEXT) &&
+      def->arg[0]->type == narrow_type) {
+    return def->arg[0];
+  }
+
+  return NULL;
+}
+
+/* the low bits of these operations only depend on the low bits of their
+   arguments, so they may be performed at the width of a truncation of their
+   result */
+static int cve_can_narrow(enum ir_op op) {
+  switch (op) {
+    case OP_ADD:
+    case OP_SUB:
+    case OP_AND:
+    case OP_OR:
+    case OP_XOR:
+    case OP_NOT:
+    case OP_NEG:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static void cve_narrow_op(struct ir *ir, struct ir_instr *instr) {
+  struct ir_instr *def = instr->arg[0]->def;
+  enum ir_type narrow_type = instr->result->type;
+
+  /* the wide operation must only exist to produce the truncated value */
+  if (!cve_has_one_use(def->result)) {
+    return;
+  }
+
+  struct ir_value *args[IR_MAX_ARGS] = {0};
+  int num_args = 0;
+
+  for (int i = 0; i < IR_MAX_ARGS && def->arg[i]; i++) {
+    args[i] = cve_narrow_arg(ir, def->arg[i], narrow_type);
+
+    if (!args[i]) {
+      return;
+    }
+
+    num_args++;
+  }
+
+  /* a fully constant operation is left for constant propagation */
+  int all_constant = 1;
+
+  for (int i = 0; i < num_args; i++) {
+    all_constant &= ir_is_constant(args[i]);
+  }
+
+  if (all_constant) {
+    return;
+  }
+
+  struct ir_insert_point point = {NULL, instr};
+  ir_set_insert_point(ir, &point);
+
+  struct ir_instr *narrow = ir_append_instr(ir, def->op, narrow_type);
+
+  for (int i = 0; i < num_args; i++) {
+    cve_orphan(def->arg[i]);
+    ir_set_arg(ir, narrow, i, args[i]);
+  }
+
+  ir_replace_uses(instr->result, narrow->result);
+  instr->tag = CVE_ORPHAN;
+  def->tag = CVE_ORPHAN;
+
+  STAT_ops_narrowed++;
+}
+
+static void cve_simplify_trunc(struct ir *ir, struct ir_instr *instr) {
+  struct ir_value *arg = instr->arg[0];
+  struct ir_instr *def = arg->def;
+
+  if (!def) {
+    return;
+  }
+
+  if (def->op == OP_SEXT || def->op == OP_ZEXT) {
+    struct ir_value *src = def->arg[0];
+    int src_size = ir_type_size(src->type);
+    int dst_size = ir_type_size(instr->result->type);
+
+    if (src_size == dst_size) {
+      /* trunc(ext(x)) back to x's type is x */
+      ir_replace_uses(instr->result, src);
+      instr->tag = CVE_ORPHAN;
+    } else if (src_size < dst_size) {
+      /* trunc(ext(x)) to a type still wider than x is a narrower ext(x) */
+      instr->op = def->op;
+      ir_set_arg0(ir, instr, src);
+    } else {
+      /* trunc(ext(x)) to a type narrower than x is trunc(x) */
+      ir_set_arg0(ir, instr, src);
+    }
+
+    def->tag = CVE_ORPHAN;
+  } else if (def->op == OP_TRUNC) {
+    /* trunc(trunc(x)) is trunc(x) */
+    ir_set_arg0(ir, instr, def->arg[0]);
+    def->tag = CVE_ORPHAN;
+  } else if (cve_can_narrow(def->op)) {
+    cve_narrow_op(ir, instr);
+  }
+}
+
+static void cve_simplify_ext(struct ir *ir, struct ir_instr *instr) {
+  struct ir_value *arg = instr->arg[0];
+  struct ir_instr *def = arg->def;
+
+  /* sext(sext(x)) is sext(x), and zext(zext(x)) is zext(x) */
+  if (def && def->op == instr->op) {
+    ir_set_arg0(ir, instr, def->arg[0]);
+    def->tag = CVE_ORPHAN;
+  }
+}
+
+static void cve_run_block(struct cve *cve, struct ir *ir,
+                          struct ir_block *block) {
+  list_for_each_entry_safe(instr, &block->instrs, struct ir_instr, it) {
+    /* skip instructions orphaned earlier in the block */
+    if (instr->tag == CVE_ORPHAN) {
+      continue;
+    }
+
+    switch (instr->op) {
+      case OP_LOAD_GUEST:
+      case OP_LOAD_FAST:
+        cve_fold_load(ir, instr);
+        break;
+      case OP_TRUNC:
+        cve_simplify_trunc(ir, instr);
+        break;
+      case OP_SEXT:
+      case OP_ZEXT:
+        cve_simplify_ext(ir, instr);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void cve_remove_orphans(struct cve *cve, struct ir *ir,
+                               struct ir_block *block) {
+  /* iterate in reverse so orphans used only by later orphans are removed */
+  list_for_each_entry_safe_reverse(instr, &block->instrs, struct ir_instr, it) {
+    if (instr->tag != CVE_ORPHAN || !list_empty(&instr->result->uses)) {
+      continue;
+    }
+
+    switch (instr->op) {
+      case OP_SEXT:
+        STAT_sext_removed++;
+        break;
+      case OP_ZEXT:
+        STAT_zext_removed++;
+        break;
+      case OP_TRUNC:
         STAT_trunc_removed++;
-      }
+        break;
+      default:
+        break;
     }
+
+    ir_remove_instr(ir, instr);
   }
 }
 
-void cve_run(struct ir *ir) {
+void cve_run(struct cve *cve, struct ir *ir) {
+  list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
+    list_for_each_entry(instr, &block->instrs, struct ir_instr, it) {
+      instr->tag = 0;
+    }
+  }
+
   list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
-    cve_run_block(ir, block);
+    cve_run_block(cve, ir, block);
   }
+
+  /* orphans may be defined in an earlier block than their last user, so
+     wait until every block has been processed before removing them */
+  list_for_each_entry_reverse(block, &ir->blocks, struct ir_block, it) {
+    cve_remove_orphans(cve, ir, block);
+  }
+}
+
+void cve_destroy(struct cve *cve) {}
+
+struct cve *cve_create() {
+  return NULL;
 }
@@ -13,13 +13,50 @@ struct lse_entry {
   struct ir_value *value;
 };
 
+/* max number of constants carried across an edge into a block */
+#define LSE_MAX_CONSTANTS 32
+
+/* the blocks of a multi-block region are chained together by local branches.
+   state is carried across these edges in two cases:
+
+   1.) a block with a single predecessor inherits the constants that were
+       available at the end of it. only constants are carried, as the register
+       allocator can't keep other values live across blocks
+
+   2.) a store at the end of a block is dead if every successor overwrites it
+       before the context is read
+
+   the entry block, and any block branched to from itself or a later block,
+   may yield to the dispatcher from its prolog, exposing the context there */
+struct lse_constant {
+  int offset;
+  struct ir_value *value;
+};
+
+struct lse_block {
+  int num_preds;
+  int yields;
+
+  /* constants available on entry, inherited from the single predecessor */
+  struct lse_constant constants[LSE_MAX_CONSTANTS];
+  int num_constants;
+
+  /* context bytes overwritten after entry, before they're read */
+  uint8_t overwritten[IR_MAX_CONTEXT / 8];
+};
+
 struct lse {
   /* current cache token */
   uint64_t token;
 
   struct lse_entry available[IR_MAX_CONTEXT];
+
+  struct lse_block *blocks;
+  int max_blocks;
 };
 
+#define lse_get_block(lse, block) (&(lse)->blocks[(block)->tag])
+
 static void lse_clear_available(struct lse *lse) {
   do {
     lse->token++;
@@ -99,14 +136,128 @@ static int lse_test_available(struct lse *lse, int offset, int size) {
   return 1;
 }
 
+/* returns the number of branch targets, filling out the local blocks among
+   them. if any target isn't a local block, control may leave the ir */
+static int lse_branch_targets(struct ir_instr *instr,
+                              struct ir_block **targets) {
+  int num_targets = 0;
+  int num_local = 0;
+
+  if (instr->op != OP_BRANCH && instr->op != OP_BRANCH_COND) {
+    return 0;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    struct ir_value *target = instr->arg[i];
+
+    if (!target) {
+      continue;
+    }
+
+    num_targets++;
+
+    if (target->type == VALUE_BLOCK) {
+      targets[num_local++] = target->blk;
+    }
+  }
+
+  return num_local == num_targets ? num_local : -1;
+}
+
+static void lse_init_blocks(struct lse *lse, struct ir *ir) {
+  int num_blocks = 0;
+
+  list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
+    block->tag = num_blocks++;
+  }
+
+  if (num_blocks > lse->max_blocks) {
+    lse->max_blocks = num_blocks;
+    lse->blocks =
+        realloc(lse->blocks, lse->max_blocks * sizeof(struct lse_block));
+  }
+
+  for (int i = 0; i < num_blocks; i++) {
+    struct lse_block *info = &lse->blocks[i];
+    info->num_preds = 0;
+    info->yields = i == 0;
+    info->num_constants = 0;
+  }
+
+  list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
+    struct ir_instr *last_instr =
+        list_last_entry(&block->instrs, struct ir_instr, it);
+
+    if (!last_instr ||
+        (last_instr->op != OP_BRANCH && last_instr->op != OP_BRANCH_COND)) {
+      continue;
+    }
+
+    for (int i = 0; i < 2; i++) {
+      struct ir_value *target = last_instr->arg[i];
+
+      if (!target || target->type != VALUE_BLOCK) {
+        continue;
+      }
+
+      struct lse_block *info = lse_get_block(lse, target->blk);
+      info->num_preds++;
+      info->yields |= target->blk->tag <= block->tag;
+    }
+  }
+}
+
+/* pass the constants available at the end of the block to any successor it
+   is the only predecessor of */
+static void lse_forward_constants(struct lse *lse, struct ir_instr *instr) {
+  for (int i = 0; i < 2; i++) {
+    struct ir_value *target = instr->arg[i];
+
+    if (!target || target->type != VALUE_BLOCK) {
+      continue;
+    }
+
+    struct lse_block *info = lse_get_block(lse, target->blk);
+
+    if (info->num_preds != 1 || info->yields) {
+      continue;
+    }
+
+    info->num_constants = 0;
+
+    for (int offset = 0; offset < IR_MAX_CONTEXT; offset++) {
+      struct ir_value *value = lse_get_available(lse, offset);
+
+      if (!value || !ir_is_constant(value)) {
+        continue;
+      }
+
+      if (info->num_constants >= LSE_MAX_CONSTANTS) {
+        break;
+      }
+
+      struct lse_constant *c = &info->constants[info->num_constants++];
+      c->offset = offset;
+      c->value = value;
+    }
+  }
+}
+
 static void lse_eliminate_loads(struct lse *lse, struct ir *ir,
                                 struct ir_block *block) {
+  struct lse_block *info = lse_get_block(lse, block);
+
   lse_clear_available(lse);
 
+  for (int i = 0; i < info->num_constants; i++) {
+    lse_set_available(lse, info->constants[i].offset, info->constants[i].value);
+  }
+
   list_for_each_entry_safe(instr, &block->instrs, struct ir_instr, it) {
     if (instr->op == OP_FALLBACK || instr->op == OP_CALL) {
       lse_clear_available(lse);
     } else if (instr->op == OP_BRANCH || instr->op == OP_BRANCH_COND) {
+      lse_forward_constants(lse, instr);
       lse_clear_available(lse);
     } else if (instr->op == OP_LOAD_CONTEXT) {
       /* if there is already a value available for this offset, reuse it and
@@ -133,15 +284,53 @@ static void lse_eliminate_loads(struct lse *lse, struct ir *ir,
   }
 }
 
+/* a context byte is overwritten on exit from the block if it's overwritten
+   on entry to every successor, none of which yield */
+static void lse_join_successors(struct lse *lse, struct ir_instr *instr) {
+  struct ir_block *targets[2];
+  int num_targets = lse_branch_targets(instr, targets);
+
+  lse_clear_available(lse);
+
+  if (num_targets <= 0) {
+    return;
+  }
+
+  for (int i = 0; i < num_targets; i++) {
+    if (lse_get_block(lse, targets[i])->yields) {
+      return;
+    }
+  }
+
+  for (int offset = 0; offset < IR_MAX_CONTEXT; offset++) {
+    int overwritten = 1;
+
+    for (int i = 0; i < num_targets && overwritten; i++) {
+      struct lse_block *info = lse_get_block(lse, targets[i]);
+      overwritten = info->overwritten[offset >> 3] & (1 << (offset & 7));
+    }
+
+    if (overwritten) {
+      /* the value doesn't matter, only that the byte is covered */
+      struct lse_entry *entry = &lse->available[offset];
+      entry->token = lse->token;
+      entry->offset = offset;
+      entry->value = NULL;
+    }
+  }
+}
+
 static void lse_eliminate_stores(struct lse *lse, struct ir *ir,
                                  struct ir_block *block) {
+  struct lse_block *info = lse_get_block(lse, block);
+
   lse_clear_available(lse);
 
   list_for_each_entry_safe_reverse(instr, &block->instrs, struct ir_instr, it) {
     if (instr->op == OP_FALLBACK || instr->op == OP_CALL) {
       lse_clear_available(lse);
     } else if (instr->op == OP_BRANCH || instr->op == OP_BRANCH_COND) {
-      lse_clear_available(lse);
+      lse_join_successors(lse, instr);
     } else if (instr->op == OP_LOAD_CONTEXT) {
       int offset = instr->arg[0]->i32;
       int size = ir_type_size(instr->result->type);
@@ -162,19 +351,35 @@ static void lse_eliminate_stores(struct lse *lse, struct ir *ir,
       lse_set_available(lse, offset, instr->arg[1]);
     }
   }
+
+  /* record what's overwritten on entry for the block's predecessors */
+  for (int offset = 0; offset < IR_MAX_CONTEXT; offset++) {
+    uint8_t mask = 1 << (offset & 7);
+
+    if (lse->available[offset].token == lse->token) {
+      info->overwritten[offset >> 3] |= mask;
+    } else {
+      info->overwritten[offset >> 3] &= ~mask;
+    }
+  }
 }
 
 void lse_run(struct lse *lse, struct ir *ir) {
+  lse_init_blocks(lse, ir);
+
+  /* successors in a region follow their predecessor, unless they're branched
+     to backwards, in which case they yield and nothing is carried to them */
   list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
     lse_eliminate_loads(lse, ir, block);
   }
 
-  list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
+  list_for_each_entry_reverse(block, &ir->blocks, struct ir_block, it) {
     lse_eliminate_stores(lse, ir, block);
   }
 }
 
 void lse_destroy(struct lse *lse) {
+  free(lse->blocks);
   free(lse);
 }
 
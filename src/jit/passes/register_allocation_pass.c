@@ -12,6 +12,19 @@
 
 DEFINE_PASS_STAT(gprs_spilled, "gprs spilled");
 DEFINE_PASS_STAT(fprs_spilled, "fprs spilled");
+DEFINE_PASS_STAT(context_eliminated, "context loads / stores eliminated");
+
+/* max number of context values promoted to registers of each kind. promoted
+   registers are unavailable to the rest of the allocation, so a minimum number
+   of registers is always left over */
+#define RA_MAX_PROMOTED_GPRS 3
+#define RA_MAX_PROMOTED_FPRS 4
+#define RA_MAX_PROMOTED_VECS 4
+#define RA_MIN_FREE_REGS 4
+
+/* set on the tag of blocks which are part of a loop inside of the ir */
+#define RA_BLOCK_IN_LOOP 0x1
+#define RA_BLOCK_INDEX_SHIFT 1
 
 struct ra_tmp;
 
@@ -22,6 +35,9 @@ struct ra_bin {
   /* machine register backing this bin */
   const struct jit_register *reg;
 
+  /* register is holding a promoted context value */
+  int promoted;
+
   /* current temporary packed in this bin */
   int tmp_idx;
 };
@@ -58,6 +74,29 @@ struct ra_use {
   int next_idx;
 };
 
+/* context candidates represent a context value which may be promoted */
+struct ra_candidate {
+  enum ir_type type;
+  int num_uses;
+  int num_blocks;
+  struct ir_block *last_block;
+
+  /* the value is written to */
+  int dirty;
+
+  /* the value is accessed inside of a loop, where it stays resident across
+     iterations once promoted */
+  int in_loop;
+
+  /* the word is the start of an access of any type or alignment, including
+     those which can't be promoted */
+  int touched;
+
+  /* the value is accessed in a way that prevents promotion, e.g. it's partially
+     accessed, or accessed as multiple types */
+  int invalid;
+};
+
 struct ra {
   const struct jit_register *registers;
   int num_registers;
@@ -71,6 +110,8 @@ struct ra {
   struct ra_use *uses;
   int num_uses;
   int max_uses;
+
+  struct ra_candidate candidates[IR_MAX_CONTEXT];
 };
 
 #define NO_REGISTER -1
@@ -89,20 +130,25 @@ struct ra {
 #define ra_get_tmp(v) (&ra->tmps[(v)->tag])
 #define ra_set_tmp(v, t) (v)->tag = (int)((t)-ra->tmps)
 
-static int ra_reg_can_store(const struct jit_register *reg,
-                            const struct ir_value *v) {
+static int ra_reg_can_store_type(const struct jit_register *reg,
+                                 enum ir_type type) {
   if (reg->flags & JIT_ALLOCATE) {
-    if (ir_is_int(v->type) && v->type <= VALUE_I64) {
+    if (ir_is_int(type) && type <= VALUE_I64) {
       return reg->flags & JIT_REG_I64;
-    } else if (ir_is_float(v->type) && v->type <= VALUE_F64) {
+    } else if (ir_is_float(type) && type <= VALUE_F64) {
       return reg->flags & JIT_REG_F64;
-    } else if (ir_is_vector(v->type) && v->type <= VALUE_V128) {
+    } else if (ir_is_vector(type) && type <= VALUE_V128) {
       return reg->flags & JIT_REG_V128;
     }
   }
   return 0;
 }
 
+static int ra_reg_can_store(const struct jit_register *reg,
+                            const struct ir_value *v) {
+  return ra_reg_can_store_type(reg, v->type);
+}
+
 static void ra_add_use(struct ra *ra, struct ra_tmp *tmp, int ordinal) {
   if (ra->num_uses >= ra->max_uses) {
     /* grow array */
@@ -391,7 +437,7 @@ static int ra_alloc_free_reg(struct ra *ra, struct ir *ir, struct ra_tmp *tmp) {
     struct ra_bin *bin = ra_get_bin(i);
     struct ra_tmp *packed = ra_get_packed(bin);
 
-    if (packed) {
+    if (packed || bin->promoted) {
       continue;
     }
 
@@ -671,7 +717,310 @@ static void ra_reset(struct ra *ra, struct ir *ir, struct ir_block *block) {
   }
 }
 
+static int ra_promote_reg(struct ra *ra, enum ir_type type) {
+  /* count the registers still available for the type */
+  int num_free = 0;
+
+  for (int i = 0; i < ra->num_registers; i++) {
+    struct ra_bin *bin = ra_get_bin(i);
+
+    if (!bin->promoted && ra_reg_can_store_type(bin->reg, type)) {
+      num_free++;
+    }
+  }
+
+  if (num_free <= RA_MIN_FREE_REGS) {
+    return NO_REGISTER;
+  }
+
+  /* prefer callee-saved registers, which don't need to be saved around the
+     calls made by the load / store thunks */
+  int reg = NO_REGISTER;
+
+  for (int i = ra->num_registers - 1; i >= 0; i--) {
+    struct ra_bin *bin = ra_get_bin(i);
+
+    if (bin->promoted || !ra_reg_can_store_type(bin->reg, type)) {
+      continue;
+    }
+
+    if (reg == NO_REGISTER) {
+      reg = i;
+    }
+
+    if (bin->reg->flags & JIT_CALLEE_SAVE) {
+      reg = i;
+      break;
+    }
+  }
+
+  return reg;
+}
+
+static int ra_can_promote_type(enum ir_type type) {
+  return type == VALUE_I32 || type == VALUE_F32 || type == VALUE_V128;
+}
+
+static void ra_find_loops(struct ra *ra, struct ir *ir) {
+  int index = 0;
+
+  list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
+    block->tag = index++ << RA_BLOCK_INDEX_SHIFT;
+  }
+
+  /* mark each block between a backwards branch and its target */
+  list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
+    struct ir_instr *last_instr =
+        list_last_entry(&block->instrs, struct ir_instr, it);
+
+    if (!last_instr ||
+        (last_instr->op != OP_BRANCH && last_instr->op != OP_BRANCH_COND)) {
+      continue;
+    }
+
+    for (int i = 0; i < IR_MAX_ARGS; i++) {
+      struct ir_value *arg = last_instr->arg[i];
+
+      if (!arg || arg->type != VALUE_BLOCK) {
+        continue;
+      }
+
+      int src_index = (int)(block->tag >> RA_BLOCK_INDEX_SHIFT);
+      int dst_index = (int)(arg->blk->tag >> RA_BLOCK_INDEX_SHIFT);
+
+      if (dst_index > src_index) {
+        continue;
+      }
+
+      struct ir_block *next = arg->blk;
+
+      while (1) {
+        next->tag |= RA_BLOCK_IN_LOOP;
+
+        if (next == block) {
+          break;
+        }
+
+        next = list_next_entry(next, struct ir_block, it);
+      }
+    }
+  }
+}
+
+/* promoted values are loaded from the context on entry and after each call,
+   and the dirty ones are stored back before each call and wherever control may
+   leave the ir. this mirrors where the backend syncs them, see
+   x64_backend_emit */
+static void ra_count_syncs(struct ir *ir, int *num_calls, int *num_exits) {
+  struct ir_block *first = list_first_entry(&ir->blocks, struct ir_block, it);
+
+  *num_calls = 0;
+  *num_exits = 0;
+
+  list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
+    /* the checks for yielding exit on two separate paths */
+    if (block == first || ir_is_loop_header(ir, block)) {
+      *num_exits += 2;
+    }
+
+    list_for_each_entry(instr, &block->instrs, struct ir_instr, it) {
+      if (ir_opdefs[instr->op].flags & IR_FLAG_CALL) {
+        *num_calls += 1;
+      }
+    }
+
+    /* branches to other blocks in the ir don't leave it, anything else does,
+       including blocks which fall off their end to dispatch */
+    struct ir_instr *last = list_last_entry(&block->instrs, struct ir_instr, it);
+
+    if (last->op == OP_BRANCH || last->op == OP_BRANCH_COND) {
+      int num_targets = last->op == OP_BRANCH ? 1 : 2;
+
+      for (int i = 0; i < num_targets; i++) {
+        if (last->arg[i]->type != VALUE_BLOCK) {
+          *num_exits += 1;
+        }
+      }
+    } else {
+      *num_exits += 1;
+    }
+  }
+}
+
+/* promote the most used context values to host registers for the duration of
+   the ir. the values are synced with the context whenever control leaves the
+   ir, and aren't carried across linked jit blocks, which would need a register
+   convention shared by all of the compiled code */
+static void ra_promote_context(struct ra *ra, struct ir *ir) {
+  struct ra_candidate *candidates = ra->candidates;
+
+  memset(candidates, 0, sizeof(ra->candidates));
+
+  for (int i = 0; i < ra->num_registers; i++) {
+    struct ra_bin *bin = ra_get_bin(i);
+    bin->promoted = 0;
+  }
+
+  ir->num_promoted = 0;
+
+  ra_find_loops(ra, ir);
+
+  /* find the context values accessed in a uniform way throughout the ir. sh4
+     / arm gprs and sh4 fprs stored in the context are all 32-bit aligned, as
+     are the 128-bit sh4 fv registers and XMTRX columns */
+  list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
+    list_for_each_entry(instr, &block->instrs, struct ir_instr, it) {
+      enum ir_type type;
+
+      if (instr->op == OP_LOAD_CONTEXT) {
+        type = instr->result->type;
+      } else if (instr->op == OP_STORE_CONTEXT) {
+        type = instr->arg[1]->type;
+      } else {
+        continue;
+      }
+
+      int offset = instr->arg[0]->i32;
+      int size = ir_type_size(type);
+      CHECK_LE(offset + size, IR_MAX_CONTEXT);
+
+      /* the rest of the words covered by the access can't be promoted on
+         their own */
+      for (int i = (offset & ~3) + 4; i < offset + size; i += 4) {
+        candidates[i].invalid = 1;
+      }
+
+      struct ra_candidate *c = &candidates[offset & ~3];
+      c->touched = 1;
+
+      if (!ra_can_promote_type(type) || (offset & 3)) {
+        c->invalid = 1;
+        continue;
+      }
+
+      if (c->num_uses && c->type != type) {
+        c->invalid = 1;
+      }
+
+      c->type = type;
+      c->num_uses++;
+      c->dirty |= instr->op == OP_STORE_CONTEXT;
+      c->in_loop |= block->tag & RA_BLOCK_IN_LOOP;
+
+      if (c->last_block != block) {
+        c->last_block = block;
+        c->num_blocks++;
+      }
+    }
+  }
+
+  /* wider values can't be promoted if any of their other words are accessed
+     on their own, even by an access which itself can't be promoted */
+  for (int i = 0; i < IR_MAX_CONTEXT; i += 4) {
+    struct ra_candidate *c = &candidates[i];
+
+    if (!c->num_uses) {
+      continue;
+    }
+
+    for (int j = i + 4; j < i + ir_type_size(c->type); j += 4) {
+      if (candidates[j].touched) {
+        c->invalid = 1;
+      }
+    }
+  }
+
+  /* promoting a value costs a load on entry and a store on exit, only promote
+     values which are used across multiple blocks or inside of a loop, in order
+     of use */
+  int num_gprs = 0;
+  int num_fprs = 0;
+  int num_vecs = 0;
+
+  while (ir->num_promoted < IR_MAX_PROMOTED) {
+    struct ra_candidate *best = NULL;
+
+    for (int i = 0; i < IR_MAX_CONTEXT; i += 4) {
+      struct ra_candidate *c = &candidates[i];
+
+      if (c->invalid || (c->num_blocks < 2 && !c->in_loop)) {
+        continue;
+      }
+
+      if (c->type == VALUE_I32 && num_gprs >= RA_MAX_PROMOTED_GPRS) {
+        continue;
+      }
+
+      if (c->type == VALUE_F32 && num_fprs >= RA_MAX_PROMOTED_FPRS) {
+        continue;
+      }
+
+      if (c->type == VALUE_V128 && num_vecs >= RA_MAX_PROMOTED_VECS) {
+        continue;
+      }
+
+      if (!best || c->num_uses > best->num_uses) {
+        best = c;
+      }
+    }
+
+    if (!best) {
+      break;
+    }
+
+    /* don't consider the candidate again */
+    best->invalid = 1;
+
+    int reg = ra_promote_reg(ra, best->type);
+
+    if (reg == NO_REGISTER) {
+      continue;
+    }
+
+    struct ir_promoted *promoted = &ir->promoted[ir->num_promoted++];
+    promoted->offset = (int)(best - candidates);
+    promoted->type = best->type;
+    promoted->reg = reg;
+    promoted->dirty = best->dirty;
+
+    struct ra_bin *bin = ra_get_bin(reg);
+    bin->promoted = 1;
+
+    if (best->type == VALUE_I32) {
+      num_gprs++;
+    } else if (best->type == VALUE_F32) {
+      num_fprs++;
+    } else {
+      num_vecs++;
+    }
+  }
+
+  if (!ir->num_promoted) {
+    return;
+  }
+
+  /* each access of a promoted value is turned into a register move, offset by
+     the loads and stores syncing the values with the context */
+  int num_uses = 0;
+  int num_dirty = 0;
+
+  for (int i = 0; i < ir->num_promoted; i++) {
+    const struct ir_promoted *p = &ir->promoted[i];
+    num_uses += candidates[p->offset].num_uses;
+    num_dirty += p->dirty;
+  }
+
+  int num_calls, num_exits;
+  ra_count_syncs(ir, &num_calls, &num_exits);
+
+  int num_loads = ir->num_promoted * (1 + num_calls);
+  int num_stores = num_dirty * (num_calls + num_exits);
+  STAT_context_eliminated += num_uses - num_loads - num_stores;
+}
+
 void ra_run(struct ra *ra, struct ir *ir) {
+  ra_promote_context(ra, ir);
+
   list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
     ra_reset(ra, ir, block);
     ra_legalize_args(ra, ir, block);
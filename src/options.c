@@ -101,6 +101,19 @@ DEFINE_PERSISTENT_OPTION_INT(deadzone_3,   DEFAULT_DEADZONE,  "Deadzone for cont
 
 /* emulator */
 DEFINE_PERSISTENT_OPTION_STRING(aspect,    "4:3",             "Video aspect ratio");
+DEFINE_OPTION_STRING(profile,              "",                "Capture profiler zones to this chrome trace-event file");
+
+/* scheduler */
+DEFINE_OPTION_INT(sched_adaptive,          1,                 "Shorten device run slices after devices interact");
+DEFINE_OPTION_INT(sched_max_slice,         1000,              "Max microseconds to run each device for between syncs");
+DEFINE_OPTION_INT(sched_min_slice,         50,                "Min microseconds to run each device for between syncs");
+DEFINE_OPTION_INT(aica_thread,             0,                 "Run the arm7 and aica on their own thread");
+
+/* render */
+DEFINE_OPTION_INT(soft_threads,            0,                 "Number of threads used by the software renderer, 0 for one per core");
+DEFINE_OPTION_INT(tex_threads,             0,                 "Number of threads used to decode textures, 0 for one per core");
+DEFINE_OPTION_INT(tex_hash,                1,                 "Reuse dirtied textures whose source data is unchanged");
+DEFINE_OPTION_INT(tex_hash_retained,       256,               "Number of replaced textures retained for reuse by their content hash");
 
 /* bios */
 DEFINE_PERSISTENT_OPTION_STRING(region,    "usa",             "System region");
@@ -109,6 +122,13 @@ DEFINE_PERSISTENT_OPTION_STRING(broadcast, "ntsc",            "System broadcast
 
 /* jit */
 DEFINE_OPTION_INT(perf,                    0,                 "Create maps for compiled code for use with perf");
+DEFINE_OPTION_INT(jit_cache,               0,                 "Cache compiled code to disk between runs");
+DEFINE_OPTION_INT(jit_async,               0,                 "Optimize compiled code on a background thread");
+DEFINE_OPTION_INT(jit_region_size,         32,                "Max number of instructions to compile past branches");
+DEFINE_OPTION_INT(jit_profile,             0,                 "Profile compiled blocks, writing a report of the hottest blocks on exit");
+DEFINE_OPTION_INT(jit_sample,              0,                 "Sample the host pc every this many microseconds while profiling");
+DEFINE_OPTION_STRING(jit_profile_format,   "txt",             "Format of the block profile report (txt, json)");
+DEFINE_OPTION_INT(jit_hot_threshold,       0,                 "Recompile blocks with wider regions once executed this many times");
 
 /* ui */
 DEFINE_PERSISTENT_OPTION_STRING(gamedir,   "",                "Directories to scan for games");
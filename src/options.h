@@ -62,6 +62,19 @@ DECLARE_OPTION_INT(deadzone_3);
 
 /* emulator */
 DECLARE_OPTION_STRING(aspect);
+DECLARE_OPTION_STRING(profile);
+
+/* scheduler */
+DECLARE_OPTION_INT(sched_adaptive);
+DECLARE_OPTION_INT(sched_max_slice);
+DECLARE_OPTION_INT(sched_min_slice);
+DECLARE_OPTION_INT(aica_thread);
+
+/* render */
+DECLARE_OPTION_INT(soft_threads);
+DECLARE_OPTION_INT(tex_threads);
+DECLARE_OPTION_INT(tex_hash);
+DECLARE_OPTION_INT(tex_hash_retained);
 
 /* bios */
 DECLARE_OPTION_STRING(region);
@@ -70,6 +83,13 @@ DECLARE_OPTION_STRING(broadcast);
 
 /* jit */
 DECLARE_OPTION_INT(perf);
+DECLARE_OPTION_INT(jit_cache);
+DECLARE_OPTION_INT(jit_async);
+DECLARE_OPTION_INT(jit_region_size);
+DECLARE_OPTION_INT(jit_profile);
+DECLARE_OPTION_INT(jit_sample);
+DECLARE_OPTION_STRING(jit_profile_format);
+DECLARE_OPTION_INT(jit_hot_threshold);
 
 /* ui */
 DECLARE_OPTION_STRING(gamedir);
@@ -682,6 +682,27 @@ void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void r_read_pixels(struct render_backend *r, uint8_t *pixels) {
+  int stride = r->width * 4;
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, r->width, r->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+  /* gl returns the bottom row first */
+  uint8_t *tmp = malloc(stride);
+
+  for (int top = 0, bottom = r->height - 1; top < bottom; top++, bottom--) {
+    uint8_t *a = &pixels[top * stride];
+    uint8_t *b = &pixels[bottom * stride];
+    memcpy(tmp, a, stride);
+    memcpy(a, b, stride);
+    memcpy(b, tmp, stride);
+  }
+
+  free(tmp);
+}
+
 void r_viewport(struct render_backend *r, int x, int y, int width, int height) {
   r->viewport.x = x;
   r->viewport.y = y;
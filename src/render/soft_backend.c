@@ -0,0 +1,1068 @@
+/*
+ * tile-binned software rasterizer
+ *
+ * implements the render backend on the cpu, for rendering on machines without
+ * a gpu. each triangle is set up and binned into 32x32 tiles as surfaces are
+ * drawn, much like the pvr itself, and the tiles are then rasterized in
+ * parallel once the last surface has been drawn. each tile renders its
+ * triangles in the order they were drawn, so depth testing and blending
+ * produce the same results as the gl backend without any synchronization
+ * between the threads
+ */
+
+#include "core/core.h"
+#include "core/profiler.h"
+#include "core/thread_pool.h"
+#include "options.h"
+#include "render/render_backend.h"
+
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
+#define TILE_SHIFT 5
+#define TILE_SIZE (1 << TILE_SHIFT)
+
+/* vertices are snapped to 1/16th of a pixel */
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+
+/* triangles with a vertex further than this many pixels from the origin are
+   dropped, keeping the fixed-point edge functions from overflowing */
+#define GUARD_BAND 8192.0f
+
+/* the gl backend writes out log2(1 + w) / 17 as the depth, which is clamped to
+   1.0 at this w. depth is stored as w directly, as only its ordering matters */
+#define MAX_DEPTH 131071.0f
+
+enum {
+  ATTR_U,
+  ATTR_V,
+  ATTR_R,
+  ATTR_G,
+  ATTR_B,
+  ATTR_A,
+  ATTR_OFFSET_R,
+  ATTR_OFFSET_G,
+  ATTR_OFFSET_B,
+  NUM_ATTRS,
+};
+
+struct plane {
+  float dx;
+  float dy;
+  float c;
+};
+
+struct texture {
+  /* rgba, null when the handle isn't in use */
+  uint8_t *pixels;
+  int width;
+  int height;
+  enum filter_mode filter;
+  enum wrap_mode wrap_u;
+  enum wrap_mode wrap_v;
+};
+
+struct viewport {
+  int x, y, w, h;
+};
+
+/* state shared by every triangle of a surface */
+struct draw_state {
+  int ui;
+  texture_handle_t texture;
+  int depth_write;
+  int depth_func;
+  int src_blend;
+  int dst_blend;
+  int shade;
+  int ignore_alpha;
+  int ignore_texture_alpha;
+  int offset_color;
+  int alpha_test;
+  float alpha_ref;
+  int debug_depth;
+};
+
+struct setup_vertex {
+  float x;
+  float y;
+  /* 1 / w */
+  float q;
+  float attrs[NUM_ATTRS];
+};
+
+struct triangle {
+  int state;
+
+  /* inclusive bounds in pixels, clipped to the viewport and scissor */
+  int minx, miny, maxx, maxy;
+
+  /* fixed-point edge functions, a pixel is inside of the edge when its value
+     is >= 0. e(x, y) = c + x * dx + y * dy for the pixel at x, y */
+  int64_t edge_c[3];
+  int64_t edge_dx[3];
+  int64_t edge_dy[3];
+
+  /* 1 / w and each attribute divided by w, interpolated linearly in screen
+     space to produce perspective-correct attributes */
+  struct plane q;
+  struct plane attrs[NUM_ATTRS];
+};
+
+struct tile_bin {
+  int *tris;
+  int num_tris;
+  int max_tris;
+};
+
+struct render_backend {
+  int width, height;
+
+  /* current viewport */
+  struct viewport viewport;
+
+  /* rgba color and depth buffers, the first row being the top of the image */
+  uint8_t *color;
+  float *depth;
+
+  /* texture cache */
+  struct texture textures[MAX_TEXTURES];
+
+  /* binned triangles waiting to be rasterized */
+  struct thread_pool *pool;
+  int tiles_x, tiles_y;
+  struct tile_bin *bins;
+
+  struct draw_state *states;
+  int num_states;
+  int max_states;
+
+  struct triangle *tris;
+  int num_tris;
+  int max_tris;
+
+  /* surface render state */
+  const struct ta_vertex *ta_verts;
+  const uint16_t *ta_indices;
+  int num_ta_verts;
+  int num_ta_indices;
+  float ta_scale[2];
+
+  const struct ui_vertex *ui_verts;
+  const uint16_t *ui_indices;
+  int num_ui_verts;
+  int num_ui_indices;
+};
+
+static inline float r_clampf(float v, float lo, float hi) {
+  /* also maps nan to lo */
+  if (!(v >= lo)) {
+    return lo;
+  }
+  if (v > hi) {
+    return hi;
+  }
+  return v;
+}
+
+static inline float r_plane_eval(const struct plane *p, float x, float y) {
+  return p->c + x * p->dx + y * p->dy;
+}
+
+static void r_plane_init(struct plane *p, const struct setup_vertex *v0,
+                         const struct setup_vertex *v1,
+                         const struct setup_vertex *v2, float f0, float f1,
+                         float f2, float inv_area) {
+  float ax = v1->x - v0->x;
+  float ay = v1->y - v0->y;
+  float bx = v2->x - v0->x;
+  float by = v2->y - v0->y;
+  float df1 = f1 - f0;
+  float df2 = f2 - f0;
+  p->dx = (df1 * by - df2 * ay) * inv_area;
+  p->dy = (df2 * ax - df1 * bx) * inv_area;
+  p->c = f0 - v0->x * p->dx - v0->y * p->dy;
+}
+
+/*
+ * textures
+ */
+static inline int r_wrap_texel(int i, int n, enum wrap_mode mode) {
+  switch (mode) {
+    case WRAP_CLAMP_TO_EDGE:
+      return CLAMP(i, 0, n - 1);
+    case WRAP_MIRRORED_REPEAT: {
+      int m = i % (2 * n);
+      m = m < 0 ? m + 2 * n : m;
+      return m < n ? m : 2 * n - 1 - m;
+    }
+    default: {
+      int m = i % n;
+      return m < 0 ? m + n : m;
+    }
+  }
+}
+
+static inline const uint8_t *r_texel(const struct texture *tex, int x, int y) {
+  x = r_wrap_texel(x, tex->width, tex->wrap_u);
+  y = r_wrap_texel(y, tex->height, tex->wrap_v);
+  return &tex->pixels[(y * tex->width + x) * 4];
+}
+
+static void r_sample_texture(const struct texture *tex, float u, float v,
+                             float *out) {
+  /* textures which were never created sample as white, like the gl backend's
+     default texture. mipmaps aren't generated, the base level is always
+     sampled */
+  if (!tex->pixels) {
+    out[0] = out[1] = out[2] = out[3] = 1.0f;
+    return;
+  }
+
+  /* keep the texel coordinates within the range of an int */
+  float fu = r_clampf(u * tex->width, -1.0e8f, 1.0e8f);
+  float fv = r_clampf(v * tex->height, -1.0e8f, 1.0e8f);
+
+  if (tex->filter == FILTER_NEAREST) {
+    const uint8_t *t = r_texel(tex, (int)floorf(fu), (int)floorf(fv));
+    for (int i = 0; i < 4; i++) {
+      out[i] = t[i] / 255.0f;
+    }
+    return;
+  }
+
+  fu -= 0.5f;
+  fv -= 0.5f;
+  float x0 = floorf(fu);
+  float y0 = floorf(fv);
+  float fx = fu - x0;
+  float fy = fv - y0;
+  int x = (int)x0;
+  int y = (int)y0;
+
+  const uint8_t *t00 = r_texel(tex, x, y);
+  const uint8_t *t10 = r_texel(tex, x + 1, y);
+  const uint8_t *t01 = r_texel(tex, x, y + 1);
+  const uint8_t *t11 = r_texel(tex, x + 1, y + 1);
+
+  for (int i = 0; i < 4; i++) {
+    float top = t00[i] + (t10[i] - t00[i]) * fx;
+    float bottom = t01[i] + (t11[i] - t01[i]) * fx;
+    out[i] = (top + (bottom - top) * fy) / 255.0f;
+  }
+}
+
+/*
+ * pixel processing
+ */
+static inline int r_depth_test(int func, float d, float dst) {
+  switch (func) {
+    case DEPTH_NEVER:
+      return 0;
+    case DEPTH_LESS:
+      return d < dst;
+    case DEPTH_EQUAL:
+      return d == dst;
+    case DEPTH_LEQUAL:
+      return d <= dst;
+    case DEPTH_GREATER:
+      return d > dst;
+    case DEPTH_NEQUAL:
+      return d != dst;
+    case DEPTH_GEQUAL:
+      return d >= dst;
+    default:
+      return 1;
+  }
+}
+
+static inline float r_blend_factor(int func, const float *src,
+                                   const float *dst, int i) {
+  switch (func) {
+    case BLEND_ZERO:
+      return 0.0f;
+    case BLEND_SRC_COLOR:
+      return src[i];
+    case BLEND_ONE_MINUS_SRC_COLOR:
+      return 1.0f - src[i];
+    case BLEND_SRC_ALPHA:
+      return src[3];
+    case BLEND_ONE_MINUS_SRC_ALPHA:
+      return 1.0f - src[3];
+    case BLEND_DST_ALPHA:
+      return dst[3];
+    case BLEND_ONE_MINUS_DST_ALPHA:
+      return 1.0f - dst[3];
+    case BLEND_DST_COLOR:
+      return dst[i];
+    case BLEND_ONE_MINUS_DST_COLOR:
+      return 1.0f - dst[i];
+    default:
+      return 1.0f;
+  }
+}
+
+static void r_shade_ta(struct render_backend *r,
+                       const struct draw_state *state, const float *attrs,
+                       float w, float *frag, int *discard) {
+  float col[4] = {attrs[ATTR_R], attrs[ATTR_G], attrs[ATTR_B], attrs[ATTR_A]};
+
+  if (state->ignore_alpha) {
+    col[3] = 1.0f;
+  }
+
+  /* mirrors the gl backend's ta fragment shader */
+  if (state->texture) {
+    float tex[4];
+    r_sample_texture(&r->textures[state->texture], attrs[ATTR_U],
+                     attrs[ATTR_V], tex);
+
+    if (state->ignore_texture_alpha) {
+      tex[3] = 1.0f;
+    }
+
+    if (state->alpha_test && tex[3] < state->alpha_ref) {
+      *discard = 1;
+      return;
+    }
+
+    switch (state->shade) {
+      case SHADE_DECAL:
+        for (int i = 0; i < 4; i++) {
+          frag[i] = tex[i];
+        }
+        break;
+      case SHADE_MODULATE:
+        for (int i = 0; i < 3; i++) {
+          frag[i] = tex[i] * col[i];
+        }
+        frag[3] = tex[3];
+        break;
+      case SHADE_DECAL_ALPHA:
+        for (int i = 0; i < 3; i++) {
+          frag[i] = tex[i] * tex[3] + col[i] * (1.0f - tex[3]);
+        }
+        frag[3] = col[3];
+        break;
+      case SHADE_MODULATE_ALPHA:
+        for (int i = 0; i < 4; i++) {
+          frag[i] = tex[i] * col[i];
+        }
+        break;
+    }
+  } else {
+    for (int i = 0; i < 4; i++) {
+      frag[i] = col[i];
+    }
+  }
+
+  if (state->offset_color) {
+    frag[0] += attrs[ATTR_OFFSET_R];
+    frag[1] += attrs[ATTR_OFFSET_G];
+    frag[2] += attrs[ATTR_OFFSET_B];
+  }
+
+  /* punch through polys are always drawn with an alpha value of 1.0 */
+  if (state->alpha_test) {
+    frag[3] = 1.0f;
+  }
+
+  if (state->debug_depth) {
+    frag[0] = frag[1] = frag[2] = log2f(1.0f + w) / 17.0f;
+  }
+}
+
+static void r_shade_ui(struct render_backend *r,
+                       const struct draw_state *state, const float *attrs,
+                       float *frag) {
+  float tex[4];
+  r_sample_texture(&r->textures[state->texture], attrs[ATTR_U], attrs[ATTR_V],
+                   tex);
+
+  for (int i = 0; i < 4; i++) {
+    frag[i] = attrs[ATTR_R + i] * tex[i];
+  }
+}
+
+static void r_shade_pixel(struct render_backend *r, const struct triangle *tri,
+                          const struct draw_state *state, int x, int y) {
+  float px = x + 0.5f;
+  float py = y + 0.5f;
+  int offset = y * r->width + x;
+
+  float q = r_plane_eval(&tri->q, px, py);
+  if (q <= 0.0f) {
+    return;
+  }
+
+  float w = 1.0f / q;
+  float depth = MIN(w, MAX_DEPTH);
+  int depth_test = !state->ui && state->depth_func != DEPTH_NONE;
+
+  if (depth_test && !r_depth_test(state->depth_func, depth, r->depth[offset])) {
+    return;
+  }
+
+  float attrs[NUM_ATTRS];
+  for (int i = 0; i < NUM_ATTRS; i++) {
+    attrs[i] = r_plane_eval(&tri->attrs[i], px, py) * w;
+  }
+
+  float frag[4];
+  int discard = 0;
+
+  if (state->ui) {
+    r_shade_ui(r, state, attrs, frag);
+  } else {
+    r_shade_ta(r, state, attrs, w, frag, &discard);
+  }
+
+  if (discard) {
+    return;
+  }
+
+  /* depth writes are disabled along with the depth test */
+  if (depth_test && state->depth_write) {
+    r->depth[offset] = depth;
+  }
+
+  uint8_t *color = &r->color[offset * 4];
+
+  for (int i = 0; i < 4; i++) {
+    frag[i] = r_clampf(frag[i], 0.0f, 1.0f);
+  }
+
+  if (state->src_blend != BLEND_NONE && state->dst_blend != BLEND_NONE) {
+    float dst[4];
+    for (int i = 0; i < 4; i++) {
+      dst[i] = color[i] / 255.0f;
+    }
+
+    float out[4];
+    for (int i = 0; i < 4; i++) {
+      float sf = r_blend_factor(state->src_blend, frag, dst, i);
+      float df = r_blend_factor(state->dst_blend, frag, dst, i);
+      out[i] = r_clampf(frag[i] * sf + dst[i] * df, 0.0f, 1.0f);
+    }
+
+    for (int i = 0; i < 4; i++) {
+      frag[i] = out[i];
+    }
+  }
+
+  for (int i = 0; i < 4; i++) {
+    color[i] = (uint8_t)(frag[i] * 255.0f + 0.5f);
+  }
+}
+
+/*
+ * rasterization
+ */
+static void r_raster_rect(struct render_backend *r, const struct triangle *tri,
+                          int minx, int miny, int maxx, int maxy,
+                          const int *edges, int num_edges) {
+  const struct draw_state *state = &r->states[tri->state];
+
+  for (int y = miny; y <= maxy; y++) {
+    /* the edges being tested cross the rect, so their values within it are
+       small enough to step through as 32-bit ints */
+    int32_t e[3];
+    int32_t dx[3];
+
+    for (int i = 0; i < num_edges; i++) {
+      int j = edges[i];
+      e[i] = (int32_t)(tri->edge_c[j] + minx * tri->edge_dx[j] +
+                       y * tri->edge_dy[j]);
+      dx[i] = (int32_t)tri->edge_dx[j];
+    }
+
+#if ARCH_X64
+    __m128i ev[3];
+    __m128i step[3];
+
+    for (int i = 0; i < num_edges; i++) {
+      ev[i] = _mm_add_epi32(_mm_set1_epi32(e[i]),
+                            _mm_set_epi32(3 * dx[i], 2 * dx[i], dx[i], 0));
+      step[i] = _mm_set1_epi32(4 * dx[i]);
+    }
+
+    for (int x = minx; x <= maxx; x += 4) {
+      /* a pixel is outside when any of its edge values are negative */
+      int outside = 0;
+
+      for (int i = 0; i < num_edges; i++) {
+        outside |= _mm_movemask_ps(_mm_castsi128_ps(ev[i]));
+        ev[i] = _mm_add_epi32(ev[i], step[i]);
+      }
+
+      int mask = ~outside & 0xf;
+
+      /* mask off pixels past the end of the span */
+      if (maxx - x < 3) {
+        mask &= (1 << (maxx - x + 1)) - 1;
+      }
+
+      while (mask) {
+        int i = ctz32(mask);
+        r_shade_pixel(r, tri, state, x + i, y);
+        mask &= mask - 1;
+      }
+    }
+#else
+    for (int x = minx; x <= maxx; x++) {
+      int inside = 1;
+
+      for (int i = 0; i < num_edges; i++) {
+        inside &= e[i] >= 0;
+        e[i] += dx[i];
+      }
+
+      if (inside) {
+        r_shade_pixel(r, tri, state, x, y);
+      }
+    }
+#endif
+  }
+}
+
+static void r_raster_triangle(struct render_backend *r,
+                              const struct triangle *tri, int tile_minx,
+                              int tile_miny, int tile_maxx, int tile_maxy) {
+  int minx = MAX(tri->minx, tile_minx);
+  int miny = MAX(tri->miny, tile_miny);
+  int maxx = MIN(tri->maxx, tile_maxx);
+  int maxy = MIN(tri->maxy, tile_maxy);
+
+  if (minx > maxx || miny > maxy) {
+    return;
+  }
+
+  /* classify each edge against the rect being rasterized, only testing those
+     which cross it */
+  int edges[3];
+  int num_edges = 0;
+
+  for (int i = 0; i < 3; i++) {
+    int64_t e =
+        tri->edge_c[i] + minx * tri->edge_dx[i] + miny * tri->edge_dy[i];
+    int64_t ex = (maxx - minx) * tri->edge_dx[i];
+    int64_t ey = (maxy - miny) * tri->edge_dy[i];
+    int64_t emin = e + MIN(ex, 0) + MIN(ey, 0);
+    int64_t emax = e + MAX(ex, 0) + MAX(ey, 0);
+
+    if (emax < 0) {
+      return;
+    }
+
+    if (emin < 0) {
+      edges[num_edges++] = i;
+    }
+  }
+
+  r_raster_rect(r, tri, minx, miny, maxx, maxy, edges, num_edges);
+}
+
+static void r_render_tile(void *data, int index) {
+  struct render_backend *r = data;
+  struct tile_bin *bin = &r->bins[index];
+
+  if (!bin->num_tris) {
+    return;
+  }
+
+  int tile_minx = (index % r->tiles_x) << TILE_SHIFT;
+  int tile_miny = (index / r->tiles_x) << TILE_SHIFT;
+  int tile_maxx = MIN(tile_minx + TILE_SIZE, r->width) - 1;
+  int tile_maxy = MIN(tile_miny + TILE_SIZE, r->height) - 1;
+
+  for (int i = 0; i < bin->num_tris; i++) {
+    const struct triangle *tri = &r->tris[bin->tris[i]];
+    r_raster_triangle(r, tri, tile_minx, tile_miny, tile_maxx, tile_maxy);
+  }
+
+  bin->num_tris = 0;
+}
+
+static void r_flush(struct render_backend *r) {
+  PROF_ENTER("gpu", "r_flush");
+
+  thread_pool_run(r->pool, &r_render_tile, r, r->tiles_x * r->tiles_y);
+
+  r->num_tris = 0;
+  r->num_states = 0;
+
+  PROF_LEAVE();
+}
+
+static void r_bin_triangle(struct render_backend *r, int index) {
+  const struct triangle *tri = &r->tris[index];
+
+  int tile_minx = tri->minx >> TILE_SHIFT;
+  int tile_miny = tri->miny >> TILE_SHIFT;
+  int tile_maxx = tri->maxx >> TILE_SHIFT;
+  int tile_maxy = tri->maxy >> TILE_SHIFT;
+
+  for (int ty = tile_miny; ty <= tile_maxy; ty++) {
+    for (int tx = tile_minx; tx <= tile_maxx; tx++) {
+      struct tile_bin *bin = &r->bins[ty * r->tiles_x + tx];
+
+      if (bin->num_tris == bin->max_tris) {
+        bin->max_tris = MAX(bin->max_tris * 2, 64);
+        bin->tris = realloc(bin->tris, bin->max_tris * sizeof(int));
+      }
+
+      bin->tris[bin->num_tris++] = index;
+    }
+  }
+}
+
+static void r_add_triangle(struct render_backend *r, int state, int cull,
+                           const struct viewport *clip,
+                           const struct setup_vertex *v0,
+                           const struct setup_vertex *v1,
+                           const struct setup_vertex *v2) {
+  const struct setup_vertex *verts[3] = {v0, v1, v2};
+
+  for (int i = 0; i < 3; i++) {
+    const struct setup_vertex *v = verts[i];
+
+    /* the gl backend moves vertices with a negative w outside of the clip
+       volume, drop the triangles using them entirely */
+    if (!(v->q > 0.0f)) {
+      return;
+    }
+
+    if (!(ABS(v->x) < GUARD_BAND && ABS(v->y) < GUARD_BAND)) {
+      return;
+    }
+  }
+
+  /* the framebuffer's y axis points down, flipping the winding order compared
+     to gl's window coordinates, where counter-clockwise triangles face the
+     front */
+  float area = (v1->x - v0->x) * (v2->y - v0->y) -
+               (v2->x - v0->x) * (v1->y - v0->y);
+
+  if (area == 0.0f || (cull == CULL_BACK && area > 0.0f) ||
+      (cull == CULL_FRONT && area < 0.0f)) {
+    return;
+  }
+
+  /* snap to fixed-point */
+  int64_t fx[3], fy[3];
+  for (int i = 0; i < 3; i++) {
+    fx[i] = (int64_t)lrintf(verts[i]->x * SUBPIXEL_ONE);
+    fy[i] = (int64_t)lrintf(verts[i]->y * SUBPIXEL_ONE);
+  }
+
+  int64_t fixed_area =
+      (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fx[2] - fx[0]) * (fy[1] - fy[0]);
+
+  if (!fixed_area) {
+    return;
+  }
+
+  /* wind the edges such that the inside of each is positive */
+  int order[3] = {0, 1, 2};
+  if (fixed_area < 0) {
+    order[1] = 2;
+    order[2] = 1;
+  }
+
+  int64_t minx = INT64_MAX, miny = INT64_MAX;
+  int64_t maxx = INT64_MIN, maxy = INT64_MIN;
+  for (int i = 0; i < 3; i++) {
+    minx = MIN(minx, fx[i]);
+    miny = MIN(miny, fy[i]);
+    maxx = MAX(maxx, fx[i]);
+    maxy = MAX(maxy, fy[i]);
+  }
+
+  struct triangle tri;
+  tri.state = state;
+  tri.minx = MAX((int)(minx >> SUBPIXEL_BITS), clip->x);
+  tri.miny = MAX((int)(miny >> SUBPIXEL_BITS), clip->y);
+  tri.maxx = MIN((int)(maxx >> SUBPIXEL_BITS), clip->x + clip->w - 1);
+  tri.maxy = MIN((int)(maxy >> SUBPIXEL_BITS), clip->y + clip->h - 1);
+
+  if (tri.minx > tri.maxx || tri.miny > tri.maxy) {
+    return;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    int a = order[i];
+    int b = order[(i + 1) % 3];
+    int64_t ex = fy[a] - fy[b];
+    int64_t ey = fx[b] - fx[a];
+    int64_t ec = fx[a] * fy[b] - fy[a] * fx[b];
+
+    /* pixels exactly on an edge are only drawn for top and left edges, so
+       pixels on edges shared between triangles are only drawn once */
+    int top_left = ex > 0 || (ex == 0 && ey > 0);
+    if (!top_left) {
+      ec -= 1;
+    }
+
+    /* evaluate at pixel centers */
+    const int64_t half = SUBPIXEL_ONE / 2;
+    tri.edge_dx[i] = ex * SUBPIXEL_ONE;
+    tri.edge_dy[i] = ey * SUBPIXEL_ONE;
+    tri.edge_c[i] = ec + ex * half + ey * half;
+  }
+
+  float inv_area = 1.0f / area;
+  r_plane_init(&tri.q, v0, v1, v2, v0->q, v1->q, v2->q, inv_area);
+  for (int i = 0; i < NUM_ATTRS; i++) {
+    r_plane_init(&tri.attrs[i], v0, v1, v2, v0->attrs[i] * v0->q,
+                 v1->attrs[i] * v1->q, v2->attrs[i] * v2->q, inv_area);
+  }
+
+  if (r->num_tris == r->max_tris) {
+    r->max_tris = MAX(r->max_tris * 2, 1024);
+    r->tris = realloc(r->tris, r->max_tris * sizeof(struct triangle));
+  }
+
+  int index = r->num_tris++;
+  r->tris[index] = tri;
+
+  r_bin_triangle(r, index);
+}
+
+static int r_add_state(struct render_backend *r,
+                       const struct draw_state *state) {
+  if (r->num_states == r->max_states) {
+    r->max_states = MAX(r->max_states * 2, 256);
+    r->states = realloc(r->states, r->max_states * sizeof(struct draw_state));
+  }
+
+  int index = r->num_states++;
+  r->states[index] = *state;
+  return index;
+}
+
+static void r_unpack_color(uint32_t color, float *out) {
+  const uint8_t *bytes = (const uint8_t *)&color;
+  for (int i = 0; i < 4; i++) {
+    out[i] = bytes[i] / 255.0f;
+  }
+}
+
+/* top of the viewport in framebuffer rows, the viewport being specified with
+   a bottom-left origin like gl */
+static int r_viewport_top(struct render_backend *r) {
+  return r->height - (r->viewport.y + r->viewport.h);
+}
+
+void r_end_ui_surfaces(struct render_backend *r) {
+  r_flush(r);
+}
+
+void r_draw_ui_surface(struct render_backend *r,
+                       const struct ui_surface *surf) {
+  /* lines aren't supported */
+  if (surf->prim_type != PRIM_TRIANGLES) {
+    return;
+  }
+
+  struct draw_state state = {0};
+  state.ui = 1;
+  state.texture = surf->texture;
+  state.src_blend = surf->src_blend;
+  state.dst_blend = surf->dst_blend;
+  int index = r_add_state(r, &state);
+
+  int top = r_viewport_top(r);
+
+  struct viewport clip = {0, 0, r->width, r->height};
+  if (surf->scissor) {
+    int x = (int)surf->scissor_rect[0];
+    int y = (int)surf->scissor_rect[1];
+    int w = (int)surf->scissor_rect[2];
+    int h = (int)surf->scissor_rect[3];
+    clip.x = MAX(x, 0);
+    clip.y = MAX(r->height - (y + h), 0);
+    clip.w = MIN(x + w, r->width) - clip.x;
+    clip.h = MIN(r->height - y, r->height) - clip.y;
+  }
+
+  for (int i = 0; i + 2 < surf->num_verts; i += 3) {
+    struct setup_vertex sv[3];
+
+    for (int j = 0; j < 3; j++) {
+      int n = surf->first_vert + i + j;
+      const struct ui_vertex *v =
+          &r->ui_verts[r->ui_indices ? r->ui_indices[n] : n];
+      struct setup_vertex *s = &sv[j];
+
+      s->x = r->viewport.x + v->xy[0];
+      s->y = top + v->xy[1];
+      s->q = 1.0f;
+      s->attrs[ATTR_U] = v->uv[0];
+      s->attrs[ATTR_V] = v->uv[1];
+      r_unpack_color(v->color, &s->attrs[ATTR_R]);
+      s->attrs[ATTR_OFFSET_R] = 0.0f;
+      s->attrs[ATTR_OFFSET_G] = 0.0f;
+      s->attrs[ATTR_OFFSET_B] = 0.0f;
+    }
+
+    r_add_triangle(r, index, CULL_NONE, &clip, &sv[0], &sv[1], &sv[2]);
+  }
+}
+
+void r_begin_ui_surfaces(struct render_backend *r,
+                         const struct ui_vertex *verts, int num_verts,
+                         const uint16_t *indices, int num_indices) {
+  r->ui_verts = verts;
+  r->num_ui_verts = num_verts;
+  r->ui_indices = indices;
+  r->num_ui_indices = num_indices;
+}
+
+void r_end_ta_surfaces(struct render_backend *r) {
+  r_flush(r);
+}
+
+void r_draw_ta_surface(struct render_backend *r,
+                       const struct ta_surface *surf) {
+  struct draw_state state = {0};
+  state.texture = surf->params.texture;
+  state.depth_write = surf->params.depth_write;
+  state.depth_func = surf->params.depth_func;
+  state.src_blend = surf->params.src_blend;
+  state.dst_blend = surf->params.dst_blend;
+  state.shade = surf->params.shade;
+  state.ignore_alpha = surf->params.ignore_alpha;
+  state.ignore_texture_alpha = surf->params.ignore_texture_alpha;
+  state.offset_color = surf->params.offset_color;
+  state.alpha_test = surf->params.alpha_test;
+  state.alpha_ref = surf->params.alpha_ref / 255.0f;
+  state.debug_depth = surf->params.debug_depth;
+  int index = r_add_state(r, &state);
+
+  struct viewport clip = r->viewport;
+  clip.y = r_viewport_top(r);
+
+  for (int i = 0; i + 2 < surf->num_verts; i += 3) {
+    struct setup_vertex sv[3];
+
+    for (int j = 0; j < 3; j++) {
+      const struct ta_vertex *v =
+          &r->ta_verts[r->ta_indices[surf->first_vert + i + j]];
+      struct setup_vertex *s = &sv[j];
+
+      s->x = clip.x + v->xyz[0] * r->ta_scale[0];
+      s->y = clip.y + v->xyz[1] * r->ta_scale[1];
+      s->q = v->xyz[2];
+      s->attrs[ATTR_U] = v->uv[0];
+      s->attrs[ATTR_V] = v->uv[1];
+      r_unpack_color(v->color, &s->attrs[ATTR_R]);
+
+      float offset[4];
+      r_unpack_color(v->offset_color, offset);
+      s->attrs[ATTR_OFFSET_R] = offset[0];
+      s->attrs[ATTR_OFFSET_G] = offset[1];
+      s->attrs[ATTR_OFFSET_B] = offset[2];
+    }
+
+    r_add_triangle(r, index, surf->params.cull, &clip, &sv[0], &sv[1],
+                   &sv[2]);
+  }
+}
+
+void r_begin_ta_surfaces(struct render_backend *r, int video_width,
+                         int video_height, const struct ta_vertex *verts,
+                         int num_verts, const uint16_t *indices,
+                         int num_indices) {
+  r->ta_verts = verts;
+  r->num_ta_verts = num_verts;
+  r->ta_indices = indices;
+  r->num_ta_indices = num_indices;
+  r->ta_scale[0] = r->viewport.w / (float)video_width;
+  r->ta_scale[1] = r->viewport.h / (float)video_height;
+}
+
+void r_read_pixels(struct render_backend *r, uint8_t *pixels) {
+  memcpy(pixels, r->color, r->width * r->height * 4);
+}
+
+void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
+                   int y, int width, int height) {
+  /* scale the rgb pixels to fill the viewport */
+  int top = r_viewport_top(r);
+
+  for (int dy = 0; dy < r->viewport.h; dy++) {
+    int row = top + dy;
+
+    if (row < 0 || row >= r->height) {
+      continue;
+    }
+
+    int sy = (dy * height) / r->viewport.h;
+
+    for (int dx = 0; dx < r->viewport.w; dx++) {
+      int col = r->viewport.x + dx;
+
+      if (col < 0 || col >= r->width) {
+        continue;
+      }
+
+      int sx = (dx * width) / r->viewport.w;
+      const uint8_t *src = &pixels[(sy * width + sx) * 3];
+      uint8_t *dst = &r->color[(row * r->width + col) * 4];
+      dst[0] = src[0];
+      dst[1] = src[1];
+      dst[2] = src[2];
+      dst[3] = 0xff;
+    }
+  }
+}
+
+void r_viewport(struct render_backend *r, int x, int y, int width, int height) {
+  r->viewport.x = x;
+  r->viewport.y = y;
+  r->viewport.w = width;
+  r->viewport.h = height;
+}
+
+void r_clear(struct render_backend *r) {
+  int num_pixels = r->width * r->height;
+
+  memset(r->color, 0, num_pixels * 4);
+
+  for (int i = 0; i < num_pixels; i++) {
+    r->depth[i] = MAX_DEPTH;
+  }
+}
+
+void r_destroy_texture(struct render_backend *r, texture_handle_t handle) {
+  if (!handle) {
+    return;
+  }
+
+  struct texture *tex = &r->textures[handle];
+  free(tex->pixels);
+  tex->pixels = NULL;
+}
+
+static void r_convert_pixels(enum pxl_format format, int width, int height,
+                             const uint8_t *src, uint8_t *dst) {
+  int num_pixels = width * height;
+
+  for (int i = 0; i < num_pixels; i++, dst += 4) {
+    switch (format) {
+      case PXL_RGB:
+        dst[0] = src[i * 3 + 0];
+        dst[1] = src[i * 3 + 1];
+        dst[2] = src[i * 3 + 2];
+        dst[3] = 0xff;
+        break;
+
+      case PXL_RGBA5551: {
+        uint16_t p = ((const uint16_t *)src)[i];
+        dst[0] = ((p >> 11) & 0x1f) * 255 / 31;
+        dst[1] = ((p >> 6) & 0x1f) * 255 / 31;
+        dst[2] = ((p >> 1) & 0x1f) * 255 / 31;
+        dst[3] = (p & 0x1) * 255;
+      } break;
+
+      case PXL_RGB565: {
+        uint16_t p = ((const uint16_t *)src)[i];
+        dst[0] = ((p >> 11) & 0x1f) * 255 / 31;
+        dst[1] = ((p >> 5) & 0x3f) * 255 / 63;
+        dst[2] = (p & 0x1f) * 255 / 31;
+        dst[3] = 0xff;
+      } break;
+
+      case PXL_RGBA4444: {
+        uint16_t p = ((const uint16_t *)src)[i];
+        dst[0] = ((p >> 12) & 0xf) * 17;
+        dst[1] = ((p >> 8) & 0xf) * 17;
+        dst[2] = ((p >> 4) & 0xf) * 17;
+        dst[3] = (p & 0xf) * 17;
+      } break;
+
+      default:
+        memcpy(dst, &src[i * 4], 4);
+        break;
+    }
+  }
+}
+
+texture_handle_t r_create_texture(struct render_backend *r,
+                                  enum pxl_format format,
+                                  enum filter_mode filter,
+                                  enum wrap_mode wrap_u, enum wrap_mode wrap_v,
+                                  int mipmaps, int width, int height,
+                                  const uint8_t *buffer) {
+  /* find next open texture entry */
+  texture_handle_t handle;
+  for (handle = 1; handle < MAX_TEXTURES; handle++) {
+    struct texture *tex = &r->textures[handle];
+    if (!tex->pixels) {
+      break;
+    }
+  }
+  CHECK_LT(handle, MAX_TEXTURES);
+
+  struct texture *tex = &r->textures[handle];
+  tex->pixels = malloc(width * height * 4);
+  tex->width = width;
+  tex->height = height;
+  tex->filter = filter;
+  tex->wrap_u = wrap_u;
+  tex->wrap_v = wrap_v;
+
+  r_convert_pixels(format, width, height, buffer, tex->pixels);
+
+  return handle;
+}
+
+int r_height(struct render_backend *r) {
+  return r->height;
+}
+
+int r_width(struct render_backend *r) {
+  return r->width;
+}
+
+void r_destroy(struct render_backend *r) {
+  for (int i = 0; i < MAX_TEXTURES; i++) {
+    r_destroy_texture(r, i);
+  }
+
+  for (int i = 0; i < r->tiles_x * r->tiles_y; i++) {
+    free(r->bins[i].tris);
+  }
+
+  thread_pool_destroy(r->pool);
+
+  free(r->bins);
+  free(r->tris);
+  free(r->states);
+  free(r->depth);
+  free(r->color);
+  free(r);
+}
+
+struct render_backend *r_create(int width, int height) {
+  struct render_backend *r = calloc(1, sizeof(struct render_backend));
+
+  r->width = width;
+  r->height = height;
+  r->viewport.w = width;
+  r->viewport.h = height;
+
+  r->color = malloc(width * height * 4);
+  r->depth = malloc(width * height * sizeof(float));
+
+  r->tiles_x = (width + TILE_SIZE - 1) >> TILE_SHIFT;
+  r->tiles_y = (height + TILE_SIZE - 1) >> TILE_SHIFT;
+  r->bins = calloc(r->tiles_x * r->tiles_y, sizeof(struct tile_bin));
+  r->pool = thread_pool_create("render", OPTION_soft_threads);
+
+  r_clear(r);
+
+  return r;
+}
@@ -6,5 +6,22 @@ DEFINE_AGGREGATE_COUNTER(arm7_instrs);
 DEFINE_AGGREGATE_COUNTER(pvr_vblanks);
 DEFINE_AGGREGATE_COUNTER(ta_renders);
 DEFINE_AGGREGATE_COUNTER(sh4_instrs);
+DEFINE_AGGREGATE_COUNTER(sh4_run_ns);
+DEFINE_AGGREGATE_COUNTER(arm7_run_ns);
+DEFINE_AGGREGATE_COUNTER(sched_slices);
+DEFINE_AGGREGATE_COUNTER(sched_slice_ns);
+DEFINE_AGGREGATE_COUNTER(jit_blocks_invalidated);
+DEFINE_AGGREGATE_COUNTER(jit_blocks_survived);
+DEFINE_AGGREGATE_COUNTER(jit_cache_hits);
+DEFINE_AGGREGATE_COUNTER(jit_cache_misses);
+DEFINE_AGGREGATE_COUNTER(jit_compiles);
 DEFINE_AGGREGATE_COUNTER(mmio_read);
 DEFINE_AGGREGATE_COUNTER(mmio_write);
+
+/* per-frame texture decode stats, set each time a context is converted */
+DEFINE_COUNTER(tex_decodes);
+DEFINE_COUNTER(tex_decode_bytes);
+DEFINE_COUNTER(tex_decode_ns);
+DEFINE_COUNTER(tex_hash_hits);
+DEFINE_COUNTER(tex_hash_misses);
+DEFINE_COUNTER(tex_hash_saved_bytes);
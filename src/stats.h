@@ -9,7 +9,22 @@ DECLARE_COUNTER(arm7_instrs);
 DECLARE_COUNTER(pvr_vblanks);
 DECLARE_COUNTER(ta_renders);
 DECLARE_COUNTER(sh4_instrs);
+DECLARE_COUNTER(sh4_run_ns);
+DECLARE_COUNTER(arm7_run_ns);
+DECLARE_COUNTER(sched_slices);
+DECLARE_COUNTER(sched_slice_ns);
+DECLARE_COUNTER(jit_blocks_invalidated);
+DECLARE_COUNTER(jit_blocks_survived);
+DECLARE_COUNTER(jit_cache_hits);
+DECLARE_COUNTER(jit_cache_misses);
+DECLARE_COUNTER(jit_compiles);
 DECLARE_COUNTER(mmio_read);
 DECLARE_COUNTER(mmio_write);
+DECLARE_COUNTER(tex_decodes);
+DECLARE_COUNTER(tex_decode_bytes);
+DECLARE_COUNTER(tex_decode_ns);
+DECLARE_COUNTER(tex_hash_hits);
+DECLARE_COUNTER(tex_hash_misses);
+DECLARE_COUNTER(tex_hash_saved_bytes);
 
 #endif
@@ -737,6 +737,8 @@ void tracer_vid_destroyed(struct tracer *tracer) {
     tex->handle = 0;
   }
 
+  tr_release_textures(tracer->r);
+
   tracer->r = NULL;
 }
 
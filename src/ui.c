@@ -1177,7 +1177,7 @@ static texture_handle_t ui_load_disc_texture(struct ui *ui, struct game *game) {
   const uint8_t *data = pvr_tex_data(pvrt);
   pvr_tex_decode(data, header->width, header->height, header->width,
                  header->texture_fmt, header->pixel_fmt, NULL, 0, converted,
-                 sizeof(converted));
+                 sizeof(converted), 0);
 
   texture_handle_t tex = r_create_texture(
       ui->r, PXL_RGBA, FILTER_BILINEAR, WRAP_CLAMP_TO_EDGE, WRAP_CLAMP_TO_EDGE,
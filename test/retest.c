@@ -3,6 +3,8 @@
 #include "core/filesystem.h"
 #include "core/option.h"
 
+DEFINE_OPTION_INT(bench, 0, "Run benchmarks along with the tests");
+
 static struct list tests;
 
 void test_register(struct test *test) {
@@ -10,6 +12,10 @@ void test_register(struct test *test) {
 }
 
 int main(int argc, char **argv) {
+  if (!options_parse(&argc, &argv)) {
+    return EXIT_FAILURE;
+  }
+
   /* set application directory */
   char appdir[PATH_MAX];
   char userdir[PATH_MAX];
@@ -19,6 +25,10 @@ int main(int argc, char **argv) {
   fs_set_appdir(appdir);
 
   list_for_each_entry(test, &tests, struct test, it) {
+    if (test->bench && !OPTION_bench) {
+      continue;
+    }
+
     LOG_INFO("===-----------------------------------------------------===");
     LOG_INFO("%s", test->name);
     LOG_INFO("===-----------------------------------------------------===");
@@ -10,17 +10,27 @@ typedef void (*test_callback_t)();
 struct test {
   const char *name;
   test_callback_t run;
+  int bench;
   struct list_node it;
 };
 
-#define TEST(name)                                                \
-  static void test_##name();                                      \
-  CONSTRUCTOR(TEST_REGISTER_##name) {                             \
-    static struct test test = {"test_" #name, &test_##name, {0}}; \
-    test_register(&test);                                         \
-  }                                                               \
+#define TEST(name)                                                   \
+  static void test_##name();                                         \
+  CONSTRUCTOR(TEST_REGISTER_##name) {                                \
+    static struct test test = {"test_" #name, &test_##name, 0, {0}}; \
+    test_register(&test);                                            \
+  }                                                                  \
   void test_##name()
 
+/* benchmarks are only ran when requested with --bench */
+#define BENCH(name)                                                    \
+  static void bench_##name();                                          \
+  CONSTRUCTOR(BENCH_REGISTER_##name) {                                 \
+    static struct test test = {"bench_" #name, &bench_##name, 1, {0}}; \
+    test_register(&test);                                              \
+  }                                                                    \
+  void bench_##name()
+
 void test_register(struct test *test);
 
 #endif
@@ -0,0 +1,274 @@
+#include "jit/backend/interp/interp_backend.h"
+#include "jit/frontend/armv3/armv3_context.h"
+#include "jit/frontend/armv3/armv3_frontend.h"
+#include "jit/frontend/armv3/armv3_guest.h"
+#include "jit/jit.h"
+#include "retest.h"
+
+#if ARCH_X64
+#include "jit/backend/x64/x64_backend.h"
+
+#define RAM_SIZE 0x4000
+#define RAM_MASK (RAM_SIZE - 1)
+#define DATA_ADDR 0x1000
+#define STACK_ADDR 0x2000
+
+/* branch to self, ending each program */
+#define B_SELF 0xeafffffe
+
+/* runs a program on either the translations, or the interpreter calling out to
+   armv3_fallback for each instruction */
+struct arm {
+  struct armv3_context ctx;
+  uint8_t ram[RAM_SIZE];
+
+  struct armv3_guest *guest;
+  struct jit_frontend *frontend;
+  struct jit_backend *backend;
+  struct jit *jit;
+};
+
+static struct arm translated;
+static struct arm interpreted;
+
+DEFINE_JIT_CODE_BUFFER(armv3_translate_code);
+
+static uint8_t arm_r8(struct memory *mem, uint32_t addr) {
+  struct arm *arm = (struct arm *)mem;
+  return arm->ram[addr & RAM_MASK];
+}
+
+static uint16_t arm_r16(struct memory *mem, uint32_t addr) {
+  struct arm *arm = (struct arm *)mem;
+  return *(uint16_t *)&arm->ram[addr & RAM_MASK];
+}
+
+static uint32_t arm_r32(struct memory *mem, uint32_t addr) {
+  struct arm *arm = (struct arm *)mem;
+  return *(uint32_t *)&arm->ram[addr & RAM_MASK];
+}
+
+static void arm_w8(struct memory *mem, uint32_t addr, uint8_t data) {
+  struct arm *arm = (struct arm *)mem;
+  arm->ram[addr & RAM_MASK] = data;
+}
+
+static void arm_w16(struct memory *mem, uint32_t addr, uint16_t data) {
+  struct arm *arm = (struct arm *)mem;
+  *(uint16_t *)&arm->ram[addr & RAM_MASK] = data;
+}
+
+static void arm_w32(struct memory *mem, uint32_t addr, uint32_t data) {
+  struct arm *arm = (struct arm *)mem;
+  *(uint32_t *)&arm->ram[addr & RAM_MASK] = data;
+}
+
+static void arm_lookup(struct memory *mem, uint32_t addr, void **userdata,
+                       uint8_t **ptr, mem_read_cb *read, mem_write_cb *write) {
+  struct arm *arm = (struct arm *)mem;
+
+  if (userdata) {
+    *userdata = NULL;
+  }
+  if (ptr) {
+    *ptr = &arm->ram[addr & RAM_MASK];
+  }
+  if (read) {
+    *read = NULL;
+  }
+  if (write) {
+    *write = NULL;
+  }
+}
+
+static void arm_compile_code(struct arm *arm, uint32_t addr) {
+  jit_compile_code(arm->jit, addr);
+}
+
+static void arm_link_code(struct arm *arm, void *branch, uint32_t target) {
+  jit_link_code(arm->jit, branch, target);
+}
+
+static void arm_check_interrupts(struct arm *arm) {}
+
+static void arm_switch_mode(struct arm *arm, uint32_t new_sr) {
+  /* the programs never switch modes */
+  CHECK_EQ(new_sr & M_MASK, arm->ctx.r[CPSR] & M_MASK);
+  arm->ctx.r[CPSR] = new_sr;
+}
+
+static void arm_restore_mode(struct arm *arm) {}
+
+static void arm_create(struct arm *arm, int translate) {
+  memset(arm, 0, sizeof(*arm));
+
+  struct armv3_guest *guest = calloc(1, sizeof(struct armv3_guest));
+  guest->addr_mask = RAM_MASK & ~3;
+  guest->ctx = &arm->ctx;
+  guest->mem = (struct memory *)arm;
+  guest->lookup = &arm_lookup;
+  guest->r8 = &arm_r8;
+  guest->r16 = &arm_r16;
+  guest->r32 = &arm_r32;
+  guest->w8 = &arm_w8;
+  guest->w16 = &arm_w16;
+  guest->w32 = &arm_w32;
+  guest->data = arm;
+  guest->offset_pc = (int)offsetof(struct armv3_context, r[15]);
+  guest->offset_cycles = (int)offsetof(struct armv3_context, run_cycles);
+  guest->offset_instrs = (int)offsetof(struct armv3_context, ran_instrs);
+  guest->offset_interrupts =
+      (int)offsetof(struct armv3_context, pending_interrupts);
+  guest->compile_code = (jit_compile_cb)&arm_compile_code;
+  guest->link_code = (jit_link_cb)&arm_link_code;
+  guest->check_interrupts = (jit_interrupt_cb)&arm_check_interrupts;
+  guest->switch_mode = (armv3_switch_mode_cb)&arm_switch_mode;
+  guest->restore_mode = (armv3_restore_mode_cb)&arm_restore_mode;
+
+  arm->guest = guest;
+  arm->frontend = armv3_frontend_create((struct jit_guest *)guest);
+  if (translate) {
+    arm->backend =
+        x64_backend_create((struct jit_guest *)guest, armv3_translate_code,
+                           sizeof(armv3_translate_code));
+  } else {
+    arm->backend =
+        interp_backend_create((struct jit_guest *)guest, arm->frontend);
+  }
+  arm->jit = jit_create(translate ? "armv3_translate" : "armv3_fallback",
+                        arm->frontend, arm->backend);
+}
+
+static void arm_destroy(struct arm *arm) {
+  jit_destroy(arm->jit);
+  arm->backend->destroy(arm->backend);
+  arm->frontend->destroy(arm->frontend);
+  free(arm->guest);
+}
+
+static void arm_run(struct arm *arm, const uint32_t *code, int num_instrs,
+                    const uint32_t *regs, uint32_t cpsr) {
+  for (int i = 0; i < num_instrs; i++) {
+    arm_w32((struct memory *)arm, i * 4, code[i]);
+  }
+  arm_w32((struct memory *)arm, num_instrs * 4, B_SELF);
+
+  for (int i = 0; i < 64; i++) {
+    arm_w32((struct memory *)arm, DATA_ADDR + i * 4, 0x11111111 * (i & 0xf));
+  }
+
+  for (int i = 0; i < 16; i++) {
+    arm->ctx.r[i] = regs[i];
+    arm->ctx.rusr[i] = &arm->ctx.r[i];
+  }
+  arm->ctx.r[15] = 0;
+  arm->ctx.r[CPSR] = cpsr;
+
+  /* run long enough to reach the final branch */
+  jit_run(arm->jit, 256);
+
+  CHECK_EQ(arm->ctx.r[15], (uint32_t)num_instrs * 4);
+}
+
+/* run the program from each of the initial states through both the
+   translations and the fallbacks, and compare the resulting contexts */
+static void check_program(const uint32_t *code, int num_instrs) {
+  static const uint32_t states[][3] = {
+      /* r0, r1, cpsr flags */
+      {0x00000005, 0x00000003, 0},
+      {0x00000005, 0x00000003, C_MASK},
+      {0x7fffffff, 0x00000001, C_MASK},
+      {0x00000000, 0xffffffff, 0},
+      {0x80000000, 0x80000000, C_MASK | V_MASK},
+      {0x00000003, 0x00000003, Z_MASK | C_MASK},
+      {0xffffffff, 0x00000001, N_MASK},
+  };
+
+  /* the program is the same for each state, so its compiled code is reused */
+  arm_create(&translated, 1);
+  arm_create(&interpreted, 0);
+
+  for (int s = 0; s < (int)ARRAY_SIZE(states); s++) {
+    uint32_t regs[16] = {0};
+    regs[0] = states[s][0];
+    regs[1] = states[s][1];
+    for (int i = 2; i < 13; i++) {
+      regs[i] = 0x01010101 * i;
+    }
+    regs[8] = DATA_ADDR;
+    regs[13] = STACK_ADDR;
+    uint32_t cpsr = MODE_SVC | states[s][2];
+
+    arm_run(&translated, code, num_instrs, regs, cpsr);
+    arm_run(&interpreted, code, num_instrs, regs, cpsr);
+
+    for (int i = 0; i < NUM_ARMV3_REGS; i++) {
+      CHECK_EQ(translated.ctx.r[i], interpreted.ctx.r[i],
+               "state %d r%d translated=0x%08x fallback=0x%08x", s, i,
+               translated.ctx.r[i], interpreted.ctx.r[i]);
+    }
+
+    CHECK(!memcmp(translated.ram, interpreted.ram, RAM_SIZE),
+          "state %d memory differs", s);
+  }
+
+  arm_destroy(&translated);
+  arm_destroy(&interpreted);
+}
+
+TEST(armv3_translate_carry_ops) {
+  static const uint32_t code[] = {
+      0xe0b02001, /* adcs r2, r0, r1 */
+      0xe0d03001, /* sbcs r3, r0, r1 */
+      0xe0f04001, /* rscs r4, r0, r1 */
+      0xe0b15000, /* adcs r5, r1, r0 */
+      0xe0d16000, /* sbcs r6, r1, r0 */
+      0xe0f17000, /* rscs r7, r1, r0 */
+  };
+
+  check_program(code, ARRAY_SIZE(code));
+}
+
+TEST(armv3_translate_rrx) {
+  static const uint32_t code[] = {
+      0xe1b02060, /* movs r2, r0, rrx */
+      0xe0813061, /* add r3, r1, r1, rrx */
+      0xe1b04061, /* movs r4, r1, rrx */
+      0xe0115060, /* ands r5, r1, r0, rrx */
+  };
+
+  check_program(code, ARRAY_SIZE(code));
+}
+
+TEST(armv3_translate_ldm_stm) {
+  static const uint32_t code[] = {
+      0xe92d000f, /* stmdb r13!, {r0-r3} */
+      0xe8b8010f, /* ldmia r8!, {r0-r3, r8} */
+      0xe1a08000, /* mov r8, r0 */
+      0xe3a08a01, /* mov r8, #0x1000 */
+      0xe8380f00, /* ldmda r8!, {r8-r11} */
+      0xe3a08a01, /* mov r8, #0x1000 */
+      0xe9a80130, /* stmib r8!, {r4, r5, r8} */
+      0xe89d00f0, /* ldmia r13, {r4-r7} */
+  };
+
+  check_program(code, ARRAY_SIZE(code));
+}
+
+TEST(armv3_translate_conditional) {
+  static const uint32_t code[] = {
+      0xe1500001, /* cmp r0, r1 */
+      0xc2822001, /* addgt r2, r2, #1 */
+      0xd2433001, /* suble r3, r3, #1 */
+      0x03b04000, /* moveqs r4, #0 */
+      0x22955001, /* addcss r5, r5, #1 */
+      0x31a06000, /* movcc r6, r0 */
+      0x4a000000, /* bmi +8 */
+      0xe3a07007, /* mov r7, #7 */
+      0x98881000, /* stmlsia r8, {r12} */
+      0x73a09009, /* movvc r9, #9 */
+  };
+
+  check_program(code, ARRAY_SIZE(code));
+}
+#endif
@@ -0,0 +1,103 @@
+#include "jit/ir/ir.h"
+#include "jit/passes/conversion_elimination_pass.h"
+#include "retest.h"
+
+/* header written by ir_write for a single block */
+#define IR_HEADER                                              \
+  "#==--------------------------------------------------==#\n" \
+  "# ir\n"                                                     \
+  "#==--------------------------------------------------==#\n" \
+  "# predecessors \n"                                          \
+  "# successors \n"                                            \
+  "%0:\n"
+
+static uint8_t ir_buffer[1024 * 1024];
+static char scratch_buffer[1024 * 1024];
+
+static void run_cve(const char *input_str, const char *output_str) {
+  struct ir ir = {0};
+  ir.buffer = ir_buffer;
+  ir.capacity = sizeof(ir_buffer);
+
+  FILE *input = tmpfile();
+  fwrite(input_str, 1, strlen(input_str), input);
+  rewind(input);
+  int res = ir_read(input, &ir);
+  fclose(input);
+  CHECK(res);
+
+  struct cve *cve = cve_create();
+  cve_run(cve, &ir);
+  cve_destroy(cve);
+
+  FILE *output = tmpfile();
+  ir_write(&ir, output);
+  rewind(output);
+  size_t n = fread(&scratch_buffer, 1, sizeof(scratch_buffer) - 1, output);
+  scratch_buffer[n] = 0;
+  fclose(output);
+  CHECK_NE(n, 0u);
+
+  CHECK_STREQ(scratch_buffer, output_str);
+}
+
+TEST(conversion_elimination_load) {
+  /* extensions performed by every user of a load are folded into it, while
+     loads with mixed users are left alone */
+  static const char input_str[] =
+      "i32 %0 = load_context i32 0x10\n"
+      "i8 %1 = load_fast i32 %0\n"
+      "i32 %2 = sext i8 %1\n"
+      "store_context i32 0x20, i32 %2\n"
+      "i16 %3 = load_guest i32 %0\n"
+      "i32 %4 = zext i16 %3\n"
+      "i32 %5 = zext i16 %3\n"
+      "store_context i32 0x24, i32 %4\n"
+      "store_context i32 0x28, i32 %5\n"
+      "i8 %6 = load_fast i32 %0\n"
+      "i32 %7 = sext i8 %6\n"
+      "i32 %8 = zext i8 %6\n"
+      "store_context i32 0x2c, i32 %7\n"
+      "store_context i32 0x30, i32 %8\n";
+
+  static const char output_str[] =
+      IR_HEADER
+      "i32 %1 = load_context i32 0x10\n"
+      "i32 %2 = load_fast i32 %1, i8 0x1\n"
+      "store_context i32 0x20, i32 %2\n"
+      "i32 %4 = load_guest i32 %1, i16 0x2\n"
+      "store_context i32 0x24, i32 %4\n"
+      "store_context i32 0x28, i32 %4\n"
+      "i8 %7 = load_fast i32 %1\n"
+      "i32 %8 = sext i8 %7\n"
+      "i32 %9 = zext i8 %7\n"
+      "store_context i32 0x2c, i32 %8\n"
+      "store_context i32 0x30, i32 %9\n";
+
+  run_cve(input_str, output_str);
+}
+
+TEST(conversion_elimination_chain) {
+  /* truncations of extensions, and operations whose upper bits are discarded
+     by a truncation, are performed at the narrower width */
+  static const char input_str[] =
+      "i8 %0 = load_context i32 0x10\n"
+      "i32 %1 = zext i8 %0\n"
+      "i8 %2 = trunc i32 %1\n"
+      "store_context i32 0x20, i8 %2\n"
+      "i16 %3 = load_context i32 0x14\n"
+      "i32 %4 = sext i16 %3\n"
+      "i32 %5 = add i32 %4, i32 0x10001\n"
+      "i16 %6 = trunc i32 %5\n"
+      "store_context i32 0x24, i16 %6\n";
+
+  static const char output_str[] =
+      IR_HEADER
+      "i8 %1 = load_context i32 0x10\n"
+      "store_context i32 0x20, i8 %1\n"
+      "i16 %3 = load_context i32 0x14\n"
+      "i16 %4 = add i16 %3, i16 0x1\n"
+      "store_context i32 0x24, i16 %4\n";
+
+  run_cve(input_str, output_str);
+}
@@ -0,0 +1,172 @@
+#include "retest.h"
+#include "core/time.h"
+#include "jit/jit.h"
+#include "jit/jit_block_map.h"
+
+#define NUM_BLOCKS 100000
+#define NUM_LOOKUPS 1000000
+#define GUEST_BASE 0x8c010000
+#define HOST_BASE 0x10000000
+
+static struct jit_block blocks[NUM_BLOCKS];
+
+/* generate blocks laid out the way they would be by the jit, with guest code
+   scattered throughout memory and host code allocated linearly from a code
+   buffer */
+static void init_blocks() {
+  uintptr_t host_addr = HOST_BASE;
+
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    struct jit_block *block = &blocks[i];
+    block->guest_addr = GUEST_BASE + i * 0x40 + (rand() % 0x20) * 2;
+    block->guest_size = 0x20;
+    block->host_addr = (uint8_t *)host_addr;
+    block->host_size = 0x40 + (rand() % 0x200);
+    host_addr += block->host_size;
+  }
+}
+
+static void init_maps(struct jit_block_map *map,
+                      struct jit_block_index *index) {
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    jit_block_map_insert(map, &blocks[i]);
+    jit_block_index_insert(index, &blocks[i]);
+  }
+}
+
+TEST(jit_block_map_find) {
+  struct jit_block_map map = {0};
+  struct jit_block_index index = {0};
+  init_blocks();
+  init_maps(&map, &index);
+
+  CHECK_EQ(map.size, NUM_BLOCKS);
+  CHECK_EQ(index.size, NUM_BLOCKS);
+
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    struct jit_block *block = &blocks[i];
+    CHECK_EQ(jit_block_map_find(&map, block->guest_addr), block);
+    CHECK_EQ(jit_block_map_find(&map, block->guest_addr + 1), NULL);
+
+    uint8_t *last = block->host_addr + block->host_size - 1;
+    CHECK_EQ(jit_block_index_find(&index, block->host_addr), block);
+    CHECK_EQ(jit_block_index_find(&index, last), block);
+  }
+
+  CHECK_EQ(jit_block_index_find(&index, (void *)(HOST_BASE - 1)), NULL);
+
+  jit_block_map_destroy(&map);
+  jit_block_index_destroy(&index);
+}
+
+TEST(jit_block_map_remove) {
+  struct jit_block_map map = {0};
+  struct jit_block_index index = {0};
+  init_blocks();
+  init_maps(&map, &index);
+
+  /* remove every other block, and ensure the remaining blocks are still found
+     after entries have been shifted back */
+  for (int i = 0; i < NUM_BLOCKS; i += 2) {
+    jit_block_map_remove(&map, &blocks[i]);
+    jit_block_index_remove(&index, &blocks[i]);
+  }
+
+  CHECK_EQ(map.size, NUM_BLOCKS / 2);
+  CHECK_EQ(index.size, NUM_BLOCKS / 2);
+
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    struct jit_block *block = &blocks[i];
+    struct jit_block *expected = (i % 2) ? block : NULL;
+    CHECK_EQ(jit_block_map_find(&map, block->guest_addr), expected);
+    CHECK_EQ(jit_block_index_find(&index, block->host_addr), expected);
+  }
+
+  /* reinsert the blocks out of order */
+  for (int i = 0; i < NUM_BLOCKS; i += 2) {
+    jit_block_map_insert(&map, &blocks[i]);
+    jit_block_index_insert(&index, &blocks[i]);
+  }
+
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    struct jit_block *block = &blocks[i];
+    CHECK_EQ(jit_block_map_find(&map, block->guest_addr), block);
+    CHECK_EQ(jit_block_index_find(&index, block->host_addr), block);
+  }
+
+  jit_block_map_destroy(&map);
+  jit_block_index_destroy(&index);
+}
+
+TEST(jit_block_map_arena) {
+  struct jit_arena arena = {0};
+  static void *ptrs[NUM_BLOCKS];
+
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    size_t size = 1 + (i % (JIT_ARENA_ALIGN * JIT_ARENA_NUM_CLASSES + 64));
+    ptrs[i] = jit_arena_alloc(&arena, size);
+    memset(ptrs[i], 0xff, size);
+
+    if (size <= JIT_ARENA_ALIGN * (JIT_ARENA_NUM_CLASSES - 1)) {
+      CHECK_EQ((uintptr_t)ptrs[i] % JIT_ARENA_ALIGN, 0);
+    }
+  }
+
+  /* freed allocations are reused by the next allocation of the same class */
+  jit_arena_free(&arena, ptrs[1], 2);
+  void *ptr = jit_arena_alloc(&arena, 3);
+  CHECK_EQ(ptr, ptrs[1]);
+  CHECK_EQ(*(uint8_t *)ptr, 0);
+
+  /* oversized allocations aren't owned by the arena's chunks, and must be
+     freed individually */
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    size_t size = 1 + (i % (JIT_ARENA_ALIGN * JIT_ARENA_NUM_CLASSES + 64));
+    jit_arena_free(&arena, ptrs[i], size);
+  }
+
+  jit_arena_destroy(&arena);
+}
+
+/* measures the throughput of the lookups performed when linking a branch:
+   mapping the branch's host address back to its source block, and the branch
+   target's guest address to its destination block */
+BENCH(jit_block_map) {
+  struct jit_block_map map = {0};
+  struct jit_block_index index = {0};
+  init_blocks();
+  init_maps(&map, &index);
+
+  static uint32_t guest_addrs[NUM_LOOKUPS];
+  static void *host_addrs[NUM_LOOKUPS];
+
+  for (int i = 0; i < NUM_LOOKUPS; i++) {
+    struct jit_block *src = &blocks[rand() % NUM_BLOCKS];
+    struct jit_block *dst = &blocks[rand() % NUM_BLOCKS];
+    guest_addrs[i] = dst->guest_addr;
+    host_addrs[i] = src->host_addr + (rand() % src->host_size);
+  }
+
+  int64_t start = time_nanoseconds();
+  uintptr_t sum = 0;
+  for (int i = 0; i < NUM_LOOKUPS; i++) {
+    sum += (uintptr_t)jit_block_map_find(&map, guest_addrs[i]);
+  }
+  int64_t lookup_ns = time_nanoseconds() - start;
+
+  start = time_nanoseconds();
+  for (int i = 0; i < NUM_LOOKUPS; i++) {
+    sum += (uintptr_t)jit_block_index_find(&index, host_addrs[i]);
+    sum += (uintptr_t)jit_block_map_find(&map, guest_addrs[i]);
+  }
+  int64_t link_ns = time_nanoseconds() - start;
+
+  CHECK_NE(sum, 0);
+
+  LOG_INFO("jit_block_map_bench %d blocks, lookup %.2f ns/op, link %.2f ns/op",
+           NUM_BLOCKS, lookup_ns / (double)NUM_LOOKUPS,
+           link_ns / (double)NUM_LOOKUPS);
+
+  jit_block_map_destroy(&map);
+  jit_block_index_destroy(&index);
+}
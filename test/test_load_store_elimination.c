@@ -79,3 +79,88 @@ static char scratch_buffer[1024 * 1024];
 
   CHECK_STREQ(scratch_buffer, output_str);
 }*/
+
+/* parse the ir, optionally run the pass over it, and write it back out. the
+   expected output is written out the same way to normalize its labels */
+static void rewrite_ir(const char *input_str, int run_pass, char *output_str,
+                       size_t size) {
+  struct ir ir = {0};
+  ir.buffer = ir_buffer;
+  ir.capacity = sizeof(ir_buffer);
+
+  FILE *input = tmpfile();
+  fwrite(input_str, 1, strlen(input_str), input);
+  rewind(input);
+  int res = ir_read(input, &ir);
+  fclose(input);
+  CHECK(res);
+
+  if (run_pass) {
+    struct lse *lse = lse_create();
+    lse_run(lse, &ir);
+    lse_destroy(lse);
+  }
+
+  FILE *output = tmpfile();
+  ir_write(&ir, output);
+  rewind(output);
+  size_t n = fread(output_str, 1, size - 1, output);
+  fclose(output);
+  output_str[n] = 0;
+}
+
+static void check_lse(const char *input_str, const char *expected_str) {
+  static char expected[1024 * 64];
+  rewrite_ir(input_str, 1, scratch_buffer, sizeof(scratch_buffer));
+  rewrite_ir(expected_str, 0, expected, sizeof(expected));
+  CHECK_STREQ(scratch_buffer, expected);
+}
+
+TEST(load_store_elimination_region) {
+  /* constants are carried into the block's single successor, and stores
+     overwritten by every successor are removed */
+  static const char input_str[] =
+      "%0:\n"
+      "store_context i32 0x10, i32 0x5\n"
+      "store_context i32 0x14, i32 0x1\n"
+      "i8 %1 = load_context i32 0x20\n"
+      "branch_cond blk %2, blk %5, i8 %1\n"
+      "%2:\n"
+      "i32 %3 = load_context i32 0x10\n"
+      "store_context i32 0x14, i32 %3\n"
+      "branch i32 0x8c000100\n"
+      "%5:\n"
+      "store_context i32 0x14, i32 0x2\n"
+      "branch i32 0x8c000200\n";
+
+  static const char output_str[] =
+      "%0:\n"
+      "store_context i32 0x10, i32 0x5\n"
+      "i8 %1 = load_context i32 0x20\n"
+      "branch_cond blk %2, blk %4, i8 %1\n"
+      "%2:\n"
+      "store_context i32 0x14, i32 0x5\n"
+      "branch i32 0x8c000100\n"
+      "%4:\n"
+      "store_context i32 0x14, i32 0x2\n"
+      "branch i32 0x8c000200\n";
+
+  check_lse(input_str, output_str);
+}
+
+TEST(load_store_elimination_region_loop) {
+  /* nothing is carried across an edge into a loop header, as it may yield
+     to the dispatcher */
+  static const char input_str[] =
+      "%0:\n"
+      "store_context i32 0x10, i32 0x5\n"
+      "store_context i32 0x14, i32 0x1\n"
+      "branch blk %3\n"
+      "%3:\n"
+      "i32 %4 = load_context i32 0x10\n"
+      "store_context i32 0x14, i32 %4\n"
+      "i8 %6 = load_context i32 0x20\n"
+      "branch_cond blk %3, i32 0x8c000100, i8 %6\n";
+
+  check_lse(input_str, input_str);
+}
@@ -0,0 +1,58 @@
+#include "retest.h"
+#include "core/core.h"
+#include "core/exception_handler.h"
+#include "core/memory.h"
+
+static uint8_t buffer[64 * 1024];
+static uint8_t *page;
+static volatile int watch_fired;
+static volatile int tracker_fired;
+static int tracker_protected;
+
+static void watch_cb(const struct exception_state *ex, void *data) {
+  watch_fired++;
+}
+
+/* mimics the jit, releasing its protection on the first write to the page */
+static int tracker_handle_exception(void *data, struct exception_state *ex) {
+  size_t page_size = get_page_size();
+
+  if (!tracker_protected || ex->fault_addr < (uintptr_t)page ||
+      ex->fault_addr >= (uintptr_t)page + page_size) {
+    return 0;
+  }
+
+  tracker_fired++;
+  tracker_protected = 0;
+  write_unprotect_pages(page, page_size);
+
+  return 1;
+}
+
+TEST(memory_shared_protect) {
+  size_t page_size = get_page_size();
+  CHECK_LE(page_size * 2, sizeof(buffer));
+  page = (uint8_t *)ALIGN_UP((uintptr_t)buffer, page_size);
+
+  struct exception_handler *handler =
+      exception_handler_add(NULL, &tracker_handle_exception);
+
+  /* protect the same page from both the tracker and a watch */
+  CHECK(write_protect_pages(page, page_size));
+  tracker_protected = 1;
+  add_single_write_watch(page, 4, &watch_cb, NULL);
+
+  /* the write is caught by both of them, no matter which handles it first */
+  volatile uint8_t *ptr = page + 16;
+  *ptr = 1;
+  CHECK_EQ(watch_fired, 1);
+  CHECK_EQ(tracker_fired, 1);
+
+  /* once both have released the page, it's writable again */
+  *ptr = 2;
+  CHECK_EQ(watch_fired, 1);
+  CHECK_EQ(tracker_fired, 1);
+  CHECK_EQ(*ptr, 2);
+
+  exception_handler_remove(handler);
+}
@@ -0,0 +1,217 @@
+#include "core/core.h"
+#include "core/time.h"
+#include "guest/pvr/tex.h"
+#include "retest.h"
+
+#define MAX_SIZE 256
+#define BENCH_SIZE 256
+#define BENCH_ITERATIONS 20
+
+struct tex_format {
+  const char *name;
+  int texture_fmt;
+  int pixel_fmt;
+  int palette_fmt;
+};
+
+static struct tex_format formats[] = {
+    {"twiddled ARGB1555", PVR_TEX_TWIDDLED, PVR_PXL_ARGB1555, 0},
+    {"twiddled RGB565", PVR_TEX_TWIDDLED, PVR_PXL_RGB565, 0},
+    {"twiddled ARGB4444", PVR_TEX_TWIDDLED, PVR_PXL_ARGB4444, 0},
+    {"twiddled YUV422", PVR_TEX_TWIDDLED, PVR_PXL_YUV422, 0},
+    {"twiddled mipmaps", PVR_TEX_TWIDDLED_MIPMAPS, PVR_PXL_RGB565, 0},
+    {"twiddled rect", PVR_TEX_TWIDDLED_RECT, PVR_PXL_ARGB1555, 0},
+    {"bitmap ARGB1555", PVR_TEX_BITMAP, PVR_PXL_ARGB1555, 0},
+    {"bitmap RGB565", PVR_TEX_BITMAP, PVR_PXL_RGB565, 0},
+    {"bitmap ARGB4444", PVR_TEX_BITMAP, PVR_PXL_ARGB4444, 0},
+    {"bitmap YUV422", PVR_TEX_BITMAP, PVR_PXL_YUV422, 0},
+    {"bitmap rect", PVR_TEX_BITMAP_RECT, PVR_PXL_YUV422, 0},
+    {"vq ARGB1555", PVR_TEX_VQ, PVR_PXL_ARGB1555, 0},
+    {"vq RGB565", PVR_TEX_VQ, PVR_PXL_RGB565, 0},
+    {"vq ARGB4444", PVR_TEX_VQ, PVR_PXL_ARGB4444, 0},
+    {"vq YUV422", PVR_TEX_VQ, PVR_PXL_YUV422, 0},
+    {"vq mipmaps", PVR_TEX_VQ_MIPMAPS, PVR_PXL_ARGB4444, 0},
+    {"pal4 ARGB1555", PVR_TEX_PALETTE_4BPP, PVR_PXL_4BPP, PVR_PAL_ARGB1555},
+    {"pal4 RGB565", PVR_TEX_PALETTE_4BPP, PVR_PXL_4BPP, PVR_PAL_RGB565},
+    {"pal4 ARGB4444", PVR_TEX_PALETTE_4BPP, PVR_PXL_4BPP, PVR_PAL_ARGB4444},
+    {"pal4 ARGB8888", PVR_TEX_PALETTE_4BPP, PVR_PXL_4BPP, PVR_PAL_ARGB8888},
+    {"pal4 mipmaps", PVR_TEX_PALETTE_4BPP_MIPMAPS, PVR_PXL_4BPP,
+     PVR_PAL_ARGB1555},
+    {"pal8 ARGB1555", PVR_TEX_PALETTE_8BPP, PVR_PXL_8BPP, PVR_PAL_ARGB1555},
+    {"pal8 RGB565", PVR_TEX_PALETTE_8BPP, PVR_PXL_8BPP, PVR_PAL_RGB565},
+    {"pal8 ARGB4444", PVR_TEX_PALETTE_8BPP, PVR_PXL_8BPP, PVR_PAL_ARGB4444},
+    {"pal8 ARGB8888", PVR_TEX_PALETTE_8BPP, PVR_PXL_8BPP, PVR_PAL_ARGB8888},
+    {"pal8 mipmaps", PVR_TEX_PALETTE_8BPP_MIPMAPS, PVR_PXL_8BPP,
+     PVR_PAL_ARGB8888},
+};
+
+/* large enough for the highest mip level of a 16-bit MAX_SIZE texture */
+static uint8_t src[MAX_SIZE * MAX_SIZE * 8];
+static uint8_t palette[1024 * 4];
+static uint8_t expected[MAX_SIZE * MAX_SIZE * 4];
+static uint8_t actual[MAX_SIZE * MAX_SIZE * 4];
+
+static void init_data() {
+  srand(0);
+
+  for (int i = 0; i < (int)sizeof(src); i++) {
+    src[i] = rand() & 0xff;
+  }
+
+  for (int i = 0; i < (int)sizeof(palette); i++) {
+    palette[i] = rand() & 0xff;
+  }
+}
+
+static int stride_for(const struct tex_format *fmt, int width) {
+  /* rect bitmaps are read from a wider surface */
+  return fmt->texture_fmt == PVR_TEX_BITMAP_RECT ? width * 2 : width;
+}
+
+static void decode(const struct tex_format *fmt, int width, int height,
+                   uint8_t *dst, int flags) {
+  pvr_tex_decode(src, width, height, stride_for(fmt, width), fmt->texture_fmt,
+                 fmt->pixel_fmt, palette, fmt->palette_fmt, dst,
+                 MAX_SIZE * MAX_SIZE * 4, flags);
+}
+
+static int decoded_size(const struct tex_format *fmt, int width, int height,
+                        int flags) {
+  int bpp = pvr_tex_decoded_fmt(fmt->pixel_fmt, flags) == PXL_RGBA ? 4 : 2;
+  return width * height * bpp;
+}
+
+/* expand a native 16-bit texel the same as the rgba conversions do */
+static uint32_t expand_texel(const struct tex_format *fmt, uint16_t p) {
+  uint8_t rgba[4];
+
+  switch (pvr_tex_decoded_fmt(fmt->pixel_fmt, PVR_DECODE_NATIVE)) {
+    case PXL_RGBA5551:
+      rgba[0] = ((p >> 11) << 3) | ((p >> 11) >> 2);
+      rgba[1] = (((p >> 6) & 0x1f) << 3) | (((p >> 6) & 0x1f) >> 2);
+      rgba[2] = (((p >> 1) & 0x1f) << 3) | (((p >> 1) & 0x1f) >> 2);
+      rgba[3] = (p & 0x1) ? 0xff : 0;
+      break;
+
+    case PXL_RGB565:
+      rgba[0] = ((p >> 11) << 3) | ((p >> 11) >> 2);
+      rgba[1] = (((p >> 5) & 0x3f) << 2) | (((p >> 5) & 0x3f) >> 4);
+      rgba[2] = ((p & 0x1f) << 3) | ((p & 0x1f) >> 2);
+      rgba[3] = 0xff;
+      break;
+
+    case PXL_RGBA4444:
+      rgba[0] = ((p >> 12) & 0xf) * 17;
+      rgba[1] = ((p >> 8) & 0xf) * 17;
+      rgba[2] = ((p >> 4) & 0xf) * 17;
+      rgba[3] = (p & 0xf) * 17;
+      break;
+
+    default:
+      LOG_FATAL("unexpected native format");
+      break;
+  }
+
+  uint32_t texel;
+  memcpy(&texel, rgba, 4);
+  return texel;
+}
+
+TEST(pvr_tex_decode_matches_ref) {
+  static const int sizes[][2] = {{2, 2},    {4, 4},    {8, 8},   {64, 64},
+                                 {256, 256}, {128, 32}, {32, 128}, {4, 8}};
+  static const int modes[] = {0, PVR_DECODE_NATIVE};
+
+  init_data();
+
+  for (int i = 0; i < ARRAY_SIZE(formats); i++) {
+    const struct tex_format *fmt = &formats[i];
+    int mipmaps = pvr_tex_mipmaps(fmt->texture_fmt);
+
+    for (int j = 0; j < ARRAY_SIZE(sizes); j++) {
+      int width = sizes[j][0];
+      int height = sizes[j][1];
+
+      /* mipmapped textures are always square */
+      if (mipmaps && width != height) {
+        continue;
+      }
+
+      for (int k = 0; k < ARRAY_SIZE(modes); k++) {
+        int flags = modes[k];
+
+        memset(expected, 0, sizeof(expected));
+        memset(actual, 0xcd, sizeof(actual));
+
+        decode(fmt, width, height, expected, flags | PVR_DECODE_REF);
+        decode(fmt, width, height, actual, flags);
+
+        int size = decoded_size(fmt, width, height, flags);
+        int res = memcmp(expected, actual, size);
+        if (res) {
+          LOG_INFO("%s %dx%d flags %d doesn't match", fmt->name, width,
+                   height, flags);
+        }
+        CHECK_EQ(res, 0);
+      }
+    }
+  }
+}
+
+TEST(pvr_tex_decode_native) {
+  const int width = 64;
+  const int height = 32;
+
+  init_data();
+
+  for (int i = 0; i < ARRAY_SIZE(formats); i++) {
+    const struct tex_format *fmt = &formats[i];
+
+    if (pvr_tex_decoded_fmt(fmt->pixel_fmt, PVR_DECODE_NATIVE) == PXL_RGBA ||
+        pvr_tex_mipmaps(fmt->texture_fmt)) {
+      continue;
+    }
+
+    /* the native 16-bit output should expand to the same rgba output */
+    decode(fmt, width, height, expected, 0);
+    decode(fmt, width, height, actual, PVR_DECODE_NATIVE);
+
+    const uint32_t *rgba = (const uint32_t *)expected;
+    const uint16_t *native = (const uint16_t *)actual;
+
+    for (int j = 0; j < width * height; j++) {
+      CHECK_EQ(rgba[j], expand_texel(fmt, native[j]), "%s texel %d",
+               fmt->name, j);
+    }
+  }
+}
+
+static double bench_decode(const struct tex_format *fmt, int flags) {
+  const int width = BENCH_SIZE;
+  const int height = BENCH_SIZE;
+
+  int64_t start = time_nanoseconds();
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    decode(fmt, width, height, actual, flags);
+  }
+  int64_t ns = time_nanoseconds() - start;
+
+  /* mtexels/sec == texels/usec */
+  double texels = (double)width * height * BENCH_ITERATIONS;
+  return texels / MAX(ns / (double)NS_PER_USEC, 1.0);
+}
+
+BENCH(pvr_tex_decode) {
+  init_data();
+
+  LOG_INFO("%-20s %12s %12s %12s", "format (mtex/s)", "ref", "simd",
+           "native");
+
+  for (int i = 0; i < ARRAY_SIZE(formats); i++) {
+    const struct tex_format *fmt = &formats[i];
+    double ref = bench_decode(fmt, PVR_DECODE_REF);
+    double simd = bench_decode(fmt, 0);
+    double native = bench_decode(fmt, PVR_DECODE_NATIVE);
+    LOG_INFO("%-20s %12.2f %12.2f %12.2f", fmt->name, ref, simd, native);
+  }
+}
@@ -0,0 +1,152 @@
+#include "retest.h"
+#include "core/list.h"
+#include "core/time.h"
+#include "guest/dreamcast.h"
+#include "guest/scheduler.h"
+
+#define NUM_TIMERS 1000
+#define NUM_CHURN 1000000
+
+static struct dreamcast dc;
+static int64_t fired[NUM_TIMERS];
+static int num_fired;
+
+static void record_timer(void *data) {
+  fired[num_fired++] = (int64_t)(intptr_t)data;
+}
+
+static int num_slices;
+
+static void run_device(struct device *dev, int64_t ns) {
+  num_slices++;
+}
+
+static void init_dc() {
+  memset(&dc, 0, sizeof(dc));
+  dc.running = 1;
+  num_fired = 0;
+}
+
+TEST(scheduler_order) {
+  init_dc();
+  struct scheduler *sched = sched_create(&dc);
+
+  /* start more timers than fit in a single chunk, in reverse order of
+     expiration */
+  for (int i = NUM_TIMERS - 1; i >= 0; i--) {
+    sched_start_timer(sched, &record_timer, (void *)(intptr_t)i, i + 1);
+  }
+
+  /* cancel every other timer */
+  struct timer *timers[NUM_TIMERS / 2];
+
+  for (int i = 0; i < NUM_TIMERS / 2; i++) {
+    timers[i] = sched_start_timer(sched, &record_timer, (void *)(intptr_t)-1,
+                                  i * 2 + 1);
+  }
+
+  for (int i = 0; i < NUM_TIMERS / 2; i++) {
+    sched_cancel_timer(sched, timers[i]);
+  }
+
+  sched_tick(sched, NUM_TIMERS);
+
+  CHECK_EQ(num_fired, NUM_TIMERS);
+  for (int i = 0; i < NUM_TIMERS; i++) {
+    CHECK_EQ(fired[i], i);
+  }
+
+  sched_destroy(sched);
+}
+
+TEST(scheduler_ties) {
+  init_dc();
+  struct scheduler *sched = sched_create(&dc);
+
+  /* timers expiring at the same time fire in the order they were started, no
+     matter the shape of the heap */
+  for (int i = 0; i < NUM_TIMERS; i++) {
+    sched_start_timer(sched, &record_timer, (void *)(intptr_t)i,
+                      i % 2 ? 10 : 20);
+  }
+
+  sched_tick(sched, 20);
+
+  CHECK_EQ(num_fired, NUM_TIMERS);
+  for (int i = 0; i < NUM_TIMERS / 2; i++) {
+    CHECK_EQ(fired[i], i * 2 + 1);
+    CHECK_EQ(fired[NUM_TIMERS / 2 + i], i * 2);
+  }
+
+  sched_destroy(sched);
+}
+
+TEST(scheduler_slices) {
+  init_dc();
+  struct scheduler *sched = sched_create(&dc);
+
+  static struct device dev;
+  dev.runif.enabled = 1;
+  dev.runif.running = 1;
+  dev.runif.run = &run_device;
+  dev.runif.sched = sched;
+  list_add(&dc.devices, &dev.it);
+  num_slices = 0;
+
+  /* each timer ends the device's slice when it expires */
+  sched_start_timer(sched, &record_timer, (void *)0, 10);
+  sched_start_timer(sched, &record_timer, (void *)1, 25);
+
+  sched_tick(sched, 40);
+  CHECK_EQ(num_fired, 2);
+  CHECK_EQ(num_slices, 3);
+  CHECK_EQ(fired[0], 0);
+  CHECK_EQ(fired[1], 1);
+
+  /* a cancelled timer no longer does */
+  struct timer *timer = sched_start_timer(sched, &record_timer, (void *)2, 10);
+  sched_cancel_timer(sched, timer);
+
+  sched_tick(sched, 40);
+  CHECK_EQ(num_fired, 2);
+  CHECK_EQ(num_slices, 4);
+
+  list_remove(&dc.devices, &dev.it);
+  sched_destroy(sched);
+}
+
+static void churn_timer(void *data) {
+  num_fired++;
+}
+
+/* measures the throughput of the scheduler under the load generated by the
+   devices, with a set of timers constantly being started, cancelled and
+   expired */
+BENCH(scheduler) {
+  init_dc();
+  struct scheduler *sched = sched_create(&dc);
+
+  static struct timer *timers[NUM_TIMERS];
+
+  for (int i = 0; i < NUM_TIMERS; i++) {
+    timers[i] = sched_start_timer(sched, &churn_timer, NULL, 1 + rand() % 1000);
+  }
+
+  int64_t start = time_nanoseconds();
+
+  for (int i = 0; i < NUM_CHURN; i++) {
+    int n = rand() % NUM_TIMERS;
+    sched_cancel_timer(sched, timers[n]);
+    timers[n] = sched_start_timer(sched, &churn_timer, NULL, 1 + rand() % 1000);
+    sched_tick(sched, 1);
+  }
+
+  int64_t churn_ns = time_nanoseconds() - start;
+
+  CHECK_NE(num_fired, 0);
+
+  LOG_INFO("scheduler_bench %d timers, %.2f ns/op", NUM_TIMERS,
+           churn_ns / (double)NUM_CHURN);
+
+  sched_destroy(sched);
+}
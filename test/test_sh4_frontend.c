@@ -0,0 +1,148 @@
+#include "jit/frontend/sh4/sh4_frontend.h"
+#include "jit/frontend/sh4/sh4_guest.h"
+#include "jit/ir/ir.h"
+#include "jit/jit_frontend.h"
+#include "retest.h"
+
+#define CODE_ADDR 0x8c010000
+#define CODE_SIZE 64
+
+static uint16_t code[CODE_SIZE];
+static struct sh4_context ctx;
+static uint8_t ir_buffer[1024 * 1024];
+
+static uint16_t sh4_r16(struct memory *mem, uint32_t addr) {
+  uint32_t index = (addr - CODE_ADDR) / 2;
+  CHECK_LT(index, (uint32_t)CODE_SIZE);
+  return code[index];
+}
+
+/* returns the size of the region formed at the start of the program, and the
+   number of its branches to static targets which were linked locally */
+static int analyze_program(const uint16_t *program, int num_instrs,
+                           int *num_local) {
+  memset(code, 0, sizeof(code));
+  memcpy(code, program, num_instrs * sizeof(uint16_t));
+  memset(&ctx, 0, sizeof(ctx));
+
+  struct sh4_guest guest = {0};
+  guest.ctx = &ctx;
+  guest.r16 = &sh4_r16;
+
+  struct jit_frontend *frontend = sh4_frontend_create((struct jit_guest *)&guest);
+
+  int size;
+  frontend->analyze_code(frontend, CODE_ADDR, 0, &size);
+
+  struct ir ir = {0};
+  ir.buffer = ir_buffer;
+  ir.capacity = sizeof(ir_buffer);
+  frontend->translate_code(frontend, CODE_ADDR, size, &ir);
+
+  *num_local = 0;
+
+  list_for_each_entry(block, &ir.blocks, struct ir_block, it) {
+    struct ir_instr *last = list_last_entry(&block->instrs, struct ir_instr, it);
+
+    if (last->op != OP_BRANCH && last->op != OP_BRANCH_COND) {
+      continue;
+    }
+
+    for (int i = 0; i < 2; i++) {
+      if (last->arg[i] && last->arg[i]->type == VALUE_BLOCK) {
+        *num_local += 1;
+      }
+    }
+  }
+
+  frontend->destroy(frontend);
+
+  return size;
+}
+
+TEST(sh4_frontend_region_bra) {
+  /* the region continues past the bra to reach its target */
+  static const uint16_t program[] = {
+      0xe001, /* 0x00: mov #1, r0 */
+      0xa001, /* 0x02: bra 0x08 */
+      0x0009, /* 0x04: nop */
+      0xe002, /* 0x06: mov #2, r0 */
+      0x7001, /* 0x08: add #1, r0 */
+      0x000b, /* 0x0a: rts */
+      0x0009, /* 0x0c: nop */
+  };
+
+  int num_local;
+  int size = analyze_program(program, ARRAY_SIZE(program), &num_local);
+  CHECK_EQ(size, 0xe);
+  /* the bra and the fall through from the skipped mov */
+  CHECK_EQ(num_local, 2);
+}
+
+TEST(sh4_frontend_region_loop) {
+  /* the loop's exit is reached by continuing past the bra back to the start
+     of the loop */
+  static const uint16_t program[] = {
+      0x71ff, /* 0x00: add #-1, r1 */
+      0x2118, /* 0x02: tst r1, r1 */
+      0x8901, /* 0x04: bt 0x0a */
+      0xaffb, /* 0x06: bra 0x00 */
+      0x0009, /* 0x08: nop */
+      0x000b, /* 0x0a: rts */
+      0x0009, /* 0x0c: nop */
+  };
+
+  int num_local;
+  int size = analyze_program(program, ARRAY_SIZE(program), &num_local);
+  CHECK_EQ(size, 0xe);
+  /* both of the bt's targets, and the bra */
+  CHECK_EQ(num_local, 3);
+}
+
+TEST(sh4_frontend_region_far) {
+  /* targets past the max region size aren't followed */
+  static const uint16_t program[] = {
+      0xa07f, /* 0x00: bra 0x102 */
+      0x0009, /* 0x02: nop */
+      0x000b, /* 0x04: rts */
+      0x0009, /* 0x06: nop */
+  };
+
+  int num_local;
+  int size = analyze_program(program, ARRAY_SIZE(program), &num_local);
+  CHECK_EQ(size, 0x4);
+  CHECK_EQ(num_local, 0);
+}
+
+TEST(sh4_frontend_region_fpscr) {
+  /* fpscr writes in a delay slot end the region */
+  static const uint16_t program[] = {
+      0x8d01, /* 0x00: bt/s 0x06 */
+      0x406a, /* 0x02: lds r0, fpscr */
+      0x7001, /* 0x04: add #1, r0 */
+      0x000b, /* 0x06: rts */
+      0x0009, /* 0x08: nop */
+  };
+
+  int num_local;
+  int size = analyze_program(program, ARRAY_SIZE(program), &num_local);
+  CHECK_EQ(size, 0x4);
+}
+
+TEST(sh4_frontend_region_data) {
+  /* code skipped over by a bra may be data, which is decoded as an invalid
+     delay slot here. the region ends before it */
+  static const uint16_t program[] = {
+      0x8903, /* 0x00: bt 0x0a */
+      0xa002, /* 0x02: bra 0x0a */
+      0x0009, /* 0x04: nop */
+      0x000b, /* 0x06: data */
+      0x000b, /* 0x08: data */
+      0x000b, /* 0x0a: rts */
+      0x0009, /* 0x0c: nop */
+  };
+
+  int num_local;
+  int size = analyze_program(program, ARRAY_SIZE(program), &num_local);
+  CHECK_EQ(size, 0x6);
+}
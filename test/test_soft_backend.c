@@ -0,0 +1,133 @@
+#include "render/render_backend.h"
+#include "retest.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+
+static uint8_t pixels[WIDTH * HEIGHT * 4];
+
+static struct ta_surface make_surf(int first_index, int num_indices) {
+  struct ta_surface surf = {0};
+  surf.params.depth_func = DEPTH_NONE;
+  surf.params.cull = CULL_NONE;
+  surf.params.src_blend = BLEND_ONE;
+  surf.params.dst_blend = BLEND_ONE;
+  surf.params.shade = SHADE_MODULATE;
+  surf.first_vert = first_index;
+  surf.num_verts = num_indices;
+  return surf;
+}
+
+static void set_vert(struct ta_vertex *v, float x, float y, float w,
+                     uint32_t color) {
+  v->xyz[0] = x;
+  v->xyz[1] = y;
+  v->xyz[2] = 1.0f / w;
+  v->uv[0] = 0.0f;
+  v->uv[1] = 0.0f;
+  v->color = color;
+  v->offset_color = 0;
+}
+
+static const uint8_t *get_pixel(int x, int y) {
+  return &pixels[(y * WIDTH + x) * 4];
+}
+
+TEST(soft_backend_shared_edges) {
+  /* additively blend a fan of triangles sharing edges with each other, no
+     pixel along the shared edges should be drawn twice */
+  struct render_backend *r = r_create(WIDTH, HEIGHT);
+  r_clear(r);
+
+  enum { num_tris = 7 };
+  struct ta_vertex verts[num_tris + 1];
+  uint16_t indices[num_tris * 3];
+
+  set_vert(&verts[0], 301.3f, 222.7f, 1.0f, 0xff000040);
+  for (int i = 0; i < num_tris; i++) {
+    float angle = (i * 2.0f * 3.14159265f) / num_tris;
+    set_vert(&verts[i + 1], 301.3f + cosf(angle) * 150.25f,
+             222.7f + sinf(angle) * 130.5f, 1.0f, 0xff000040);
+  }
+
+  for (int i = 0; i < num_tris; i++) {
+    indices[i * 3 + 0] = 0;
+    indices[i * 3 + 1] = i + 1;
+    indices[i * 3 + 2] = ((i + 1) % num_tris) + 1;
+  }
+
+  r_begin_ta_surfaces(r, WIDTH, HEIGHT, verts, num_tris + 1, indices,
+                      num_tris * 3);
+  struct ta_surface surf = make_surf(0, num_tris * 3);
+  r_draw_ta_surface(r, &surf);
+  r_end_ta_surfaces(r);
+
+  r_read_pixels(r, pixels);
+
+  int covered = 0;
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      const uint8_t *p = get_pixel(x, y);
+      CHECK(p[0] == 0x00 || p[0] == 0x40);
+      covered += p[0] == 0x40;
+    }
+  }
+
+  /* the center and a point outside of the fan */
+  CHECK_EQ(get_pixel(301, 222)[0], 0x40);
+  CHECK_EQ(get_pixel(20, 20)[0], 0x00);
+
+  /* roughly the area of the heptagon */
+  CHECK(covered > 53000 && covered < 54300);
+
+  r_destroy(r);
+}
+
+TEST(soft_backend_depth_test) {
+  struct render_backend *r = r_create(WIDTH, HEIGHT);
+  r_clear(r);
+
+  /* three full-screen quads, with the blue one being nearest */
+  struct ta_vertex verts[12];
+  uint16_t indices[18];
+  float ws[3] = {2.0f, 1.0f, 4.0f};
+  uint32_t colors[3] = {0xff00ff00, 0xffff0000, 0xff0000ff};
+
+  for (int i = 0; i < 3; i++) {
+    struct ta_vertex *v = &verts[i * 4];
+    set_vert(&v[0], 0.0f, 0.0f, ws[i], colors[i]);
+    set_vert(&v[1], WIDTH, 0.0f, ws[i], colors[i]);
+    set_vert(&v[2], 0.0f, HEIGHT, ws[i], colors[i]);
+    set_vert(&v[3], WIDTH, HEIGHT, ws[i], colors[i]);
+
+    uint16_t *idx = &indices[i * 6];
+    idx[0] = i * 4 + 0;
+    idx[1] = i * 4 + 2;
+    idx[2] = i * 4 + 1;
+    idx[3] = i * 4 + 1;
+    idx[4] = i * 4 + 2;
+    idx[5] = i * 4 + 3;
+  }
+
+  r_begin_ta_surfaces(r, WIDTH, HEIGHT, verts, 12, indices, 18);
+  for (int i = 0; i < 3; i++) {
+    struct ta_surface surf = make_surf(i * 6, 6);
+    surf.params.depth_func = DEPTH_LESS;
+    surf.params.depth_write = 1;
+    surf.params.src_blend = BLEND_NONE;
+    surf.params.dst_blend = BLEND_NONE;
+    r_draw_ta_surface(r, &surf);
+  }
+  r_end_ta_surfaces(r);
+
+  r_read_pixels(r, pixels);
+
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      const uint8_t *p = get_pixel(x, y);
+      CHECK(p[0] == 0x00 && p[1] == 0x00 && p[2] == 0xff && p[3] == 0xff);
+    }
+  }
+
+  r_destroy(r);
+}
@@ -0,0 +1,87 @@
+#include "core/core.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tex.h"
+#include "guest/pvr/tr.h"
+#include "options.h"
+#include "retest.h"
+#include "stats.h"
+
+#define TEX_SIZE 8
+
+static uint16_t texels[2][TEX_SIZE * TEX_SIZE];
+static struct tr_texture textures[2];
+static int current;
+
+static struct tr_texture *find_texture(void *userdata, union tsp tsp,
+                                       union tcw tcw) {
+  return &textures[current];
+}
+
+/* convert a context using an 8x8 bitmap texture as its background */
+static texture_handle_t convert(struct render_backend *r, int tex,
+                                int data) {
+  static struct ta_context ctx;
+  static struct tr_context rc;
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.bg_isp.texture = 1;
+  ctx.bg_tcw.scan_order = 1;
+  ctx.bg_tcw.pixel_fmt = PVR_PXL_RGB565;
+  ctx.bg_tcw.texture_addr = tex;
+
+  struct tr_texture *entry = &textures[tex];
+  entry->tsp = ctx.bg_tsp;
+  entry->tcw = ctx.bg_tcw;
+  entry->texture = (const uint8_t *)texels[data];
+  entry->texture_size = sizeof(texels[data]);
+  entry->dirty = 1;
+
+  current = tex;
+  tr_convert_context(r, NULL, &find_texture, &ctx, &rc);
+  CHECK(!entry->dirty);
+
+  return entry->handle;
+}
+
+TEST(tr_reuse_hashed_textures) {
+  struct render_backend *r = r_create(640, 480);
+
+  memset(textures, 0, sizeof(textures));
+  for (int i = 0; i < TEX_SIZE * TEX_SIZE; i++) {
+    texels[0][i] = i;
+    texels[1][i] = ~i;
+  }
+
+  /* first use of the data is decoded */
+  texture_handle_t a = convert(r, 0, 0);
+  CHECK_NE(a, 0);
+  CHECK_EQ(prof_counter_load(COUNTER_tex_decodes), 1);
+
+  /* dirtied without the data changing reuses the handle */
+  CHECK_EQ(convert(r, 0, 0), a);
+  CHECK_EQ(prof_counter_load(COUNTER_tex_decodes), 0);
+  CHECK_EQ(prof_counter_load(COUNTER_tex_hash_hits), 1);
+
+  /* new data is decoded, and the replaced handle is retained */
+  texture_handle_t b = convert(r, 0, 1);
+  CHECK_NE(b, a);
+  CHECK_EQ(prof_counter_load(COUNTER_tex_decodes), 1);
+  CHECK_EQ(prof_counter_load(COUNTER_tex_hash_misses), 1);
+
+  /* another texture using the original data adopts the retained handle */
+  CHECK_EQ(convert(r, 1, 0), a);
+  CHECK_EQ(prof_counter_load(COUNTER_tex_decodes), 0);
+  CHECK_EQ(prof_counter_load(COUNTER_tex_hash_hits), 1);
+
+  /* disabling hashing always decodes */
+  OPTION_tex_hash = 0;
+  CHECK_NE(convert(r, 1, 0), a);
+  CHECK_EQ(prof_counter_load(COUNTER_tex_decodes), 1);
+  OPTION_tex_hash = 1;
+
+  for (int i = 0; i < ARRAY_SIZE(textures); i++) {
+    r_destroy_texture(r, textures[i].handle);
+  }
+  tr_release_textures(r);
+  r_destroy(r);
+}
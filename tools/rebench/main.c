@@ -0,0 +1,193 @@
+#include "core/core.h"
+#include "core/filesystem.h"
+#include "core/option.h"
+#include "core/time.h"
+#include "guest/dreamcast.h"
+#include "guest/sh4/sh4.h"
+#include "jit/jit.h"
+#include "options.h"
+#include "stats.h"
+
+DEFINE_OPTION_INT(frames, 1800, "Number of frames to measure");
+DEFINE_OPTION_INT(warmup, 300, "Number of frames to run before measuring");
+DEFINE_OPTION_STRING(output, "", "Write results to this path, else stdout");
+
+/* per-frame measurements, a frame being the time between two vblanks */
+struct frame {
+  int64_t host_ns;
+  int64_t sh4_instrs;
+  int64_t arm7_instrs;
+  int64_t compiles;
+};
+
+static struct frame *frames;
+static int num_frames;
+static int64_t last_vblank;
+static int vblanked;
+
+static void vblank_in(void *userdata, int video_disabled) {
+  int64_t now = time_nanoseconds();
+
+  if (last_vblank) {
+    frames[num_frames].host_ns = now - last_vblank;
+    vblanked = 1;
+  }
+
+  last_vblank = now;
+}
+
+static void sample_counters(struct frame *frame) {
+  /* flip the profiler's aggregate counters at every frame, instead of every
+     second, to read the counts for the frame that just finished */
+  static int64_t flip_time;
+  flip_time += NS_PER_SEC + 1;
+  prof_flip(flip_time);
+
+  frame->sh4_instrs = prof_counter_load(COUNTER_sh4_instrs);
+  frame->arm7_instrs = prof_counter_load(COUNTER_arm7_instrs);
+  frame->compiles = prof_counter_load(COUNTER_jit_compiles);
+}
+
+static int frame_time_cmp(const void *a, const void *b) {
+  int64_t lhs = *(const int64_t *)a;
+  int64_t rhs = *(const int64_t *)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static double percentile_ms(const int64_t *sorted, int n, int pct) {
+  int i = MIN((n * pct) / 100, n - 1);
+  return sorted[i] / (double)NS_PER_MS;
+}
+
+static void write_results(FILE *out, struct dreamcast *dc, const char *path,
+                          int64_t boot_ns) {
+  int start = OPTION_warmup;
+  int n = num_frames - start;
+
+  int64_t host_ns = 0;
+  int64_t sh4_instrs = 0;
+  int64_t arm7_instrs = 0;
+  int64_t compiles = 0;
+  int64_t *sorted = malloc(n * sizeof(int64_t));
+
+  for (int i = 0; i < n; i++) {
+    struct frame *frame = &frames[start + i];
+    host_ns += frame->host_ns;
+    sh4_instrs += frame->sh4_instrs;
+    arm7_instrs += frame->arm7_instrs;
+    compiles += frame->compiles;
+    sorted[i] = frame->host_ns;
+  }
+
+  qsort(sorted, n, sizeof(int64_t), &frame_time_cmp);
+
+  double host_sec = host_ns / (double)NS_PER_SEC;
+  double mean_ms = (host_ns / (double)n) / NS_PER_MS;
+
+  /* live code in the sh4's cache at the end of the run */
+  struct jit *jit = dc->sh4->jit;
+  int64_t code_size = 0;
+  for (int i = 0; i < jit->reverse_blocks.size; i++) {
+    code_size += jit->reverse_blocks.entries[i]->host_size;
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"image\": \"%s\",\n", path);
+  fprintf(out, "  \"frames\": %d,\n", n);
+  fprintf(out, "  \"warmup_frames\": %d,\n", start);
+  fprintf(out, "  \"boot_ms\": %.3f,\n", boot_ns / (double)NS_PER_MS);
+  fprintf(out, "  \"host_sec\": %.6f,\n", host_sec);
+  fprintf(out, "  \"fps\": %.3f,\n", n / host_sec);
+  fprintf(out, "  \"frame_ms\": {\"mean\": %.3f, \"min\": %.3f, "
+          "\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+          mean_ms, sorted[0] / (double)NS_PER_MS,
+          percentile_ms(sorted, n, 50), percentile_ms(sorted, n, 90),
+          percentile_ms(sorted, n, 99), sorted[n - 1] / (double)NS_PER_MS);
+  fprintf(out, "  \"sh4_mips\": %.3f,\n", sh4_instrs / host_sec / 1000000.0);
+  fprintf(out, "  \"arm7_mips\": %.3f,\n",
+          arm7_instrs / host_sec / 1000000.0);
+  fprintf(out, "  \"compiles\": %" PRId64 ",\n", compiles);
+  fprintf(out, "  \"sh4_blocks\": %d,\n", jit->reverse_blocks.size);
+  fprintf(out, "  \"sh4_code_bytes\": %" PRId64 "\n", code_size);
+  fprintf(out, "}\n");
+
+  free(sorted);
+}
+
+int main(int argc, char **argv) {
+  if (!options_parse(&argc, &argv)) {
+    return EXIT_FAILURE;
+  }
+
+  if (argc < 2 || OPTION_frames <= 0 || OPTION_warmup < 0) {
+    LOG_INFO("rebench [--frames=n] [--warmup=n] [--output=path] "
+             "/path/to/image");
+    return EXIT_FAILURE;
+  }
+
+  const char *path = argv[1];
+
+  /* set application directory */
+  char appdir[PATH_MAX];
+  char userdir[PATH_MAX];
+  int r = fs_userdir(userdir, sizeof(userdir));
+  CHECK(r);
+  snprintf(appdir, sizeof(appdir), "%s" PATH_SEPARATOR ".redream", userdir);
+  fs_set_appdir(appdir);
+
+  /* there's no host to sync the emulation speed to, the machine runs as fast
+     as possible, and doesn't render or output any audio */
+  int total_frames = OPTION_warmup + OPTION_frames;
+  frames = calloc(total_frames + 1, sizeof(struct frame));
+
+  int64_t boot_start = time_nanoseconds();
+
+  struct dreamcast *dc = dc_create();
+  dc->vblank_in = &vblank_in;
+
+  if (!dc_load(dc, path)) {
+    LOG_WARNING("failed to load %s", path);
+    dc_destroy(dc);
+    return EXIT_FAILURE;
+  }
+
+  int64_t boot_ns = time_nanoseconds() - boot_start;
+
+  /* the scheduler bounds the length of each slice itself, this only controls
+     how often the frame state is polled */
+  const int64_t MACHINE_STEP = MAX(OPTION_sched_max_slice, 1) * NS_PER_USEC;
+
+  while (num_frames < total_frames && dc_running(dc)) {
+    dc_tick(dc, MACHINE_STEP);
+
+    if (vblanked) {
+      sample_counters(&frames[num_frames]);
+      num_frames++;
+      vblanked = 0;
+    }
+  }
+
+  if (num_frames <= OPTION_warmup) {
+    LOG_WARNING("machine stopped after %d frames", num_frames);
+    dc_destroy(dc);
+    return EXIT_FAILURE;
+  }
+
+  FILE *out = stdout;
+
+  if (*OPTION_output) {
+    out = fopen(OPTION_output, "w");
+    CHECK_NOTNULL(out, "failed to open %s", OPTION_output);
+  }
+
+  write_results(out, dc, path, boot_ns);
+
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  dc_destroy(dc);
+  free(frames);
+
+  return EXIT_SUCCESS;
+}
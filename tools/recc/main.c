@@ -8,12 +8,13 @@
 #include "jit/pass_stats.h"
 #include "jit/passes/constant_propagation_pass.h"
 #include "jit/passes/control_flow_analysis_pass.h"
+#include "jit/passes/conversion_elimination_pass.h"
 #include "jit/passes/dead_code_elimination_pass.h"
 #include "jit/passes/expression_simplification_pass.h"
 #include "jit/passes/load_store_elimination_pass.h"
 #include "jit/passes/register_allocation_pass.h"
 
-DEFINE_OPTION_STRING(pass, "cfa,lse,cprop,esimp,dce,ra",
+DEFINE_OPTION_STRING(pass, "cfa,lse,cprop,esimp,cve,dce,ra",
                      "Comma-separated list of passes to run");
 
 DEFINE_PASS_STAT(ir_instrs_total, "total ir instructions");
@@ -94,6 +95,10 @@ static void process_file(struct jit_backend *backend, const char *filename,
       struct esimp *esimp = esimp_create();
       esimp_run(esimp, &ir);
       esimp_destroy(esimp);
+    } else if (!strcmp(name, "cve")) {
+      struct cve *cve = cve_create();
+      cve_run(cve, &ir);
+      cve_destroy(cve);
     } else if (!strcmp(name, "ra")) {
       struct ra *ra = ra_create(backend->registers, backend->num_registers,
                                 backend->emitters, backend->num_emitters);
@@ -82,7 +82,7 @@ void convert_tex(const char *texname) {
     int mip_width = header->width >> levels;
     int mip_height = header->height >> levels;
     pvr_tex_decode(data, mip_width, mip_height, mip_width, header->texture_fmt,
-                   header->pixel_fmt, NULL, 0, converted, sizeof(converted));
+                   header->pixel_fmt, NULL, 0, converted, sizeof(converted), 0);
 
     char pngname[PATH_MAX];
     snprintf(pngname, sizeof(pngname), "%s.%dx%d.png", texname, mip_width,
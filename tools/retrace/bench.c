@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include "core/core.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tex.h"
+#include "guest/pvr/tr.h"
+
+#define BENCH_DEFAULT_ITERATIONS 100
+
+struct bench_texture {
+  const struct trace_cmd *cmd;
+  /* context the texture was first used by, its stride and palette format are
+     needed to decode it */
+  const struct ta_context *ctx;
+};
+
+struct bench_stats {
+  int64_t convert_ns;
+  int64_t parse_ns;
+  int64_t sort_ns;
+  int64_t index_ns;
+  int64_t texture_ns;
+
+  int64_t num_params;
+  int64_t num_surfs;
+  int64_t num_verts;
+  int64_t num_indices;
+  int64_t num_texels;
+};
+
+struct bench {
+  struct ta_context **ctxs;
+  int num_ctxs;
+
+  struct bench_texture *texs;
+  int num_texs;
+
+  struct tr_context *rc;
+  struct bench_stats stats;
+};
+
+static struct tr_texture *find_texture(void *userdata, union tsp tsp,
+                                       union tcw tcw) {
+  /* return a non-zero handle so it doesn't try to create a texture with
+     the render backend (which is NULL). textures are instead decoded
+     separately by bench_decode_textures */
+  static struct tr_texture tex;
+  tex.handle = 1;
+  return &tex;
+}
+
+static void bench_decode_textures(struct bench *bench) {
+  static uint8_t converted[1024 * 1024 * 4];
+
+  int64_t start = time_nanoseconds();
+
+  for (int i = 0; i < bench->num_texs; i++) {
+    struct bench_texture *tex = &bench->texs[i];
+    const struct ta_context *ctx = tex->ctx;
+    union tsp tsp = tex->cmd->texture.tsp;
+    union tcw tcw = tex->cmd->texture.tcw;
+
+    int texture_fmt = ta_texture_format(tcw);
+    int width = ta_texture_width(tsp, tcw);
+    int height = ta_texture_height(tsp, tcw);
+    int stride = ta_texture_stride(tsp, tcw, ctx->stride);
+
+    pvr_tex_decode(tex->cmd->texture.texture, width, height, stride,
+                   texture_fmt, tcw.pixel_fmt, tex->cmd->texture.palette,
+                   ctx->palette_fmt, converted, sizeof(converted),
+                   PVR_DECODE_NATIVE);
+
+    bench->stats.num_texels += width * height;
+  }
+
+  bench->stats.texture_ns += time_nanoseconds() - start;
+}
+
+static void bench_convert_contexts(struct bench *bench) {
+  struct tr_context *rc = bench->rc;
+
+  for (int i = 0; i < bench->num_ctxs; i++) {
+    int64_t start = time_nanoseconds();
+    tr_convert_context(NULL, NULL, &find_texture, bench->ctxs[i], rc);
+    bench->stats.convert_ns += time_nanoseconds() - start;
+
+    bench->stats.parse_ns += rc->parse_ns;
+    bench->stats.sort_ns += rc->sort_ns;
+    bench->stats.index_ns += rc->index_ns;
+
+    bench->stats.num_params += rc->num_params;
+    bench->stats.num_surfs += rc->num_surfs;
+    bench->stats.num_verts += rc->num_verts;
+    bench->stats.num_indices += rc->num_indices;
+  }
+}
+
+static void bench_load(struct bench *bench, struct trace *trace) {
+  int max_ctxs = 0;
+  int max_texs = 0;
+  int first_pending = 0;
+
+  for (struct trace_cmd *cmd = trace->cmds; cmd; cmd = cmd->next) {
+    if (cmd->type == TRACE_CMD_CONTEXT) {
+      if (bench->num_ctxs == max_ctxs) {
+        max_ctxs = MAX(max_ctxs * 2, 16);
+        bench->ctxs =
+            realloc(bench->ctxs, max_ctxs * sizeof(struct ta_context *));
+      }
+
+      struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+      trace_copy_context(cmd, ctx);
+      bench->ctxs[bench->num_ctxs++] = ctx;
+
+      /* textures are written to the trace before the context using them */
+      for (int i = first_pending; i < bench->num_texs; i++) {
+        bench->texs[i].ctx = ctx;
+      }
+      first_pending = bench->num_texs;
+    } else if (cmd->type == TRACE_CMD_TEXTURE) {
+      if (bench->num_texs == max_texs) {
+        max_texs = MAX(max_texs * 2, 16);
+        bench->texs =
+            realloc(bench->texs, max_texs * sizeof(struct bench_texture));
+      }
+
+      struct bench_texture *tex = &bench->texs[bench->num_texs++];
+      tex->cmd = cmd;
+      tex->ctx = NULL;
+    }
+  }
+
+  /* drop any trailing textures which were never used by a context */
+  bench->num_texs = first_pending;
+
+  bench->rc = calloc(1, sizeof(struct tr_context));
+}
+
+static void bench_unload(struct bench *bench) {
+  for (int i = 0; i < bench->num_ctxs; i++) {
+    free(bench->ctxs[i]);
+  }
+  free(bench->ctxs);
+  free(bench->texs);
+  free(bench->rc);
+}
+
+static void bench_print_stage(const char *name, int64_t ns, int64_t total_ns,
+                              int64_t num_ctxs) {
+  LOG_INFO("%-16s %10.3f ms %10.3f us/context %6.2f%%", name,
+           ns / (double)NS_PER_MS, (ns / (double)NS_PER_USEC) / num_ctxs,
+           (ns * 100.0) / total_ns);
+}
+
+int cmd_bench(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  int iterations = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+
+  if (iterations <= 0) {
+    return 0;
+  }
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  struct bench bench = {0};
+  bench_load(&bench, trace);
+
+  if (!bench.num_ctxs) {
+    LOG_WARNING("no contexts found in %s", filename);
+    bench_unload(&bench);
+    trace_destroy(trace);
+    return 0;
+  }
+
+  /* warm up the caches and the ta's lookup tables before measuring */
+  bench_convert_contexts(&bench);
+  bench_decode_textures(&bench);
+  memset(&bench.stats, 0, sizeof(bench.stats));
+
+  for (int i = 0; i < iterations; i++) {
+    bench_convert_contexts(&bench);
+    bench_decode_textures(&bench);
+  }
+
+  /* print results */
+  struct bench_stats *stats = &bench.stats;
+  int64_t num_ctxs = (int64_t)bench.num_ctxs * iterations;
+  int64_t num_texs = (int64_t)bench.num_texs * iterations;
+  int64_t other_ns =
+      stats->convert_ns - stats->parse_ns - stats->sort_ns - stats->index_ns;
+  int64_t total_ns = stats->convert_ns + stats->texture_ns;
+  double convert_sec = stats->convert_ns / (double)NS_PER_SEC;
+  double texture_sec = stats->texture_ns / (double)NS_PER_SEC;
+
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("bench results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("%d contexts, %d textures, %d iterations", bench.num_ctxs,
+           bench.num_texs, iterations);
+  LOG_INFO("");
+  LOG_INFO("contexts/sec     %.3f", num_ctxs / convert_sec);
+  LOG_INFO("params/sec       %.3f", stats->num_params / convert_sec);
+  LOG_INFO("params/context   %.3f", stats->num_params / (double)num_ctxs);
+  LOG_INFO("surfs/context    %.3f", stats->num_surfs / (double)num_ctxs);
+  LOG_INFO("verts/context    %.3f", stats->num_verts / (double)num_ctxs);
+  LOG_INFO("indices/context  %.3f", stats->num_indices / (double)num_ctxs);
+  if (num_texs) {
+    LOG_INFO("textures/sec     %.3f", num_texs / texture_sec);
+    LOG_INFO("mtexels/sec      %.3f", stats->num_texels / texture_sec / 1e6);
+  }
+  LOG_INFO("");
+  bench_print_stage("parse", stats->parse_ns, total_ns, num_ctxs);
+  bench_print_stage("sort", stats->sort_ns, total_ns, num_ctxs);
+  bench_print_stage("index", stats->index_ns, total_ns, num_ctxs);
+  bench_print_stage("other", other_ns, total_ns, num_ctxs);
+  bench_print_stage("texture decode", stats->texture_ns, total_ns,
+                    num_ctxs);
+
+  bench_unload(&bench);
+  trace_destroy(trace);
+
+  return 1;
+}